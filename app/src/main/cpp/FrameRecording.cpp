@@ -0,0 +1,139 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include "FrameRecording.h"
+#include "vulkan-utils/vulkan_utils.h"
+
+static const char FRAME_RECORDING_MAGIC[4] = { 'V', 'P', 'B', 'R' };
+static const uint32_t FRAME_RECORDING_VERSION = 1;
+
+uint32_t frameRecordingFrameSize(uint32_t width, uint32_t height, uint32_t format) {
+    switch (format) {
+        case FRAME_FORMAT_RGBA8888:
+            return width * height * 4;
+        case FRAME_FORMAT_I420:
+            return width * height + 2 * (((width + 1) / 2) * ((height + 1) / 2));
+        default:
+            return 0;
+    }
+}
+
+FrameRecordingWriter::~FrameRecordingWriter() {
+    close();
+}
+
+bool FrameRecordingWriter::open(const char *path, uint32_t width, uint32_t height, uint32_t format) {
+    close();
+
+    memcpy(mHeader.magic, FRAME_RECORDING_MAGIC, sizeof(mHeader.magic));
+    mHeader.version = FRAME_RECORDING_VERSION;
+    mHeader.width = width;
+    mHeader.height = height;
+    mHeader.format = format;
+    mHeader.frame_size = frameRecordingFrameSize(width, height, format);
+    ASSERT(mHeader.frame_size > 0);
+
+    mFile = fopen(path, "wb");
+    if (mFile == nullptr) {
+        loge("Could not open frame recording for writing: %s", path);
+        return false;
+    }
+
+    if (1 != fwrite(&mHeader, sizeof(mHeader), 1, mFile)) {
+        close();
+        return false;
+    }
+    mNumFrames = 0;
+    return true;
+}
+
+bool FrameRecordingWriter::writeFrame(int64_t timestamp_ns, const FilterParams &filter_params, const uint8_t *data) {
+    ASSERT(mFile != nullptr);
+
+    int32_t rotation = filter_params.rotation;
+    ASSERT(1 == fwrite(&timestamp_ns, sizeof(timestamp_ns), 1, mFile));
+    ASSERT(1 == fwrite(&rotation, sizeof(rotation), 1, mFile));
+    ASSERT(1 == fwrite(filter_params.seek_values, sizeof(filter_params.seek_values), 1, mFile));
+    ASSERT(1 == fwrite(filter_params.use_filter, sizeof(filter_params.use_filter), 1, mFile));
+    ASSERT(1 == fwrite(data, mHeader.frame_size, 1, mFile));
+
+    mNumFrames++;
+    return true;
+}
+
+void FrameRecordingWriter::close() {
+    if (mFile != nullptr) {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+}
+
+FrameRecordingReader::~FrameRecordingReader() {
+    close();
+}
+
+bool FrameRecordingReader::open(const char *path) {
+    close();
+
+    mFile = fopen(path, "rb");
+    if (mFile == nullptr) {
+        loge("Could not open frame recording: %s", path);
+        return false;
+    }
+
+    if (1 != fread(&mHeader, sizeof(mHeader), 1, mFile)
+        || 0 != memcmp(mHeader.magic, FRAME_RECORDING_MAGIC, sizeof(mHeader.magic))
+        || mHeader.version != FRAME_RECORDING_VERSION
+        || mHeader.frame_size != frameRecordingFrameSize(mHeader.width, mHeader.height, mHeader.format)
+        || mHeader.frame_size == 0) {
+        loge("Not a valid frame recording: %s", path);
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool FrameRecordingReader::readFrame(int64_t &timestamp_ns, FilterParams &filter_params, uint8_t *data) {
+    if (mFile == nullptr)
+        return false;
+
+    int32_t rotation = 0;
+    if (1 != fread(&timestamp_ns, sizeof(timestamp_ns), 1, mFile))
+        return false;
+    if (1 != fread(&rotation, sizeof(rotation), 1, mFile)
+        || 1 != fread(filter_params.seek_values, sizeof(filter_params.seek_values), 1, mFile)
+        || 1 != fread(filter_params.use_filter, sizeof(filter_params.use_filter), 1, mFile)
+        || 1 != fread(data, mHeader.frame_size, 1, mFile)) {
+        loge("Truncated frame in frame recording");
+        return false;
+    }
+    filter_params.rotation = rotation;
+    return true;
+}
+
+bool FrameRecordingReader::rewind() {
+    ASSERT(mFile != nullptr);
+    ASSERT(0 == fseek(mFile, sizeof(mHeader), SEEK_SET));
+    return true;
+}
+
+void FrameRecordingReader::close() {
+    if (mFile != nullptr) {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+}
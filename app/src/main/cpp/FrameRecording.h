@@ -0,0 +1,104 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_PHOTO_BOOTH_FRAMERECORDING_H
+#define VULKAN_PHOTO_BOOTH_FRAMERECORDING_H
+
+#include <cstdint>
+#include <cstdio>
+#include "vulkan-utils/FilterParams.h"
+
+/**
+ * Recorded camera frames for deterministic replay of the render path
+ *
+ * File layout (little-endian):
+ *   FrameRecordingHeader
+ *   For each frame:
+ *     int64_t timestamp_ns
+ *     int32_t rotation, int32_t seek_values[NUM_FILTERS], int8_t use_filter[NUM_FILTERS]
+ *     frame_size bytes of pixel data
+ *
+ * Every frame has the same size and format, so frames can be seeked to directly.
+ */
+enum FRAME_RECORDING_FORMAT {
+    FRAME_FORMAT_RGBA8888 = 1, // Tightly packed RGBA, 4 bytes per pixel
+    FRAME_FORMAT_I420 = 2,     // Planar Y, then U and V at half resolution
+};
+
+struct FrameRecordingHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t frame_size;
+};
+
+/**
+ * Number of bytes used by one frame of the given format
+ */
+uint32_t frameRecordingFrameSize(uint32_t width, uint32_t height, uint32_t format);
+
+/**
+ * Appends frames to a new recording
+ */
+class FrameRecordingWriter {
+public:
+    ~FrameRecordingWriter();
+
+    bool open(const char *path, uint32_t width, uint32_t height, uint32_t format);
+    bool writeFrame(int64_t timestamp_ns, const FilterParams &filter_params, const uint8_t *data);
+    void close();
+
+    bool isOpen() { return mFile != nullptr; }
+    const FrameRecordingHeader &header() { return mHeader; }
+    uint32_t numFrames() { return mNumFrames; }
+
+private:
+    FILE *mFile = nullptr;
+    FrameRecordingHeader mHeader = {};
+    uint32_t mNumFrames = 0;
+};
+
+/**
+ * Reads frames back from a recording, in order
+ */
+class FrameRecordingReader {
+public:
+    ~FrameRecordingReader();
+
+    bool open(const char *path);
+
+    /**
+     * Read the next frame
+     *
+     * @param timestamp_ns Capture time of the frame
+     * @param filter_params Filter settings that were active for the frame
+     * @param data Destination for header().frame_size bytes of pixel data
+     * @return False at the end of the recording or on a truncated frame
+     */
+    bool readFrame(int64_t &timestamp_ns, FilterParams &filter_params, uint8_t *data);
+    bool rewind();
+    void close();
+
+    const FrameRecordingHeader &header() { return mHeader; }
+
+private:
+    FILE *mFile = nullptr;
+    FrameRecordingHeader mHeader = {};
+};
+
+#endif //VULKAN_PHOTO_BOOTH_FRAMERECORDING_H
@@ -0,0 +1,289 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GifEncodeQueue.h"
+
+#include <chrono>
+#include <cstdio>
+#include "third_party/androidndkgif/AsyncFileGifOutput.h"
+#include "third_party/androidndkgif/GCTGifEncoder.h"
+#include "third_party/androidndkgif/GifOutput.h"
+
+void GifEncodeJob::addFrame(FrameHandle &&frame) {
+    {
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        mFrames.push_back(std::move(frame));
+        mNumFrames++;
+    }
+    mFrameAdded.notify_one();
+}
+
+void GifEncodeJob::finishFrames() {
+    {
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        mFramesFinished = true;
+    }
+    mFrameAdded.notify_one();
+}
+
+bool GifEncodeJob::getPalette(std::vector<uint32_t> &colors) {
+    std::lock_guard<std::mutex> lock(mFramesLock);
+    colors = mPalette;
+    return !mPalette.empty();
+}
+
+void GifEncodeJob::setColorCounts(const std::vector<uint32_t> &counts) {
+    std::lock_guard<std::mutex> lock(mFramesLock);
+    mColorCounts = counts;
+}
+
+bool GifEncodeJob::isDone() const {
+    State state = getState();
+    return SAVED == state || FAILED == state || CANCELLED == state;
+}
+
+uint32_t GifEncodeJob::getFrameCount() const {
+    uint32_t num_frames = mNumFrames.load(std::memory_order_relaxed);
+    return (mBoomerang && num_frames > 2) ? 2 * num_frames - 2 : num_frames;
+}
+
+uint8_t *GifEncodeJob::takeGif(size_t &size) {
+    if (SAVED != getState())
+        return nullptr;
+    size = mGifSize;
+    return mGif.release();
+}
+
+bool GifEncodeJob::onFrameWritten(void *job, uint32_t framesWritten, uint32_t) {
+    auto encode_job = static_cast<GifEncodeJob *>(job);
+    encode_job->mFramesWritten.store(framesWritten, std::memory_order_relaxed);
+    if (encode_job->mOnProgress)
+        encode_job->mOnProgress(*encode_job);
+    return !encode_job->mCancelRequested.load(std::memory_order_relaxed);
+}
+
+void GifEncodeJob::encode() {
+    // Cancelled between leaving the queue and getting here
+    if (mCancelRequested.load(std::memory_order_relaxed)) {
+        complete(CANCELLED);
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    mState.store(ENCODING, std::memory_order_release);
+
+    // Outlive the encoder. The file is written behind on a thread of its own, encoding only waits
+    // for storage once 2 buffers are waiting to be written. Memory starts with room for a frame's
+    // worth of indices, the whole GIF is often not much more.
+    AsyncFileGifOutput file_output;
+    MemoryGifOutput memory_output(mInMemory ? (size_t) WIDTH * HEIGHT : 0);
+    GifOutput *output = &memory_output;
+    if (!mInMemory) {
+        if (!file_output.open(PATH.c_str())) {
+            complete(FAILED);
+            return;
+        }
+        output = &file_output;
+    }
+
+    GCTGifEncoder encoder;
+    encoder.setThreadCount(mThreadCount);
+    encoder.setFrameWrittenCallback(onFrameWritten, this);
+    encoder.setDitherMode(mDitherMode);
+    if (0 != mPaletteFrames) {
+        encoder.setStreaming(mPaletteFrames);
+        encoder.setLzwStripCount(mThreadCount);
+    }
+    encoder.init(WIDTH, HEIGHT, output);
+
+    // GCTGifEncoder reads the frames in place until release(). When streaming each one is encoded
+    // as soon as capture adds it, the handles move but the pixels don't.
+    uint32_t num_frames = 0;
+    bool palette_published = false;
+    std::vector<uint32_t> color_counts;
+    while (true) {
+        const uint16_t *pixels = nullptr;
+        bool palette_indices = false;
+        {
+            std::unique_lock<std::mutex> lock(mFramesLock);
+            mFrameAdded.wait(lock, [this, num_frames] {
+                return num_frames < mFrames.size() || mFramesFinished || 0 == mPaletteFrames
+                       || mCancelRequested.load(std::memory_order_relaxed);
+            });
+            // Arrive with the frames, ahead of the palette being built
+            if (!mColorCounts.empty()) {
+                color_counts.swap(mColorCounts);
+                encoder.setColorCounts(color_counts.data());
+            }
+            if (num_frames == mFrames.size() || mCancelRequested.load(std::memory_order_relaxed))
+                break;
+            pixels = mFrames[num_frames].data();
+            palette_indices = mFrames[num_frames].holdsPaletteIndices();
+        }
+        if (palette_indices) {
+            encoder.encodeFrame(reinterpret_cast<const uint8_t *>(pixels), DELAY_MS);
+        } else {
+            encoder.encodeFrame(pixels, DELAY_MS);
+        }
+        // Capture can map the frames still to come to the palette once it is built
+        if (0 != mPaletteFrames && !palette_published) {
+            uint32_t colors[256];
+            uint32_t num_colors = encoder.getStreamPalette(colors);
+            if (0 != num_colors) {
+                std::lock_guard<std::mutex> lock(mFramesLock);
+                mPalette.assign(colors, colors + num_colors);
+                palette_published = true;
+            }
+        }
+        // Ready for the way back, frame n is shown again right after frame n + 1
+        if (mBoomerang && num_frames >= 2)
+            encoder.prepareShow(num_frames - 1, num_frames);
+        num_frames++;
+    }
+
+    // Frame n was the n-th one added, showing it again reuses its compressed image
+    if (mBoomerang) {
+        for (int n = (int) num_frames - 2; n >= 1; n--) {
+            encoder.showFrame(n, DELAY_MS);
+        }
+    }
+    encoder.release();
+    if (!mInMemory) {
+        // The tail of the file, at most what fits in the buffers
+        file_output.waitUntilClosed();
+        AsyncFileGifOutput::Stats stats = file_output.getStats();
+        mWriteMs = stats.writeMs;
+        mWriteStallMs = stats.stallMs;
+    }
+    mBytesWritten = output->getSize();
+
+    mEncodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    bool cancelled = mCancelRequested.load(std::memory_order_relaxed);
+    if (cancelled || output->hasFailed()) {
+        if (!mInMemory)
+            remove(PATH.c_str());
+        complete(cancelled ? CANCELLED : FAILED);
+    } else {
+        mGifSize = memory_output.getSize();
+        mGif.reset(memory_output.releaseData());
+        complete(SAVED);
+    }
+}
+
+void GifEncodeJob::requestCancel() {
+    {
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        mCancelRequested.store(true, std::memory_order_relaxed);
+    }
+    // A streaming job may be waiting for frames
+    mFrameAdded.notify_one();
+}
+
+void GifEncodeJob::complete(State state) {
+    // Free the frames for the next capture before anyone is told
+    {
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        mFrames.clear();
+    }
+    mState.store(state, std::memory_order_release);
+    if (mOnCompletion)
+        mOnCompletion(*this);
+}
+
+GifEncodeQueue::GifEncodeQueue(uint32_t numEncoders, uint32_t maxJobs) :
+        MAX_JOBS(maxJobs < 1 ? 1 : maxJobs) {
+    for (uint32_t i = 0; i < (numEncoders < 1 ? 1 : numEncoders); i++) {
+        mEncoders.push_back(std::thread(&GifEncodeQueue::encoderThread, this));
+    }
+}
+
+GifEncodeQueue::~GifEncodeQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mJobQueued.notify_all();
+    for (std::thread &encoder : mEncoders) {
+        encoder.join();
+    }
+}
+
+bool GifEncodeQueue::submit(const std::shared_ptr<GifEncodeJob> &job) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mStopping || mQueued.size() + mNumEncoding >= MAX_JOBS)
+            return false;
+        mQueued.push_back(job);
+    }
+    mJobQueued.notify_one();
+    return true;
+}
+
+void GifEncodeQueue::cancel(const std::shared_ptr<GifEncodeJob> &job) {
+    job->requestCancel();
+
+    bool was_queued = false;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (auto queued = mQueued.begin(); queued != mQueued.end(); queued++) {
+            if (*queued == job) {
+                mQueued.erase(queued);
+                was_queued = true;
+                break;
+            }
+        }
+    }
+    if (was_queued) {
+        job->complete(GifEncodeJob::CANCELLED);
+        mJobDone.notify_all();
+    }
+}
+
+bool GifEncodeQueue::isFull() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mQueued.size() + mNumEncoding >= MAX_JOBS;
+}
+
+uint32_t GifEncodeQueue::numJobs() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mQueued.size() + mNumEncoding;
+}
+
+void GifEncodeQueue::waitUntilIdle() {
+    std::unique_lock<std::mutex> lock(mLock);
+    mJobDone.wait(lock, [this] { return mQueued.empty() && 0 == mNumEncoding; });
+}
+
+void GifEncodeQueue::encoderThread() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mJobQueued.wait(lock, [this] { return mStopping || !mQueued.empty(); });
+        // Even when stopping, the queued GIFs are encoded first
+        if (mQueued.empty())
+            return;
+
+        std::shared_ptr<GifEncodeJob> job = mQueued.front();
+        mQueued.pop_front();
+        mNumEncoding++;
+        lock.unlock();
+
+        job->encode();
+
+        lock.lock();
+        mNumEncoding--;
+        mJobDone.notify_all();
+    }
+}
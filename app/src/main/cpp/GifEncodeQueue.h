@@ -0,0 +1,251 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_PHOTO_BOOTH_GIF_ENCODE_QUEUE_H
+#define VULKAN_PHOTO_BOOTH_GIF_ENCODE_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame_queue.h"
+#include "third_party/androidndkgif/ColorReduceKernels.h"
+
+/**
+ * One GIF to encode: the captured frames and where to save them, a file or memory
+ *
+ * The submitter keeps the job as a handle to follow its progress. The job owns its frames, they go
+ * back to their pool once the GIF is written.
+ */
+class GifEncodeJob {
+public:
+    enum State {
+        QUEUED,
+        ENCODING,
+        SAVED,
+        FAILED,     // The GIF could not be written
+        CANCELLED,  // Nothing is left on disk
+    };
+
+    /**
+     * Called on the encoder thread after each frame is written
+     */
+    typedef std::function<void(GifEncodeJob &job)> ProgressCallback;
+
+    /**
+     * Called once the job is SAVED, FAILED or CANCELLED, on the encoder thread, or on the thread
+     * cancelling a job that was still queued
+     */
+    typedef std::function<void(GifEncodeJob &job)> CompletionCallback;
+
+    /**
+     * @param path File to write, replaced if it exists. Unused when the GIF is kept in memory.
+     * @param delayMs How long each frame is shown
+     */
+    GifEncodeJob(const std::string &path, uint16_t width, uint16_t height, int32_t delayMs) :
+            PATH(path), WIDTH(width), HEIGHT(height), DELAY_MS(delayMs) {}
+
+    /**
+     * Frames are shown in the order they are added. Only a streaming job takes more once submitted.
+     */
+    void addFrame(FrameHandle &&frame);
+
+    /**
+     * No more frames are coming, a streaming job can finish its GIF
+     */
+    void finishFrames();
+
+    /**
+     * Submit the job before its frames are captured, each one is encoded as it is added. The palette
+     * is built from the first paletteFrames frames, see GCTGifEncoder::setStreaming. 0, the
+     * default, waits for every frame.
+     */
+    void setStreaming(uint32_t paletteFrames) { mPaletteFrames = paletteFrames; }
+
+    /**
+     * Floyd-Steinberg by default. Frames mapped to the palette elsewhere need an ordered dither.
+     */
+    void setDitherMode(DitherMode ditherMode) { mDitherMode = ditherMode; }
+    DitherMode getDitherMode() const { return mDitherMode; }
+
+    /**
+     * The palette of a streaming job once it is built from the first frames, 0xFFBBGGRR colors.
+     * From then on frames can be added already mapped to it with the job's dither mode, see
+     * FrameHandle::setPaletteIndices.
+     *
+     * @return False until the palette is built
+     */
+    bool getPalette(std::vector<uint32_t> &colors);
+
+    /**
+     * Colors of the frames the palette is built from, counted elsewhere, so their pixels are not
+     * counted again. Add before the last of them: the first frames of a streaming job, every frame
+     * otherwise, each counted once.
+     *
+     * @param counts See ColorHistogram::addCounts
+     */
+    void setColorCounts(const std::vector<uint32_t> &counts);
+
+    /**
+     * Play the frames backwards after going forwards, without repeating the first and last frames
+     */
+    void setBoomerang(bool boomerang) { mBoomerang = boomerang; }
+
+    /**
+     * Threads GCTGifEncoder uses for this GIF, see GCTGifEncoder::setThreadCount. Streaming uses
+     * them for LZW strips.
+     */
+    void setThreadCount(int32_t threadCount) { mThreadCount = threadCount; }
+
+    /**
+     * Encode into memory instead of writing PATH, takeGif() hands the GIF over once SAVED
+     */
+    void setInMemory(bool inMemory) { mInMemory = inMemory; }
+    bool isInMemory() const { return mInMemory; }
+
+    /**
+     * The GIF of an in-memory job, the caller owns it from now on and frees it with free().
+     * Null before the job is SAVED and after the GIF was taken.
+     */
+    uint8_t *takeGif(size_t &size);
+
+    void setProgressCallback(ProgressCallback callback) { mOnProgress = callback; }
+    void setCompletionCallback(CompletionCallback callback) { mOnCompletion = callback; }
+
+    State getState() const { return mState.load(std::memory_order_acquire); }
+    bool isDone() const;
+
+    /**
+     * Frames written so far, and how many the GIF will have
+     */
+    uint32_t getFramesWritten() const { return mFramesWritten.load(std::memory_order_relaxed); }
+    uint32_t getFrameCount() const;
+
+    /**
+     * Time from the start of encoding to completion, waiting for frames included when streaming
+     */
+    double getEncodeMs() const { return mEncodeMs; }
+
+    /**
+     * Once done: the size of the GIF, and for a file how long its writer thread waited on storage
+     * and how long encoding waited for the writer, see AsyncFileGifOutput
+     */
+    uint64_t getBytesWritten() const { return mBytesWritten; }
+    double getWriteMs() const { return mWriteMs; }
+    double getWriteStallMs() const { return mWriteStallMs; }
+
+    const std::string PATH;
+    const uint16_t WIDTH;
+    const uint16_t HEIGHT;
+    const int32_t DELAY_MS;
+
+private:
+    friend class GifEncodeQueue;
+
+    void encode();
+    void requestCancel();
+    void complete(State state);
+    static bool onFrameWritten(void *job, uint32_t framesWritten, uint32_t frameCount);
+
+    // Capture adds frames to a streaming job while it is encoded
+    std::mutex mFramesLock;
+    std::condition_variable mFrameAdded;
+    std::vector<FrameHandle> mFrames;
+    bool mFramesFinished = false;
+    // Still counted once the frames are given back
+    std::atomic<uint32_t> mNumFrames {0};
+    uint32_t mPaletteFrames = 0;
+    std::vector<uint32_t> mPalette; // Guarded by mFramesLock
+    std::vector<uint32_t> mColorCounts; // Guarded by mFramesLock, until encode() takes them
+    DitherMode mDitherMode = DITHER_FLOYD_STEINBERG;
+    bool mBoomerang = false;
+    int32_t mThreadCount = 1;
+    bool mInMemory = false;
+    std::unique_ptr<uint8_t, void (*)(void *)> mGif {nullptr, free};
+    size_t mGifSize = 0;
+    ProgressCallback mOnProgress;
+    CompletionCallback mOnCompletion;
+
+    std::atomic<State> mState {QUEUED};
+    std::atomic<bool> mCancelRequested {false};
+    std::atomic<uint32_t> mFramesWritten {0};
+    double mEncodeMs = 0;
+    uint64_t mBytesWritten = 0;
+    double mWriteMs = 0;
+    double mWriteStallMs = 0;
+};
+
+/**
+ * GIFs waiting to be encoded, and the threads encoding them
+ *
+ * Capture hands its frames over with submit() and can start on the next GIF straight away. The
+ * number of jobs queued or encoding is bounded, as each one holds on to its frames until written.
+ */
+class GifEncodeQueue {
+public:
+    /**
+     * @param numEncoders GIFs encoded at the same time, each on a thread of its own
+     * @param maxJobs GIFs queued or being encoded at once, submit() refuses more
+     */
+    GifEncodeQueue(uint32_t numEncoders, uint32_t maxJobs);
+
+    /**
+     * Waits for every submitted GIF to be written, captured photos are not thrown away. Streaming
+     * jobs still capturing have to be finished or cancelled first.
+     */
+    ~GifEncodeQueue();
+
+    /**
+     * @return False if maxJobs GIFs are already queued or encoding
+     */
+    bool submit(const std::shared_ptr<GifEncodeJob> &job);
+
+    /**
+     * A queued job completes as CANCELLED right away. A job being encoded stops after the frame
+     * it is writing and its file is deleted.
+     */
+    void cancel(const std::shared_ptr<GifEncodeJob> &job);
+
+    bool isFull() const;
+    uint32_t numJobs() const;
+
+    /**
+     * Block until every submitted job is done
+     */
+    void waitUntilIdle();
+
+    const uint32_t MAX_JOBS;
+
+private:
+    void encoderThread();
+
+    mutable std::mutex mLock;
+    std::condition_variable mJobQueued;
+    std::condition_variable mJobDone;
+    std::deque<std::shared_ptr<GifEncodeJob>> mQueued;
+    uint32_t mNumEncoding = 0;
+    bool mStopping = false;
+    std::vector<std::thread> mEncoders;
+};
+
+#endif //VULKAN_PHOTO_BOOTH_GIF_ENCODE_QUEUE_H
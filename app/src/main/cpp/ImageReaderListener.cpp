@@ -14,12 +14,25 @@
  * limitations under the License.
  */
 
+#ifdef ANDROID
 #include <android/trace.h>
 #include <media/NdkImageReader.h>
+#endif
+#include <cstring>
 #include "ImageReaderListener.h"
 #include "vulkan-utils/vulkan_utils.h"
+#include "frame_queue.h"
+#ifdef ANDROID
 #include "native-lib.h"
-#include "ring_buffer.h"
+#else
+// UI callbacks are provided by the host driver, see host/frame_replay.cpp
+void updateFramerateUI(double current_fps, double vulkan_render_time);
+void updateGifProgress();
+void gifFrameCaptured();
+void gifReadyToEncode();
+bool getGifPalette(std::vector<uint32_t> &colors, DitherMode &dither_mode);
+void gifColorsCounted(const std::vector<uint32_t> &counts);
+#endif
 
 /**
  * Controlling flags
@@ -32,9 +45,9 @@ bool ImageReaderListener::surface_ready_left = false;
 bool ImageReaderListener::surface_ready_right = false;
 bool ImageReaderListener::native_draw_to_display = false;
 bool ImageReaderListener::vulkan_queue_empty = true;
-bool ImageReaderListener::gif_being_encoded = false;
-bool ImageReaderListener::gif_requested = false;
+std::atomic<bool> ImageReaderListener::gif_requested(false);
 int ImageReaderListener::gif_frames_captured = 0;
+int ImageReaderListener::gif_color_frames = 0;
 
 ImageReaderListener::ImageReaderListener(VulkanInstance *instance, VulkanImageRenderer *renderer, VulkanAHBManager *vahbManager, FilterParams *filterParams, ANativeWindow *outputWindow) {
     mInstance = instance;
@@ -43,10 +56,26 @@ ImageReaderListener::ImageReaderListener(VulkanInstance *instance, VulkanImageRe
     mFilterParams = filterParams;
     mMainOutputWindow = outputWindow;
 
-    // Create ring buffer for GIF creation
-    gifRingBuffer = new RingBuffer<uint32_t *>(NUM_GIF_FRAMES);
+    // Create frame queue for GIF creation. Capture and the GIF encoder borrow frames from this
+    // arena instead of allocating them. Frames still being read back count towards
+    // NUM_GIF_FRAMES, and a capture only starts when fewer than MAX_QUEUED_GIFS are waiting to be
+    // encoded, so the pool never needs more than MAX_QUEUED_GIFS GIFs worth of frames.
+    gifFramePool = new FramePool(NUM_GIF_FRAMES * MAX_QUEUED_GIFS,
+            VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH * VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT);
+    gifFrameQueue = new FrameQueue(gifFramePool, NUM_GIF_FRAMES);
 }
 
+ImageReaderListener::~ImageReaderListener() {
+    stopRecording();
+
+    // The renderer may still be writing into pending frames
+    mRenderer->flushReadbacks();
+    mPendingGifFrames.clear();
+    delete gifFrameQueue;
+    delete gifFramePool;
+}
+
+#ifdef ANDROID
 /**
  * Static method so onImageAvailable can be used as a callback
  */
@@ -68,9 +97,7 @@ void ImageReaderListener::onImageAvailable(void* obj, AImageReader* reader) {
     // If the listener is null, something is wrong
     if (obj == nullptr) { return; }
 
-    start_render_time = now_ms();
     auto thiz = reinterpret_cast<ImageReaderListener*>(obj);
-    thiz->mOnImageAvailableCount++;
     AImage* image = nullptr;
 
     // Get latest AImage from the reader. NOTE: this will be freed by the renderer
@@ -114,11 +141,99 @@ void ImageReaderListener::onImageAvailable(void* obj, AImageReader* reader) {
     // Get/add the corresponding VulkanAHardwareBuffer from the hashmap
     VulkanAHardwareBufferImage *vkAHB = mVahbManager->getVulkanAHB(ahb);
 
+    {
+        std::lock_guard<std::mutex> lock(thiz->mRecordingLock);
+        if (thiz->mRecorder.isOpen()) {
+            thiz->recordFrame(image);
+        }
+    }
+
+    thiz->processFrame(vkAHB, image);
+}
+
+/**
+ * Append a camera image to the current recording
+ *
+ * Requires CPU readable YUV_420_888 images, ie. the preview ImageReader must be created with
+ * AIMAGE_FORMAT_YUV_420_888 and AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN, as createPreviewImageReader
+ * does while startFrameRecording is in effect. Recording is stopped if the image planes cannot be
+ * read. Called with mRecordingLock held.
+ */
+void ImageReaderListener::recordFrame(AImage *image) {
+    ATrace_beginSection("VULKAN_PHOTOBOOTH: record frame");
+    const FrameRecordingHeader &header = mRecorder.header();
+    uint8_t *dst = mRecordingFrame.data();
+
+    int64_t timestamp_ns = 0;
+    AImage_getTimestamp(image, &timestamp_ns);
+
+    // Pack Y, U and V planes into I420, dropping row padding and interleaving
+    for (int plane = 0; plane < 3; plane++) {
+        uint8_t *data = nullptr;
+        int data_length = 0;
+        int32_t row_stride = 0;
+        int32_t pixel_stride = 0;
+        if (AMEDIA_OK != AImage_getPlaneData(image, plane, &data, &data_length)
+            || AMEDIA_OK != AImage_getPlaneRowStride(image, plane, &row_stride)
+            || AMEDIA_OK != AImage_getPlanePixelStride(image, plane, &pixel_stride)) {
+            loge("Camera images are not CPU readable YUV_420_888, stopping frame recording.");
+            closeRecording();
+            ATrace_endSection();
+            return;
+        }
+
+        uint32_t plane_width = (0 == plane) ? header.width : (header.width + 1) / 2;
+        uint32_t plane_height = (0 == plane) ? header.height : (header.height + 1) / 2;
+        for (uint32_t y = 0; y < plane_height; y++) {
+            const uint8_t *row = data + y * row_stride;
+            for (uint32_t x = 0; x < plane_width; x++) {
+                *dst++ = row[x * pixel_stride];
+            }
+        }
+    }
+
+    mRecorder.writeFrame(timestamp_ns, *mFilterParams, mRecordingFrame.data());
+    ATrace_endSection();
+}
+#endif
+
+bool ImageReaderListener::startRecording(const char *path, uint32_t width, uint32_t height) {
+    std::lock_guard<std::mutex> lock(mRecordingLock);
+    closeRecording();
+    ASSERT(mRecorder.open(path, width, height, FRAME_FORMAT_I420));
+    mRecordingFrame.resize(mRecorder.header().frame_size);
+    logd("Recording camera frames to: %s", path);
+    return true;
+}
+
+void ImageReaderListener::stopRecording() {
+    std::lock_guard<std::mutex> lock(mRecordingLock);
+    closeRecording();
+}
+
+void ImageReaderListener::closeRecording() {
+    if (mRecorder.isOpen()) {
+        logd("Stopped frame recording after %d frames.", mRecorder.numFrames());
+        mRecorder.close();
+    }
+    mRecordingFrame.clear();
+}
+
+/**
+ * Render a frame and handle GIF frame capture and frame statistics
+ *
+ * @param inputImage The image to render
+ * @param image The AImage backing inputImage, freed by the renderer once it is done with it
+ */
+void ImageReaderListener::processFrame(VulkanInputImage *inputImage, AImage *image) {
+    start_render_time = now_ms();
+    mOnImageAvailableCount++;
+
     // The first time an image is received, create the render pipeline, afterward re-use the same pipeline
     if (!mRenderer->isPipelineInitialized) {
         ATrace_beginSection("VULKAN_PHOTOBOOTH: Create Vulkan pipeline.");
         //TODO: do something if assert fails and die.
-        ASSERT_FORMATTED(mRenderer->createPipeline(vkAHB->sampler(), vkAHB->isSamplerImmutable()),
+        ASSERT_FORMATTED(mRenderer->createPipeline(inputImage->sampler(), inputImage->isSamplerImmutable()),
                          "creation of Render pipeline failed.");
         ATrace_endSection();
     }
@@ -127,39 +242,51 @@ void ImageReaderListener::onImageAvailable(void* obj, AImageReader* reader) {
     // Send the image to the renderer so it will passed into the Vulkan pipeline for effects and display
     ATrace_beginSection("VULKAN_PHOTOBOOTH: renderImageAndReadback call from native-lib.");
 
-    // Only copy out every 12th frame, and only if a gif is not currently being encoded
+    // Only copy out every 12th frame, GIFs still being encoded hold on to frames of their own.
     // if ringbuf_data is null, no copy will be made in renderImageAndReadback.
-    uint32_t *ringbuf_data = nullptr;
+    // Copies still in flight count towards the GIF so no extra frames are requested.
+    // Once the GIF's palette is known the GPU maps the frame to it and only the indices are read
+    // back, half the bytes of RGB565. Until then the GPU counts the colors the palette is built from.
+    uint16_t *ringbuf_data = nullptr;
+    bool gif_palette_indices = false;
+    bool gif_count_colors = false;
+    const int gif_frame_number = gif_frames_captured + mPendingGifFrames.size();
     if (1 == frame_count % 12
         && gif_requested
-        && !gif_being_encoded) {
-            ringbuf_data = new uint32_t[VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH * VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT];
-        if (gifRingBuffer->isFull()) {
-            delete gifRingBuffer->get();
+        && gif_frame_number < NUM_GIF_FRAMES) {
+        FrameHandle gif_frame = gifFramePool->acquire();
+        if (gif_frame) {
+            if (0 == gif_frame_number)
+                mRenderer->clearGifColorCounts();
+            gif_count_colors = gif_frame_number < gif_color_frames;
+
+            DitherMode dither_mode;
+            if (!getGifPalette(mGifPalette, dither_mode)
+                || !mRenderer->setGifPalette(mGifPalette.data(), mGifPalette.size(), dither_mode)) {
+                mRenderer->clearGifPalette();
+            }
+            gif_palette_indices = mRenderer->hasGifPalette();
+            gif_frame.setPaletteIndices(gif_palette_indices);
+            ringbuf_data = gif_frame.data();
+            mPendingGifFrames.push_back(std::move(gif_frame));
         }
     }
 
     RENDERER_RETURN_CODE render_state = RENDER_STATE_NOT_SET;
 
     // Send the frame to the renderer
+    double render_start = now_ms();
     double fence_delay = mRenderer->renderImageAndReadback(
-            vkAHB, mFilterParams, image, native_draw_to_display, surface_ready_left, surface_ready_right, render_state,
-            ringbuf_data);
+            inputImage, mFilterParams, image, native_draw_to_display, surface_ready_left, surface_ready_right, render_state,
+            ringbuf_data, gif_palette_indices, gif_count_colors);
+    last_frame_timing.render_ms = now_ms() - render_start;
+    last_frame_timing.gif_frame_copied = (nullptr != ringbuf_data);
     ATrace_endSection(); // renderImageAndReadback
 
-    // Save to the ring buffer
-    if (nullptr != ringbuf_data) {
-        gifRingBuffer->put(ringbuf_data);
-        gif_frames_captured++;
-        updateGifProgress();
-
-        if (gif_frames_captured >= NUM_GIF_FRAMES) {
-            gif_requested = false;
-            gifReadyToEncode();
-        }
-    }
+    // The frame is read back once the GPU is done with it, a frame or two from now
+    harvestGifFrames();
 
-    thiz->mOnImageAvailableCount--;
+    mOnImageAvailableCount--;
 
     // Signal to Kotlin that the vulkan queue has been drained
     vulkan_queue_empty = !native_draw_to_display && (render_state == RENDER_QUEUE_EMPTY);
@@ -189,10 +316,38 @@ void ImageReaderListener::onImageAvailable(void* obj, AImageReader* reader) {
             updateFramerateUI(current_fps, vulkan_render_time);
         }
     }
+    last_frame_timing.total_ms = now_ms() - start_render_time;
+    last_frame_timing.gif_frames_captured = gif_frames_captured;
+
     // Record time the last time a frame was successfully submitted to the Vulkan pipeline
     last_time = now_ms();
 }
 
+void ImageReaderListener::harvestGifFrames() {
+    mCompletedGifFrames.clear();
+    mRenderer->getCompletedReadbacks(mCompletedGifFrames);
+
+    // Readbacks complete in the order they were requested, hand them to the encoder
+    for (size_t i = 0; i < mCompletedGifFrames.size() && !mPendingGifFrames.empty(); i++) {
+        gifFrameQueue->put(std::move(mPendingGifFrames.front()));
+        mPendingGifFrames.pop_front();
+        gif_frames_captured++;
+
+        // Every frame counted has completed, the palette can be built from the counts alone
+        if (gif_frames_captured == gif_color_frames && mRenderer->readGifColorCounts(mGifColorCounts)) {
+            gifColorsCounted(mGifColorCounts);
+        }
+        gifFrameCaptured();
+        updateGifProgress();
+
+        if (gif_frames_captured >= NUM_GIF_FRAMES) {
+            // Hand the job over first, the next capture may start as soon as this is cleared
+            gifReadyToEncode();
+            gif_requested = false;
+        }
+    }
+}
+
 int ImageReaderListener::onImageAvailableCount() {
     return mOnImageAvailableCount;
 }
\ No newline at end of file
@@ -18,10 +18,29 @@
 #define VULKAN_PHOTO_BOOTH_IMAGEREADERLISTENER_H
 
 
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#ifdef ANDROID
 #include <media/NdkImageReader.h>
-#include "vulkan-utils/VulkanImageRenderer.h"
-#include "ring_buffer.h"
 #include "vulkan-utils/VulkanAHBManager.h"
+#else
+class VulkanAHBManager;
+#endif
+#include "vulkan-utils/VulkanImageRenderer.h"
+#include "frame_queue.h"
+#include "FrameRecording.h"
+
+/**
+ * Timings for the most recently processed frame, in ms
+ */
+struct FrameTiming {
+    double render_ms = 0;  // renderImageAndReadback. GIF frame readbacks complete asynchronously
+    double total_ms = 0;   // All of processFrame
+    bool gif_frame_copied = false;
+    int gif_frames_captured = 0;
+};
 
 /**
  * Listener for each new frame received from the camera
@@ -36,20 +55,43 @@ public:
     // State flags
     static bool native_draw_to_display; // Can Vulkan write to the screen?
     static bool vulkan_queue_empty; // Are there any frames propagating through Vulkan?
-    static bool gif_being_encoded; // Is a gif currently being encoded
-    static bool gif_requested; // Has a gif been requested
+    // Has a gif been requested. Set by the capture thread once the GIF's job and counters are, read
+    // by the ImageReader thread.
+    static std::atomic<bool> gif_requested;
 
     // GIF generator info
     static const uint16_t NUM_GIF_FRAMES = 7;
-    RingBuffer<uint32_t *> *gifRingBuffer;
+    static const uint16_t MAX_QUEUED_GIFS = 3; // Captured GIFs waiting for or being encoded
+    FramePool *gifFramePool;
+    FrameQueue *gifFrameQueue; // Captured frames, read by the GIF encoder
     static int gif_frames_captured; // Counter for # frames captured for GIF so far
+    static int gif_color_frames; // First frames of a GIF whose colors the GPU counts for the palette
 
     ImageReaderListener(VulkanInstance *instance, VulkanImageRenderer *renderer, VulkanAHBManager *vahbManager, FilterParams *filterParams, ANativeWindow *outputWindow);
+    ~ImageReaderListener();
 
+#ifdef ANDROID
     static void onImageAvailableCallback(void* obj, AImageReader* reader);
     void onImageAvailable(void* obj, AImageReader* reader);
+#endif
     int onImageAvailableCount();
 
+    /**
+     * Render one frame: everything done for a camera image once it has been acquired
+     *
+     * Called by onImageAvailable, and directly by the replay driver (host/frame_replay.cpp).
+     */
+    void processFrame(VulkanInputImage *inputImage, AImage *image);
+
+    /**
+     * Record incoming camera frames and filter settings for later replay (see FrameRecording.h).
+     * The camera images have to be CPU readable YUV_420_888. Safe to call while frames arrive.
+     */
+    bool startRecording(const char *path, uint32_t width, uint32_t height);
+    void stopRecording();
+
+    FrameTiming last_frame_timing;
+
 private:
     VulkanInstance *mInstance = nullptr;
     VulkanImageRenderer *mRenderer = nullptr;
@@ -58,6 +100,23 @@ private:
     ANativeWindow *mMainOutputWindow = nullptr; // The output surface to grab images from for gif
     int mOnImageAvailableCount = 0;
 
+    /**
+     * Move GIF frames the renderer has finished reading back into the ring buffer
+     */
+    void harvestGifFrames();
+    std::deque<FrameHandle> mPendingGifFrames; // Requested from the renderer, not yet read back
+    std::vector<uint16_t *> mCompletedGifFrames;
+    std::vector<uint32_t> mGifPalette;
+    std::vector<uint32_t> mGifColorCounts;
+
+#ifdef ANDROID
+    void recordFrame(AImage *image);
+#endif
+    void closeRecording();
+    std::mutex mRecordingLock; // Guards the recorder, started and stopped from the JNI thread
+    FrameRecordingWriter mRecorder;
+    std::vector<uint8_t> mRecordingFrame;
+
     // Frame counter
     int frame_count = 0;
     double last_time = 0;
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_PHOTO_BOOTH_FRAME_QUEUE_H
+#define VULKAN_PHOTO_BOOTH_FRAME_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class FramePool;
+
+/**
+ * Move-only ownership of one frame buffer from a FramePool
+ *
+ * The buffer goes back to its pool when the handle is destroyed or reset, so frames can be passed
+ * between the render and encode threads without either side having to free them.
+ */
+class FrameHandle {
+public:
+    FrameHandle() {}
+    FrameHandle(FrameHandle &&other) : mPool(other.mPool), mSlot(other.mSlot) {
+        other.mPool = nullptr;
+    }
+    FrameHandle &operator=(FrameHandle &&other) {
+        if (this != &other) {
+            reset();
+            mPool = other.mPool;
+            mSlot = other.mSlot;
+            other.mPool = nullptr;
+        }
+        return *this;
+    }
+    FrameHandle(const FrameHandle &) = delete;
+    FrameHandle &operator=(const FrameHandle &) = delete;
+    ~FrameHandle() { reset(); }
+
+    inline uint16_t *data() const;
+    explicit operator bool() const { return nullptr != mPool; }
+
+    /**
+     * The frame holds one palette index byte per pixel instead of RGB565, see FramePool. Travels
+     * with the frame through a FrameQueue.
+     */
+    inline void setPaletteIndices(bool paletteIndices);
+    inline bool holdsPaletteIndices() const;
+
+    /**
+     * Return the buffer to the pool early
+     */
+    inline void reset();
+
+private:
+    friend class FramePool;
+    friend class FrameQueue;
+    FrameHandle(FramePool *pool, uint32_t slot) : mPool(pool), mSlot(slot) {}
+
+    FramePool *mPool = nullptr;
+    uint32_t mSlot = 0;
+};
+
+/**
+ * Fixed arena of equally sized frame buffers, allocated once
+ *
+ * Frames hold RGB565 pixels, the format the renderer reads back and the GIF encoders take, or once
+ * the GIF's palette is known, the palette indices the renderer mapped them to, in the first half of
+ * the frame. Every frame starts on a FRAME_ALIGNMENT boundary so SIMD code can use aligned loads.
+ * acquire() and release (through FrameHandle) are lock-free and may be called from any thread.
+ */
+class FramePool {
+public:
+    /**
+     * @param numFrames Maximum number of frames alive at once
+     * @param frameSize Size of each frame, in pixels
+     */
+    FramePool(uint32_t numFrames, size_t frameSize) :
+            NUM_FRAMES(numFrames), FRAME_SIZE(frameSize),
+            FRAME_STRIDE((frameSize * sizeof(uint16_t) + FRAME_ALIGNMENT - 1) / FRAME_ALIGNMENT * FRAME_ALIGNMENT / sizeof(uint16_t)),
+            mArena(new uint8_t[numFrames * FRAME_STRIDE * sizeof(uint16_t) + FRAME_ALIGNMENT]),
+            mInUse(new std::atomic<bool>[numFrames]),
+            mPaletteIndices(new bool[numFrames]) {
+        uintptr_t arena = reinterpret_cast<uintptr_t>(mArena.get());
+        mPixels = reinterpret_cast<uint16_t *>((arena + FRAME_ALIGNMENT - 1) & ~(uintptr_t) (FRAME_ALIGNMENT - 1));
+        for (uint32_t i = 0; i < NUM_FRAMES; i++) {
+            mInUse[i].store(false, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Take a free frame from the pool
+     *
+     * @return An empty handle if every frame is in use
+     */
+    FrameHandle acquire() {
+        for (uint32_t i = 0; i < NUM_FRAMES; i++) {
+            bool expected = false;
+            if (!mInUse[i].load(std::memory_order_relaxed)
+                && mInUse[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                mPaletteIndices[i] = false;
+                return FrameHandle(this, i);
+            }
+        }
+        return FrameHandle();
+    }
+
+    uint32_t numFree() const {
+        uint32_t free_frames = 0;
+        for (uint32_t i = 0; i < NUM_FRAMES; i++) {
+            if (!mInUse[i].load(std::memory_order_relaxed))
+                free_frames++;
+        }
+        return free_frames;
+    }
+
+    static const size_t FRAME_ALIGNMENT = 64; // Cache line, and wide enough for AVX-512
+
+    const uint32_t NUM_FRAMES;
+    const size_t FRAME_SIZE;    // Pixels in a frame
+    const size_t FRAME_STRIDE;  // Pixels between the start of consecutive frames
+
+private:
+    friend class FrameHandle;
+    friend class FrameQueue;
+
+    uint16_t *frame(uint32_t slot) const { return mPixels + slot * FRAME_STRIDE; }
+    void release(uint32_t slot) { mInUse[slot].store(false, std::memory_order_release); }
+
+    std::unique_ptr<uint8_t[]> mArena;
+    uint16_t *mPixels;
+    std::unique_ptr<std::atomic<bool>[]> mInUse;
+    // Only touched by the frame's owner, handing the frame over publishes it with the pixels
+    std::unique_ptr<bool[]> mPaletteIndices;
+};
+
+uint16_t *FrameHandle::data() const {
+    return (nullptr == mPool) ? nullptr : mPool->frame(mSlot);
+}
+
+void FrameHandle::setPaletteIndices(bool paletteIndices) {
+    if (nullptr != mPool)
+        mPool->mPaletteIndices[mSlot] = paletteIndices;
+}
+
+bool FrameHandle::holdsPaletteIndices() const {
+    return nullptr != mPool && mPool->mPaletteIndices[mSlot];
+}
+
+void FrameHandle::reset() {
+    if (nullptr != mPool) {
+        mPool->release(mSlot);
+        mPool = nullptr;
+    }
+}
+
+/**
+ * Lock-free single-producer / single-consumer queue of frames with overwrite-oldest semantics
+ *
+ * Replaces RingBuffer (ring_buffer.h) for GIF frames. put() never fails: when the queue is full the
+ * oldest frame is evicted and goes back to its pool.
+ *
+ * Each slot holds a frame index + 1, 0 when empty. Both sides advance mTail with a CAS, so the
+ * consumer and an evicting producer can never take the same frame. The producer only ever waits
+ * if the consumer has claimed the slot it is about to reuse but has not yet taken the frame out of
+ * it, a window of a few instructions.
+ */
+class FrameQueue {
+public:
+    /**
+     * @param pool Pool every queued frame comes from
+     * @param capacity Maximum number of queued frames
+     */
+    FrameQueue(FramePool *pool, uint32_t capacity) :
+            CAPACITY(capacity),
+            mPool(pool),
+            mSlots(new std::atomic<uint32_t>[capacity]) {
+        for (uint32_t i = 0; i < CAPACITY; i++) {
+            mSlots[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~FrameQueue() {
+        while (get()) {}
+    }
+
+    /**
+     * Producer only. Add a frame, evicting the oldest one if the queue is full.
+     */
+    void put(FrameHandle &&frame) {
+        if (!frame || frame.mPool != mPool)
+            return;
+
+        uint64_t head = mHead.load(std::memory_order_relaxed);
+        uint64_t tail = mTail.load(std::memory_order_acquire);
+        if (head - tail >= CAPACITY) {
+            // If the consumer gets there first, the queue is no longer full either way
+            if (mTail.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel)) {
+                uint32_t evicted = mSlots[tail % CAPACITY].exchange(0, std::memory_order_acquire);
+                mPool->release(evicted - 1);
+                mEvictions.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic<uint32_t> &slot = mSlots[head % CAPACITY];
+        while (0 != slot.load(std::memory_order_acquire)) {}
+        slot.store(frame.mSlot + 1, std::memory_order_release);
+        frame.mPool = nullptr;
+
+        mHead.store(head + 1, std::memory_order_release);
+    }
+
+    /**
+     * Consumer only. Take the oldest frame.
+     *
+     * @return An empty handle if the queue is empty
+     */
+    FrameHandle get() {
+        uint64_t tail = mTail.load(std::memory_order_acquire);
+        while (tail != mHead.load(std::memory_order_acquire)) {
+            // Fails if the producer just evicted this frame, tail is reloaded and we try the next
+            if (mTail.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel)) {
+                uint32_t slot = mSlots[tail % CAPACITY].exchange(0, std::memory_order_acquire);
+                return FrameHandle(mPool, slot - 1);
+            }
+        }
+        return FrameHandle();
+    }
+
+    bool isEmpty() const {
+        return 0 == numItems();
+    }
+
+    bool isFull() const {
+        return CAPACITY == numItems();
+    }
+
+    size_t numItems() const {
+        uint64_t tail = mTail.load(std::memory_order_acquire);
+        uint64_t head = mHead.load(std::memory_order_acquire);
+        return (head > tail) ? (size_t) (head - tail) : 0;
+    }
+
+    /**
+     * Number of frames dropped by put() to make room, since construction
+     */
+    uint64_t numEvictions() const {
+        return mEvictions.load(std::memory_order_relaxed);
+    }
+
+    const uint32_t CAPACITY;
+
+private:
+    FramePool *const mPool;
+    std::unique_ptr<std::atomic<uint32_t>[]> mSlots;
+    std::atomic<uint64_t> mHead {0};
+    std::atomic<uint64_t> mTail {0};
+    std::atomic<uint64_t> mEvictions {0};
+};
+
+#endif //VULKAN_PHOTO_BOOTH_FRAME_QUEUE_H
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_PHOTO_BOOTH_BENCH_UTILS_H
+#define VULKAN_PHOTO_BOOTH_BENCH_UTILS_H
+
+/**
+ * Timing and synthetic frames shared by the host benchmarks
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "third_party/androidndkgif/ColorHistogram.h"
+#include "third_party/androidndkgif/GCTGifEncoder.h"
+
+static inline double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Exposes the encoder's median cut so benchmarks run against a real palette
+ */
+class PaletteBuilder : public GCTGifEncoder {
+public:
+    void build(uint32_t *pixels, uint32_t pixelNum, Cube *cubes) {
+        computeColorTable(pixels, cubes, pixelNum);
+    }
+
+    void buildFromCounts(const uint32_t *counts, Cube *cubes) {
+        colorHistogram.clear();
+        colorHistogram.addCounts(counts);
+        computeColorTable(cubes);
+    }
+};
+
+/**
+ * Smooth gradients with sensor-like noise, roughly what the camera filters produce. A transparent
+ * strip down the left edge exercises the transparent index. The same frame every call.
+ */
+static inline void fillNoisyFrame(std::vector<uint32_t> &frame, uint32_t width, uint32_t height) {
+    srand(1);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t r = (x * 255 / width + (rand() & 15)) & 0xFF;
+            uint32_t g = (y * 255 / height + (rand() & 15)) & 0xFF;
+            uint32_t b = ((x + y) * 127 / (width + height) + 64 + (rand() & 31)) & 0xFF;
+            uint32_t a = x < 4 ? 0x00 : 0xFF;
+            frame[y * width + x] = (a << 24) | (b << 16) | (g << 8) | r;
+        }
+    }
+}
+
+/**
+ * Fixed pattern noise, the same in every frame
+ */
+static inline uint32_t grainAt(uint32_t x, uint32_t y) {
+    uint32_t hash = (x * 73856093u) ^ (y * 19349663u);
+    hash ^= hash >> 13;
+    hash *= 0x5bd1e995u;
+    return hash ^ (hash >> 15);
+}
+
+/**
+ * Gradients with sensor-like noise and a bright square, a fifth of the width, moving across them
+ * at squareY. Frame n of a GIF, RGBA.
+ */
+static inline void fillMovingSquareFrame(uint32_t *frame, uint32_t width, uint32_t height, uint32_t n,
+                                         uint32_t squareY) {
+    uint32_t squareSize = width / 5;
+    uint32_t squareX = (n * width / 12) % width;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t grain = grainAt(x, y);
+            uint32_t r = (x * 255 / width + (grain & 15)) & 0xFF;
+            uint32_t g = (y * 255 / height + ((grain >> 4) & 15)) & 0xFF;
+            uint32_t b = ((x + y) * 127 / (width + height) + 64 + ((grain >> 8) & 31)) & 0xFF;
+            if (x >= squareX && x < squareX + squareSize && y >= squareY && y < squareY + squareSize) {
+                r = 240;
+                g = 200 + ((grain >> 16) & 15);
+                b = 40;
+            }
+            frame[y * width + x] = 0xFF000000 | (b << 16) | (g << 8) | r;
+        }
+    }
+}
+
+/**
+ * The whole file, empty if it can't be read
+ */
+static inline std::string readFile(const std::string &path) {
+    std::string data;
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (nullptr == fp)
+        return data;
+    char buffer[65536];
+    size_t read;
+    while (0 < (read = fread(buffer, 1, sizeof(buffer), fp)))
+        data.append(buffer, read);
+    fclose(fp);
+    return data;
+}
+
+/**
+ * Adds RGBA pixels to the color counts the way shaders/gif_colors.comp.glsl does, see
+ * ColorHistogram::addCounts. Empty counts are sized first.
+ */
+static inline void addColorCounts(const uint32_t *pixels, uint32_t pixelNum, std::vector<uint32_t> &counts) {
+    counts.resize(ColorHistogram::BIN_NUM * ColorHistogram::COUNT_NUM);
+    for (uint32_t i = 0; i < pixelNum; i++) {
+        uint32_t pixel = pixels[i];
+        uint32_t *bin = &counts[ColorHistogram::binIndex(pixel) * ColorHistogram::COUNT_NUM];
+        bin[0]++;
+        for (int c = 0; c < 3; c++) {
+            bin[1 + c] += (pixel >> (8 * c)) & ((1 << ColorHistogram::BIN_SHIFT) - 1);
+        }
+    }
+}
+
+#endif //VULKAN_PHOTO_BOOTH_BENCH_UTILS_H
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Speed and quality of the GIF encoder's dither modes
+ *
+ * Color reduces a synthetic camera-like frame and a smooth gradient without noise to a 255 color
+ * median cut palette with every DitherMode, through BaseGifEncoder::reduceColor on 1 thread and on
+ * more, and reports MPix/s and the PSNR against the original. Dithering trades per-pixel error for
+ * smoother gradients, so the PSNR after a small blur of both images, closer to what the eye sees,
+ * is reported as well. Results on more threads are checked to match 1 thread exactly, including
+ * the wavefront Floyd-Steinberg.
+ *
+ * Usage: dither_bench [iterations] [threads] [frame_width frame_height]
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "third_party/androidndkgif/GCTGifEncoder.h"
+#include "third_party/androidndkgif/WorkerPool.h"
+#include "bench_utils.h"
+
+/**
+ * Exposes the encoder's median cut and color reduction without opening a file
+ */
+class DitherEncoder : public GCTGifEncoder {
+public:
+    DitherEncoder(uint16_t frameWidth, uint16_t frameHeight) {
+        width = frameWidth;
+        height = frameHeight;
+    }
+
+    void buildPalette(const std::vector<uint32_t> &frame, Cube *cubes) {
+        std::vector<uint32_t> scratch(frame);
+        memset(cubes, 0, 256 * sizeof(Cube));
+        computeColorTable(scratch.data(), cubes, scratch.size());
+    }
+
+    void reduce(PaletteLookupTable *table, Cube *cubes, uint32_t *pixels, uint8_t *indices,
+                uint32_t *colors, uint32_t threadNum) {
+        reduceColor(table, cubes, 255, pixels, indices, colors, threadNum);
+    }
+};
+
+/**
+ * A sky-like gradient, where a palette shows bands without dither
+ */
+static void fillSmoothFrame(std::vector<uint32_t> &frame, uint32_t width, uint32_t height) {
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t r = 40 + x * 120 / width;
+            uint32_t g = 90 + y * 100 / height;
+            uint32_t b = 150 + (x + y) * 100 / (width + height);
+            frame[y * width + x] = 0xFF000000 | (b << 16) | (g << 8) | r;
+        }
+    }
+}
+
+/**
+ * PSNR of the opaque pixels, optionally after a 3x3 [1 2 1] blur of both images
+ */
+static double psnr(const std::vector<uint32_t> &original, const std::vector<uint32_t> &reduced,
+                   uint32_t width, uint32_t height, bool blur) {
+    const int32_t weights[3] = {1, 2, 1};
+    int32_t border = blur ? 1 : 0;
+    double squaredError = 0.0;
+    uint64_t samples = 0;
+    for (int32_t y = border; y < (int32_t) height - border; y++) {
+        for (int32_t x = border; x < (int32_t) width - border; x++) {
+            bool opaque = true;
+            for (int32_t dy = -border; dy <= border; dy++) {
+                for (int32_t dx = -border; dx <= border; dx++)
+                    opaque = opaque && 0 != (original[(y + dy) * width + x + dx] >> 24);
+            }
+            if (!opaque)
+                continue;
+            for (int32_t color = 0; color < COLOR_MAX; color++) {
+                int32_t sumOriginal = 0;
+                int32_t sumReduced = 0;
+                int32_t weightSum = 0;
+                for (int32_t dy = -border; dy <= border; dy++) {
+                    for (int32_t dx = -border; dx <= border; dx++) {
+                        int32_t weight = blur ? weights[dy + 1] * weights[dx + 1] : 1;
+                        uint32_t i = (y + dy) * width + x + dx;
+                        sumOriginal += weight * (int32_t) GET_COLOR(original[i], color);
+                        sumReduced += weight * (int32_t) GET_COLOR(reduced[i], color);
+                        weightSum += weight;
+                    }
+                }
+                double diff = (double) (sumOriginal - sumReduced) / weightSum;
+                squaredError += diff * diff;
+                samples++;
+            }
+        }
+    }
+    double mse = squaredError / (samples > 0 ? samples : 1);
+    return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+struct ReduceResult {
+    std::vector<uint8_t> indices;
+    std::vector<uint32_t> colors;
+    double seconds = 0.0;
+};
+
+static void reduce(DitherEncoder &encoder, Cube *cubes, const std::vector<uint32_t> &frame,
+                   uint32_t threadNum, uint32_t iterations, ReduceResult &result) {
+    PaletteLookupTable table;
+    std::vector<uint32_t> pixels;
+    result.indices.resize(frame.size());
+    result.colors.resize(frame.size());
+    result.seconds = 0.0;
+    for (uint32_t n = 0; n < iterations; n++) {
+        pixels = frame;
+        auto start = std::chrono::steady_clock::now();
+        encoder.reduce(&table, cubes, pixels.data(), result.indices.data(), result.colors.data(), threadNum);
+        result.seconds += seconds_since(start);
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = argc > 1 ? (uint32_t) atoi(argv[1]) : 20;
+    uint32_t threads = argc > 2 ? (uint32_t) atoi(argv[2]) : 4;
+    uint32_t width = argc > 4 ? (uint32_t) atoi(argv[3]) : 500;
+    uint32_t height = argc > 4 ? (uint32_t) atoi(argv[4]) : 281;
+
+    if (iterations < 1 || threads < 2 || width < 3 || height < 3) {
+        fprintf(stderr, "iterations must be at least 1, threads 2 and the frame 3x3\n");
+        return 1;
+    }
+
+    printf("%u iterations of %ux%u, %d pool workers besides the calling thread\n", iterations, width,
+           height, WorkerPool::shared().getWorkerCount());
+    bool ok = true;
+    double megaPixels = (double) width * height * iterations / 1e6;
+    for (int smooth = 0; smooth <= 1; smooth++) {
+        std::vector<uint32_t> frame(width * height);
+        if (smooth)
+            fillSmoothFrame(frame, width, height);
+        else
+            fillNoisyFrame(frame, width, height);
+
+        DitherEncoder encoder(width, height);
+        Cube cubes[256];
+        encoder.buildPalette(frame, cubes);
+
+        printf("%s frame\n", smooth ? "smooth" : "camera");
+        for (int mode = DITHER_NONE; mode < DITHER_MODE_MAX; mode++) {
+            encoder.setDitherMode((DitherMode) mode);
+            ReduceResult single;
+            ReduceResult multiple;
+            reduce(encoder, cubes, frame, 1, iterations, single);
+            reduce(encoder, cubes, frame, threads, iterations, multiple);
+            bool match = single.indices == multiple.indices && single.colors == multiple.colors;
+            ok = ok && match;
+            printf("  %-15s %7.1f MPix/s  %7.1f MPix/s on %u threads  %5.2f dB PSNR  %5.2f dB blurred  %s\n",
+                   getDitherModeName((DitherMode) mode), megaPixels / single.seconds,
+                   megaPixels / multiple.seconds, threads, psnr(frame, single.colors, width, height, false),
+                   psnr(frame, single.colors, width, height, true),
+                   match ? "same on 1 thread" : "DIFFERS FROM 1 THREAD");
+        }
+    }
+
+    return ok ? 0 : 1;
+}
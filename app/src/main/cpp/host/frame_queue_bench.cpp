@@ -0,0 +1,156 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Stress test and throughput benchmark for FrameQueue against the mutex RingBuffer it replaced
+ *
+ * A producer thread pushes numbered frames as fast as it can while a consumer thread drains them,
+ * so the queue is constantly both full (evicting) and empty. The consumer checks every frame it
+ * receives is newer than the last and that nothing was lost or handed out twice.
+ *
+ * Usage: frame_queue_bench [frames] [capacity] [frame_width frame_height]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "frame_queue.h"
+#include "ring_buffer.h"
+#include "bench_utils.h"
+
+/**
+ * RingBuffer as ImageReaderListener used it: a fresh allocation per frame, the producer frees the
+ * oldest frame itself when the buffer is full
+ */
+static bool benchRingBuffer(uint32_t num_frames, uint32_t capacity, size_t frame_size) {
+    RingBuffer<uint32_t *> ring(capacity);
+    uint64_t consumed = 0;
+    uint64_t dropped = 0;
+    uint32_t last_frame = 0;
+    bool in_order = true;
+    std::atomic<bool> done(false);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+        while (!done.load() || !ring.isEmpty()) {
+            uint32_t *frame = ring.get();
+            if (nullptr == frame)
+                continue;
+            if (frame[0] <= last_frame && consumed > 0)
+                in_order = false;
+            last_frame = frame[0];
+            consumed++;
+            delete [] frame;
+        }
+    });
+
+    for (uint32_t n = 1; n <= num_frames; n++) {
+        uint32_t *frame = new uint32_t[frame_size];
+        frame[0] = n;
+        if (ring.isFull()) {
+            uint32_t *oldest = ring.get();
+            if (nullptr != oldest) {
+                delete [] oldest;
+                dropped++;
+            }
+        }
+        ring.put(frame);
+    }
+    done.store(true);
+    consumer.join();
+    double elapsed = seconds_since(start);
+
+    // put() silently overwrites when the consumer refills the slot between isFull and put, those
+    // frames leak and show up as missing here
+    uint64_t lost = num_frames - consumed - dropped;
+    printf("RingBuffer  %8.0f frames/s  consumed=%llu dropped=%llu leaked=%llu %s\n",
+           num_frames / elapsed, (unsigned long long) consumed, (unsigned long long) dropped,
+           (unsigned long long) lost, in_order ? "in order" : "OUT OF ORDER");
+    return in_order;
+}
+
+static bool benchFrameQueue(uint32_t num_frames, uint32_t capacity, size_t frame_size) {
+    // Room for a full queue, the frame being filled and the frame being consumed
+    FramePool pool(capacity + 2, frame_size);
+    FrameQueue queue(&pool, capacity);
+    uint64_t consumed = 0;
+    uint64_t pool_empty = 0;
+    uint32_t last_frame = 0;
+    bool in_order = true;
+    std::atomic<bool> done(false);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+        while (!done.load() || !queue.isEmpty()) {
+            FrameHandle frame = queue.get();
+            if (!frame)
+                continue;
+            // Frames are RGB565, the frame number takes the first two pixels
+            uint32_t frame_number;
+            memcpy(&frame_number, frame.data(), sizeof(frame_number));
+            if (frame_number <= last_frame && consumed > 0)
+                in_order = false;
+            last_frame = frame_number;
+            consumed++;
+        }
+    });
+
+    for (uint32_t n = 1; n <= num_frames; n++) {
+        FrameHandle frame = pool.acquire();
+        if (!frame) {
+            // Only possible if frames are leaking
+            pool_empty++;
+            continue;
+        }
+        memcpy(frame.data(), &n, sizeof(n));
+        queue.put(std::move(frame));
+    }
+    done.store(true);
+    consumer.join();
+    double elapsed = seconds_since(start);
+
+    uint64_t lost = num_frames - pool_empty - consumed - queue.numEvictions();
+    bool ok = in_order && 0 == lost && 0 == pool_empty && pool.numFree() == pool.NUM_FRAMES;
+    printf("FrameQueue  %8.0f frames/s  consumed=%llu dropped=%llu leaked=%llu %s\n",
+           num_frames / elapsed, (unsigned long long) consumed,
+           (unsigned long long) queue.numEvictions(), (unsigned long long) (lost + pool_empty),
+           in_order ? "in order" : "OUT OF ORDER");
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint32_t num_frames = argc > 1 ? (uint32_t) atoi(argv[1]) : 1000000;
+    uint32_t capacity = argc > 2 ? (uint32_t) atoi(argv[2]) : 7;
+    uint32_t width = argc > 4 ? (uint32_t) atoi(argv[3]) : 16;
+    uint32_t height = argc > 4 ? (uint32_t) atoi(argv[4]) : 16;
+
+    if (capacity < 1 || width * height < 2) {
+        fprintf(stderr, "capacity must be at least 1 and frames at least 2 pixels\n");
+        return 1;
+    }
+
+    printf("%u frames of %ux%u, capacity %u\n", num_frames, width, height, capacity);
+    benchRingBuffer(num_frames, capacity, width * height);
+    bool ok = benchFrameQueue(num_frames, capacity, width * height);
+
+    if (!ok) {
+        fprintf(stderr, "FrameQueue lost, duplicated or reordered frames\n");
+        return 1;
+    }
+    return 0;
+}
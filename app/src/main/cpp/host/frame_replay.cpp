@@ -0,0 +1,246 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Deterministic replay of recorded camera frames through ImageReaderListener
+ *
+ * Frames from a FrameRecording are uploaded to a host texture and passed to
+ * ImageReaderListener::processFrame, the same path camera images take on device, together with
+ * the recorded FilterParams. One CSV line of timings is printed per frame.
+ *
+ * Usage:
+ *   frame_replay <recording> [--max-speed] [--gif] [--displays N]
+ *   frame_replay --synthesize <recording> <frames> <width> <height>
+ *
+ * --max-speed ignores the recorded timestamps, --gif keeps requesting GIF captures so the
+ * readback path is exercised.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "vulkan-utils/vulkan_utils.h"
+#include "vulkan-utils/VulkanInstance.h"
+#include "vulkan-utils/VulkanHostImage.h"
+#include "vulkan-utils/VulkanImageRenderer.h"
+#include "ImageReaderListener.h"
+#include "FrameRecording.h"
+
+static const uint32_t OUTPUT_WIDTH = 1920;
+static const uint32_t OUTPUT_HEIGHT = 1080;
+static const uint32_t RENDERER_COPY_WIDTH = 500;
+
+static ImageReaderListener *listener = nullptr;
+static bool keep_requesting_gifs = false;
+static uint32_t gifs_captured = 0;
+
+// UI callbacks normally implemented by native-lib.cpp
+void updateFramerateUI(double current_fps, double vulkan_render_time) {
+}
+
+void updateGifProgress() {
+}
+
+void gifFrameCaptured() {
+}
+
+bool getGifPalette(std::vector<uint32_t> &colors, DitherMode &dither_mode) {
+    // Nothing is encoded, so there is never a palette
+    return false;
+}
+
+void gifColorsCounted(const std::vector<uint32_t> &counts) {
+}
+
+void gifReadyToEncode() {
+    gifs_captured++;
+
+    // Nothing is encoded, just release the captured frames
+    while (listener->gifFrameQueue->get()) {}
+    ImageReaderListener::gif_frames_captured = 0;
+    ImageReaderListener::gif_requested = keep_requesting_gifs;
+}
+
+static uint8_t clampToByte(int value) {
+    return (uint8_t) std::min(255, std::max(0, value));
+}
+
+/**
+ * BT.601 full range I420 -> RGBA8888
+ */
+static void convertI420ToRGBA(const uint8_t *src, uint32_t width, uint32_t height, uint32_t *dst) {
+    const uint32_t chroma_width = (width + 1) / 2;
+    const uint8_t *y_plane = src;
+    const uint8_t *u_plane = y_plane + width * height;
+    const uint8_t *v_plane = u_plane + chroma_width * ((height + 1) / 2);
+
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            int luma = y_plane[y * width + x];
+            int u = u_plane[(y / 2) * chroma_width + x / 2] - 128;
+            int v = v_plane[(y / 2) * chroma_width + x / 2] - 128;
+
+            uint32_t r = clampToByte(luma + ((359 * v) >> 8));
+            uint32_t g = clampToByte(luma - ((88 * u + 183 * v) >> 8));
+            uint32_t b = clampToByte(luma + ((454 * u) >> 8));
+            dst[y * width + x] = 0xFF000000 | (b << 16) | (g << 8) | r;
+        }
+    }
+}
+
+/**
+ * Write a recording of a moving test pattern at 30fps, cycling through the filters
+ */
+static int synthesize(const char *path, uint32_t num_frames, uint32_t width, uint32_t height) {
+    FrameRecordingWriter writer;
+    if (!writer.open(path, width, height, FRAME_FORMAT_I420))
+        return 1;
+
+    std::vector<uint8_t> frame(writer.header().frame_size);
+    uint8_t *u_plane = frame.data() + width * height;
+    const uint32_t chroma_size = ((width + 1) / 2) * ((height + 1) / 2);
+
+    FilterParams filter_params;
+    for (uint32_t frame_count = 0; frame_count < num_frames; frame_count++) {
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                frame[y * width + x] = (uint8_t) (x + y + 4 * frame_count);
+            }
+        }
+        memset(u_plane, (uint8_t) (128 + frame_count), chroma_size);
+        memset(u_plane + chroma_size, (uint8_t) (128 - frame_count), chroma_size);
+
+        // Switch to the next filter every 2 seconds, sweeping its slider
+        filter_params.rotation = 0;
+        for (int i = 0; i < NUM_FILTERS; i++) {
+            filter_params.seek_values[i] = (frame_count * 2) % 100;
+            filter_params.use_filter[i] = (i == (frame_count / 60) % NUM_FILTERS);
+        }
+
+        int64_t timestamp_ns = int64_t(frame_count) * 1000000000 / 30;
+        if (!writer.writeFrame(timestamp_ns, filter_params, frame.data()))
+            return 1;
+    }
+
+    printf("Wrote %u frames (%ux%u) to %s\n", writer.numFrames(), width, height, path);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 6 && 0 == strcmp(argv[1], "--synthesize")) {
+        return synthesize(argv[2], (uint32_t) atoi(argv[3]), (uint32_t) atoi(argv[4]), (uint32_t) atoi(argv[5]));
+    }
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <recording> [--max-speed] [--gif] [--displays N]\n"
+                        "       %s --synthesize <recording> <frames> <width> <height>\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    bool max_speed = false;
+    uint32_t num_displays = 1;
+    for (int i = 2; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--max-speed")) {
+            max_speed = true;
+        } else if (0 == strcmp(argv[i], "--gif")) {
+            keep_requesting_gifs = true;
+        } else if (0 == strcmp(argv[i], "--displays") && i + 1 < argc) {
+            num_displays = std::min(3, std::max(1, atoi(argv[++i])));
+        }
+    }
+
+    FrameRecordingReader reader;
+    if (!reader.open(argv[1]))
+        return 1;
+    const FrameRecordingHeader &header = reader.header();
+
+    VulkanInstance instance;
+    if (!instance.init()) {
+        fprintf(stderr, "Could not initialize Vulkan\n");
+        return 1;
+    }
+
+    VulkanImageRenderer renderer(&instance, num_displays, header.width, header.height,
+                                 VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR);
+    if (!renderer.initHeadless(OUTPUT_WIDTH, OUTPUT_HEIGHT, RENDERER_COPY_WIDTH)) {
+        fprintf(stderr, "Could not init VulkanImageRenderer\n");
+        return 1;
+    }
+
+    VulkanHostImage input(&instance);
+    if (!input.init(header.width, header.height)) {
+        fprintf(stderr, "Could not create the input image\n");
+        return 1;
+    }
+
+    FilterParams filter_params;
+    listener = new ImageReaderListener(&instance, &renderer, nullptr, &filter_params, nullptr);
+    ImageReaderListener::surface_ready = true;
+    ImageReaderListener::surface_ready_left = true;
+    ImageReaderListener::surface_ready_right = true;
+    ImageReaderListener::native_draw_to_display = true;
+    ImageReaderListener::gif_requested = keep_requesting_gifs;
+
+    std::vector<uint8_t> frame(header.frame_size);
+    std::vector<uint32_t> rgba(header.width * header.height);
+    std::vector<double> render_times;
+    int64_t timestamp_ns = 0;
+    int64_t first_timestamp_ns = 0;
+    auto replay_start = std::chrono::steady_clock::now();
+
+    printf("frame,timestamp_ms,upload_ms,render_ms,total_ms,gif_copy\n");
+    for (uint32_t frame_count = 0; reader.readFrame(timestamp_ns, filter_params, frame.data()); frame_count++) {
+        if (0 == frame_count)
+            first_timestamp_ns = timestamp_ns;
+
+        // Hold the frame back until it would have arrived from the camera
+        if (!max_speed) {
+            std::this_thread::sleep_until(replay_start + std::chrono::nanoseconds(timestamp_ns - first_timestamp_ns));
+        }
+
+        double upload_start = now_ms();
+        if (FRAME_FORMAT_I420 == header.format) {
+            convertI420ToRGBA(frame.data(), header.width, header.height, rgba.data());
+            input.upload(rgba.data());
+        } else {
+            input.upload(reinterpret_cast<const uint32_t *>(frame.data()));
+        }
+        double upload_ms = now_ms() - upload_start;
+
+        listener->processFrame(&input, nullptr);
+
+        const FrameTiming &timing = listener->last_frame_timing;
+        render_times.push_back(timing.render_ms);
+        printf("%u,%.3f,%.3f,%.3f,%.3f,%d\n", frame_count, (timestamp_ns - first_timestamp_ns) / 1e6,
+               upload_ms, timing.render_ms, timing.total_ms, timing.gif_frame_copied ? 1 : 0);
+    }
+
+    vkDeviceWaitIdle(instance.device());
+
+    if (!render_times.empty()) {
+        std::sort(render_times.begin(), render_times.end());
+        fprintf(stderr, "%zu frames, %u GIFs captured. render p50=%.3fms p95=%.3fms max=%.3fms\n",
+                render_times.size(), gifs_captured, render_times[render_times.size() / 2],
+                render_times[(render_times.size() * 95) / 100], render_times.back());
+    }
+
+    delete listener;
+    return 0;
+}
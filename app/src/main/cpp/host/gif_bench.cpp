@@ -0,0 +1,163 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * End to end benchmark of GCTGifEncoder on a boomerang GIF like the photo booth saves
+ *
+ * Synthesizes camera-like frames of a still background with something moving across it, queues them
+ * forwards and then backwards the way encodeAndSaveGif does and encodes the whole GIF with 1 to 8
+ * threads. The way back is queued both as new frames, encoded again, and with showFrame, reusing
+ * the frames' compressed images. Both write whole frames; the delta runs then only write what
+ * changed since the frame before. Runs with the same frame delta setting must produce exactly the
+ * same file, and so must writing the delta GIF behind on a writer thread, to memory or into a
+ * caller's buffer instead.
+ *
+ * Usage: gif_bench [captured_frames] [frame_width frame_height]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "third_party/androidndkgif/AsyncFileGifOutput.h"
+#include "third_party/androidndkgif/GCTGifEncoder.h"
+#include "third_party/androidndkgif/GifOutput.h"
+#include "bench_utils.h"
+
+/**
+ * Forwards, then backwards without repeating the ends, like encodeAndSaveGif
+ */
+static void encodeBoomerang(GCTGifEncoder &encoder, std::vector<std::vector<uint32_t>> &frames, bool reuse) {
+    int32_t capturedFrames = (int32_t) frames.size();
+    for (int32_t n = 0; n < capturedFrames; n++)
+        encoder.encodeFrame(frames[n].data(), 250);
+    for (int32_t n = capturedFrames - 2; n >= 1; n--) {
+        if (reuse)
+            encoder.showFrame(n, 250);
+        else
+            encoder.encodeFrame(frames[n].data(), 250);
+    }
+    encoder.release();
+}
+
+int main(int argc, char **argv) {
+    uint32_t capturedFrames = argc > 1 ? (uint32_t) atoi(argv[1]) : 9;
+    uint32_t width = argc > 3 ? (uint32_t) atoi(argv[2]) : 500;
+    uint32_t height = argc > 3 ? (uint32_t) atoi(argv[3]) : 500;
+
+    if (capturedFrames < 1 || width < 1 || height < 1 || width > 65535 || height > 65535) {
+        fprintf(stderr, "need at least 1 frame and a frame size from 1x1 to 65535x65535\n");
+        return 1;
+    }
+
+    std::vector<std::vector<uint32_t>> frames(capturedFrames, std::vector<uint32_t>(width * height));
+    for (uint32_t n = 0; n < capturedFrames; n++)
+        fillMovingSquareFrame(frames[n].data(), width, height, n, height / 3);
+
+    uint32_t shownFrames = capturedFrames + (capturedFrames > 2 ? capturedFrames - 2 : 0);
+    printf("%u frame boomerang of %ux%u\n", shownFrames, width, height);
+    std::string path = std::string(P_tmpdir) + "/gif_bench.gif";
+    const char *modes[] = {"re-encode", "reuse", "delta"};
+    std::string references[2];
+    double baselineSeconds = 0.0;
+    bool ok = true;
+    for (int mode = 0; mode < 3; mode++) {
+        bool reuse = mode > 0;
+        bool delta = mode > 1;
+        for (int32_t threads = 1; threads <= 8; threads *= 2) {
+            auto start = std::chrono::steady_clock::now();
+            GCTGifEncoder encoder;
+            encoder.setThreadCount(threads);
+            encoder.setFrameDelta(delta);
+            if (!encoder.init(width, height, path.c_str())) {
+                fprintf(stderr, "cannot write %s\n", path.c_str());
+                return 1;
+            }
+            encodeBoomerang(encoder, frames, reuse);
+            double seconds = seconds_since(start);
+
+            std::string data = readFile(path);
+            std::string &reference = references[delta];
+            if (reference.empty())
+                reference = data;
+            if (0.0 == baselineSeconds)
+                baselineSeconds = seconds;
+            bool same = data == reference && !data.empty();
+            ok = ok && same;
+            printf("%-9s %d threads  %8.1f ms  %.2fx  %zu bytes  %s\n", modes[mode], threads,
+                   seconds * 1000.0, baselineSeconds / seconds, data.size(), same ? "same file" : "DIFFERENT FILE");
+        }
+    }
+
+    // The delta GIF again through each kind of output, on 4 threads. The async file also runs
+    // with 2 buffers of 4 KB, small enough for the encoder to wait on the writer.
+    enum Kind { FILE_OUTPUT, ASYNC_FILE, SMALL_ASYNC_FILE, MEMORY, CALLER_BUFFER, SHORT_BUFFER, KIND_MAX };
+    const char *outputs[] = {"file", "async file", "async 2x4 KB", "memory", "caller buffer", "short buffer"};
+    const std::string &reference = references[1];
+    std::vector<uint8_t> callerBuffer(reference.size());
+    for (int kind = 0; kind < KIND_MAX; kind++) {
+        FileGifOutput fileOutput;
+        AsyncFileGifOutput asyncOutput(SMALL_ASYNC_FILE == kind ? 4096 : 256 * 1024, 2);
+        MemoryGifOutput memoryOutput;
+        // One byte too small must fail rather than write past the end
+        BufferGifOutput bufferOutput(callerBuffer.data(), callerBuffer.size() - (SHORT_BUFFER == kind ? 1 : 0));
+        GifOutput *outputsByKind[] = {&fileOutput, &asyncOutput, &asyncOutput, &memoryOutput, &bufferOutput,
+                                      &bufferOutput};
+        bool opened = true;
+        if (FILE_OUTPUT == kind)
+            opened = fileOutput.open(path.c_str());
+        else if (ASYNC_FILE == kind || SMALL_ASYNC_FILE == kind)
+            opened = asyncOutput.open(path.c_str());
+        if (!opened) {
+            fprintf(stderr, "cannot write %s\n", path.c_str());
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        GCTGifEncoder encoder;
+        encoder.setThreadCount(4);
+        encoder.init(width, height, outputsByKind[kind]);
+        encodeBoomerang(encoder, frames, true);
+        double seconds = seconds_since(start);
+
+        std::string data;
+        std::string writer;
+        if (ASYNC_FILE == kind || SMALL_ASYNC_FILE == kind) {
+            // Encoding is done, the writer may still be busy with the tail
+            asyncOutput.waitUntilClosed();
+            AsyncFileGifOutput::Stats stats = asyncOutput.getStats();
+            char line[128];
+            snprintf(line, sizeof(line), "  %s, storage %.1f ms, %u stalls %.1f ms",
+                     stats.ioUring ? "io_uring" : "pwrite", stats.writeMs, stats.stallNum, stats.stallMs);
+            writer = line;
+        }
+        if (MEMORY == kind)
+            data.assign((const char *) memoryOutput.getData(), memoryOutput.getSize());
+        else if (CALLER_BUFFER == kind || SHORT_BUFFER == kind)
+            data.assign((const char *) callerBuffer.data(), bufferOutput.getSize());
+        else
+            data = readFile(path);
+        bool same = SHORT_BUFFER == kind ? bufferOutput.hasFailed()
+                                         : data == reference && !outputsByKind[kind]->hasFailed();
+        ok = ok && same;
+        printf("%-13s output  %8.1f ms  %zu bytes  %s%s\n", outputs[kind], seconds * 1000.0, data.size(),
+               SHORT_BUFFER == kind ? (same ? "fails" : "DOES NOT FAIL") : (same ? "same file" : "DIFFERENT FILE"),
+               writer.c_str());
+    }
+    remove(path.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,443 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Throughput of a photo booth taking GIFs back to back, with GifEncodeQueue
+ *
+ * Each GIF takes capture_ms to capture. Encoding serially makes the next capture wait for the GIF
+ * before it, the queue lets captures carry on while up to MAX_QUEUED_GIFS GIFs wait to be encoded
+ * on 1 or 2 encoder threads. Streamed GIFs are encoded frame by frame while they are captured, "to
+ * file" is the time from the last frame captured to the GIF saved. Runs of the same kind must
+ * write the same files. GIFs kept in memory must match the files, and cancelling GIFs queued, being
+ * encoded and being streamed is checked last. Last a streamed GIF whose frames after the palette
+ * frames come already mapped to its palette, as the renderer's GPU pass maps them, must be the same
+ * as the one mapped by the encoder, and so must GIFs whose palette comes from colors counted the way
+ * the GPU counts them.
+ *
+ * Usage: gif_queue_bench [gifs] [capture_ms] [frame_width frame_height]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "GifEncodeQueue.h"
+#include "third_party/androidndkgif/ColorHistogram.h"
+#include "third_party/androidndkgif/OrderedDither.h"
+#include "third_party/androidndkgif/PixelConvert.h"
+#include "bench_utils.h"
+
+static const uint32_t NUM_GIF_FRAMES = 7;
+static const uint32_t MAX_QUEUED_GIFS = 3;
+
+/**
+ * Frame n of a GIF, with the square somewhere else in every GIF. RGB565 like the frames the
+ * renderer reads back.
+ */
+static void fillFrame(uint16_t *frame, uint32_t width, uint32_t height, uint32_t gif, uint32_t n) {
+    std::vector<uint32_t> rgba(width * height);
+    fillMovingSquareFrame(rgba.data(), width, height, n, (gif * height / 7) % (height - width / 5 + 1));
+    convertRgbaToRgb565(rgba.data(), 0, frame, 0, width, height);
+}
+
+static std::string gifPath(uint32_t gif) {
+    return std::string(P_tmpdir) + "/gif_queue_bench_" + std::to_string(gif) + ".gif";
+}
+
+static double ms_between(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * Capture is simulated by waiting capture_ms / NUM_GIF_FRAMES before copying each prepared frame
+ * into the pool. A streaming job is submitted before its first frame.
+ */
+static std::shared_ptr<GifEncodeJob> capture(GifEncodeQueue *queue, FramePool &pool,
+                                             const std::vector<std::vector<uint16_t>> &frames,
+                                             uint32_t width, uint32_t height, uint32_t gif, uint32_t captureMs,
+                                             uint32_t paletteFrames,
+                                             std::chrono::steady_clock::time_point *savedAt = nullptr) {
+    auto job = std::make_shared<GifEncodeJob>(gifPath(gif), width, height, 250);
+    job->setBoomerang(true);
+    job->setThreadCount(2);
+    job->setStreaming(paletteFrames);
+    if (nullptr != savedAt) {
+        job->setCompletionCallback([savedAt](GifEncodeJob &) {
+            *savedAt = std::chrono::steady_clock::now();
+        });
+    }
+    if (0 != paletteFrames && !queue->submit(job)) {
+        fprintf(stderr, "queue refused GIF %u\n", gif);
+        exit(1);
+    }
+    for (uint32_t n = 0; n < NUM_GIF_FRAMES; n++) {
+        std::this_thread::sleep_for(std::chrono::microseconds(captureMs * 1000 / NUM_GIF_FRAMES));
+        FrameHandle frame = pool.acquire();
+        if (!frame) {
+            fprintf(stderr, "frame pool is empty\n");
+            exit(1);
+        }
+        memcpy(frame.data(), frames[gif * NUM_GIF_FRAMES + n].data(), width * height * sizeof(uint16_t));
+        job->addFrame(std::move(frame));
+    }
+    job->finishFrames();
+    return job;
+}
+
+/**
+ * Takes the GIFs one after another and checks the files against the first run of the same kind
+ */
+static bool runBooth(const char *name, uint32_t encoders, bool waitForEncode, uint32_t paletteFrames,
+                     uint32_t gifs, uint32_t captureMs, uint32_t width, uint32_t height,
+                     const std::vector<std::vector<uint16_t>> &frames, std::vector<std::string> &references,
+                     double &serialSeconds) {
+    FramePool pool(NUM_GIF_FRAMES * MAX_QUEUED_GIFS, width * height);
+    std::vector<std::chrono::steady_clock::time_point> captured(gifs);
+    std::vector<std::chrono::steady_clock::time_point> saved(gifs);
+    auto start = std::chrono::steady_clock::now();
+    double waitedSeconds = 0.0;
+    {
+        GifEncodeQueue queue(encoders, MAX_QUEUED_GIFS);
+        for (uint32_t gif = 0; gif < gifs; gif++) {
+            // The shutter stays disabled while the queue is full
+            auto wait_start = std::chrono::steady_clock::now();
+            while (queue.isFull()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            waitedSeconds += seconds_since(wait_start);
+
+            std::shared_ptr<GifEncodeJob> job = capture(&queue, pool, frames, width, height, gif, captureMs,
+                                                        paletteFrames, &saved[gif]);
+            captured[gif] = std::chrono::steady_clock::now();
+            if (0 == paletteFrames && !queue.submit(job)) {
+                fprintf(stderr, "queue refused GIF %u\n", gif);
+                return false;
+            }
+            if (waitForEncode) {
+                wait_start = std::chrono::steady_clock::now();
+                queue.waitUntilIdle();
+                waitedSeconds += seconds_since(wait_start);
+            }
+        }
+        queue.waitUntilIdle();
+    }
+    double seconds = seconds_since(start);
+    if (0.0 == serialSeconds)
+        serialSeconds = seconds;
+
+    bool same = true;
+    double toFileMs = 0.0;
+    size_t bytes = 0;
+    for (uint32_t gif = 0; gif < gifs; gif++) {
+        std::string data = readFile(gifPath(gif));
+        if (references.size() <= gif)
+            references.push_back(data);
+        same = same && !data.empty() && data == references[gif];
+        toFileMs += ms_between(captured[gif], saved[gif]);
+        bytes += data.size();
+        remove(gifPath(gif).c_str());
+    }
+    printf("%-8s %u encoders  %8.1f ms  %.2fx  %6.2f GIFs/s  to file %7.1f ms  shutter waited %8.1f ms"
+           "  %8zu bytes  %s\n", name, encoders, seconds * 1000.0, serialSeconds / seconds, gifs / seconds,
+           toFileMs / gifs, waitedSeconds * 1000.0, bytes / gifs, same ? "same files" : "DIFFERENT FILES");
+    return same;
+}
+
+/**
+ * Cancel the last of three queued GIFs, and the first from its progress callback after 2 frames
+ */
+static bool checkCancel(uint32_t width, uint32_t height, const std::vector<std::vector<uint16_t>> &frames) {
+    // One more GIF than the queue takes, to try and submit it
+    FramePool pool(NUM_GIF_FRAMES * (MAX_QUEUED_GIFS + 1), width * height);
+    GifEncodeQueue queue(1, MAX_QUEUED_GIFS);
+    std::vector<std::shared_ptr<GifEncodeJob>> jobs;
+    std::atomic<uint32_t> completions(0);
+    std::atomic<uint32_t> progressCalls(0);
+    for (uint32_t gif = 0; gif < MAX_QUEUED_GIFS; gif++) {
+        jobs.push_back(capture(&queue, pool, frames, width, height, gif, 0, 0));
+        jobs.back()->setCompletionCallback([&completions](GifEncodeJob &) { completions++; });
+        jobs.back()->setProgressCallback([&queue, &jobs, &progressCalls](GifEncodeJob &job) {
+            progressCalls++;
+            if (&job == jobs[0].get() && 2 == job.getFramesWritten())
+                queue.cancel(jobs[0]);
+        });
+    }
+    for (auto &job : jobs) {
+        queue.submit(job);
+    }
+    bool refused = !queue.submit(capture(&queue, pool, frames, width, height, MAX_QUEUED_GIFS, 0, 0));
+    queue.cancel(jobs[2]);
+    queue.waitUntilIdle();
+
+    bool ok = refused
+              && GifEncodeJob::CANCELLED == jobs[0]->getState() && 2 == jobs[0]->getFramesWritten()
+              && GifEncodeJob::SAVED == jobs[1]->getState()
+              && jobs[1]->getFrameCount() == jobs[1]->getFramesWritten()
+              && GifEncodeJob::CANCELLED == jobs[2]->getState()
+              && readFile(gifPath(0)).empty() && !readFile(gifPath(1)).empty() && readFile(gifPath(2)).empty()
+              && 3 == completions && 2 + jobs[1]->getFrameCount() == progressCalls
+              && pool.NUM_FRAMES == pool.numFree();
+    printf("cancel: queued job %s, job being encoded %s, full queue %s, frames returned %u/%u  %s\n",
+           GifEncodeJob::CANCELLED == jobs[2]->getState() ? "cancelled" : "NOT CANCELLED",
+           GifEncodeJob::CANCELLED == jobs[0]->getState() ? "cancelled" : "NOT CANCELLED",
+           refused ? "refuses" : "DOES NOT REFUSE", pool.numFree(), pool.NUM_FRAMES, ok ? "ok" : "FAILED");
+    for (uint32_t gif = 0; gif < MAX_QUEUED_GIFS; gif++) {
+        remove(gifPath(gif).c_str());
+    }
+    return ok;
+}
+
+/**
+ * Cancel a streaming GIF waiting for its third frame
+ */
+static bool checkStreamingCancel(uint32_t width, uint32_t height, const std::vector<std::vector<uint16_t>> &frames) {
+    FramePool pool(NUM_GIF_FRAMES, width * height);
+    GifEncodeQueue queue(1, 1);
+    auto job = std::make_shared<GifEncodeJob>(gifPath(0), width, height, 250);
+    job->setStreaming(1);
+    std::atomic<uint32_t> written(0);
+    job->setProgressCallback([&written](GifEncodeJob &job) { written = job.getFramesWritten(); });
+    queue.submit(job);
+    for (uint32_t n = 0; n < 2; n++) {
+        FrameHandle frame = pool.acquire();
+        memcpy(frame.data(), frames[n].data(), width * height * sizeof(uint16_t));
+        job->addFrame(std::move(frame));
+    }
+    // The first frame is written once the second is known
+    while (0 == written) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    queue.cancel(job);
+    queue.waitUntilIdle();
+
+    bool ok = GifEncodeJob::CANCELLED == job->getState() && readFile(gifPath(0)).empty()
+              && pool.NUM_FRAMES == pool.numFree();
+    printf("cancel: streaming job waiting for frames %s, frames returned %u/%u  %s\n",
+           GifEncodeJob::CANCELLED == job->getState() ? "cancelled" : "NOT CANCELLED",
+           pool.numFree(), pool.NUM_FRAMES, ok ? "ok" : "FAILED");
+    remove(gifPath(0).c_str());
+    return ok;
+}
+
+/**
+ * The first GIF again, queued and streamed into memory, must be the same as its file
+ */
+static bool checkInMemory(uint32_t width, uint32_t height, const std::vector<std::vector<uint16_t>> &frames,
+                          const std::string &reference, const std::string &streamedReference) {
+    FramePool pool(NUM_GIF_FRAMES, width * height);
+    GifEncodeQueue queue(1, 1);
+    bool ok = true;
+    for (uint32_t paletteFrames = 0; paletteFrames <= 2; paletteFrames += 2) {
+        auto job = std::make_shared<GifEncodeJob>("", width, height, 250);
+        job->setInMemory(true);
+        job->setBoomerang(true);
+        job->setThreadCount(2);
+        job->setStreaming(paletteFrames);
+        if (0 != paletteFrames)
+            queue.submit(job);
+        for (uint32_t n = 0; n < NUM_GIF_FRAMES; n++) {
+            FrameHandle frame = pool.acquire();
+            memcpy(frame.data(), frames[n].data(), width * height * sizeof(uint16_t));
+            job->addFrame(std::move(frame));
+        }
+        job->finishFrames();
+        if (0 == paletteFrames)
+            queue.submit(job);
+        queue.waitUntilIdle();
+
+        size_t size = 0;
+        size_t takenAgainSize = 0;
+        uint8_t *gif = job->takeGif(size);
+        bool same = nullptr != gif && nullptr == job->takeGif(takenAgainSize)
+                    && std::string((const char *) gif, size) == (0 != paletteFrames ? streamedReference : reference);
+        free(gif);
+        ok = ok && same;
+        printf("in memory: %s GIF  %zu bytes  %s\n", 0 != paletteFrames ? "streamed" : "queued", size,
+               same ? "same as the file" : "DIFFERENT FROM THE FILE");
+    }
+    return ok;
+}
+
+/**
+ * Maps a frame to the palette the way shaders/gif_palette.comp.glsl does: the ordered dither offset
+ * added to each channel, then the nearest color, the lowest index on a tie
+ */
+static void mapToPalette(const uint16_t *frame, uint32_t width, uint32_t height,
+                         const std::vector<uint32_t> &palette, DitherMode ditherMode, uint8_t *indices) {
+    for (uint32_t y = 0; y < height; y++) {
+        const int8_t *offsets = getOrderedDitherRow(ditherMode, y);
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t pixel = rgb565ToPixel(frame[y * width + x]);
+            int32_t offset = nullptr != offsets ? offsets[(x % ORDERED_DITHER_SIZE) * 4] : 0;
+            int32_t color[3];
+            for (int c = 0; c < 3; c++) {
+                color[c] = std::min(std::max((int32_t) ((pixel >> (8 * c)) & 0xFF) + offset, 0), 255);
+            }
+            uint32_t closest = UINT32_MAX;
+            for (uint32_t i = 0; i < palette.size(); i++) {
+                int32_t diffR = (int32_t) (palette[i] & 0xFF) - color[0];
+                int32_t diffG = (int32_t) ((palette[i] >> 8) & 0xFF) - color[1];
+                int32_t diffB = (int32_t) ((palette[i] >> 16) & 0xFF) - color[2];
+                closest = std::min(closest, ((uint32_t) (diffR * diffR + diffG * diffG + diffB * diffB) << 8) | i);
+            }
+            indices[y * width + x] = closest & 0xFF;
+        }
+    }
+}
+
+/**
+ * The first GIF streamed into memory with a Bayer dither twice, once with every frame RGB565 and
+ * once with the frames after the palette frames mapped to the palette the job publishes
+ */
+static bool checkPaletteIndices(uint32_t width, uint32_t height, const std::vector<std::vector<uint16_t>> &frames) {
+    FramePool pool(NUM_GIF_FRAMES, width * height);
+    GifEncodeQueue queue(1, 1);
+    std::string gifs[2];
+    uint32_t mappedFrames = 0;
+    for (int mapped = 0; mapped < 2; mapped++) {
+        auto job = std::make_shared<GifEncodeJob>("", width, height, 250);
+        job->setInMemory(true);
+        job->setBoomerang(true);
+        job->setDitherMode(DITHER_BAYER);
+        job->setStreaming(2);
+        queue.submit(job);
+        std::vector<uint32_t> palette;
+        for (uint32_t n = 0; n < NUM_GIF_FRAMES; n++) {
+            // The palette is published right after the second frame is encoded
+            while (mapped && 2 <= n && !job->getPalette(palette)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            FrameHandle frame = pool.acquire();
+            if (mapped && !palette.empty()) {
+                mapToPalette(frames[n].data(), width, height, palette, job->getDitherMode(),
+                             reinterpret_cast<uint8_t *>(frame.data()));
+                frame.setPaletteIndices(true);
+                mappedFrames++;
+            } else {
+                memcpy(frame.data(), frames[n].data(), width * height * sizeof(uint16_t));
+            }
+            job->addFrame(std::move(frame));
+        }
+        job->finishFrames();
+        queue.waitUntilIdle();
+
+        size_t size = 0;
+        uint8_t *gif = job->takeGif(size);
+        if (nullptr != gif)
+            gifs[mapped].assign((const char *) gif, size);
+        free(gif);
+    }
+    bool ok = !gifs[0].empty() && gifs[0] == gifs[1] && NUM_GIF_FRAMES - 2 == mappedFrames;
+    printf("palette indices: %u frames mapped before encoding, %zu bytes  %s\n", mappedFrames, gifs[1].size(),
+           ok ? "same as mapped by the encoder" : "DIFFERENT");
+    return ok;
+}
+
+/**
+ * Adds the frame to the color counts, expanded the way the GPU reads it
+ */
+static void countColors(const uint16_t *frame, uint32_t width, uint32_t height, std::vector<uint32_t> &counts) {
+    std::vector<uint32_t> rgba(width * height);
+    convertRgb565ToRgba(frame, 0, rgba.data(), 0, width, height);
+    addColorCounts(rgba.data(), width * height, counts);
+}
+
+/**
+ * The first GIF in memory, streamed and not, with and without the colors of its palette frames
+ * counted before encoding. Not streamed it is not a boomerang, whose frames count as often as they
+ * are shown.
+ */
+static bool checkColorCounts(uint32_t width, uint32_t height, const std::vector<std::vector<uint16_t>> &frames) {
+    FramePool pool(NUM_GIF_FRAMES, width * height);
+    GifEncodeQueue queue(1, 1);
+    bool ok = true;
+    for (uint32_t paletteFrames : {2u, 0u}) {
+        std::string gifs[2];
+        for (int counted = 0; counted < 2; counted++) {
+            auto job = std::make_shared<GifEncodeJob>("", width, height, 250);
+            job->setInMemory(true);
+            job->setBoomerang(0 != paletteFrames);
+            job->setStreaming(paletteFrames);
+            uint32_t countedFrames = 0 != paletteFrames ? paletteFrames : NUM_GIF_FRAMES;
+            std::vector<uint32_t> counts;
+            for (uint32_t n = 0; n < NUM_GIF_FRAMES; n++) {
+                if (counted && n < countedFrames)
+                    countColors(frames[n].data(), width, height, counts);
+                // Before the last frame counted is added, as the listener does
+                if (counted && n + 1 == countedFrames)
+                    job->setColorCounts(counts);
+                FrameHandle frame = pool.acquire();
+                memcpy(frame.data(), frames[n].data(), width * height * sizeof(uint16_t));
+                job->addFrame(std::move(frame));
+            }
+            job->finishFrames();
+            queue.submit(job);
+            queue.waitUntilIdle();
+
+            size_t size = 0;
+            uint8_t *gif = job->takeGif(size);
+            if (nullptr != gif)
+                gifs[counted].assign((const char *) gif, size);
+            free(gif);
+        }
+        bool same = !gifs[0].empty() && gifs[0] == gifs[1];
+        printf("color counts: %s, %zu bytes  %s\n", 0 != paletteFrames ? "streamed" : "every frame",
+               gifs[1].size(), same ? "same as counted by the encoder" : "DIFFERENT");
+        ok = ok && same;
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint32_t gifs = argc > 1 ? (uint32_t) atoi(argv[1]) : 6;
+    uint32_t captureMs = argc > 2 ? (uint32_t) atoi(argv[2]) : 150;
+    uint32_t width = argc > 4 ? (uint32_t) atoi(argv[3]) : 500;
+    uint32_t height = argc > 4 ? (uint32_t) atoi(argv[4]) : 500;
+
+    if (gifs < 1 || width < 5 || height < 1 || width > 65535 || height > 65535) {
+        fprintf(stderr, "need at least 1 GIF and a frame size from 5x1 to 65535x65535\n");
+        return 1;
+    }
+
+    std::vector<std::vector<uint16_t>> frames(std::max(gifs, MAX_QUEUED_GIFS + 1) * NUM_GIF_FRAMES,
+                                              std::vector<uint16_t>(width * height));
+    for (uint32_t i = 0; i < frames.size(); i++)
+        fillFrame(frames[i].data(), width, height, i / NUM_GIF_FRAMES, i % NUM_GIF_FRAMES);
+
+    printf("%u GIFs of %u %ux%u frames, %u ms to capture each\n", gifs, NUM_GIF_FRAMES, width, height, captureMs);
+    std::vector<std::string> references;
+    std::vector<std::string> streamedReferences;
+    double serialSeconds = 0.0;
+    bool ok = runBooth("serial", 1, true, 0, gifs, captureMs, width, height, frames, references, serialSeconds);
+    ok = runBooth("queued", 1, false, 0, gifs, captureMs, width, height, frames, references, serialSeconds) && ok;
+    ok = runBooth("queued", 2, false, 0, gifs, captureMs, width, height, frames, references, serialSeconds) && ok;
+    // The palette comes from the first 2 frames, as in the app
+    ok = runBooth("streamed", 1, false, 2, gifs, captureMs, width, height, frames, streamedReferences,
+                  serialSeconds) && ok;
+    ok = runBooth("streamed", 2, false, 2, gifs, captureMs, width, height, frames, streamedReferences,
+                  serialSeconds) && ok;
+    ok = checkInMemory(width, height, frames, references[0], streamedReferences[0]) && ok;
+    ok = checkCancel(width, height, frames) && ok;
+    ok = checkStreamingCancel(width, height, frames) && ok;
+    ok = checkPaletteIndices(width, height, frames) && ok;
+    ok = checkColorCounts(width, height, frames) && ok;
+    return ok ? 0 : 1;
+}
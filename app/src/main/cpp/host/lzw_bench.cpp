@@ -0,0 +1,296 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Throughput benchmark for the GIF encoder's LZW stage
+ *
+ * Color reduces a synthetic camera-like frame to palette indices the way the encoder does, then
+ * LZW encodes it with 1 to 8 strips and reports MB/s of palette indices and the compressed size.
+ * Every result is decoded again and compared with the input, so a bad strip join fails the run.
+ *
+ * Then compares LzwDictionary against the 2 MB table of every code and byte the encoder used to
+ * allocate and zero for every strip, on the whole frame and on 32x32 parts like the ones frame
+ * delta writes, and checks both write the same codes.
+ *
+ * Usage: lzw_bench [iterations] [frame_width frame_height]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "third_party/androidndkgif/GCTGifEncoder.h"
+#include "third_party/androidndkgif/BitWritingBlock.h"
+#include "third_party/androidndkgif/ColorReduceKernels.h"
+#include "third_party/androidndkgif/GifOutput.h"
+#include "bench_utils.h"
+
+/**
+ * Palette indices of palette_bench's frame, with Floyd-Steinberg like the encoder
+ */
+static std::vector<uint8_t> makeIndices(uint32_t width, uint32_t height) {
+    std::vector<uint32_t> frame(width * height);
+    fillNoisyFrame(frame, width, height);
+
+    Cube cubes[256];
+    memset(cubes, 0, sizeof(cubes));
+    std::vector<uint32_t> scratch(frame);
+    PaletteBuilder().build(scratch.data(), scratch.size(), cubes);
+
+    PaletteLookupTable table;
+    table.build(cubes, 255);
+    std::vector<uint8_t> indices(frame.size());
+    ColorReduceRow row;
+    row.table = &table;
+    row.fillCells = true;
+    row.ditherMode = DITHER_FLOYD_STEINBERG;
+    row.width = width;
+    row.colorOut = nullptr;
+    for (uint32_t y = 0; y < height; y++) {
+        row.pixels = frame.data() + y * width;
+        row.nextPixels = y + 1 < height ? row.pixels + width : nullptr;
+        row.indexOut = indices.data() + y * width;
+        getColorReduceKernel()(row);
+    }
+    return indices;
+}
+
+/**
+ * Decodes what LzwEncoder::write produced, the way GIF viewers read it
+ */
+static bool decode(const std::string &data, std::vector<uint8_t> &out) {
+    if (data.size() < 2)
+        return false;
+    uint32_t minCodeSize = (uint8_t) data[0];
+    std::string codes;
+    size_t pos = 1;
+    while (pos < data.size() && 0 != data[pos]) {
+        size_t size = (uint8_t) data[pos];
+        codes.append(data, pos + 1, size);
+        pos += size + 1;
+    }
+
+    const uint32_t clearCode = 1 << minCodeSize;
+    std::vector<std::vector<uint8_t>> dictionary;
+    std::vector<uint8_t> previous;
+    uint32_t codeSize = minCodeSize + 1;
+    uint32_t bitBuffer = 0;
+    uint32_t bitCount = 0;
+    size_t byte = 0;
+    out.clear();
+    while (true) {
+        while (bitCount < codeSize && byte < codes.size()) {
+            bitBuffer |= (uint32_t) (uint8_t) codes[byte++] << bitCount;
+            bitCount += 8;
+        }
+        if (bitCount < codeSize)
+            return true;
+        uint32_t code = bitBuffer & ((1 << codeSize) - 1);
+        bitBuffer >>= codeSize;
+        bitCount -= codeSize;
+
+        if (clearCode == code) {
+            dictionary.clear();
+            for (uint32_t i = 0; i < clearCode + 2; i++)
+                dictionary.push_back(std::vector<uint8_t>(1, (uint8_t) i));
+            codeSize = minCodeSize + 1;
+            previous.clear();
+            continue;
+        }
+        if (clearCode + 1 == code || dictionary.empty())
+            return clearCode + 1 == code;
+
+        std::vector<uint8_t> entry;
+        if (code < dictionary.size()) {
+            entry = dictionary[code];
+        } else if (code == dictionary.size() && !previous.empty()) {
+            entry = previous;
+            entry.push_back(previous[0]);
+        } else {
+            return false;
+        }
+        if (!previous.empty() && dictionary.size() < 4096) {
+            previous.push_back(entry[0]);
+            dictionary.push_back(previous);
+        }
+        out.insert(out.end(), entry.begin(), entry.end());
+        previous = entry;
+        if (dictionary.size() == (1u << codeSize) && codeSize < 12)
+            codeSize++;
+    }
+}
+
+/**
+ * LzwEncoder::encodeStrip for a single strip as it was before LzwDictionary
+ */
+static void encodeWithFullTable(const uint8_t *pixels, uint16_t width, const EncodeRect &rect,
+                                BitWritingBlock *writingBlock) {
+    const uint32_t maxCode = LzwEncoder::MAX_STACK_SIZE;
+    const uint8_t *endPixels = pixels + (rect.y + rect.height - 1) * width + rect.x + rect.width;
+    uint32_t dataSize = 8;
+    uint32_t codeSize = dataSize + 1;
+    uint32_t codeMask = (1 << codeSize) - 1;
+
+    std::vector<uint16_t> table(maxCode * LzwEncoder::BYTE_NUM);
+    pixels = pixels + width * rect.y + rect.x;
+    const uint8_t *rowStart = pixels;
+    uint32_t clearCode = 1 << dataSize;
+    writingBlock->writeBits(clearCode, codeSize);
+    uint32_t nextCode = clearCode + 2;
+    uint16_t current = *pixels;
+    if (rect.width <= ++pixels - rowStart) {
+        rowStart += width;
+        pixels = rowStart;
+    }
+    while (endPixels > pixels) {
+        uint16_t *next = &table[current * LzwEncoder::BYTE_NUM + *pixels];
+        if (0 == *next || *next >= maxCode) {
+            writingBlock->writeBits(current, codeSize);
+            *next = nextCode;
+            if (nextCode < maxCode) {
+                nextCode++;
+            } else {
+                writingBlock->writeBits(clearCode, codeSize);
+                nextCode = clearCode + 2;
+                codeSize = dataSize + 1;
+                codeMask = (1 << codeSize) - 1;
+                memset(table.data(), 0, table.size() * sizeof(uint16_t));
+            }
+            if (codeMask < nextCode - 1 && nextCode < maxCode) {
+                codeSize++;
+                codeMask = (1 << codeSize) - 1;
+            }
+            current = *pixels;
+        } else {
+            current = *next;
+        }
+        if (rect.width <= ++pixels - rowStart) {
+            rowStart += width;
+            pixels = rowStart;
+        }
+    }
+    writingBlock->writeBits(current, codeSize);
+}
+
+static std::vector<uint8_t> toBytes(const BitWritingBlock &writingBlock) {
+    std::vector<uint8_t> data;
+    writingBlock.appendSubBlocks(data);
+    return data;
+}
+
+/**
+ * MB/s of both dictionaries over the given rects, true when they write the same codes
+ */
+static bool benchDictionary(const char *name, const std::vector<uint8_t> &indices, uint16_t width,
+                            const std::vector<EncodeRect> &rects, uint32_t iterations) {
+    uint64_t bytes = 0;
+    for (const EncodeRect &rect : rects)
+        bytes += rect.width * rect.height;
+
+    LzwDictionary dictionary;
+    double dictionarySeconds = 0.0;
+    double tableSeconds = 0.0;
+    bool match = true;
+    for (uint32_t n = 0; n < iterations; n++) {
+        for (const EncodeRect &rect : rects) {
+            BitWritingBlock compact;
+            auto start = std::chrono::steady_clock::now();
+            LzwEncoder::encodeStrip(indices.data(), width, rect, 0, rect.height, true, true, &dictionary, &compact);
+            dictionarySeconds += seconds_since(start);
+
+            BitWritingBlock full;
+            start = std::chrono::steady_clock::now();
+            encodeWithFullTable(indices.data(), width, rect, &full);
+            tableSeconds += seconds_since(start);
+
+            if (0 == n)
+                match = match && toBytes(compact) == toBytes(full);
+        }
+    }
+    printf("%-12s dictionary %8.1f MB/s  2 MB table %8.1f MB/s  %.2fx  %s\n", name,
+           (double) bytes * iterations / dictionarySeconds / 1e6,
+           (double) bytes * iterations / tableSeconds / 1e6, tableSeconds / dictionarySeconds,
+           match ? "same codes" : "CODES DIFFER");
+    return match;
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = argc > 1 ? (uint32_t) atoi(argv[1]) : 20;
+    uint32_t width = argc > 3 ? (uint32_t) atoi(argv[2]) : 500;
+    uint32_t height = argc > 3 ? (uint32_t) atoi(argv[3]) : 281;
+
+    if (iterations < 1 || width < 1 || height < 1) {
+        fprintf(stderr, "iterations and frame size must be at least 1\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> indices = makeIndices(width, height);
+    EncodeRect rect;
+    rect.x = 0;
+    rect.y = 0;
+    rect.width = width;
+    rect.height = height;
+
+    printf("%u iterations of %ux%u\n", iterations, width, height);
+    bool ok = true;
+    size_t singleStripSize = 0;
+    for (int32_t strips = 1; strips <= LzwEncoder::MAX_STRIPS; strips *= 2) {
+        LzwEncoder encoder;
+        encoder.setStripCount(strips);
+
+        // Far more than LZW ever writes for 8 bit indices
+        std::vector<uint8_t> buffer(indices.size() * 2 + 1024);
+        size_t size = 0;
+        double seconds = 0.0;
+        for (uint32_t n = 0; n < iterations; n++) {
+            BufferGifOutput output(buffer.data(), buffer.size());
+            auto start = std::chrono::steady_clock::now();
+            encoder.write(&output, indices.data(), width, rect);
+            seconds += seconds_since(start);
+            size = output.getSize();
+        }
+        std::string data((const char *) buffer.data(), size);
+
+        std::vector<uint8_t> decoded;
+        bool match = decode(data, decoded) && decoded == indices;
+        ok = ok && match;
+        if (1 == strips)
+            singleStripSize = size;
+
+        printf("%d strips  %8.1f MB/s  %8zu bytes  %+.2f%%  %s\n", strips,
+               (double) indices.size() * iterations / seconds / 1e6, size,
+               100.0 * ((double) size - singleStripSize) / singleStripSize, match ? "decodes" : "DOES NOT DECODE");
+    }
+
+    std::vector<EncodeRect> wholeFrame(1, rect);
+    ok = benchDictionary("whole frame", indices, width, wholeFrame, iterations) && ok;
+    std::vector<EncodeRect> parts;
+    for (uint32_t y = 0; y + 32 <= height; y += 32) {
+        for (uint32_t x = 0; x + 32 <= width; x += 32) {
+            EncodeRect part;
+            part.x = x;
+            part.y = y;
+            part.width = 32;
+            part.height = 32;
+            parts.push_back(part);
+        }
+    }
+    if (!parts.empty())
+        ok = benchDictionary("32x32 parts", indices, width, parts, iterations) && ok;
+    return ok ? 0 : 1;
+}
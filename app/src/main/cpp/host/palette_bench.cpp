@@ -0,0 +1,422 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Throughput benchmark for nearest palette color search in the GIF encoder
+ *
+ * Builds a 255 color palette from a synthetic camera-like frame with the encoder's own median cut,
+ * timing it on 1 and 4 threads and reporting the PSNR of the frame mapped to it without dither, and
+ * from the frame's colors counted beforehand, as the GPU counts them, which must give the same
+ * palette in a time that does not depend on the frame size. Then compares it with the palette of
+ * a proxy of the frame no larger than proxy_size, box filtered down a mip chain the way
+ * VulkanPaletteMapper does, by the PSNR of the whole frame mapped to each. Then maps every pixel
+ * to the palette with the linear scan reduceColor used to do and with PaletteLookupTable, and
+ * checks both pick the same index for every pixel.
+ *
+ * Then runs the whole remap stage, lookup plus each DitherMode, through every ColorReduceKernel
+ * the CPU supports and checks each one matches the scalar kernel exactly.
+ *
+ * Last the frame as RGB565, the way the renderer reads it back: builds Rgb565PaletteTable, maps the
+ * frame with it against the best kernel on the expanded frame, and checks all 65536 colors map to
+ * the index the linear scan finds.
+ *
+ * Usage: palette_bench [iterations] [frame_width frame_height] [proxy_size]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "third_party/androidndkgif/GCTGifEncoder.h"
+#include "third_party/androidndkgif/ColorReduceKernels.h"
+#include "bench_utils.h"
+
+/**
+ * Counts the colors of pixels the way shaders/gif_colors.comp.glsl does
+ */
+static void countColors(const std::vector<uint32_t> &pixels, std::vector<uint32_t> &counts) {
+    counts.clear();
+    addColorCounts(pixels.data(), pixels.size(), counts);
+}
+
+/**
+ * PSNR of the opaque pixels mapped to the palette, without dither
+ */
+static double paletteError(const std::vector<uint32_t> &frame, const Cube *cubes) {
+    PaletteLookupTable table;
+    table.build(cubes, 255);
+    double squaredError = 0.0;
+    uint64_t samples = 0;
+    for (uint32_t pixel : frame) {
+        if (0 == (pixel >> 24))
+            continue;
+        const Cube &cube = cubes[table.lookup(pixel & 0xFF, (pixel >> 8) & 0xFF, (pixel >> 16) & 0xFF)];
+        for (int color = 0; color < COLOR_MAX; color++) {
+            double diff = (double) GET_COLOR(pixel, color) - cube.color[color];
+            squaredError += diff * diff;
+        }
+        samples += COLOR_MAX;
+    }
+    double mse = squaredError / (samples > 0 ? samples : 1);
+    return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+/**
+ * Halves the frame until no side is larger than proxySize, averaging 2x2 pixels like the linear
+ * blits down VulkanPaletteMapper's mip chain. Odd rows and columns at the edge are dropped.
+ */
+static void downsample(std::vector<uint32_t> &frame, uint32_t &width, uint32_t &height, uint32_t proxySize) {
+    while (std::max(width, height) > proxySize) {
+        uint32_t halfWidth = std::max(width / 2, 1u);
+        uint32_t halfHeight = std::max(height / 2, 1u);
+        std::vector<uint32_t> half(halfWidth * halfHeight);
+        for (uint32_t y = 0; y < halfHeight; y++) {
+            for (uint32_t x = 0; x < halfWidth; x++) {
+                uint32_t x1 = std::min(2 * x + 1, width - 1);
+                uint32_t y1 = std::min(2 * y + 1, height - 1);
+                const uint32_t quad[4] = {
+                        frame[2 * y * width + 2 * x], frame[2 * y * width + x1],
+                        frame[y1 * width + 2 * x], frame[y1 * width + x1],
+                };
+                uint32_t pixel = 0;
+                for (int c = 0; c < 4; c++) {
+                    uint32_t sum = 2; // Rounded to nearest
+                    for (uint32_t p : quad) {
+                        sum += (p >> (8 * c)) & 0xFF;
+                    }
+                    pixel |= (sum / 4) << (8 * c);
+                }
+                half[y * halfWidth + x] = pixel;
+            }
+        }
+        frame.swap(half);
+        width = halfWidth;
+        height = halfHeight;
+    }
+}
+
+/**
+ * Milliseconds per palette from the color counts of a proxy of the frame, counting included, and
+ * the PSNR of the whole frame mapped to it
+ */
+static double benchProxyPalette(const std::vector<uint32_t> &frame, uint32_t width, uint32_t height,
+                                uint32_t proxySize, uint32_t iterations,
+                                uint32_t &proxyWidth, uint32_t &proxyHeight, double &psnr) {
+    std::vector<uint32_t> proxy(frame);
+    proxyWidth = width;
+    proxyHeight = height;
+    downsample(proxy, proxyWidth, proxyHeight, proxySize);
+
+    PaletteBuilder builder;
+    std::vector<uint32_t> counts;
+    Cube cubes[256];
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < iterations; n++) {
+        countColors(proxy, counts);
+        memset(cubes, 0, sizeof(cubes));
+        builder.buildFromCounts(counts.data(), cubes);
+    }
+    double milliseconds = seconds_since(start) * 1000.0 / iterations;
+    psnr = paletteError(frame, cubes);
+    return milliseconds;
+}
+
+/**
+ * Milliseconds per palette from the frame's color counts, and whether it is the one from its pixels
+ */
+static double benchPaletteFromCounts(const std::vector<uint32_t> &frame, uint32_t iterations,
+                                     const Cube *pixelCubes, bool &same) {
+    std::vector<uint32_t> counts;
+    countColors(frame, counts);
+
+    PaletteBuilder builder;
+    Cube cubes[256];
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < iterations; n++) {
+        memset(cubes, 0, sizeof(cubes));
+        builder.buildFromCounts(counts.data(), cubes);
+    }
+    double milliseconds = seconds_since(start) * 1000.0 / iterations;
+
+    same = true;
+    for (uint32_t i = 0; i < 255; i++) {
+        for (int color = 0; color < COLOR_MAX; color++) {
+            same = same && cubes[i].color[color] == pixelCubes[i].color[color];
+        }
+    }
+    return milliseconds;
+}
+
+/**
+ * Milliseconds per palette and the PSNR of the opaque pixels mapped to it, without dither
+ */
+static double benchPalette(const std::vector<uint32_t> &frame, int32_t threadCount, uint32_t iterations,
+                           Cube *cubes, double &psnr) {
+    PaletteBuilder builder;
+    builder.setThreadCount(threadCount);
+    std::vector<uint32_t> pixels(frame);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < iterations; n++) {
+        memset(cubes, 0, 256 * sizeof(Cube));
+        builder.build(pixels.data(), pixels.size(), cubes);
+    }
+    double milliseconds = seconds_since(start) * 1000.0 / iterations;
+    psnr = paletteError(frame, cubes);
+    return milliseconds;
+}
+
+/**
+ * The search BaseGifEncoder::reduceColor did for every pixel before PaletteLookupTable
+ */
+static uint32_t linearSearch(const Cube *cubes, uint32_t cubeNum, uint32_t r, uint32_t g, uint32_t b) {
+    uint32_t closestColor = 0;
+    uint32_t closestDifference = UINT32_MAX;
+    for (uint32_t i = 0; i < cubeNum; i++) {
+        int32_t diffR = cubes[i].color[RED] - r;
+        int32_t diffG = cubes[i].color[GREEN] - g;
+        int32_t diffB = cubes[i].color[BLUE] - b;
+        uint32_t difference = diffR * diffR + diffG * diffG + diffB * diffB;
+        if (difference < closestDifference) {
+            closestDifference = difference;
+            closestColor = i;
+        }
+    }
+    return closestColor;
+}
+
+struct RemapResult {
+    std::vector<uint32_t> pixels;
+    std::vector<uint8_t> indices;
+    std::vector<uint32_t> colors;
+    double seconds = 0.0;
+};
+
+/**
+ * Color reduce the frame row by row like BaseGifEncoder::reduceColor does
+ */
+static void remap(ColorReduceKernel kernel, PaletteLookupTable &table, DitherMode ditherMode,
+                  const std::vector<uint32_t> &frame, uint32_t width, uint32_t height,
+                  uint32_t iterations, RemapResult &result) {
+    result.indices.resize(frame.size());
+    result.colors.resize(frame.size());
+    result.seconds = 0.0;
+    for (uint32_t n = 0; n < iterations; n++) {
+        result.pixels = frame;
+        auto start = std::chrono::steady_clock::now();
+        ColorReduceRow row;
+        row.table = &table;
+        row.fillCells = true;
+        row.ditherMode = ditherMode;
+        row.width = width;
+        for (uint32_t y = 0; y < height; y++) {
+            row.y = y;
+            row.pixels = result.pixels.data() + y * width;
+            row.nextPixels = y + 1 < height ? row.pixels + width : nullptr;
+            row.indexOut = result.indices.data() + y * width;
+            row.colorOut = result.colors.data() + y * width;
+            kernel(row);
+        }
+        result.seconds += seconds_since(start);
+    }
+}
+
+static bool benchKernels(const Cube *cubes, uint32_t cubeNum, const std::vector<uint32_t> &frame,
+                         uint32_t width, uint32_t height, uint32_t iterations) {
+    bool ok = true;
+    double megaPixels = (double) width * height * iterations / 1e6;
+    for (int mode = DITHER_NONE; mode < DITHER_MODE_MAX; mode++) {
+        DitherMode dither = (DitherMode) mode;
+        PaletteLookupTable table;
+        table.build(cubes, cubeNum);
+        RemapResult reference;
+        // Warm up so every kernel sees the same filled cells
+        remap(getColorReduceKernel(COLOR_REDUCE_SCALAR), table, dither, frame, width, height, 1, reference);
+        remap(getColorReduceKernel(COLOR_REDUCE_SCALAR), table, dither, frame, width, height, iterations, reference);
+
+        for (int type = COLOR_REDUCE_SCALAR; type < COLOR_REDUCE_KERNEL_MAX; type++) {
+            ColorReduceKernel kernel = getColorReduceKernel((ColorReduceKernelType) type);
+            if (nullptr == kernel)
+                continue;
+            RemapResult result;
+            remap(kernel, table, dither, frame, width, height, iterations, result);
+            bool match = result.pixels == reference.pixels && result.indices == reference.indices
+                    && result.colors == reference.colors;
+            ok = ok && match;
+            printf("remap %-6s %-15s %8.1f MPix/s  %.2fx  %s\n",
+                   getColorReduceKernelName((ColorReduceKernelType) type),
+                   getDitherModeName(dither), megaPixels / result.seconds,
+                   reference.seconds / result.seconds, match ? "matches scalar" : "DIFFERS FROM SCALAR");
+        }
+    }
+    return ok;
+}
+
+/**
+ * RGB565 frames without dither, a load from the 64K entry table per pixel
+ */
+static bool benchRgb565(const Cube *cubes, uint32_t cubeNum, const std::vector<uint32_t> &frame,
+                        uint32_t width, uint32_t height, uint32_t iterations) {
+    std::vector<uint16_t> frame565(frame.size());
+    std::vector<uint32_t> expanded(frame.size());
+    for (size_t i = 0; i < frame.size(); i++) {
+        uint32_t pixel = frame[i];
+        frame565[i] = (((pixel & 0xFF) >> 3) << 11) | ((((pixel >> 8) & 0xFF) >> 2) << 5) | (((pixel >> 16) & 0xFF) >> 3);
+        expanded[i] = rgb565ToPixel(frame565[i]);
+    }
+
+    // A new palette every iteration, the table is built once per GIF or per FastGifEncoder palette
+    double buildSeconds = 0.0;
+    for (uint32_t n = 0; n < iterations; n++) {
+        PaletteLookupTable table;
+        Rgb565PaletteTable lut;
+        auto start = std::chrono::steady_clock::now();
+        lut.build(&table, cubes, cubeNum);
+        buildSeconds += seconds_since(start);
+    }
+
+    PaletteLookupTable table;
+    Rgb565PaletteTable lut;
+    lut.build(&table, cubes, cubeNum);
+    std::vector<uint8_t> indices(frame.size());
+    std::vector<uint32_t> colors(frame.size());
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < iterations; n++)
+        lut.map(frame565.data(), frame565.size(), indices.data(), colors.data());
+    double mapSeconds = seconds_since(start);
+
+    ColorReduceKernelType best = COLOR_REDUCE_SCALAR;
+    for (int type = COLOR_REDUCE_SCALAR; type < COLOR_REDUCE_KERNEL_MAX; type++) {
+        if (nullptr != getColorReduceKernel((ColorReduceKernelType) type))
+            best = (ColorReduceKernelType) type;
+    }
+    RemapResult reference;
+    remap(getColorReduceKernel(best), table, DITHER_NONE, expanded, width, height, 1, reference);
+    remap(getColorReduceKernel(best), table, DITHER_NONE, expanded, width, height, iterations, reference);
+    bool match = indices == reference.indices && colors == reference.colors;
+
+    uint32_t mismatches = 0;
+    for (uint32_t color = 0; color < Rgb565PaletteTable::COLOR_NUM; color++) {
+        uint32_t pixel = rgb565ToPixel(color);
+        if (lut.lookup(color) != linearSearch(cubes, cubeNum, pixel & 0xFF, (pixel >> 8) & 0xFF, (pixel >> 16) & 0xFF))
+            mismatches++;
+    }
+
+    double megaPixels = (double) width * height * iterations / 1e6;
+    printf("RGB565 table  %8.2f ms to build, %.1f MPix/s  %-6s on RGBA %.1f MPix/s  %.2fx  %s, %u of 65536 colors differ\n",
+           buildSeconds * 1000.0 / iterations, megaPixels / mapSeconds, getColorReduceKernelName(best),
+           megaPixels / reference.seconds, reference.seconds / mapSeconds,
+           match ? "frame matches" : "FRAME DIFFERS", mismatches);
+    return match && 0 == mismatches;
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = argc > 1 ? (uint32_t) atoi(argv[1]) : 20;
+    uint32_t width = argc > 3 ? (uint32_t) atoi(argv[2]) : 500;
+    uint32_t height = argc > 3 ? (uint32_t) atoi(argv[3]) : 281;
+    uint32_t proxySize = argc > 4 ? (uint32_t) atoi(argv[4]) : 64;
+    uint32_t pixelNum = width * height;
+
+    if (iterations < 1 || pixelNum < 1 || proxySize < 1) {
+        fprintf(stderr, "iterations, frame and proxy size must be at least 1\n");
+        return 1;
+    }
+
+    std::vector<uint32_t> frame(pixelNum);
+    fillNoisyFrame(frame, width, height);
+
+    Cube cubes[256];
+    double psnr = 0.0;
+    double paletteMs[2];
+    paletteMs[1] = benchPalette(frame, 4, iterations, cubes, psnr);
+    paletteMs[0] = benchPalette(frame, 1, iterations, cubes, psnr);
+    bool countsMatch = false;
+    double countsMs = benchPaletteFromCounts(frame, iterations, cubes, countsMatch);
+    uint32_t proxyWidth = 0;
+    uint32_t proxyHeight = 0;
+    double proxyPsnr = 0.0;
+    double proxyMs = benchProxyPalette(frame, width, height, proxySize, iterations,
+                                       proxyWidth, proxyHeight, proxyPsnr);
+
+    const uint32_t cubeNum = 255;
+    std::vector<uint8_t> linearOut(pixelNum);
+    std::vector<uint8_t> tableOut(pixelNum);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < iterations; n++) {
+        for (uint32_t i = 0; i < pixelNum; i++) {
+            uint32_t pixel = frame[i];
+            linearOut[i] = linearSearch(cubes, cubeNum, pixel & 0xFF, (pixel >> 8) & 0xFF, (pixel >> 16) & 0xFF);
+        }
+    }
+    double linearSeconds = seconds_since(start);
+
+    // A fresh table every iteration so filling the cells is included. GCTGifEncoder keeps one table
+    // for the whole GIF and FastGifEncoder one per palette, so this is the worst case.
+    double fillSeconds = 0.0;
+    double lookupSeconds = 0.0;
+    for (uint32_t n = 0; n < iterations; n++) {
+        PaletteLookupTable table;
+        start = std::chrono::steady_clock::now();
+        table.build(cubes, cubeNum);
+        for (uint32_t i = 0; i < pixelNum; i++) {
+            uint32_t pixel = frame[i];
+            tableOut[i] = table.lookup(pixel & 0xFF, (pixel >> 8) & 0xFF, (pixel >> 16) & 0xFF);
+        }
+        fillSeconds += seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < pixelNum; i++) {
+            uint32_t pixel = frame[i];
+            tableOut[i] = table.lookupShared(pixel & 0xFF, (pixel >> 8) & 0xFF, (pixel >> 16) & 0xFF);
+        }
+        lookupSeconds += seconds_since(start);
+    }
+
+    // Every 7th color of the whole RGB cube, not just the ones in the frame
+    PaletteLookupTable table;
+    table.build(cubes, cubeNum);
+    uint64_t mismatches = 0;
+    for (uint32_t color = 0; color < (1 << 24); color += 7) {
+        uint32_t r = color & 0xFF;
+        uint32_t g = (color >> 8) & 0xFF;
+        uint32_t b = color >> 16;
+        if (table.lookup(r, g, b) != linearSearch(cubes, cubeNum, r, g, b))
+            mismatches++;
+    }
+
+    double megaPixels = (double) pixelNum * iterations / 1e6;
+    printf("%u iterations of %ux%u, %u palette colors\n", iterations, width, height, cubeNum);
+    printf("median cut    %8.2f ms  %.2f ms on 4 threads, %.2f dB PSNR without dither\n",
+           paletteMs[0], paletteMs[1], psnr);
+    printf("median cut    %8.2f ms  from color counts, %s\n", countsMs,
+           countsMatch ? "same palette" : "DIFFERENT palette");
+    printf("median cut    %8.2f ms  counting a %ux%u proxy included, %.2f dB PSNR mapping the whole frame\n",
+           proxyMs, proxyWidth, proxyHeight, proxyPsnr);
+    printf("linear scan   %8.1f MPix/s\n", megaPixels / linearSeconds);
+    printf("lookup table  %8.1f MPix/s  first frame on a new palette\n", megaPixels / fillSeconds);
+    printf("lookup table  %8.1f MPix/s  cells already filled\n", megaPixels / lookupSeconds);
+    printf("frame results %s, RGB cube: %llu mismatches\n",
+           linearOut == tableOut ? "match" : "DIFFER", (unsigned long long) mismatches);
+
+
+    bool kernelsMatch = benchKernels(cubes, cubeNum, frame, width, height, iterations);
+    bool rgb565Match = benchRgb565(cubes, cubeNum, frame, width, height, iterations);
+
+    return (linearOut == tableOut && 0 == mismatches && countsMatch && kernelsMatch && rgb565Match) ? 0 : 1;
+}
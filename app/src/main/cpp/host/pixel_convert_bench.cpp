@@ -0,0 +1,265 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Throughput benchmark and check of the pixel format conversions frames go through on their way
+ * from the renderer's readback to the GIF encoders
+ *
+ * Runs RGB565 to RGBA8888 and back, swapping red and blue and splitting RGBA into planes through
+ * every PixelConvertKernels the CPU supports, in MPix/s, and checks each gives the scalar kernels'
+ * result byte for byte, also on every row length up to 64 pixels from unaligned addresses. Then
+ * checks every RGB565 color survives the round trip, swapping twice gives the frame back, and
+ * the image helpers compact padded rows the way a row at a time copy does.
+ *
+ * Usage: pixel_convert_bench [iterations] [frame_width frame_height]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "third_party/androidndkgif/PixelConvert.h"
+#include "bench_utils.h"
+
+/**
+ * Smooth gradients with some noise on top, like a camera frame
+ */
+static std::vector<uint32_t> makeFrame(uint32_t width, uint32_t height) {
+    std::vector<uint32_t> frame(width * height);
+    uint32_t seed = 12345;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t noise = (seed >> 16) & 0x0F;
+            uint32_t r = (x * 255 / width + noise) & 0xFF;
+            uint32_t g = (y * 255 / height + noise) & 0xFF;
+            uint32_t b = ((x + y) * 127 / (width + height) + (seed >> 24)) & 0xFF;
+            frame[y * width + x] = ((seed >> 8) & 0xFF000000) | (b << 16) | (g << 8) | r;
+        }
+    }
+    return frame;
+}
+
+/**
+ * Output of every conversion of one set of kernels, and its throughput
+ */
+struct ConvertResult {
+    std::vector<uint32_t> rgba;
+    std::vector<uint16_t> rgb565;
+    std::vector<uint32_t> swapped;
+    std::vector<uint8_t> planes;
+    std::vector<uint8_t> planesNoAlpha;
+    double mpixPerSecond[4];
+};
+
+/**
+ * Runs all four conversions of kernels over the frame, iterations times each
+ */
+static void runKernels(const PixelConvertKernels &kernels, const std::vector<uint32_t> &frame,
+                       const std::vector<uint16_t> &frame565, uint32_t iterations,
+                       ConvertResult &result) {
+    uint32_t pixelNum = frame.size();
+    result.rgba.assign(pixelNum, 0);
+    result.rgb565.assign(pixelNum, 0);
+    result.swapped.assign(pixelNum, 0);
+    result.planes.assign(pixelNum * 4, 0);
+    result.planesNoAlpha.assign(pixelNum * 3, 0);
+
+    double mpix = (double) pixelNum * iterations / 1e6;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < iterations; n++) {
+        kernels.rgb565ToRgba(frame565.data(), result.rgba.data(), pixelNum);
+    }
+    result.mpixPerSecond[0] = mpix / seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < iterations; n++) {
+        kernels.rgbaToRgb565(frame.data(), result.rgb565.data(), pixelNum);
+    }
+    result.mpixPerSecond[1] = mpix / seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < iterations; n++) {
+        kernels.swapRedBlue(frame.data(), result.swapped.data(), pixelNum);
+    }
+    result.mpixPerSecond[2] = mpix / seconds_since(start);
+
+    uint8_t *planes = result.planes.data();
+    start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < iterations; n++) {
+        kernels.rgbaToPlanar(frame.data(), planes, planes + pixelNum, planes + 2 * pixelNum,
+                             planes + 3 * pixelNum, pixelNum);
+    }
+    result.mpixPerSecond[3] = mpix / seconds_since(start);
+
+    uint8_t *noAlpha = result.planesNoAlpha.data();
+    kernels.rgbaToPlanar(frame.data(), noAlpha, noAlpha + pixelNum, noAlpha + 2 * pixelNum, NULL,
+                         pixelNum);
+}
+
+static bool sameResult(const ConvertResult &a, const ConvertResult &b) {
+    return a.rgba == b.rgba && a.rgb565 == b.rgb565 && a.swapped == b.swapped &&
+           a.planes == b.planes && a.planesNoAlpha == b.planesNoAlpha;
+}
+
+/**
+ * Every row length up to 64 pixels from addresses one pixel off alignment, so the vector kernels'
+ * tails run, with canaries past the end of every output
+ */
+static bool checkTails(const PixelConvertKernels &kernels, const PixelConvertKernels &scalar,
+                       const std::vector<uint32_t> &frame, const std::vector<uint16_t> &frame565) {
+    const uint32_t MAX_WIDTH = 64;
+    const uint32_t CANARY = 0xA5A5A5A5;
+    for (uint32_t width = 1; width <= MAX_WIDTH; width++) {
+        std::vector<uint32_t> rgba[2];
+        std::vector<uint16_t> rgb565[2];
+        std::vector<uint32_t> swapped[2];
+        std::vector<uint8_t> planes[2];
+        for (int k = 0; k < 2; k++) {
+            const PixelConvertKernels &kernel = k == 0 ? scalar : kernels;
+            rgba[k].assign(width + 2, CANARY);
+            rgb565[k].assign(width + 2, CANARY & 0xFFFF);
+            swapped[k].assign(width + 2, CANARY);
+            planes[k].assign(4 * (width + 1) + 1, CANARY & 0xFF);
+            kernel.rgb565ToRgba(frame565.data() + 1, rgba[k].data() + 1, width);
+            kernel.rgbaToRgb565(frame.data() + 1, rgb565[k].data() + 1, width);
+            kernel.swapRedBlue(frame.data() + 1, swapped[k].data() + 1, width);
+            uint8_t *plane = planes[k].data() + 1;
+            kernel.rgbaToPlanar(frame.data() + 1, plane, plane + width + 1, plane + 2 * (width + 1),
+                                plane + 3 * (width + 1), width);
+        }
+        if (rgba[0] != rgba[1] || rgb565[0] != rgb565[1] || swapped[0] != swapped[1] ||
+            planes[0] != planes[1]) {
+            printf("  differs from scalar on %u pixel rows\n", width);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Every RGB565 color expands and packs back to itself, and swapping twice is the identity, with
+ * the image helpers on packed images
+ */
+static bool checkRoundTrips(const std::vector<uint32_t> &frame) {
+    std::vector<uint16_t> colors(1 << 16);
+    for (uint32_t color = 0; color < colors.size(); color++) {
+        colors[color] = color;
+    }
+    std::vector<uint32_t> expanded(colors.size());
+    std::vector<uint16_t> packed(colors.size());
+    convertRgb565ToRgba(colors.data(), 0, expanded.data(), 0, 256, 256);
+    convertRgbaToRgb565(expanded.data(), 0, packed.data(), 0, 256, 256);
+    bool ok = packed == colors;
+    for (uint32_t color = 0; ok && color < colors.size(); color++) {
+        ok = expanded[color] == rgb565ToPixel(color) && pixelToRgb565(expanded[color]) == color;
+    }
+
+    std::vector<uint32_t> swapped(frame.size());
+    swapRedBlue(frame.data(), 0, swapped.data(), 0, frame.size(), 1);
+    for (uint32_t i = 0; ok && i < frame.size(); i++) {
+        uint32_t pixel = frame[i];
+        ok = swapped[i] == ((pixel & 0xFF00FF00) | ((pixel & 0xFF) << 16) | ((pixel >> 16) & 0xFF));
+    }
+    swapRedBlue(swapped.data(), 0, swapped.data(), 0, frame.size(), 1);
+    return ok && swapped == frame;
+}
+
+/**
+ * Rows padded to a pitch the way a GPU lays out a linear image, compacted by the image helpers,
+ * against converting a row at a time
+ */
+static bool checkPitches(const PixelConvertKernels &scalar, const std::vector<uint32_t> &frame,
+                         uint32_t width, uint32_t height) {
+    const uint32_t PAD = 13;
+    size_t pitch565 = (width + PAD) * sizeof(uint16_t);
+    size_t pitch8888 = (width + PAD) * sizeof(uint32_t);
+    std::vector<uint16_t> padded565((width + PAD) * height, 0xBEEF);
+    std::vector<uint32_t> padded8888((width + PAD) * height, 0xDEADBEEF);
+    for (uint32_t y = 0; y < height; y++) {
+        memcpy(&padded8888[y * (width + PAD)], &frame[y * width], width * sizeof(uint32_t));
+        scalar.rgbaToRgb565(&frame[y * width], &padded565[y * (width + PAD)], width);
+    }
+
+    uint32_t pixelNum = width * height;
+    std::vector<uint32_t> rgba(pixelNum), expectedRgba(pixelNum);
+    std::vector<uint16_t> rgb565(pixelNum), expected565(pixelNum), copied565(pixelNum);
+    std::vector<uint32_t> swapped(pixelNum), expectedSwapped(pixelNum);
+    std::vector<uint8_t> planes(pixelNum * 4), expectedPlanes(pixelNum * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        uint32_t row = y * width;
+        scalar.rgb565ToRgba(&padded565[y * (width + PAD)], &expectedRgba[row], width);
+        scalar.rgbaToRgb565(&frame[row], &expected565[row], width);
+        scalar.swapRedBlue(&frame[row], &expectedSwapped[row], width);
+        uint8_t *plane = expectedPlanes.data() + row;
+        scalar.rgbaToPlanar(&frame[row], plane, plane + pixelNum, plane + 2 * pixelNum,
+                            plane + 3 * pixelNum, width);
+    }
+
+    convertRgb565ToRgba(padded565.data(), pitch565, rgba.data(), 0, width, height);
+    convertRgbaToRgb565(padded8888.data(), pitch8888, rgb565.data(), 0, width, height);
+    swapRedBlue(padded8888.data(), pitch8888, swapped.data(), 0, width, height);
+    convertRgbaToPlanar(padded8888.data(), pitch8888, planes.data(), 4, width, height);
+    copyPixelRows(padded565.data(), pitch565, copied565.data(), 0, width * sizeof(uint16_t), height);
+    return rgba == expectedRgba && rgb565 == expected565 && swapped == expectedSwapped &&
+           planes == expectedPlanes && copied565 == expected565;
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+    uint32_t width = argc > 3 ? strtoul(argv[2], NULL, 10) : 1000;
+    uint32_t height = argc > 3 ? strtoul(argv[3], NULL, 10) : 562;
+    if (iterations < 1 || width < 65 || height < 1) {
+        fprintf(stderr, "iterations must be at least 1 and frames at least 65 pixels wide\n");
+        return 1;
+    }
+
+    std::vector<uint32_t> frame = makeFrame(width, height);
+    std::vector<uint16_t> frame565(frame.size());
+    for (uint32_t i = 0; i < frame.size(); i++) {
+        frame565[i] = pixelToRgb565(frame[i]);
+    }
+    printf("%ux%u frame, %u iterations, in MPix/s\n", width, height, iterations);
+    printf("kernel   565->RGBA  RGBA->565   swap R/B     planar\n");
+
+    const PixelConvertKernels &scalar = *getPixelConvertKernels(PIXEL_CONVERT_SCALAR);
+    ConvertResult expected;
+    bool ok = true;
+    for (int type = 0; type < PIXEL_CONVERT_KERNEL_MAX; type++) {
+        const PixelConvertKernels *kernels =
+                getPixelConvertKernels(static_cast<PixelConvertKernelType>(type));
+        const char *name = getPixelConvertKernelName(static_cast<PixelConvertKernelType>(type));
+        if (NULL == kernels) {
+            printf("%-6s   not supported\n", name);
+            continue;
+        }
+        ConvertResult result;
+        runKernels(*kernels, frame, frame565, iterations, type == 0 ? expected : result);
+        const ConvertResult &timed = type == 0 ? expected : result;
+        bool same = type == 0 || sameResult(result, expected);
+        same = checkTails(*kernels, scalar, frame, frame565) && same;
+        ok = ok && same;
+        printf("%-6s %10.0f %10.0f %10.0f %10.0f  %s\n", name, timed.mpixPerSecond[0],
+               timed.mpixPerSecond[1], timed.mpixPerSecond[2], timed.mpixPerSecond[3],
+               same ? "same as scalar" : "DIFFERS");
+    }
+
+    bool roundTrips = checkRoundTrips(frame);
+    bool pitches = checkPitches(scalar, frame, width, height);
+    printf("round trips %s, padded rows %s\n", roundTrips ? "ok" : "FAILED", pitches ? "ok" : "FAILED");
+    return ok && roundTrips && pitches ? 0 : 1;
+}
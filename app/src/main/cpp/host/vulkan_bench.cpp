@@ -0,0 +1,203 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Host benchmark for VulkanImageRenderer::renderImageAndReadback
+ *
+ * Renders synthetic camera frames to headless surfaces and reports per-frame CPU time of the
+ * render call, with a GIF readback every 12th frame as in ImageReaderListener. GIF frames are read
+ * back as RGB565 for the first half of the frames, with the colors of their downsampled proxies
+ * counted on the GPU, and mapped to a palette on the GPU for the second, as once a streamed GIF has
+ * its palette, when the GPU can.
+ *
+ * Usage: vulkan_bench [frames] [num_displays] [camera_width camera_height] [output_width output_height]
+ *                     [frames_in_flight]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "vulkan-utils/vulkan_utils.h"
+#include "vulkan-utils/VulkanInstance.h"
+#include "vulkan-utils/VulkanHostImage.h"
+#include "vulkan-utils/VulkanImageRenderer.h"
+
+static const int GIF_COPY_INTERVAL = 12;
+
+/**
+ * Fill the input frame with a moving gradient so every frame is different
+ */
+static void fillTestFrame(uint32_t *pixels, uint32_t width, uint32_t height, uint32_t frame) {
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t r = (x + frame) & 0xFF;
+            uint32_t g = (y + 2 * frame) & 0xFF;
+            uint32_t b = ((x ^ y) + frame) & 0xFF;
+            pixels[y * width + x] = 0xFF000000 | (b << 16) | (g << 8) | r;
+        }
+    }
+}
+
+static void printStats(const char *label, std::vector<double> &times) {
+    if (times.empty())
+        return;
+
+    std::sort(times.begin(), times.end());
+    double total = 0;
+    for (double t : times)
+        total += t;
+
+    printf("%-16s n=%-5zu mean=%7.3fms p50=%7.3fms p95=%7.3fms max=%7.3fms\n", label, times.size(),
+           total / times.size(), times[times.size() / 2], times[(times.size() * 95) / 100],
+           times.back());
+}
+
+int main(int argc, char **argv) {
+    uint32_t num_frames = argc > 1 ? (uint32_t) atoi(argv[1]) : 600;
+    uint32_t num_displays = argc > 2 ? (uint32_t) atoi(argv[2]) : 1;
+    uint32_t camera_width = argc > 4 ? (uint32_t) atoi(argv[3]) : 1280;
+    uint32_t camera_height = argc > 4 ? (uint32_t) atoi(argv[4]) : 720;
+    uint32_t output_width = argc > 6 ? (uint32_t) atoi(argv[5]) : 1920;
+    uint32_t output_height = argc > 6 ? (uint32_t) atoi(argv[6]) : 1080;
+    uint32_t frames_in_flight = argc > 7 ? (uint32_t) atoi(argv[7]) : VulkanImageRenderer::DEFAULT_FRAMES_IN_FLIGHT;
+    uint32_t copy_width = 500;
+
+    if (num_displays < 1 || num_displays > 3) {
+        fprintf(stderr, "num_displays must be between 1 and 3\n");
+        return 1;
+    }
+
+    VulkanInstance instance;
+    if (!instance.init()) {
+        fprintf(stderr, "Could not initialize Vulkan\n");
+        return 1;
+    }
+
+    // Headless surfaces on lavapipe / SwiftShader advertise BGRA8 rather than the device's RGB565
+    VulkanImageRenderer renderer(&instance, num_displays, camera_width, camera_height,
+                                 VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR, frames_in_flight);
+    if (!renderer.initHeadless(output_width, output_height, copy_width)) {
+        fprintf(stderr, "Could not init VulkanImageRenderer\n");
+        return 1;
+    }
+
+    VulkanHostImage input(&instance);
+    if (!input.init(camera_width, camera_height)
+        || !renderer.createPipeline(input.sampler(), input.isSamplerImmutable())) {
+        fprintf(stderr, "Could not create the render pipeline\n");
+        return 1;
+    }
+
+    FilterParams filter_params;
+    for (int i = 0; i < NUM_FILTERS; i++) {
+        filter_params.seek_values[i] = 50;
+        filter_params.use_filter[i] = 0;
+    }
+
+    std::vector<uint32_t> frame(camera_width * camera_height);
+    std::vector<uint16_t> gif_frame(VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH * VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT);
+    std::vector<double> render_times;
+    std::vector<double> readback_times;
+    std::vector<double> index_readback_times;
+    std::vector<double> upload_times;
+    std::vector<uint16_t *> completed_readbacks;
+    RendererStats rgb565_stats;
+
+    // 6x6x6 color cube, like the palette of a GIF would
+    std::vector<uint32_t> palette;
+    for (uint32_t i = 0; i < 216; i++) {
+        palette.push_back(0xFF000000 | (i % 6) * 51 | ((i / 6 % 6) * 51) << 8 | ((i / 36) * 51) << 16);
+    }
+
+    for (uint32_t frame_count = 0; frame_count < num_frames; frame_count++) {
+        if (frame_count == num_frames / 2) {
+            renderer.flushReadbacks();
+            rgb565_stats = renderer.getStats();
+            renderer.resetStats();
+            if (!renderer.setGifPalette(palette.data(), palette.size(), DITHER_BAYER)) {
+                printf("GIF frames can't be mapped to a palette on this GPU\n");
+            }
+        }
+        fillTestFrame(frame.data(), camera_width, camera_height, frame_count);
+
+        double start = now_ms();
+        input.upload(frame.data());
+        upload_times.push_back(now_ms() - start);
+
+        bool gif_copy = (1 == frame_count % GIF_COPY_INTERVAL);
+        RENDERER_RETURN_CODE render_state = RENDER_STATE_NOT_SET;
+
+        start = now_ms();
+        renderer.renderImageAndReadback(&input, &filter_params, nullptr, true, true, true,
+                                        render_state, gif_copy ? gif_frame.data() : nullptr,
+                                        renderer.hasGifPalette(), !renderer.hasGifPalette());
+        double elapsed = now_ms() - start;
+
+        if (gif_copy && renderer.hasGifPalette())
+            index_readback_times.push_back(elapsed);
+        else if (gif_copy)
+            readback_times.push_back(elapsed);
+        else
+            render_times.push_back(elapsed);
+
+        completed_readbacks.clear();
+        renderer.getCompletedReadbacks(completed_readbacks);
+    }
+
+    // Drain the queue before the renderer is torn down
+    renderer.flushReadbacks();
+    vkDeviceWaitIdle(instance.device());
+
+    printf("%u frames, %u display(s), camera %ux%u, output %ux%u, GIF copy %ux%u, %u frame(s) in flight\n",
+           num_frames, num_displays, camera_width, camera_height, output_width, output_height,
+           VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH, VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT,
+           frames_in_flight);
+    printStats("upload", upload_times);
+    printStats("render", render_times);
+    printStats("render+readback", readback_times);
+    if (!index_readback_times.empty())
+        printStats("render+indices", index_readback_times);
+
+    // Submission statistics over the second half only, they don't depend on the readback format
+    const RendererStats &stats = renderer.getStats();
+    if (stats.frames_submitted > 0) {
+        printf("submit: mean=%7.3fms max=%7.3fms, waiting on GPU: %.3fms total, %u/%u frames blocked\n",
+               stats.submit_ms_total / stats.frames_submitted, stats.submit_ms_max, stats.wait_ms_total,
+               stats.frames_blocked, stats.frames_submitted);
+        printf("queue depth: mean=%.2f max=%u\n",
+               (double) stats.queue_depth_total / stats.frames_submitted, stats.queue_depth_max);
+    }
+    if (rgb565_stats.readbacks_completed > 0) {
+        printf("GIF readbacks: %u, mean copy=%7.3fms\n", rgb565_stats.readbacks_completed,
+               rgb565_stats.readback_copy_ms_total / rgb565_stats.readbacks_completed);
+    }
+    std::vector<uint32_t> color_counts;
+    if (renderer.readGifColorCounts(color_counts)) {
+        uint64_t pixels_counted = 0;
+        for (size_t i = 0; i < color_counts.size(); i += ColorHistogram::COUNT_NUM)
+            pixels_counted += color_counts[i];
+        printf("GIF colors counted on the GPU: %llu pixels, %zu KB read back once\n",
+               (unsigned long long) pixels_counted, color_counts.size() * sizeof(uint32_t) / 1024);
+    }
+    if (stats.readbacks_completed > 0) {
+        printf("GIF readbacks %s: %u, mean copy=%7.3fms\n",
+               renderer.hasGifPalette() ? "as palette indices" : "(second half)", stats.readbacks_completed,
+               stats.readback_copy_ms_total / stats.readbacks_completed);
+    }
+
+    return 0;
+}
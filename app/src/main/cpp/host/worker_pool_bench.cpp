@@ -0,0 +1,196 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Dispatch overhead and stress test for the GIF encoders' WorkerPool
+ *
+ * Times handing out a parallel pass of small tasks the way the encoders did before the pool,
+ * creating and joining a pthread per task on every call, against WorkerPool::parallelFor on the
+ * shared pool, for 1 to 8 tasks per pass. Then runs nested parallelFor calls and task groups
+ * that wait for tasks of their own from inside pool threads, and checks every task ran exactly
+ * once.
+ *
+ * Usage: worker_pool_bench [passes] [work_per_task]
+ */
+
+#include <pthread.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "third_party/androidndkgif/WorkerPool.h"
+#include "bench_utils.h"
+
+/**
+ * A few microseconds of work the compiler cannot drop, about the size of a small LZW strip
+ */
+static uint32_t work(uint32_t seed, uint32_t amount) {
+    uint32_t value = seed + 1;
+    for (uint32_t i = 0; i < amount; i++)
+        value = value * 1664525 + 1013904223;
+    return value;
+}
+
+struct ThreadTask {
+    uint32_t index;
+    uint32_t amount;
+    uint32_t result;
+};
+
+static void *threadTask(void *data) {
+    ThreadTask *task = (ThreadTask *) data;
+    task->result = work(task->index, task->amount);
+    return nullptr;
+}
+
+/**
+ * The calling thread takes task 0 and a new thread each of the others, like ColorHistogram,
+ * LzwEncoder and FastGifEncoder used to
+ */
+static uint32_t runOnNewThreads(uint32_t taskNum, uint32_t amount) {
+    std::vector<ThreadTask> tasks(taskNum);
+    std::vector<pthread_t> threads(taskNum);
+    for (uint32_t i = 0; i < taskNum; i++) {
+        tasks[i].index = i;
+        tasks[i].amount = amount;
+    }
+    for (uint32_t i = 1; i < taskNum; i++)
+        pthread_create(&threads[i], nullptr, threadTask, &tasks[i]);
+    threadTask(&tasks[0]);
+    uint32_t sum = tasks[0].result;
+    for (uint32_t i = 1; i < taskNum; i++) {
+        pthread_join(threads[i], nullptr);
+        sum += tasks[i].result;
+    }
+    return sum;
+}
+
+static uint32_t runOnPool(uint32_t taskNum, uint32_t amount) {
+    std::vector<uint32_t> results(taskNum);
+    WorkerPool::shared().parallelFor(taskNum, [&](uint32_t i) {
+        results[i] = work(i, amount);
+    });
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < taskNum; i++)
+        sum += results[i];
+    return sum;
+}
+
+/**
+ * parallelFor inside parallelFor inside tasks of a group, every slot must be hit exactly once
+ */
+static bool stressNested(WorkerPool &pool, uint32_t rounds) {
+    const uint32_t outer = 6;
+    const uint32_t inner = 5;
+    const uint32_t rows = 37;
+    for (uint32_t round = 0; round < rounds; round++) {
+        std::vector<std::atomic<uint32_t>> hits(outer * inner * rows);
+        for (auto &hit : hits)
+            hit.store(0);
+
+        WorkerPool::TaskGroup group;
+        for (uint32_t o = 0; o < outer; o++) {
+            pool.run(&group, [&pool, &hits, o]() {
+                pool.parallelFor(inner, [&pool, &hits, o](uint32_t i) {
+                    pool.parallelFor(0, rows, 4, [&hits, o, i](uint32_t, uint32_t begin, uint32_t end) {
+                        for (uint32_t r = begin; r < end; r++)
+                            hits[(o * inner + i) * rows + r].fetch_add(1);
+                    });
+                });
+            });
+        }
+        pool.wait(&group);
+
+        for (auto &hit : hits) {
+            if (1 != hit.load())
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Uneven slices, empty slices and more chunks than items
+ */
+static bool checkSlices(WorkerPool &pool) {
+    for (uint32_t count = 0; count < 20; count++) {
+        for (uint32_t chunks = 1; chunks <= 9; chunks++) {
+            std::vector<std::atomic<uint32_t>> hits(count);
+            for (auto &hit : hits)
+                hit.store(0);
+            pool.parallelFor(3, 3 + count, chunks, [&hits](uint32_t, uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++)
+                    hits[i - 3].fetch_add(1);
+            });
+            for (auto &hit : hits) {
+                if (1 != hit.load())
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    uint32_t passes = argc > 1 ? (uint32_t) atoi(argv[1]) : 2000;
+    uint32_t amount = argc > 2 ? (uint32_t) atoi(argv[2]) : 2000;
+
+    if (passes < 1) {
+        fprintf(stderr, "passes must be at least 1\n");
+        return 1;
+    }
+
+    printf("%u passes, %d pool workers besides the calling thread\n", passes,
+           WorkerPool::shared().getWorkerCount());
+    bool ok = true;
+    for (uint32_t taskNum = 1; taskNum <= 8; taskNum *= 2) {
+        uint32_t expected = 0;
+        for (uint32_t i = 0; i < taskNum; i++)
+            expected += work(i, amount);
+
+        bool match = true;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t n = 0; n < passes; n++)
+            match = match && expected == runOnNewThreads(taskNum, amount);
+        double threadSeconds = seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        for (uint32_t n = 0; n < passes; n++)
+            match = match && expected == runOnPool(taskNum, amount);
+        double poolSeconds = seconds_since(start);
+
+        ok = ok && match;
+        printf("%u tasks  new threads %8.2f us/pass  pool %8.2f us/pass  %5.2fx  %s\n", taskNum,
+               threadSeconds * 1e6 / passes, poolSeconds * 1e6 / passes,
+               threadSeconds / poolSeconds, match ? "same results" : "RESULTS DIFFER");
+    }
+
+    bool slices = checkSlices(WorkerPool::shared());
+    bool nested = stressNested(WorkerPool::shared(), 200);
+    // A pool without workers runs everything on the waiting thread
+    WorkerPool single(0);
+    bool singleNested = stressNested(single, 20);
+    // More workers than cores, so tasks get stolen while others wait
+    WorkerPool crowded(WorkerPool::MAX_WORKERS);
+    bool crowdedNested = stressNested(crowded, 200);
+    printf("slices %s, nested %s, no workers %s, %d workers %s\n",
+           slices ? "ok" : "FAILED", nested ? "ok" : "FAILED",
+           singleNested ? "ok" : "FAILED", WorkerPool::MAX_WORKERS, crowdedNested ? "ok" : "FAILED");
+    ok = ok && slices && nested && singleNested && crowdedNested;
+
+    return ok ? 0 : 1;
+}
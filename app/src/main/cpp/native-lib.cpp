@@ -15,6 +15,8 @@
  */
 
 #include <jni.h>
+#include <cstdlib>
+#include <mutex>
 #include <string>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_android.h>
@@ -34,9 +36,8 @@
 #include "ImageReaderListener.h"
 
 #include "native-lib.h"
-#include "third_party/androidndkgif/GCTGifEncoder.h"
-#include "ring_buffer.h"
-#include "third_party/androidndkgif/FastGifEncoder.h"
+#include "GifEncodeQueue.h"
+#include "frame_queue.h"
 
 #define LOG_TAG2 "VulkanPhoto"
 
@@ -48,6 +49,12 @@ static jmethodID findClassMethod;
 // ImageReader
 AImageReader *preview_reader = nullptr;
 ImageReaderListener *listener = nullptr;
+uint32_t preview_width = 0;
+uint32_t preview_height = 0;
+bool preview_cpu_readable = false; // YUV_420_888 the CPU can read, for frame recording
+
+// Camera frames are recorded here for host/frame_replay while set, see startFrameRecording
+std::string frame_recording_path;
 
 // Displays
 ANativeWindow *output_window = nullptr;
@@ -64,8 +71,25 @@ VulkanAHBManager *vahbManager = nullptr;
 // Current set of filter paramters
 FilterParams *filter_params = nullptr;
 
-GCTGifEncoder *gifEncoder = nullptr;
-//FastGifEncoder* gifEncoder = nullptr;
+// GIFs are encoded off the JNI and render threads, one at a time
+GifEncodeQueue *gifEncodeQueue = nullptr;
+// The GIF being captured. Set on the capture thread, used and handed over on the ImageReader thread.
+static std::mutex capturing_gif_job_lock;
+static std::shared_ptr<GifEncodeJob> capturing_gif_job;
+// Encode each frame as it is captured, the palette comes from the first 2 frames. Otherwise the
+// palette comes from every frame, and encoding starts once they are all captured.
+bool stream_gif_encoding = true;
+// Once a streamed GIF has its palette, the GPU maps later frames to it and only the palette indices
+// are read back. Floyd-Steinberg can't be done a pixel at a time, these GIFs use Bayer dither.
+bool gpu_gif_palette = true;
+// The GPU counts the colors of the frames the palette is built from, only the counts are read back
+// for it. Each frame counts once, also the ones a boomerang shows twice.
+bool gpu_gif_colors = true;
+// Count the colors of a proxy of each frame the GPU downsamples to at most 64 pixels a side, rather
+// than every pixel. It builds the palette about twice as fast but loses 2-3 dB PSNR in
+// host/palette_bench, a larger proxy does not close the gap.
+bool gif_palette_proxy = false;
+static const uint32_t GIF_STREAM_PALETTE_FRAMES = 2;
 
 // Default GIF width/height
 uint32_t rendererCopyWidth = 500;
@@ -146,26 +170,63 @@ void areSurfacesReady() {
     // All required surfaces are now ready, initialize renderer
     logd("Calling init on render output surfaces");
     ASSERT_FORMATTED(renderer->init(output_window, output_window_left, output_window_right, rendererCopyWidth, rendererCopyHeight), "Could not init VulkanImageRenderer.");
+    renderer->setGifColorProxy(gif_palette_proxy);
 //    ASSERT_FORMATTED(renderer->init(output_window, output_window, output_window), "Could not init VulkanImageRenderer.");
 
     // Set up ImageReader
     listener = new ImageReaderListener(vulkan_instance, renderer, vahbManager, filter_params, output_window);
+    if (!frame_recording_path.empty() && preview_cpu_readable) {
+        listener->startRecording(frame_recording_path.c_str(), preview_width, preview_height);
+    }
     AImageReader_ImageListener preview_image_listener { listener, ImageReaderListener::onImageAvailableCallback };
     AImageReader_setImageListener(preview_reader, &preview_image_listener);
 }
 
 
+/**
+ * The GIF being captured, or null. Copied, so it stays valid while it is used.
+ */
+static std::shared_ptr<GifEncodeJob> getCapturingGifJob() {
+    std::lock_guard<std::mutex> lock(capturing_gif_job_lock);
+    return capturing_gif_job;
+}
+
 void cleanup() {
     logd("Cleaning up Vulkan memory.");
+    // Stop frames arriving first, nothing may add frames to the GIF being captured any more
+    if (nullptr != preview_reader)
+        AImageReader_setImageListener(preview_reader, nullptr);
+    ImageReaderListener::gif_requested = false;
+
+    // Queued GIFs are still saved, one still being captured is not. Their frames belong to the
+    // listener's pool, the queue has to be done with them before the listener goes.
+    std::shared_ptr<GifEncodeJob> job;
+    {
+        std::lock_guard<std::mutex> lock(capturing_gif_job_lock);
+        job = std::move(capturing_gif_job);
+    }
+    if (nullptr != job && nullptr != gifEncodeQueue)
+        gifEncodeQueue->cancel(job);
+    job.reset();
+    delete(gifEncodeQueue);
+    gifEncodeQueue = nullptr;
+
+    // Flushes its readbacks, before the renderer goes
+    delete(listener);
+    listener = nullptr;
+
 //    getEnv()->DeleteGlobalRef(class_loader);
 //    getEnv()->DeleteGlobalRef(mainActivity);
     if (nullptr != renderer)
         delete(renderer);
+    renderer = nullptr;
 
     delete(vahbManager);
+    vahbManager = nullptr;
     delete(vulkan_instance);
+    vulkan_instance = nullptr;
     delete(filter_params);
-    delete(listener);
+    filter_params = nullptr;
 }
 
 void updateFramerateUI(double current_fps, double vulkan_render_time) {
@@ -200,6 +261,9 @@ Java_dev_hadrosaur_vulkanphotobooth_MainActivity_initializeNative(
         return false;
     }
 
+    if (nullptr == gifEncodeQueue)
+        gifEncodeQueue = new GifEncodeQueue(1, ImageReaderListener::MAX_QUEUED_GIFS);
+
     ATrace_endSection();
 
     logd("SUCCEEDED Initializing Vulkan!");
@@ -227,15 +291,24 @@ Java_dev_hadrosaur_vulkanphotobooth_CameraUtilsKt_createPreviewImageReader(
 
     //Free'd in cleanup()
 //    AImageReader_new(width, height, format, max_images, &preview_reader);
-//    AImageReader_newWithUsage(width, height, AIMAGE_FORMAT_YUV_420_888,
-    AImageReader_newWithUsage(width, height, AIMAGE_FORMAT_PRIVATE,
 //    AImageReader_newWithUsage(width, height, AIMAGE_FORMAT_JPEG,
-//                              AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN |
 //                              AHARDWAREBUFFER_USAGE_CPU_WRITE_NEVER |
-//                              AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN |
 //                              AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN |
-                              AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE,
-            max_images, &preview_reader);
+    // PRIVATE is fastest. While recording frames the CPU has to read them, which needs
+    // YUV_420_888. The renderer imports either through their external format.
+    preview_cpu_readable = !frame_recording_path.empty();
+    preview_width = (uint32_t) width;
+    preview_height = (uint32_t) height;
+    if (preview_cpu_readable) {
+        AImageReader_newWithUsage(width, height, AIMAGE_FORMAT_YUV_420_888,
+                                  AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN |
+                                  AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE,
+                                  max_images, &preview_reader);
+    } else {
+        AImageReader_newWithUsage(width, height, AIMAGE_FORMAT_PRIVATE,
+                                  AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE,
+                                  max_images, &preview_reader);
+    }
 
     // Create a VulkanImageRenderer with the actual width/height of the AHardwareBuffer.
     // Free'd in cleanup()
@@ -418,39 +491,131 @@ Java_dev_hadrosaur_vulkanphotobooth_MainActivity_updateFilterParams(
     }
 }
 
-extern "C" JNIEXPORT jboolean JNICALL
-Java_dev_hadrosaur_vulkanphotobooth_MainActivity_createGif(
-        JNIEnv* env, jobject, jstring filepath) {
-
-    // If a gif is already in flight, just return
-    if (ImageReaderListener::gif_requested || ImageReaderListener::gif_being_encoded) {
+/**
+ * Start capturing a GIF for path, or memory. False if a GIF is already being captured or too many
+ * wait to be encoded.
+ */
+static bool start_gif_capture(const char* path, bool in_memory) {
+    // If a gif capture is already in flight, or no more can be queued for encoding, just return
+    if (ImageReaderListener::gif_requested || nullptr == gifEncodeQueue || gifEncodeQueue->isFull()) {
         return false;
     }
 
-    int width = VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH;
-    int height = VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT;
+    auto job = std::make_shared<GifEncodeJob>(path,
+            VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH, VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT, 250); // 4fps
+    job->setInMemory(in_memory);
+    job->setBoomerang(true);
+    job->setThreadCount(8); // GCT encodes whole frames in parallel, or LZW strips when streaming
+    job->setCompletionCallback(gifSaved);
+    if (stream_gif_encoding) {
+        // Encoding starts with the first frame captured
+        job->setStreaming(GIF_STREAM_PALETTE_FRAMES);
+        if (gpu_gif_palette)
+            job->setDitherMode(DITHER_BAYER);
+        if (!gifEncodeQueue->submit(job))
+            return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(capturing_gif_job_lock);
+        capturing_gif_job = job;
+    }
+
+    // Published to the ImageReader thread by gif_requested
+    ImageReaderListener::gif_frames_captured = 0;
+    ImageReaderListener::gif_color_frames = !gpu_gif_colors ? 0
+            : stream_gif_encoding ? GIF_STREAM_PALETTE_FRAMES : ImageReaderListener::NUM_GIF_FRAMES;
+    ImageReaderListener::gif_requested = true;
+    return true;
+}
 
-    gifEncoder = new GCTGifEncoder();
-    // gifEncoder = new FastGifEncoder();
-    gifEncoder->setThreadCount(8); // This does nothing for GCT but will speed up fast encoder
+extern "C" JNIEXPORT jboolean JNICALL
+Java_dev_hadrosaur_vulkanphotobooth_MainActivity_createGif(
+        JNIEnv* env, jobject, jstring filepath) {
 
     const char* pathChars = env->GetStringUTFChars(filepath, 0);
-    bool result = gifEncoder->init((uint16_t) width,(uint16_t) height, pathChars);
+    bool started = start_gif_capture(pathChars, false);
     env->ReleaseStringUTFChars(filepath, pathChars);
+    return started;
+}
 
-    if (result) {
-        ImageReaderListener::gif_frames_captured = 0;
-        ImageReaderListener::gif_requested = true;
-        return true;
-    } else {
-        logd("Error initializing GIF encoder.");
+extern "C" JNIEXPORT jboolean JNICALL
+Java_dev_hadrosaur_vulkanphotobooth_MainActivity_createGifInMemory(
+        JNIEnv* env, jobject) {
+    return start_gif_capture("", true);
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_dev_hadrosaur_vulkanphotobooth_MainActivity_startFrameRecording(
+        JNIEnv* env, jobject, jstring path) {
+    const char* pathChars = env->GetStringUTFChars(path, 0);
+    frame_recording_path = pathChars;
+    env->ReleaseStringUTFChars(path, pathChars);
+
+    // Otherwise recording starts with the next preview ImageReader, created CPU readable
+    if (nullptr == listener || !preview_cpu_readable)
+        return false;
+    return listener->startRecording(frame_recording_path.c_str(), preview_width, preview_height);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_dev_hadrosaur_vulkanphotobooth_MainActivity_stopFrameRecording(
+        JNIEnv* env, jobject) {
+    frame_recording_path.clear();
+    if (nullptr != listener)
+        listener->stopRecording();
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_dev_hadrosaur_vulkanphotobooth_MainActivity_releaseGifBuffer(
+        JNIEnv* env, jobject, jobject gif) {
+    // The buffer wraps what GifEncodeJob::takeGif handed over
+    free(env->GetDirectBufferAddress(gif));
+}
+
+void gifFrameCaptured() {
+    // A streaming job encodes the frame straight away, otherwise it is kept for gifReadyToEncode
+    std::shared_ptr<GifEncodeJob> job = getCapturingGifJob();
+    if (stream_gif_encoding && nullptr != job) {
+        for (FrameHandle frame = listener->gifFrameQueue->get(); frame; frame = listener->gifFrameQueue->get()) {
+            job->addFrame(std::move(frame));
+        }
     }
+}
 
-    return false;
+bool getGifPalette(std::vector<uint32_t> &colors, DitherMode &dither_mode) {
+    if (!gpu_gif_palette || !stream_gif_encoding)
+        return false;
+    std::shared_ptr<GifEncodeJob> job = getCapturingGifJob();
+    if (nullptr == job)
+        return false;
+    dither_mode = job->getDitherMode();
+    return job->getPalette(colors);
+}
+
+void gifColorsCounted(const std::vector<uint32_t> &counts) {
+    std::shared_ptr<GifEncodeJob> job = getCapturingGifJob();
+    if (nullptr != job)
+        job->setColorCounts(counts);
 }
 
 void gifReadyToEncode() {
-    // GIF ready to encode, notify kotlin
+    // Hand the captured frames over to be encoded, the next GIF can be captured right away
+    std::shared_ptr<GifEncodeJob> job;
+    {
+        std::lock_guard<std::mutex> lock(capturing_gif_job_lock);
+        job = std::move(capturing_gif_job);
+    }
+    if (nullptr != job) {
+        for (FrameHandle frame = listener->gifFrameQueue->get(); frame; frame = listener->gifFrameQueue->get()) {
+            job->addFrame(std::move(frame));
+        }
+        job->finishFrames();
+        if (!stream_gif_encoding && (nullptr == gifEncodeQueue || !gifEncodeQueue->submit(job))) {
+            loge("GIF encode queue is full, dropping %s", job->PATH.c_str());
+        }
+    }
+
+    // GIF captured, notify kotlin
     JNIEnv *jni_env = getEnv();
     jclass clazz = findClass("dev/hadrosaur/vulkanphotobooth/MainActivity");
     jmethodID gifReadyToEncode = jni_env->GetStaticMethodID(clazz, "gifReadyToEncode", "()V");
@@ -458,34 +623,56 @@ void gifReadyToEncode() {
     jni_env->DeleteLocalRef(clazz);
 }
 
-extern "C" JNIEXPORT void JNICALL
-Java_dev_hadrosaur_vulkanphotobooth_MainActivity_encodeAndSaveGif(
-        JNIEnv* env, jobject) {
-    ImageReaderListener::gif_being_encoded = true;
-
-    int num_frames = listener->gifRingBuffer->numItems();
-    uint32_t **frames = new uint32_t *[num_frames];
-
-    // Going forward
-    for (int n = 0; n < num_frames; n++) {
-        uint32_t *temp_frame = listener->gifRingBuffer->get();
-        frames[n] = temp_frame;
-        //            logd("Encoding gif frame: %d", n);
-        gifEncoder->encodeFrame(temp_frame, 250); // 4fps
-        //            logd("Done encoding gif frame: %d", n);
-        //           delete(temp_frame);
+void gifSaved(GifEncodeJob &job) {
+    logd("GIF %s encoded in %.0f ms, state %d, %llu bytes, storage %.1f ms, encoder waited %.1f ms for it.",
+         job.isInMemory() ? "in memory" : job.PATH.c_str(), job.getEncodeMs(), job.getState(),
+         (unsigned long long) job.getBytesWritten(), job.getWriteMs(), job.getWriteStallMs());
+
+    // Called on an encoder thread, which has to be detached again before it exits
+    JNIEnv *jni_env = nullptr;
+    bool attached = false;
+    if (JNI_EDETACHED == jvm->GetEnv((void**)&jni_env, JNI_VERSION_1_6)) {
+        if (jvm->AttachCurrentThread(&jni_env, nullptr) < 0)
+            return;
+        attached = true;
     }
 
-    // Going backward for boomerang effect
-    for (int n = num_frames -2; n >= 1; n--) {
-        gifEncoder->encodeFrame(frames[n], 250); // 4fps
+    jclass clazz = findClass("dev/hadrosaur/vulkanphotobooth/MainActivity");
+    if (job.isInMemory()) {
+        // Kotlin reads the GIF where the encoder wrote it, and frees it with releaseGifBuffer
+        size_t size = 0;
+        uint8_t *gif = job.takeGif(size);
+        jobject jgif = nullptr;
+        if (nullptr != gif) {
+            jgif = jni_env->NewDirectByteBuffer(gif, (jlong) size);
+            if (nullptr == jgif)
+                free(gif);
+        }
+        jmethodID gifEncodedCallback = jni_env->GetStaticMethodID(clazz, "gifEncodedCallback", "(Ljava/nio/ByteBuffer;)V");
+        jni_env->CallStaticVoidMethod(clazz, gifEncodedCallback, jgif);
+        if (jni_env->ExceptionCheck()) {
+            // Kotlin never got the buffer, so nothing will release it
+            jni_env->ExceptionDescribe();
+            jni_env->ExceptionClear();
+            if (nullptr != jgif)
+                free(gif);
+        }
+        if (nullptr != jgif)
+            jni_env->DeleteLocalRef(jgif);
+    } else {
+        jmethodID gifSavedCallback = jni_env->GetStaticMethodID(clazz, "gifSavedCallback", "(Ljava/lang/String;Z)V");
+        jstring jfilepath = jni_env->NewStringUTF(job.PATH.c_str());
+        jni_env->CallStaticVoidMethod(clazz, gifSavedCallback, jfilepath, (jboolean) (GifEncodeJob::SAVED == job.getState()));
+        if (jni_env->ExceptionCheck()) {
+            jni_env->ExceptionDescribe();
+            jni_env->ExceptionClear();
+        }
+        jni_env->DeleteLocalRef(jfilepath);
     }
+    jni_env->DeleteLocalRef(clazz);
 
-    logd("About to release gif encoder.");
-    gifEncoder->release();
-    logd("Gif encoded correctly.");
-
-    ImageReaderListener::gif_being_encoded = false;
+    if (attached)
+        jvm->DetachCurrentThread();
 }
 
 void updateGifProgress() {
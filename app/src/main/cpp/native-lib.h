@@ -18,7 +18,7 @@
 #define VULKAN_PHOTO_BOOTH_NATIVE_LIB_H
 
 #include <jni.h>
-#include "third_party/androidndkgif/GCTGifEncoder.h"
+#include "GifEncodeQueue.h"
 
 JNIEnv* getEnv();
 jclass findClass(const char* name);
@@ -27,7 +27,11 @@ void updateFramerateUI(double current_fps, double vulkan_render_time);
 bool InitializeVulkan();
 void cleanup();
 void updateGifProgress();
+void gifFrameCaptured();
 void gifReadyToEncode();
+void gifSaved(GifEncodeJob &job);
+bool getGifPalette(std::vector<uint32_t> &colors, DitherMode &dither_mode);
+void gifColorsCounted(const std::vector<uint32_t> &counts);
 
 /**
  * Initialize the native/vulkan setup
@@ -118,13 +122,44 @@ Java_dev_hadrosaur_vulkanphotobooth_MainActivity_updateFilterParams(
         jintArray jseek_values,
         jbooleanArray juse_filter);
 
-/** Tell the rendered to begin copying out frames for GIF generation */
+/**
+ * Tell the rendered to begin copying out frames for GIF generation. Once they are copied out the
+ * GIF is queued to be encoded and saved, and another one can be captured.
+ */
 extern "C" JNIEXPORT jboolean JNICALL
 Java_dev_hadrosaur_vulkanphotobooth_MainActivity_createGif(
         JNIEnv* env, jobject, jstring filepath);
 
-/** Frames have been copied out, begin encoding and saving GIF file */
+/**
+ * Like createGif, but the GIF is encoded into memory and handed to Kotlin's gifEncodedCallback as
+ * a direct ByteBuffer, without a copy or a trip through storage
+ */
+extern "C" JNIEXPORT jboolean JNICALL
+Java_dev_hadrosaur_vulkanphotobooth_MainActivity_createGifInMemory(
+        JNIEnv* env, jobject);
+
+/**
+ * Record camera frames and filter settings to path for host/frame_replay (see FrameRecording.h).
+ * Recording needs a CPU readable YUV_420_888 preview ImageReader, which createPreviewImageReader
+ * only creates while a recording path is set. Returns true if recording started right away,
+ * otherwise it starts once the camera is next opened.
+ */
+extern "C" JNIEXPORT jboolean JNICALL
+Java_dev_hadrosaur_vulkanphotobooth_MainActivity_startFrameRecording(
+        JNIEnv* env, jobject, jstring path);
+
+/**
+ * Stop and close the recording, later preview ImageReaders are PRIVATE again
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_dev_hadrosaur_vulkanphotobooth_MainActivity_stopFrameRecording(
+        JNIEnv* env, jobject);
+
+/**
+ * Free the memory behind a ByteBuffer from gifEncodedCallback
+ */
 extern "C" JNIEXPORT void JNICALL
-Java_dev_hadrosaur_vulkanphotobooth_MainActivity_encodeAndSaveGif(JNIEnv* env, jobject);
+Java_dev_hadrosaur_vulkanphotobooth_MainActivity_releaseGifBuffer(
+        JNIEnv* env, jobject, jobject gif);
 
 #endif //VULKAN_PHOTO_BOOTH_NATIVE_LIB_H
@@ -20,11 +20,13 @@
 #include <cstdlib>
 #include <memory>
 #include <mutex>
-#include "vulkan-utils/vulkan_utils.h"
 
 /**
  * Standard ring buffer of type T
  *
+ * Superseded by FrameQueue (frame_queue.h) for GIF frames, kept as the baseline for
+ * host/frame_queue_bench.
+ *
  * @tparam T type for the ring buffer
  */
 template <class T>
@@ -0,0 +1,61 @@
+#version 450
+#pragma shader_stage(compute)
+
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Counts the colors of a GIF frame for its palette, see VulkanPaletteMapper
+ *
+ * Adds every pixel to the GIF encoder's color histogram (ColorHistogram.h) kept on the GPU, so only
+ * the histogram is read back to build the palette. Bins are the top 5 bits of R, G and B, and also
+ * sum the low 3 bits, so the colors coming out are the mean of the pixels in the bin. Frames add up
+ * until the histogram is cleared.
+ */
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0, rgba8) uniform readonly image2D frame;
+
+// ColorHistogram::addCounts layout: count, then the R, G and B sums of each bin
+layout(std430, set = 0, binding = 1) buffer Counts {
+    uint counts[];
+};
+
+const uint BIN_BITS = 5u;
+const uint BIN_SHIFT = 8u - BIN_BITS;
+const uint LOW_MASK = (1u << BIN_SHIFT) - 1u;
+
+void main() {
+    ivec2 xy = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(xy, imageSize(frame)))) {
+        return;
+    }
+
+    uvec3 color = uvec3(imageLoad(frame, xy).rgb * 255.0 + 0.5);
+    uvec3 high = color >> BIN_SHIFT;
+    uvec3 low = color & LOW_MASK;
+    uint bin = 4u * (high.r | (high.g << BIN_BITS) | (high.b << (2u * BIN_BITS)));
+
+    atomicAdd(counts[bin], 1u);
+    // Most pixels of smooth frames leave nothing to add
+    if (0u != low.r)
+        atomicAdd(counts[bin + 1u], low.r);
+    if (0u != low.g)
+        atomicAdd(counts[bin + 2u], low.g);
+    if (0u != low.b)
+        atomicAdd(counts[bin + 3u], low.b);
+}
@@ -0,0 +1,80 @@
+#version 450
+#pragma shader_stage(compute)
+
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Maps a GIF frame to its palette, see VulkanPaletteMapper
+ *
+ * Each invocation maps 4 pixels and writes their indices as one uint, so the frame comes back as one
+ * byte per pixel in row order. The search is the GIF encoder's: the ordered dither offset is added
+ * to each channel, then the squared distance to every palette color is measured in integers, and
+ * the lowest index wins a tie.
+ */
+
+layout(local_size_x = 64) in;
+
+layout(set = 0, binding = 0, rgba8) uniform readonly image2D frame;
+
+// VulkanPaletteMapper::Params
+layout(std430, set = 0, binding = 1) readonly buffer Params {
+    uint colorNum;
+    uint width;
+    uint height;
+    uint useDither;
+    uint palette[256];        // 0xAABBGGRR
+    int ditherOffsets[1024];  // 32x32 tile, see OrderedDither.h
+} params;
+
+layout(std430, set = 0, binding = 2) writeonly buffer Indices {
+    uint indices[];
+};
+
+const uint DITHER_SIZE = 32u;
+
+uint nearestColor(ivec3 color) {
+    // Distance in the high bits and index in the low 8, so the minimum is also the lowest index on a tie
+    uint closest = 0xFFFFFFFFu;
+    for (uint i = 0u; i < params.colorNum; i++) {
+        uint entry = params.palette[i];
+        ivec3 diff = ivec3(entry & 0xFFu, (entry >> 8) & 0xFFu, (entry >> 16) & 0xFFu) - color;
+        uint distance = uint(diff.r * diff.r + diff.g * diff.g + diff.b * diff.b);
+        closest = min(closest, (distance << 8) | i);
+    }
+    return closest & 0xFFu;
+}
+
+void main() {
+    uint pixelNum = params.width * params.height;
+    uint first = gl_GlobalInvocationID.x * 4u;
+    if (first >= pixelNum) {
+        return;
+    }
+
+    uint packedIndices = 0u;
+    for (uint i = 0u; i < 4u && first + i < pixelNum; i++) {
+        uint pixel = first + i;
+        ivec2 xy = ivec2(pixel % params.width, pixel / params.width);
+        ivec3 color = ivec3(imageLoad(frame, xy).rgb * 255.0 + 0.5);
+        if (0u != params.useDither) {
+            int offset = params.ditherOffsets[(uint(xy.y) % DITHER_SIZE) * DITHER_SIZE + uint(xy.x) % DITHER_SIZE];
+            color = clamp(color + offset, 0, 255);
+        }
+        packedIndices |= nearestColor(color) << (8u * i);
+    }
+    indices[gl_GlobalInvocationID.x] = packedIndices;
+}
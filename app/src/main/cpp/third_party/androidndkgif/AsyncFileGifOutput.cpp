@@ -0,0 +1,447 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include "AsyncFileGifOutput.h"
+
+// Android blocks io_uring for apps, the kiosks take the pwrite() path
+#if defined(__linux__) && !defined(__ANDROID__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define GIF_WRITER_IO_URING 1
+#endif
+#endif
+
+#ifdef GIF_WRITER_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+using namespace std;
+
+static double msSince(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t size, uint64_t offset)
+{
+	while (0 < size) {
+		ssize_t written = pwrite(fd, data, size, offset);
+		if (0 > written && EINTR == errno) {
+			continue;
+		}
+		if (0 >= written) {
+			return false;
+		}
+		data += written;
+		size -= written;
+		offset += written;
+	}
+	return true;
+}
+
+#ifdef GIF_WRITER_IO_URING
+// Just enough of io_uring for writes, through the raw system calls as liburing is not around
+class IoUring {
+	int ringFd;
+	uint32_t entries;
+	void* sqRing;
+	size_t sqRingSize;
+	void* cqRing;
+	size_t cqRingSize;
+	io_uring_sqe* sqes;
+	size_t sqesSize;
+	uint32_t* sqHead;
+	uint32_t* sqTail;
+	uint32_t* sqMask;
+	uint32_t* sqArray;
+	uint32_t* cqHead;
+	uint32_t* cqTail;
+	uint32_t* cqMask;
+	io_uring_cqe* cqes;
+	uint32_t unsubmitted;
+
+public:
+	IoUring()
+	{
+		ringFd = -1;
+		entries = 0;
+		sqRing = MAP_FAILED;
+		sqRingSize = 0;
+		cqRing = MAP_FAILED;
+		cqRingSize = 0;
+		sqes = (io_uring_sqe*)MAP_FAILED;
+		sqesSize = 0;
+		sqHead = NULL;
+		sqTail = NULL;
+		sqMask = NULL;
+		sqArray = NULL;
+		cqHead = NULL;
+		cqTail = NULL;
+		cqMask = NULL;
+		cqes = NULL;
+		unsubmitted = 0;
+	}
+
+	~IoUring()
+	{
+		if (MAP_FAILED != (void*)sqes) {
+			munmap(sqes, sqesSize);
+		}
+		if (MAP_FAILED != cqRing && cqRing != sqRing) {
+			munmap(cqRing, cqRingSize);
+		}
+		if (MAP_FAILED != sqRing) {
+			munmap(sqRing, sqRingSize);
+		}
+		if (0 <= ringFd) {
+			::close(ringFd);
+		}
+	}
+
+	// False when the kernel has no io_uring or it is not allowed
+	bool init(uint32_t entryNum)
+	{
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		ringFd = syscall(__NR_io_uring_setup, entryNum, &params);
+		if (0 > ringFd) {
+			return false;
+		}
+		entries = params.sq_entries;
+		sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool singleMap = 0 != (params.features & IORING_FEAT_SINGLE_MMAP);
+		if (singleMap) {
+			sqRingSize = cqRingSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+		}
+		sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+		if (MAP_FAILED == sqRing) {
+			return false;
+		}
+		cqRing = singleMap ? sqRing : mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		if (MAP_FAILED == cqRing) {
+			return false;
+		}
+		sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = (io_uring_sqe*)mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+		if (MAP_FAILED == (void*)sqes) {
+			return false;
+		}
+
+		uint8_t* sq = (uint8_t*)sqRing;
+		sqHead = (uint32_t*)(sq + params.sq_off.head);
+		sqTail = (uint32_t*)(sq + params.sq_off.tail);
+		sqMask = (uint32_t*)(sq + params.sq_off.ring_mask);
+		sqArray = (uint32_t*)(sq + params.sq_off.array);
+		uint8_t* cq = (uint8_t*)cqRing;
+		cqHead = (uint32_t*)(cq + params.cq_off.head);
+		cqTail = (uint32_t*)(cq + params.cq_off.tail);
+		cqMask = (uint32_t*)(cq + params.cq_off.ring_mask);
+		cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+		return true;
+	}
+
+	// Submitted by the next wait()
+	bool queueWrite(int fd, const uint8_t* data, size_t size, uint64_t offset, uint64_t userData)
+	{
+		uint32_t tail = *sqTail;
+		if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= entries) {
+			return false;
+		}
+		uint32_t index = tail & *sqMask;
+		io_uring_sqe* sqe = &sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)(uintptr_t)data;
+		sqe->len = size;
+		sqe->off = offset;
+		sqe->user_data = userData;
+		sqArray[index] = index;
+		__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+		++unsubmitted;
+		return true;
+	}
+
+	// Submits what is queued and returns the next completion, a result below 0 is -errno
+	bool wait(uint64_t* userData, int32_t* result)
+	{
+		while (true) {
+			uint32_t head = *cqHead;
+			bool completed = head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+			if (completed && 0 == unsubmitted) {
+				io_uring_cqe* cqe = &cqes[head & *cqMask];
+				*userData = cqe->user_data;
+				*result = cqe->res;
+				__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+				return true;
+			}
+			int submitted = syscall(__NR_io_uring_enter, ringFd, unsubmitted, completed ? 0 : 1, IORING_ENTER_GETEVENTS, NULL, 0);
+			if (0 > submitted) {
+				if (EINTR == errno) {
+					continue;
+				}
+				return false;
+			}
+			unsubmitted -= submitted;
+		}
+	}
+};
+#endif
+
+AsyncFileGifOutput::AsyncFileGifOutput(size_t bufferSize, uint32_t bufferNum) :
+		BUFFER_SIZE(0 < bufferSize ? bufferSize : 1), BUFFER_NUM(1 < bufferNum ? bufferNum : 2)
+{
+	fd = -1;
+	filling = -1;
+	fillingSize = 0;
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&changed, NULL);
+	closing = false;
+	writeFailed = false;
+	memset(&stats, 0, sizeof(stats));
+	writerStarted = false;
+}
+
+AsyncFileGifOutput::~AsyncFileGifOutput()
+{
+	close();
+	waitUntilClosed();
+	for (uint32_t i = 0; i < buffers.size(); ++i) {
+		delete[] buffers[i];
+	}
+	pthread_cond_destroy(&changed);
+	pthread_mutex_destroy(&lock);
+}
+
+bool AsyncFileGifOutput::open(const char* fileName)
+{
+	close();
+	waitUntilClosed();
+	fd = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (0 > fd) {
+		return false;
+	}
+	if (buffers.empty()) {
+		for (uint32_t i = 0; i < BUFFER_NUM; ++i) {
+			buffers.push_back(new uint8_t[BUFFER_SIZE]);
+		}
+		bufferSizes.resize(BUFFER_NUM);
+	}
+	freeBuffers.clear();
+	for (uint32_t i = 1; i < BUFFER_NUM; ++i) {
+		freeBuffers.push_back(i);
+	}
+	filling = 0;
+	fillingSize = 0;
+	closing = false;
+	writeFailed = false;
+	memset(&stats, 0, sizeof(stats));
+	size = 0;
+	failed = false;
+
+	writerStarted = 0 == pthread_create(&writer, NULL, writerThread, this);
+	if (!writerStarted) {
+		::close(fd);
+		fd = -1;
+		filling = -1;
+		return false;
+	}
+	return true;
+}
+
+bool AsyncFileGifOutput::write(const void* data, size_t dataSize)
+{
+	if (0 > filling) {
+		failed = true;
+		return false;
+	}
+	size += dataSize;
+	const uint8_t* src = (const uint8_t*)data;
+	while (0 < dataSize) {
+		size_t copied = BUFFER_SIZE - fillingSize < dataSize ? BUFFER_SIZE - fillingSize : dataSize;
+		memcpy(buffers[filling] + fillingSize, src, copied);
+		fillingSize += copied;
+		src += copied;
+		dataSize -= copied;
+		if (BUFFER_SIZE == fillingSize) {
+			handOver(true);
+		}
+	}
+	return true;
+}
+
+void AsyncFileGifOutput::handOver(bool takeNext)
+{
+	pthread_mutex_lock(&lock);
+	bufferSizes[filling] = fillingSize;
+	fullBuffers.push_back(filling);
+	filling = -1;
+	fillingSize = 0;
+	if (takeNext) {
+		// Everything is being written, this is the only time the encoder waits on storage
+		if (freeBuffers.empty()) {
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			pthread_cond_broadcast(&changed);
+			while (freeBuffers.empty()) {
+				pthread_cond_wait(&changed, &lock);
+			}
+			stats.stallMs += msSince(start);
+			++stats.stallNum;
+		}
+		filling = freeBuffers.back();
+		freeBuffers.pop_back();
+	}
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&lock);
+}
+
+bool AsyncFileGifOutput::close()
+{
+	if (0 > filling) {
+		return !failed;
+	}
+	if (0 < fillingSize) {
+		handOver(false);
+	}
+	pthread_mutex_lock(&lock);
+	filling = -1;
+	closing = true;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&lock);
+	return !failed;
+}
+
+bool AsyncFileGifOutput::waitUntilClosed()
+{
+	if (writerStarted) {
+		pthread_join(writer, NULL);
+		writerStarted = false;
+		if (writeFailed) {
+			failed = true;
+		}
+	}
+	return !failed;
+}
+
+AsyncFileGifOutput::Stats AsyncFileGifOutput::getStats()
+{
+	pthread_mutex_lock(&lock);
+	Stats copy = stats;
+	pthread_mutex_unlock(&lock);
+	return copy;
+}
+
+void AsyncFileGifOutput::releaseBuffer(uint32_t buffer, bool written, double ms)
+{
+	pthread_mutex_lock(&lock);
+	if (written) {
+		stats.bytesWritten += bufferSizes[buffer];
+	} else {
+		writeFailed = true;
+	}
+	stats.writeMs += ms;
+	freeBuffers.push_back(buffer);
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&lock);
+}
+
+void* AsyncFileGifOutput::writerThread(void* output)
+{
+	((AsyncFileGifOutput*)output)->writeBehind();
+	return NULL;
+}
+
+void AsyncFileGifOutput::writeBehind()
+{
+	bool ioUring = false;
+#ifdef GIF_WRITER_IO_URING
+	// Twice the buffers, a short write is finished with another entry
+	IoUring ring;
+	ioUring = ring.init(2 * BUFFER_NUM);
+	vector<bool> pending(BUFFER_NUM, false);
+	vector<size_t> done(BUFFER_NUM);
+	vector<uint64_t> offsets(BUFFER_NUM);
+#endif
+	uint64_t offset = 0;
+	uint32_t inFlight = 0;
+	vector<uint32_t> batch;
+
+	pthread_mutex_lock(&lock);
+	stats.ioUring = ioUring;
+	while (true) {
+		while (0 == inFlight && fullBuffers.empty() && !closing) {
+			pthread_cond_wait(&changed, &lock);
+		}
+		if (0 == inFlight && fullBuffers.empty()) {
+			break;
+		}
+		batch.assign(fullBuffers.begin(), fullBuffers.end());
+		fullBuffers.clear();
+		pthread_mutex_unlock(&lock);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (!ioUring) {
+			for (uint32_t i = 0; i < batch.size(); ++i) {
+				uint32_t buffer = batch[i];
+				bool written = writeAll(fd, buffers[buffer], bufferSizes[buffer], offset);
+				offset += bufferSizes[buffer];
+				releaseBuffer(buffer, written, msSince(start));
+				start = chrono::steady_clock::now();
+			}
+		}
+#ifdef GIF_WRITER_IO_URING
+		else {
+			// Every full buffer goes to the kernel at once, each is free again as soon as it is written
+			for (uint32_t i = 0; i < batch.size(); ++i) {
+				uint32_t buffer = batch[i];
+				done[buffer] = 0;
+				offsets[buffer] = offset;
+				offset += bufferSizes[buffer];
+				pending[buffer] = true;
+				++inFlight;
+				ring.queueWrite(fd, buffers[buffer], bufferSizes[buffer], offsets[buffer], buffer);
+			}
+			uint64_t buffer;
+			int32_t result;
+			if (!ring.wait(&buffer, &result)) {
+				// The ring broke down, what was in flight is written again at the same offsets
+				ioUring = false;
+				for (uint32_t i = 0; i < BUFFER_NUM; ++i) {
+					if (pending[i]) {
+						pending[i] = false;
+						releaseBuffer(i, writeAll(fd, buffers[i], bufferSizes[i], offsets[i]), msSince(start));
+					}
+				}
+				inFlight = 0;
+			} else {
+				size_t left = bufferSizes[buffer] - done[buffer];
+				if (0 < result && (size_t)result < left) {
+					// Short write, the rest goes in again
+					done[buffer] += result;
+					ring.queueWrite(fd, buffers[buffer] + done[buffer], left - result, offsets[buffer] + done[buffer], buffer);
+				} else {
+					// An error may only mean this kind of write is not supported, pwrite() gets to try
+					bool written = (size_t)result == left
+							|| (0 > result && writeAll(fd, buffers[buffer] + done[buffer], left, offsets[buffer] + done[buffer]));
+					pending[buffer] = false;
+					--inFlight;
+					releaseBuffer(buffer, written, msSince(start));
+				}
+			}
+		}
+#endif
+		pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+
+	if (0 != ::close(fd)) {
+		pthread_mutex_lock(&lock);
+		writeFailed = true;
+		pthread_mutex_unlock(&lock);
+	}
+	fd = -1;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "GifOutput.h"
+
+// Writes the file on a thread of its own, so the encoder only ever copies into memory. Writes fill
+// one of bufferNum buffers and full ones are written behind while the next one fills. The encoder
+// only waits on storage when every buffer is still being written, which is counted as a stall. On
+// Linux hosts the writer hands the buffers to io_uring, everywhere else, and when io_uring is not
+// allowed, to pwrite().
+class AsyncFileGifOutput : public GifOutput {
+public:
+	struct Stats {
+		uint64_t bytesWritten; // Reached the file so far
+		double writeMs;        // Writer thread waiting for storage
+		double stallMs;        // Encoder waiting for a buffer to be written
+		uint32_t stallNum;
+		bool ioUring;
+	};
+
+	// bufferSize * bufferNum is what may be written behind before the encoder waits
+	AsyncFileGifOutput(size_t bufferSize = 256 * 1024, uint32_t bufferNum = 2);
+	virtual ~AsyncFileGifOutput();
+
+	bool open(const char* fileName);
+	virtual bool write(const void* data, size_t dataSize);
+	// Hands the last buffer over without waiting, the writer thread closes the file
+	virtual bool close();
+	// Returns once the file is written and closed, false if anything failed
+	bool waitUntilClosed();
+	Stats getStats();
+
+private:
+	const size_t BUFFER_SIZE;
+	const uint32_t BUFFER_NUM;
+
+	int fd;
+	std::vector<uint8_t*> buffers;
+	std::vector<size_t> bufferSizes;
+	int32_t filling; // Buffer the encoder writes to, -1 once closed
+	size_t fillingSize;
+
+	// Guards everything below, changed wakes the writer and the encoder both
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	std::deque<uint32_t> fullBuffers;
+	std::vector<uint32_t> freeBuffers;
+	bool closing;
+	bool writeFailed;
+	Stats stats;
+
+	pthread_t writer;
+	bool writerStarted;
+
+	void handOver(bool takeNext);
+	void releaseBuffer(uint32_t buffer, bool written, double ms);
+	static void* writerThread(void* output);
+	void writeBehind();
+};
@@ -1,8 +1,12 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <atomic>
 #include <vector>
 #include "BaseGifEncoder.h"
+#include "ColorReduceKernels.h"
+#include "PixelConvert.h"
+#include "WorkerPool.h"
 
 using namespace std;
 
@@ -12,117 +16,107 @@ BaseGifEncoder::BaseGifEncoder() {
 	frameNum = 0;
 	lastColorReducedPixels = NULL;
 	lastRootColor = 0;
-	useDither = true;
+	ditherMode = DITHER_FLOYD_STEINBERG;
+	output = NULL;
 }
 
-void BaseGifEncoder::qsortColorHistogram(uint32_t* imageColorHistogram, int32_t maxColor, uint32_t from, uint32_t to)
+bool BaseGifEncoder::init(uint16_t width, uint16_t height, const char* fileName)
 {
-	if (to == from) {
-		return ;
+	if (!fileOutput.open(fileName)) {
+		return false;
 	}
-	uint32_t middle = from + ((to - from) >> 1);
-	uint32_t shift = maxColor << 3;
-	uint32_t pivot = ((imageColorHistogram[middle]) >> shift) & 0xFF;
+	return init(width, height, &fileOutput);
+}
+
+void BaseGifEncoder::updateCubeRange(Cube* cube, const vector<ColorHistogram::Entry>& entries)
+{
+	for (uint32_t color = 0; color < COLOR_MAX; ++color) {
+		cube->cMin[color] = 255;
+		cube->cMax[color] = 0;
+	}
+	for (uint32_t i = cube->colorHistogramFromIndex; i <= cube->colorHistogramToIndex; ++i) {
+		for (uint32_t color = 0; color < COLOR_MAX; ++color) {
+			uint32_t value = GET_COLOR(entries[i].color, color);
+			cube->cMin[color] = MIN(cube->cMin[color], value);
+			cube->cMax[color] = MAX(cube->cMax[color], value);
+		}
+	}
+}
+
+void BaseGifEncoder::splitCube(Cube* nextCube, Cube* maxCube, int32_t maxColor, vector<ColorHistogram::Entry>& entries)
+{
+	uint32_t from = maxCube->colorHistogramFromIndex;
+	uint32_t to = maxCube->colorHistogramToIndex;
+
+	// Median by pixel count, not by histogram entry
+	uint64_t weights[Cube::COLOR_RANGE] = {0, };
+	uint64_t total = 0;
+	for (uint32_t i = from; i <= to; ++i) {
+		weights[GET_COLOR(entries[i].color, maxColor)] += entries[i].count;
+		total += entries[i].count;
+	}
+	uint32_t median = maxCube->cMin[maxColor];
+	uint64_t below = weights[median];
+	while (below * 2 < total) {
+		below += weights[++median];
+	}
+	// Both halves need at least one color, cMin < cMax as the cube is split on this channel
+	if (median >= maxCube->cMax[maxColor]) {
+		median = maxCube->cMax[maxColor] - 1;
+	}
+
 	uint32_t i = from;
 	uint32_t k = to;
 	while (i <= k) {
-		while (((imageColorHistogram[i] >> shift) & 0xFF) < pivot && i <= k) {
-			++i;
-		}
-		while (((imageColorHistogram[k] >> shift) & 0xFF) > pivot && i <= k && 1 < k) {
-			--k;
-		}
-		if (i <= k) {
-			uint32_t temp = imageColorHistogram[k];
-			imageColorHistogram[k] = imageColorHistogram[i];
-			imageColorHistogram[i] = temp;
+		if (GET_COLOR(entries[i].color, maxColor) <= median) {
 			++i;
+		} else {
+			ColorHistogram::Entry temp = entries[k];
+			entries[k] = entries[i];
+			entries[i] = temp;
 			--k;
 		}
 	}
-	if (from < k && -1 != k) {
-		qsortColorHistogram(imageColorHistogram, maxColor, from, k);
-	}
-	if (i < to) {
-		qsortColorHistogram(imageColorHistogram, maxColor, i, to);
-	}
+
+	nextCube->colorHistogramFromIndex = from;
+	nextCube->colorHistogramToIndex = i - 1;
+	maxCube->colorHistogramFromIndex = i;
+	updateCubeRange(nextCube, entries);
+	updateCubeRange(maxCube, entries);
 }
 
-void BaseGifEncoder::updateColorHistogram(Cube* nextCube, Cube* maxCube, int32_t maxColor, uint32_t* imageColorHistogram)
+void BaseGifEncoder::computeColorTable(uint32_t* pixels, Cube* cubes, uint32_t pixelNum)
 {
-	qsortColorHistogram(imageColorHistogram, maxColor, maxCube->colorHistogramFromIndex, maxCube->colorHistogramToIndex);
-	uint32_t median = maxCube->colorHistogramFromIndex + ((maxCube->colorHistogramToIndex - maxCube->colorHistogramFromIndex) >> 1);
-	nextCube->colorHistogramFromIndex = maxCube->colorHistogramFromIndex;
-	nextCube->colorHistogramToIndex = median;
-
-	if (GET_COLOR(imageColorHistogram[nextCube->colorHistogramFromIndex], maxColor) !=
-		GET_COLOR(imageColorHistogram[maxCube->colorHistogramToIndex], maxColor)) {
-			if (GET_COLOR(imageColorHistogram[nextCube->colorHistogramFromIndex], maxColor) != GET_COLOR(imageColorHistogram[nextCube->colorHistogramToIndex], maxColor)) {
-				if (GET_COLOR(imageColorHistogram[median], maxColor) == GET_COLOR(imageColorHistogram[median + 1], maxColor)) {
-					while (GET_COLOR(imageColorHistogram[nextCube->colorHistogramToIndex], maxColor) == GET_COLOR(imageColorHistogram[median], maxColor)) {
-						--median;
-					}
-					nextCube->colorHistogramToIndex = median;
-				}
-			} else {
-				while (GET_COLOR(imageColorHistogram[nextCube->colorHistogramToIndex], maxColor) == GET_COLOR(imageColorHistogram[median], maxColor)) {
-					++median;
-				}
-				nextCube->colorHistogramToIndex = median;
-			}
+	colorHistogram.clear();
+	colorHistogram.add(pixels, pixelNum);
+	if (0 != frameNum && NULL != lastColorReducedPixels) {
+		colorHistogram.add(lastColorReducedPixels, pixelNum);
 	}
-	maxCube->colorHistogramFromIndex = maxCube->colorHistogramToIndex > median + 1 ? median + 1 : maxCube->colorHistogramToIndex;
-	nextCube->cMin[maxColor] = GET_COLOR(imageColorHistogram[nextCube->colorHistogramFromIndex], maxColor);
-	nextCube->cMax[maxColor] = GET_COLOR(imageColorHistogram[nextCube->colorHistogramToIndex], maxColor);
-	maxCube->cMin[maxColor] = GET_COLOR(imageColorHistogram[maxCube->colorHistogramFromIndex], maxColor);
-	maxCube->cMax[maxColor] = GET_COLOR(imageColorHistogram[maxCube->colorHistogramToIndex], maxColor);
+	computeColorTable(cubes);
 }
 
-void BaseGifEncoder::computeColorTable(uint32_t* pixels, Cube* cubes, uint32_t pixelNum)
+void BaseGifEncoder::computeColorTable(const uint16_t* pixels, Cube* cubes, uint32_t pixelNum)
 {
-	uint32_t colors[COLOR_MAX][Cube::COLOR_RANGE] = {0, };
-	uint32_t* pixelBegin = pixels;
-
-	vector<uint32_t> colorHistogramMemory;
+	colorHistogram.clear();
+	colorHistogram.add(pixels, pixelNum);
 	if (0 != frameNum && NULL != lastColorReducedPixels) {
-		colorHistogramMemory.resize(pixelNum * 2 * sizeof(uint32_t));
-		memcpy(&colorHistogramMemory[0], pixels, pixelNum * sizeof(uint32_t));
-		memcpy(&colorHistogramMemory[pixelNum], lastColorReducedPixels, pixelNum * sizeof(uint32_t));
-		pixelNum *= 2;
-	} else {
-		colorHistogramMemory.resize(pixelNum * sizeof(uint32_t));
-		memcpy(&colorHistogramMemory[0], pixels, pixelNum * sizeof(uint32_t));
-	}
-	uint32_t *colorHistogram = &colorHistogramMemory[0];
-	pixels = colorHistogram;
-	uint32_t* last = colorHistogram + pixelNum;
-
-	while (last != pixels) {
-		uint8_t r = (*pixels) & 0xFF;
-		uint8_t g = ((*pixels) >> 8) & 0xFF;
-		uint8_t b = ((*pixels) >> 16) & 0xFF;
-		++colors[RED][r];
-		++colors[GREEN][g];
-		++colors[BLUE][b];
-		++pixels;
+		colorHistogram.add(lastColorReducedPixels, pixelNum);
+	}
+	computeColorTable(cubes);
+}
+
+void BaseGifEncoder::computeColorTable(Cube* cubes)
+{
+	vector<ColorHistogram::Entry>& entries = colorHistogram.collectEntries();
+	if (entries.empty()) {
+		return;
 	}
 
 	uint32_t cubeIndex = 0;
 	Cube* cube = &cubes[cubeIndex];
-	for (uint32_t i = 0; i < COLOR_MAX; ++i) {
-		cube->cMin[i] = 255;
-		cube->cMax[i] = 0;
-	}
-	for (uint32_t i = 0; i < 256; ++i) {
-		for (uint32_t color = 0; color < COLOR_MAX; ++color) {
-			if (0 != colors[color][i]) {
-				cube->cMax[color] = cube->cMax[color] < i ? i : cube->cMax[color];
-				cube->cMin[color] = cube->cMin[color] > i ? i : cube->cMin[color];
-			}
-		}
-	}
 	cube->colorHistogramFromIndex = 0;
-	cube->colorHistogramToIndex = pixelNum - 1;
+	cube->colorHistogramToIndex = entries.size() - 1;
+	updateCubeRange(cube, entries);
 	uint32_t comparingColorList[COLOR_MAX] = {GREEN, RED, BLUE};
 	for (cubeIndex = 1; cubeIndex < 255; ++cubeIndex) {
 		uint32_t maxDiff = 0;
@@ -150,98 +144,93 @@ void BaseGifEncoder::computeColorTable(uint32_t* pixels, Cube* cubes, uint32_t p
 		if (1 >= maxDiff) {
 			break;
 		}
-		Cube* nextCube = &cubes[cubeIndex];
-		for (int32_t color = 0; color < COLOR_MAX; ++color) {
-			if (color == maxColor) {
-				updateColorHistogram(nextCube, maxCube, maxColor, colorHistogram);
-			} else {
-				nextCube->cMax[color] = maxCube->cMax[color];
-				nextCube->cMin[color] = maxCube->cMin[color];
-			}
-		}
+		splitCube(&cubes[cubeIndex], maxCube, maxColor, entries);
+	}
+	// Cubes left over repeat the first one's color
+	for (uint32_t i = cubeIndex; i < 255; ++i) {
+		cubes[i].colorHistogramFromIndex = cubes[0].colorHistogramFromIndex;
+		cubes[i].colorHistogramToIndex = cubes[0].colorHistogramToIndex;
 	}
 	for (uint32_t i = 0; i < 255; ++i) {
 		Cube* temp_cube = &cubes[i];
-		for (int32_t color = 0; color < COLOR_MAX; ++color) {
-			qsortColorHistogram(colorHistogram, color, temp_cube->colorHistogramFromIndex, temp_cube->colorHistogramToIndex);
-			uint32_t median = temp_cube->colorHistogramFromIndex + ((temp_cube->colorHistogramToIndex - temp_cube->colorHistogramFromIndex) >> 1);
-			if (median < pixelNum) {
-				temp_cube->color[color] = GET_COLOR(colorHistogram[median], color);
+		uint64_t sums[COLOR_MAX] = {0, };
+		uint64_t count = 0;
+		for (uint32_t k = temp_cube->colorHistogramFromIndex; k <= temp_cube->colorHistogramToIndex; ++k) {
+			for (int32_t color = 0; color < COLOR_MAX; ++color) {
+				sums[color] += (uint64_t)GET_COLOR(entries[k].color, color) * entries[k].count;
 			}
+			count += entries[k].count;
+		}
+		for (int32_t color = 0; color < COLOR_MAX; ++color) {
+			temp_cube->color[color] = (sums[color] + count / 2) / count;
 		}
 	}
 }
 
+void BaseGifEncoder::setDitherMode(DitherMode ditherMode)
+{
+	this->ditherMode = ditherMode;
+}
+
 void BaseGifEncoder::reduceColor(Cube* cubes, uint32_t cubeNum, uint32_t* pixels)
 {
-	const int32_t ERROR_PROPAGATION_DIRECTION_NUM = 4;
-	const int32_t ERROR_PROPAGATION_DIRECTION_X[] = {1, -1, 0, 1};
-	const int32_t ERROR_PROPAGATION_DIRECTION_Y[] = {0, 1, 1, 1};
-	const int32_t ERROR_PROPAGATION_DIRECTION_WEIGHT[] = {7, 3, 5, 1};
+	// Palette indices overwrite the start of pixels, always behind the row being read
+	reduceColor(&paletteLookupTable, cubes, cubeNum, pixels, (uint8_t*)pixels, lastColorReducedPixels, 1);
+}
 
-	uint32_t pixelNum = width * height;
-	uint32_t* last = pixels + pixelNum;
-	uint8_t* pixelOut = (uint8_t*)pixels;
-	uint32_t* colorReducedPixelOut = lastColorReducedPixels;
-	for (uint32_t y = 0; y < height; ++y) {
-		for (uint32_t x = 0; x < width; ++x) {
-			if (0 == (*pixels >> 24)) {
-				*pixelOut = 255; //l transparent color
-				*colorReducedPixelOut = 0;
-			} else {
-				Cube* cube = cubes;
-				uint32_t r = (*pixels) & 0xFF;
-				uint32_t g = ((*pixels) >> 8) & 0xFF;
-				uint32_t b = ((*pixels) >> 16) & 0xFF;
-
-				Cube* closestColorCube = cube;
-				int32_t diffR = cube->color[RED] - r;
-				int32_t diffG = cube->color[GREEN] - g;
-				int32_t diffB = cube->color[BLUE] - b;
-				uint32_t closestDifference = diffR * diffR + diffG * diffG + diffB * diffB;
-				Cube* lastCube = cube + cubeNum;
-
-				for (Cube* testCube = cube; testCube != lastCube; ++testCube) {
-					diffR = testCube->color[RED] - r;
-					diffG = testCube->color[GREEN] - g;
-					diffB = testCube->color[BLUE] - b;
-					uint32_t difference = diffR * diffR + diffG * diffG + diffB * diffB;
-
-					if (difference < closestDifference) {
-						closestDifference = difference;
-						closestColorCube = testCube;
-					}
-				}
+void BaseGifEncoder::reduceColor(PaletteLookupTable* table, Cube* cubes, uint32_t cubeNum, uint32_t* pixels,
+		uint8_t* indices, uint32_t* colorReducedPixels, uint32_t threadNum)
+{
+	table->build(cubes, cubeNum);
+	threadNum = MAX(1, MIN(threadNum, (uint32_t)height));
+	if (1 < threadNum) {
+		// Threads share the table read-only, fill the cells this frame needs up front
+		table->fillCells(pixels, width * height);
+	}
 
-				uint32_t closestColor = closestColorCube - cube;
-				cube = &cubes[closestColor];
-				*pixelOut = closestColor;
-				*colorReducedPixelOut = (0xFF000000 | (cube->color[BLUE] << 16) | (cube->color[GREEN] << 8) | cube->color[RED]);
-				if (useDither) {
-					diffR = r - (uint32_t)cube->color[RED];
-					diffG = g - (uint32_t)cube->color[GREEN];
-					diffB = b - (uint32_t)cube->color[BLUE];
-					for (int directionId = 0; directionId < ERROR_PROPAGATION_DIRECTION_NUM; ++directionId) {
-						uint32_t* pixel = pixels + ERROR_PROPAGATION_DIRECTION_X[directionId] + ERROR_PROPAGATION_DIRECTION_Y[directionId] * width;
-						if (x + ERROR_PROPAGATION_DIRECTION_X[directionId] >= width ||
-							y + ERROR_PROPAGATION_DIRECTION_Y[directionId] >= height || 0 == (*pixels >> 24)) {
-								continue;
-						}
-						int32_t weight = ERROR_PROPAGATION_DIRECTION_WEIGHT[directionId];
-						int32_t dstR = ((int32_t)((*pixel) & 0xFF) + (diffR * weight + 8) / 16);
-						int32_t dstG = (((int32_t)((*pixel) >> 8) & 0xFF) + (diffG * weight + 8) / 16);
-						int32_t dstB = (((int32_t)((*pixel) >> 16) & 0xFF) + (diffB * weight + 8) / 16);
-						int32_t dstA = (int32_t)(*pixel >> 24);
-						int32_t newR = MIN(255, MAX(0, dstR));
-						int32_t newG = MIN(255, MAX(0, dstG));
-						int32_t newB = MIN(255, MAX(0, dstB));
-						*pixel = (dstA << 24) | (newB << 16) | (newG << 8) | newR;
-					}
-				}
-			}
-			++pixels;
-			++pixelOut;
-			++colorReducedPixelOut;
+	// Floyd-Steinberg rows wait for the row above to be a few pixels ahead
+	bool wavefront = DITHER_FLOYD_STEINBERG == ditherMode && 1 < threadNum;
+	vector<atomic<uint32_t> > progress(wavefront ? height : 0);
+	atomic<uint32_t> nextRow(0);
+	WorkerPool::shared().parallelFor(threadNum, [&](uint32_t) {
+		ColorReduceKernel kernel = getColorReduceKernel();
+		ColorReduceRow row;
+		row.table = table;
+		row.fillCells = 1 == threadNum;
+		row.ditherMode = ditherMode;
+		row.width = width;
+		// Rows are taken in order, so the row above is always being reduced already and never
+		// waits for this one
+		for (uint32_t y = nextRow.fetch_add(1); y < height; y = nextRow.fetch_add(1)) {
+			row.y = y;
+			row.pixels = pixels + y * width;
+			row.nextPixels = y + 1 < height ? row.pixels + width : NULL;
+			row.indexOut = indices + y * width;
+			row.colorOut = NULL != colorReducedPixels ? colorReducedPixels + y * width : NULL;
+			row.aboveProgress = wavefront && 0 < y ? &progress[y - 1] : NULL;
+			row.progress = wavefront ? &progress[y] : NULL;
+			kernel(row);
 		}
+	});
+}
+
+void BaseGifEncoder::reduceColor(PaletteLookupTable* table, Cube* cubes, uint32_t cubeNum, const uint16_t* pixels,
+		uint32_t* scratch, uint8_t* indices, uint32_t* colorReducedPixels, uint32_t threadNum)
+{
+	uint32_t pixelNum = width * height;
+	if (DITHER_NONE != ditherMode) {
+		convertRgb565ToRgba(pixels, 0, scratch, 0, width, height);
+		reduceColor(table, cubes, cubeNum, scratch, indices, colorReducedPixels, threadNum);
+		return;
+	}
+
+	threadNum = MAX(1, MIN(threadNum, (uint32_t)height));
+	if (1 == threadNum) {
+		rgb565Table.map(pixels, pixelNum, indices, colorReducedPixels);
+		return;
 	}
+	const Rgb565PaletteTable* lut = &rgb565Table;
+	WorkerPool::shared().parallelFor(0, pixelNum, threadNum, [=](uint32_t, uint32_t begin, uint32_t end) {
+		lut->map(pixels + begin, end - begin, indices + begin, NULL != colorReducedPixels ? colorReducedPixels + begin : NULL);
+	});
 }
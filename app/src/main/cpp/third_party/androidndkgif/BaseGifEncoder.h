@@ -1,5 +1,12 @@
 #pragma once
 
+#include "ColorHistogram.h"
+#include "ColorReduceKernels.h"
+#include "GifOutput.h"
+#include "LzwEncoder.h"
+#include "PaletteLookupTable.h"
+#include "Rgb565PaletteTable.h"
+
 struct EncodeRect {
 	int32_t x;
 	int32_t y;
@@ -38,25 +45,53 @@ protected:
 	int32_t frameNum;
 	uint32_t* lastColorReducedPixels;
 	uint32_t lastRootColor;
-	bool useDither;
+	DitherMode ditherMode;
 	uint32_t* lastPixels;
+	ColorHistogram colorHistogram;
+	PaletteLookupTable paletteLookupTable;
+	Rgb565PaletteTable rgb565Table;
+	LzwEncoder lzwEncoder;
 
-	FILE* fp;
+	// Where the GIF goes between init() and release(), fileOutput when given a file name
+	GifOutput* output;
+	FileGifOutput fileOutput;
 
-	void qsortColorHistogram(uint32_t* imageColorHistogram, int32_t maxColor, uint32_t from, uint32_t to);
-	void updateColorHistogram(Cube* nextCube, Cube* maxCube, int32_t maxColor, uint32_t* imageColorHistogram);
+	void updateCubeRange(Cube* cube, const std::vector<ColorHistogram::Entry>& entries);
+	void splitCube(Cube* nextCube, Cube* maxCube, int32_t maxColor, std::vector<ColorHistogram::Entry>& entries);
 	void computeColorTable(uint32_t* pixels, Cube* cubes, uint32_t pixelNum);
+	void computeColorTable(const uint16_t* pixels, Cube* cubes, uint32_t pixelNum);
+	// Median cut of whatever colorHistogram holds
+	void computeColorTable(Cube* cubes);
 	void reduceColor(Cube* cubes, uint32_t cubeNum, uint32_t* pixels);
+	// Only touches its arguments, frames can be reduced on several threads with a table each.
+	// With threadNum above 1 rows are also split between WorkerPool threads sharing the table, and
+	// indices must not overlap pixels.
+	void reduceColor(PaletteLookupTable* table, Cube* cubes, uint32_t cubeNum, uint32_t* pixels,
+			uint8_t* indices, uint32_t* colorReducedPixels, uint32_t threadNum);
+	// RGB565 frames. Without dither every index is a load from rgb565Table, which must already be
+	// built for cubes and is shared read-only. Dither needs 8 bit channels, the frame is then expanded
+	// into scratch and reduced like any other.
+	void reduceColor(PaletteLookupTable* table, Cube* cubes, uint32_t cubeNum, const uint16_t* pixels,
+			uint32_t* scratch, uint8_t* indices, uint32_t* colorReducedPixels, uint32_t threadNum);
 public:
 	BaseGifEncoder();
 	virtual ~BaseGifEncoder() {}
 
-	virtual bool init(uint16_t width, uint16_t height, const char* fileName) = 0;
+	// Writes to a file, replaced if it exists
+	bool init(uint16_t width, uint16_t height, const char* fileName);
+	// output must stay valid until release(), which writes the last byte and closes it
+	virtual bool init(uint16_t width, uint16_t height, GifOutput* output) = 0;
 	virtual void release() = 0;
+	// Floyd-Steinberg when true
 	virtual void setDither(bool useDither) = 0;
+	void setDitherMode(DitherMode ditherMode);
 	virtual uint16_t getWidth() = 0;
 	virtual uint16_t getHeight() = 0;
 	virtual void setThreadCount(int32_t threadCount) = 0;
+	// Encodes each frame as this many strips in parallel, at a small cost in file size
+	virtual void setLzwStripCount(int32_t stripCount) = 0;
 
 	virtual void encodeFrame(uint32_t* pixels, int32_t delayMs) = 0;
+	// RGB565 frames are opaque and never changed
+	virtual void encodeFrame(const uint16_t* pixels, int32_t delayMs) = 0;
 };
\ No newline at end of file
@@ -1,60 +1,78 @@
 #include "BitWritingBlock.h"
-#include <memory>
+#include <string.h>
 
 using namespace std;
 
 BitWritingBlock::BitWritingBlock()
 {
-	currnet = new uint8_t[BLOCK_SIZE];
-	memset(currnet, 0, BLOCK_SIZE);
-	datas.push_back(currnet);
-	pos = 0;
-	remain = 8;
+	byteNum = 0;
+	accumulator = 0;
+	bitCount = 0;
 }
 
-BitWritingBlock::~BitWritingBlock()
+void BitWritingBlock::flushWord()
 {
-	for (list<uint8_t*>::iterator i = datas.begin(); i != datas.end(); ++i) {
-		delete[] (*i);
+	if (byteNum + 4 > bytes.size()) {
+		bytes.resize(bytes.empty() ? 256 : bytes.size() * 2);
 	}
+	uint8_t* out = &bytes[byteNum];
+	out[0] = accumulator;
+	out[1] = accumulator >> 8;
+	out[2] = accumulator >> 16;
+	out[3] = accumulator >> 24;
+	byteNum += 4;
+	accumulator >>= 32;
+	bitCount -= 32;
 }
 
-void BitWritingBlock::writeBits(uint32_t src, int32_t bitNum)
+void BitWritingBlock::writeByte(uint8_t b)
 {
-	while (0 < bitNum) {
-		if (remain <= bitNum) {
-			currnet[pos] = currnet[pos] | (src << (8 - remain));
-			src >>= remain;
-			bitNum -= remain;
-			remain = 8;
-			++pos;
-			if (pos == BLOCK_SIZE) {
-				currnet = new uint8_t[BLOCK_SIZE];
-				memset(currnet, 0, BLOCK_SIZE);
-				datas.push_back(currnet);
-				pos = 0;
+	writeBits(b, 8);
+}
+
+void BitWritingBlock::append(const BitWritingBlock& other)
+{
+	const uint8_t* in = other.bytes.empty() ? NULL : &other.bytes[0];
+	if (0 == bitCount) {
+		// Nothing pending, the words copy over as they are
+		if (0 < other.byteNum) {
+			if (byteNum + other.byteNum > bytes.size()) {
+				bytes.resize(byteNum + other.byteNum);
 			}
-		} else {
-			currnet[pos] = (currnet[pos] << bitNum) | (((1 << bitNum) - 1) & src);
-			remain -= bitNum;
-			bitNum = 0;
+			memcpy(&bytes[byteNum], in, other.byteNum);
+			byteNum += other.byteNum;
+		}
+	} else {
+		for (size_t i = 0; i < other.byteNum; i += 4) {
+			writeBits(in[i] | (in[i + 1] << 8) | (in[i + 2] << 16) | ((uint32_t)in[i + 3] << 24), 32);
 		}
 	}
+	writeBits((uint32_t)other.accumulator, other.bitCount);
 }
 
-void BitWritingBlock::writeByte(uint8_t b)
+void BitWritingBlock::appendSubBlocks(vector<uint8_t>& out) const
 {
-	writeBits(b, 8);
-}
+	uint8_t tail[8];
+	size_t tailNum = (bitCount + 8) / 8;
+	for (size_t i = 0; i < tailNum; ++i) {
+		tail[i] = accumulator >> (i * 8);
+	}
 
-bool BitWritingBlock::toFile(FILE* dst)
-{
-	uint8_t size;
-	for (list<uint8_t*>::iterator i = datas.begin(); i != datas.end(); ++i) {
-		uint8_t* block = (*i);
-		size = block == currnet ? (remain == 0 ? pos : pos + 1) : BLOCK_SIZE;
-		fwrite(&size, 1, 1, dst);
-		fwrite(block, size, 1, dst);
+	size_t total = byteNum + tailNum;
+	size_t begin = out.size();
+	out.resize(begin + total + (total + BLOCK_SIZE - 1) / BLOCK_SIZE);
+	uint8_t* dst = &out[begin];
+	for (size_t offset = 0; offset < total; offset += BLOCK_SIZE) {
+		size_t size = total - offset < BLOCK_SIZE ? total - offset : BLOCK_SIZE;
+		*dst++ = size;
+		// The block may run from the flushed words into the tail
+		size_t fromBytes = offset < byteNum ? (byteNum - offset < size ? byteNum - offset : size) : 0;
+		if (0 < fromBytes) {
+			memcpy(dst, &bytes[offset], fromBytes);
+		}
+		if (fromBytes < size) {
+			memcpy(dst + fromBytes, tail + (offset + fromBytes - byteNum), size - fromBytes);
+		}
+		dst += size;
 	}
-	return true;
 }
@@ -1,21 +1,38 @@
 #pragma once
 
-#include <list>
 #include <stdint.h>
-#include <stdio.h>
+#include <stddef.h>
+#include <vector>
 
+// Bits packed LSB first, the way GIF image data is. Codes gather in a 64 bit accumulator that is
+// flushed a 32 bit word at a time into one growing buffer, and the 255 byte sub-blocks are only
+// cut when the data is written out.
 class BitWritingBlock {
 	static const int32_t BLOCK_SIZE = 255;
 
-	std::list<uint8_t*> datas;
-	uint8_t* currnet;
-	int pos;
-	int remain;
+	std::vector<uint8_t> bytes; // Capacity, byteNum of it are written
+	size_t byteNum;
+	uint64_t accumulator;
+	uint32_t bitCount; // Bits in the accumulator, below 32 between calls
+
+	void flushWord();
 public:
 	BitWritingBlock();
-	~BitWritingBlock();
 
-	void writeBits(uint32_t src, int32_t bit);
+	// bitNum up to 32
+	inline void writeBits(uint32_t src, int32_t bitNum)
+	{
+		accumulator |= ((uint64_t)src & ((1ull << bitNum) - 1)) << bitCount;
+		bitCount += bitNum;
+		if (bitCount >= 32) {
+			flushWord();
+		}
+	}
 	void writeByte(uint8_t b);
-	bool toFile(FILE* dst);
+	// Appends the bits written to other, they need not end on a byte boundary
+	void append(const BitWritingBlock& other);
+	// Appends the size prefixed sub-blocks, without the block terminator. Like the block list this
+	// replaced, the last byte is always written even when no bits reach into it, which keeps files
+	// byte for byte the same.
+	void appendSubBlocks(std::vector<uint8_t>& out) const;
 };
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "ColorHistogram.h"
+#include "PixelConvert.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+// Below this many pixels per thread handing out the slices costs more than it saves
+static const uint32_t MIN_PIXELS_PER_THREAD = 32 * 1024;
+// RGB565 pixels expanded at once before counting
+static const uint32_t EXPAND_PIXELS = 1024;
+
+ColorHistogram::ColorHistogram()
+{
+	threadCount = 1;
+	usedHistograms = 0;
+}
+
+void ColorHistogram::setThreadCount(int32_t threadCount)
+{
+	if (threadCount < 1) {
+		threadCount = 1;
+	} else if (threadCount > MAX_THREADS) {
+		threadCount = MAX_THREADS;
+	}
+	this->threadCount = threadCount;
+	bins.clear();
+	usedHistograms = 0;
+}
+
+void ColorHistogram::clear()
+{
+	if (bins.size() != (size_t)threadCount * BIN_NUM) {
+		Bin empty = {};
+		bins.assign(threadCount * BIN_NUM, empty);
+	} else {
+		memset(&bins[0], 0, usedHistograms * BIN_NUM * sizeof(Bin));
+	}
+	usedHistograms = 0;
+}
+
+void ColorHistogram::count(Bin* histogram, const uint32_t* pixels, uint32_t pixelNum, uint32_t weight)
+{
+	const uint32_t lowMask = (1 << BIN_SHIFT) - 1;
+	const uint32_t* last = pixels + pixelNum;
+	for (; last != pixels; ++pixels) {
+		uint32_t pixel = *pixels;
+		Bin* bin = &histogram[binIndex(pixel)];
+		bin->count += weight;
+		bin->sum[0] += (pixel & lowMask) * weight;
+		bin->sum[1] += ((pixel >> 8) & lowMask) * weight;
+		bin->sum[2] += ((pixel >> 16) & lowMask) * weight;
+	}
+}
+
+void ColorHistogram::count(Bin* histogram, const uint16_t* pixels, uint32_t pixelNum, uint32_t weight)
+{
+	// Expanded a cache friendly piece at a time
+	uint32_t expanded[EXPAND_PIXELS];
+	void (*expand)(const uint16_t*, uint32_t*, uint32_t) = getPixelConvertKernels().rgb565ToRgba;
+	for (uint32_t begin = 0; begin < pixelNum; begin += EXPAND_PIXELS) {
+		uint32_t num = pixelNum - begin < EXPAND_PIXELS ? pixelNum - begin : EXPAND_PIXELS;
+		expand(pixels + begin, expanded, num);
+		count(histogram, expanded, num, weight);
+	}
+}
+
+void ColorHistogram::add(const uint32_t* pixels, uint32_t pixelNum, uint32_t weight)
+{
+	addPixels(pixels, pixelNum, weight);
+}
+
+void ColorHistogram::add(const uint16_t* pixels, uint32_t pixelNum, uint32_t weight)
+{
+	addPixels(pixels, pixelNum, weight);
+}
+
+void ColorHistogram::addCounts(const uint32_t* counts)
+{
+	if (bins.empty()) {
+		clear();
+	}
+
+	usedHistograms = 0 == usedHistograms ? 1 : usedHistograms;
+	Bin* histogram = &bins[0];
+	for (int32_t binId = 0; binId < BIN_NUM; ++binId, counts += COUNT_NUM) {
+		histogram[binId].count += counts[0];
+		histogram[binId].sum[0] += counts[1];
+		histogram[binId].sum[1] += counts[2];
+		histogram[binId].sum[2] += counts[3];
+	}
+}
+
+template <class Pixel>
+void ColorHistogram::addPixels(const Pixel* pixels, uint32_t pixelNum, uint32_t weight)
+{
+	if (bins.empty()) {
+		clear();
+	}
+
+	uint32_t jobNum = MIN_PIXELS_PER_THREAD > pixelNum ? 1 : pixelNum / MIN_PIXELS_PER_THREAD;
+	jobNum = (uint32_t)threadCount < jobNum ? threadCount : jobNum;
+	usedHistograms = (uint32_t)usedHistograms < jobNum ? jobNum : usedHistograms;
+	if (1 == jobNum) {
+		count(&bins[0], pixels, pixelNum, weight);
+		return;
+	}
+
+	// Each slice counts into a histogram of its own
+	Bin* histograms = &bins[0];
+	WorkerPool::shared().parallelFor(0, pixelNum, jobNum, [=](uint32_t slice, uint32_t begin, uint32_t end) {
+		count(histograms + slice * BIN_NUM, pixels + begin, end - begin, weight);
+	});
+}
+
+vector<ColorHistogram::Entry>& ColorHistogram::collectEntries()
+{
+	entries.clear();
+	if (0 == usedHistograms) {
+		return entries;
+	}
+
+	const uint32_t mask = (1 << BIN_BITS) - 1;
+	for (int32_t binId = 0; binId < BIN_NUM; ++binId) {
+		uint32_t count = 0;
+		uint32_t sum[3] = {0, 0, 0};
+		for (int32_t threadId = 0; threadId < usedHistograms; ++threadId) {
+			const Bin& bin = bins[threadId * BIN_NUM + binId];
+			count += bin.count;
+			sum[0] += bin.sum[0];
+			sum[1] += bin.sum[1];
+			sum[2] += bin.sum[2];
+		}
+		if (0 == count) {
+			continue;
+		}
+
+		Entry entry;
+		entry.color = 0;
+		entry.count = count;
+		for (int32_t c = 0; c < 3; ++c) {
+			uint32_t high = ((binId >> (c * BIN_BITS)) & mask) << BIN_SHIFT;
+			uint32_t low = (sum[c] + count / 2) / count;
+			entry.color |= (high + low) << (c * 8);
+		}
+		entries.push_back(entry);
+	}
+	return entries;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Color histogram for the median cut.
+// Colors are binned by the top BIN_BITS of each channel. Every bin also sums the low bits it dropped,
+// so the colors coming out are the mean of the pixels in the bin and not the bin's corner.
+// Pixels are counted on up to MAX_THREADS threads of the WorkerPool, each into its own histogram,
+// and merged by collectEntries(). The alpha channel is ignored like the median cut always did.
+class ColorHistogram
+{
+public:
+	static const int32_t BIN_BITS = 5;
+	static const int32_t BIN_SHIFT = 8 - BIN_BITS;
+	static const int32_t BIN_NUM = 1 << (BIN_BITS * 3);
+	static const int32_t MAX_THREADS = 8;
+	static const int32_t COUNT_NUM = 4;
+
+	// A non-empty bin, color is 0x00BBGGRR
+	struct Entry
+	{
+		uint32_t color;
+		uint32_t count;
+	};
+
+	ColorHistogram();
+
+	// Drops everything counted so far
+	void setThreadCount(int32_t threadCount);
+	void clear();
+
+	// Counts the pixels weight times each, on top of the ones already added since clear()
+	void add(const uint32_t* pixels, uint32_t pixelNum, uint32_t weight = 1);
+	// RGB565 pixels, counted as the colors they expand to
+	void add(const uint16_t* pixels, uint32_t pixelNum, uint32_t weight = 1);
+	// Pixels counted elsewhere, on the GPU: BIN_NUM bins of COUNT_NUM, the pixel count then the sums
+	// of the low bits R, G and B dropped, in that order
+	void addCounts(const uint32_t* counts);
+
+	// Merges the thread histograms, the entries are in no particular order and the caller may reorder
+	// them. Valid until the next call.
+	std::vector<Entry>& collectEntries();
+
+	static inline uint32_t binIndex(uint32_t pixel)
+	{
+		const uint32_t mask = (1 << BIN_BITS) - 1;
+		return ((pixel >> BIN_SHIFT) & mask) | ((pixel >> (BIN_SHIFT * 2)) & (mask << BIN_BITS)) | ((pixel >> (BIN_SHIFT * 3)) & (mask << (BIN_BITS * 2)));
+	}
+
+private:
+	// sum adds up the low BIN_SHIFT bits of R, G and B, good for 600M pixels in a single bin
+	struct Bin
+	{
+		uint32_t count;
+		uint32_t sum[3];
+	};
+
+	int32_t threadCount;
+	int32_t usedHistograms; // the ones holding anything since clear()
+	std::vector<Bin> bins; // threadCount histograms back to back
+	std::vector<Entry> entries;
+
+	template <class Pixel>
+	void addPixels(const Pixel* pixels, uint32_t pixelNum, uint32_t weight);
+	static void count(Bin* histogram, const uint32_t* pixels, uint32_t pixelNum, uint32_t weight);
+	static void count(Bin* histogram, const uint16_t* pixels, uint32_t pixelNum, uint32_t weight);
+};
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "ColorReduceKernels.h"
+#include "ColorReduceKernelsImpl.h"
+
+#ifdef COLOR_REDUCE_X86_KERNELS
+void colorReduceRowSse4(const ColorReduceRow& row);
+void colorReduceRowAvx2(const ColorReduceRow& row);
+#endif
+#ifdef __aarch64__
+void colorReduceRowNeon(const ColorReduceRow& row);
+#endif
+
+static void colorReduceRowScalar(const ColorReduceRow& row)
+{
+	reduceRow<ScalarOps>(row);
+}
+
+ColorReduceKernel getColorReduceKernel(ColorReduceKernelType type)
+{
+	switch (type) {
+	case COLOR_REDUCE_SCALAR:
+		return colorReduceRowScalar;
+#ifdef COLOR_REDUCE_X86_KERNELS
+	case COLOR_REDUCE_SSE4:
+		return __builtin_cpu_supports("sse4.1") ? colorReduceRowSse4 : NULL;
+	case COLOR_REDUCE_AVX2:
+		return __builtin_cpu_supports("avx2") ? colorReduceRowAvx2 : NULL;
+#endif
+#ifdef __aarch64__
+	case COLOR_REDUCE_NEON:
+		// Advanced SIMD is mandatory on arm64
+		return colorReduceRowNeon;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+static ColorReduceKernel pickColorReduceKernel()
+{
+	const ColorReduceKernelType preferred[] = {COLOR_REDUCE_AVX2, COLOR_REDUCE_NEON, COLOR_REDUCE_SSE4, COLOR_REDUCE_SCALAR};
+	for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); ++i) {
+		ColorReduceKernel kernel = getColorReduceKernel(preferred[i]);
+		if (NULL != kernel) {
+			return kernel;
+		}
+	}
+	return colorReduceRowScalar;
+}
+
+ColorReduceKernel getColorReduceKernel()
+{
+	static ColorReduceKernel kernel = pickColorReduceKernel();
+	return kernel;
+}
+
+const char* getColorReduceKernelName(ColorReduceKernelType type)
+{
+	const char* names[] = {"scalar", "sse4", "avx2", "neon"};
+	return type < COLOR_REDUCE_KERNEL_MAX ? names[type] : "unknown";
+}
+
+const char* getDitherModeName(DitherMode mode)
+{
+	const char* names[] = {"none", "floyd-steinberg", "bayer", "blue noise"};
+	return mode < DITHER_MODE_MAX ? names[mode] : "unknown";
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "PaletteLookupTable.h"
+
+enum DitherMode
+{
+	DITHER_NONE = 0,
+	// Error diffusion, each row takes the error of the row above. Rows on several threads follow
+	// each other a few pixels apart, with the same result as on one.
+	DITHER_FLOYD_STEINBERG,
+	// Thresholds added to each pixel on its own before the lookup, see OrderedDither.h
+	DITHER_BAYER,
+	DITHER_BLUE_NOISE,
+	DITHER_MODE_MAX
+};
+
+const char* getDitherModeName(DitherMode mode);
+
+// Maps one row of RGBA pixels to palette indices, with optional dithering.
+// Every kernel gives the same result as the scalar one, they only differ in speed.
+struct ColorReduceRow
+{
+	ColorReduceRow() : table(NULL), fillCells(false), ditherMode(DITHER_NONE), width(0), y(0),
+			pixels(NULL), nextPixels(NULL), indexOut(NULL), colorOut(NULL), aboveProgress(NULL), progress(NULL) {}
+
+	PaletteLookupTable* table;
+	// Fill empty cells on the way, only allowed when the table is not shared with other threads
+	bool fillCells;
+	DitherMode ditherMode;
+	uint32_t width;
+	// Row of the frame, picks the ordered dither thresholds
+	uint32_t y;
+
+	// Dithered in place
+	uint32_t* pixels;
+	// Receives the error from pixels, NULL for the last row
+	uint32_t* nextPixels;
+	// Palette index of each pixel, 255 for transparent pixels. NULL to only dither the row.
+	uint8_t* indexOut;
+	// Palette color of each pixel, 0 for transparent pixels. May be NULL.
+	uint32_t* colorOut;
+
+	// Floyd-Steinberg rows reduced at the same time: how many pixels of this row the row above is
+	// done with, NULL when it is done with all of them
+	const std::atomic<uint32_t>* aboveProgress;
+	// Receives how many pixels of nextPixels this row is done with. May be NULL.
+	std::atomic<uint32_t>* progress;
+};
+
+typedef void (*ColorReduceKernel)(const ColorReduceRow& row);
+
+enum ColorReduceKernelType
+{
+	COLOR_REDUCE_SCALAR = 0,
+	COLOR_REDUCE_SSE4,
+	COLOR_REDUCE_AVX2,
+	COLOR_REDUCE_NEON,
+	COLOR_REDUCE_KERNEL_MAX
+};
+
+// The fastest kernel the CPU supports, picked once
+ColorReduceKernel getColorReduceKernel();
+
+// NULL if the kernel was not built for this architecture or the CPU does not support it
+ColorReduceKernel getColorReduceKernel(ColorReduceKernelType type);
+const char* getColorReduceKernelName(ColorReduceKernelType type);
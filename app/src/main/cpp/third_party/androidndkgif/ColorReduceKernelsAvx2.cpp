@@ -0,0 +1,10 @@
+#include "ColorReduceKernelsX86.h"
+
+#ifdef COLOR_REDUCE_X86_KERNELS
+
+void colorReduceRowAvx2(const ColorReduceRow& row)
+{
+	reduceRow<Avx2Ops>(row);
+}
+
+#endif
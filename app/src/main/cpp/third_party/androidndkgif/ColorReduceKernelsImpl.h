@@ -0,0 +1,247 @@
+#pragma once
+
+// Shared by the ColorReduceKernels*.cpp files only. Each of them is built with different
+// instruction set flags, so everything here has internal linkage to keep the linker from
+// mixing up their copies.
+
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "ColorReduceKernels.h"
+#include "OrderedDither.h"
+
+namespace {
+
+const int32_t ERROR_PROPAGATION_DIRECTION_NUM = 4;
+// Right, bottom left, bottom, bottom right
+const int32_t ERROR_PROPAGATION_DIRECTION_WEIGHT[] = {7, 3, 5, 1};
+
+inline uint32_t cellOf(uint32_t rgb)
+{
+	const uint32_t shift = PaletteLookupTable::CELL_SHIFT;
+	const uint32_t bits = PaletteLookupTable::CELL_BITS;
+	uint32_t r = (rgb & 0xFF) >> shift;
+	uint32_t g = ((rgb >> 8) & 0xFF) >> shift;
+	uint32_t b = ((rgb >> 16) & 0xFF) >> shift;
+	return (r << (bits * 2)) | (g << bits) | b;
+}
+
+// Ops provides:
+//   Pixel load(uint32_t rgba), uint32_t store(const Pixel&)   pixels as the Ops like to work on them
+//   Spread spread(uint32_t rgb, uint32_t color)   the error of each direction, (diff * weight + 8) / 16
+//   Pixel diffuse(const Pixel&, const Spread&, int32_t directionId)   add it, clamping to 0..255
+//   uint32_t search(const uint8_t* indices, const uint32_t* colors, uint32_t count, uint32_t rgb)
+template <class Ops>
+inline uint32_t findColor(const ColorReduceRow& row, PaletteLookupTable::View& view, uint32_t rgb)
+{
+	uint32_t cellId = cellOf(rgb);
+	uint32_t cell = view.cells[cellId];
+	if (PaletteLookupTable::EMPTY_CELL == cell && row.fillCells) {
+		row.table->fillCell(cellId);
+		view = row.table->getView();
+		cell = view.cells[cellId];
+	}
+
+	if (PaletteLookupTable::EMPTY_CELL == cell) {
+		return Ops::search(view.palette, view.paletteColors, view.paletteCount, rgb);
+	}
+	uint32_t offset = cell >> 8;
+	return Ops::search(view.candidates + offset, view.candidateColors + offset, (cell & 0xFF) + 1, rgb);
+}
+
+template <class Ops>
+inline void writeColor(const ColorReduceRow& row, uint32_t x, uint32_t index, uint32_t color)
+{
+	if (NULL != row.indexOut) {
+		row.indexOut[x] = index;
+	}
+	if (NULL != row.colorOut) {
+		row.colorOut[x] = color;
+	}
+}
+
+// Adds the thresholds to the row in place. Plain byte arithmetic on whole tiles, so each file's
+// copy is vectorized for its instruction set.
+inline void addOrderedDither(const ColorReduceRow& row)
+{
+	const int8_t* offsets = getOrderedDitherRow(row.ditherMode, row.y);
+	uint8_t* bytes = (uint8_t*)row.pixels;
+	const uint32_t tileBytes = ORDERED_DITHER_SIZE * 4;
+	uint32_t byteNum = row.width * 4;
+	for (uint32_t begin = 0; begin < byteNum; begin += tileBytes) {
+		uint8_t* tile = bytes + begin;
+		uint32_t count = byteNum - begin < tileBytes ? byteNum - begin : tileBytes;
+		for (uint32_t i = 0; i < count; ++i) {
+			int32_t value = tile[i] + offsets[i];
+			tile[i] = value < 0 ? 0 : (value > 255 ? 255 : value);
+		}
+	}
+}
+
+// Returns how many pixels of the row the row above is done with, once that is at least needed
+inline uint32_t waitForRowAbove(const ColorReduceRow& row, uint32_t needed)
+{
+	if (NULL == row.aboveProgress) {
+		return row.width;
+	}
+	uint32_t done = row.aboveProgress->load(std::memory_order_acquire);
+	for (uint32_t spins = 0; done < needed; ++spins) {
+		// The row above may be on a thread that is not running
+		if (spins >= 64) {
+			sched_yield();
+		}
+		done = row.aboveProgress->load(std::memory_order_acquire);
+	}
+	return done;
+}
+
+template <class Ops>
+void reduceRow(const ColorReduceRow& row)
+{
+	PaletteLookupTable::View view = row.table->getView();
+	uint32_t width = row.width;
+	uint32_t* pixels = row.pixels;
+	uint32_t* nextPixels = row.nextPixels;
+
+	if (DITHER_FLOYD_STEINBERG != row.ditherMode) {
+		if (DITHER_NONE != row.ditherMode) {
+			addOrderedDither(row);
+		}
+		for (uint32_t x = 0; x < width; ++x) {
+			uint32_t pixel = pixels[x];
+			if (0 == (pixel >> 24)) {
+				writeColor<Ops>(row, x, 255, 0); // transparent color
+				continue;
+			}
+			uint32_t index = findColor<Ops>(row, view, pixel & 0xFFFFFF);
+			writeColor<Ops>(row, x, index, 0xFF000000 | view.paletteColors[index]);
+		}
+		return;
+	}
+
+	// The pixel being mapped and its three neighbours below stay in registers, each pixel is
+	// loaded and stored once no matter how much error it receives. A pixel is only loaded once
+	// the row above is done with it, and handed to the row below once this row is.
+	uint32_t ready = waitForRowAbove(row, 1);
+	typename Ops::Pixel current = Ops::load(pixels[0]);
+	typename Ops::Pixel belowLeft = current;
+	typename Ops::Pixel below = NULL != nextPixels ? Ops::load(nextPixels[0]) : current;
+	typename Ops::Pixel belowRight = below;
+
+	for (uint32_t x = 0; x < width; ++x) {
+		bool hasRight = x + 1 < width;
+		if (hasRight && x + 1 >= ready) {
+			ready = waitForRowAbove(row, x + 2);
+		}
+		typename Ops::Pixel right = hasRight ? Ops::load(pixels[x + 1]) : current;
+		if (NULL != nextPixels && hasRight) {
+			belowRight = Ops::load(nextPixels[x + 1]);
+		}
+
+		uint32_t pixel = Ops::store(current);
+		pixels[x] = pixel;
+		if (0 == (pixel >> 24)) {
+			writeColor<Ops>(row, x, 255, 0); // transparent color
+		} else {
+			uint32_t rgb = pixel & 0xFFFFFF;
+			uint32_t index = findColor<Ops>(row, view, rgb);
+			uint32_t color = view.paletteColors[index];
+			writeColor<Ops>(row, x, index, 0xFF000000 | color);
+
+			typename Ops::Spread spread = Ops::spread(rgb, color);
+			if (hasRight) {
+				right = Ops::diffuse(right, spread, 0);
+			}
+			if (NULL != nextPixels) {
+				if (x > 0) {
+					belowLeft = Ops::diffuse(belowLeft, spread, 1);
+				}
+				below = Ops::diffuse(below, spread, 2);
+				if (hasRight) {
+					belowRight = Ops::diffuse(belowRight, spread, 3);
+				}
+			}
+		}
+
+		// Nothing else reaches the pixel below left of the next one
+		if (NULL != nextPixels && x > 0) {
+			nextPixels[x - 1] = Ops::store(belowLeft);
+			if (NULL != row.progress && 0 == (x & 15)) {
+				row.progress->store(x, std::memory_order_release);
+			}
+		}
+		current = right;
+		belowLeft = below;
+		below = belowRight;
+	}
+	if (NULL != nextPixels) {
+		nextPixels[width - 1] = Ops::store(belowLeft);
+	}
+	if (NULL != row.progress) {
+		row.progress->store(width, std::memory_order_release);
+	}
+}
+
+struct ScalarOps
+{
+	struct Spread
+	{
+		int32_t error[ERROR_PROPAGATION_DIRECTION_NUM][3];
+	};
+
+	static inline Spread spread(uint32_t rgb, uint32_t color)
+	{
+		Spread spread;
+		for (int32_t c = 0; c < 3; ++c) {
+			int32_t diff = (int32_t)((rgb >> (c * 8)) & 0xFF) - (int32_t)((color >> (c * 8)) & 0xFF);
+			for (int32_t directionId = 0; directionId < ERROR_PROPAGATION_DIRECTION_NUM; ++directionId) {
+				spread.error[directionId][c] = (diff * ERROR_PROPAGATION_DIRECTION_WEIGHT[directionId] + 8) / 16;
+			}
+		}
+		return spread;
+	}
+
+	typedef uint32_t Pixel;
+
+	static inline Pixel load(uint32_t pixel)
+	{
+		return pixel;
+	}
+
+	static inline uint32_t store(Pixel pixel)
+	{
+		return pixel;
+	}
+
+	static inline Pixel diffuse(Pixel pixel, const Spread& spread, int32_t directionId)
+	{
+		uint32_t result = pixel & 0xFF000000;
+		for (int32_t c = 0; c < 3; ++c) {
+			int32_t value = (int32_t)((pixel >> (c * 8)) & 0xFF) + spread.error[directionId][c];
+			value = value < 0 ? 0 : (value > 255 ? 255 : value);
+			result |= value << (c * 8);
+		}
+		return result;
+	}
+
+	static inline uint32_t search(const uint8_t* indices, const uint32_t* colors, uint32_t count, uint32_t rgb)
+	{
+		int32_t r = rgb & 0xFF;
+		int32_t g = (rgb >> 8) & 0xFF;
+		int32_t b = (rgb >> 16) & 0xFF;
+
+		// Difference in the high bits and index in the low 8 bits, so the minimum is also the lowest index on a tie
+		uint32_t closest = 0xFFFFFFFF;
+		for (uint32_t i = 0; i < count; ++i) {
+			int32_t diffR = (int32_t)(colors[i] & 0xFF) - r;
+			int32_t diffG = (int32_t)((colors[i] >> 8) & 0xFF) - g;
+			int32_t diffB = (int32_t)((colors[i] >> 16) & 0xFF) - b;
+			uint32_t key = ((uint32_t)(diffR * diffR + diffG * diffG + diffB * diffB) << 8) | indices[i];
+			closest = key < closest ? key : closest;
+		}
+		return closest & 0xFF;
+	}
+};
+
+} // namespace
@@ -0,0 +1,83 @@
+#include "ColorReduceKernelsImpl.h"
+
+#ifdef __aarch64__
+
+#include <string.h>
+#include <arm_neon.h>
+
+namespace {
+
+// Channels are spread over the four 32-bit lanes (R, G, B, A), alpha always stays 0
+struct NeonOps
+{
+	struct Spread
+	{
+		int32x4_t error[ERROR_PROPAGATION_DIRECTION_NUM];
+	};
+
+	static inline int32x4_t unpack(uint32_t pixel)
+	{
+		uint16x8_t wide = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(pixel)));
+		return vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(wide)));
+	}
+
+	static inline Spread spread(uint32_t rgb, uint32_t color)
+	{
+		Spread spread;
+		int32x4_t diff = vsubq_s32(unpack(rgb), unpack(color));
+		for (int32_t directionId = 0; directionId < ERROR_PROPAGATION_DIRECTION_NUM; ++directionId) {
+			int32x4_t error = vmlaq_n_s32(vdupq_n_s32(8), diff, ERROR_PROPAGATION_DIRECTION_WEIGHT[directionId]);
+			// Round towards zero like the scalar division, add 15 to negative values before shifting
+			int32x4_t bias = vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(error, 31)), 28));
+			spread.error[directionId] = vshrq_n_s32(vaddq_s32(error, bias), 4);
+		}
+		return spread;
+	}
+
+	typedef int32x4_t Pixel;
+
+	static inline Pixel load(uint32_t pixel)
+	{
+		return unpack(pixel);
+	}
+
+	static inline uint32_t store(Pixel pixel)
+	{
+		uint16x4_t narrow = vqmovun_s32(pixel);
+		uint8x8_t bytes = vqmovn_u16(vcombine_u16(narrow, narrow));
+		return vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+	}
+
+	static inline Pixel diffuse(Pixel pixel, const Spread& spread, int32_t directionId)
+	{
+		int32x4_t value = vaddq_s32(pixel, spread.error[directionId]);
+		return vminq_s32(vmaxq_s32(value, vdupq_n_s32(0)), vdupq_n_s32(255));
+	}
+
+	static inline uint32_t search(const uint8_t* indices, const uint32_t* colors, uint32_t count, uint32_t rgb)
+	{
+		uint8x16_t target = vreinterpretq_u8_u32(vdupq_n_u32(rgb));
+		uint32x4_t closest = vdupq_n_u32(0xFFFFFFFF);
+		for (uint32_t i = 0; i < count; i += 4) {
+			uint8x16_t diff = vabdq_u8(vreinterpretq_u8_u32(vld1q_u32(colors + i)), target);
+			uint32x4_t low = vpaddlq_u16(vmull_u8(vget_low_u8(diff), vget_low_u8(diff)));
+			uint32x4_t high = vpaddlq_u16(vmull_high_u8(diff, diff));
+			uint32x4_t distances = vpaddq_u32(low, high);
+
+			uint32_t packedIndices;
+			memcpy(&packedIndices, indices + i, sizeof(packedIndices));
+			uint32x4_t keys = vorrq_u32(vshlq_n_u32(distances, 8), vreinterpretq_u32_s32(unpack(packedIndices)));
+			closest = vminq_u32(closest, keys);
+		}
+		return vminvq_u32(closest) & 0xFF;
+	}
+};
+
+} // namespace
+
+void colorReduceRowNeon(const ColorReduceRow& row)
+{
+	reduceRow<NeonOps>(row);
+}
+
+#endif
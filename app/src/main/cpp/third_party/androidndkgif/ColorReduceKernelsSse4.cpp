@@ -0,0 +1,10 @@
+#include "ColorReduceKernelsX86.h"
+
+#ifdef COLOR_REDUCE_X86_KERNELS
+
+void colorReduceRowSse4(const ColorReduceRow& row)
+{
+	reduceRow<Sse4Ops>(row);
+}
+
+#endif
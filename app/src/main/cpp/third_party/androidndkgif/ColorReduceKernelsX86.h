@@ -0,0 +1,125 @@
+#pragma once
+
+// SSE4.1 and AVX2 ops for ColorReduceKernelsImpl.h. The build defines COLOR_REDUCE_X86_KERNELS on x86
+// and builds the files including this with -msse4.1 or -mavx2.
+
+#include "ColorReduceKernelsImpl.h"
+
+#ifdef COLOR_REDUCE_X86_KERNELS
+
+#include <string.h>
+#include <immintrin.h>
+
+namespace {
+
+// Channels are spread over the four 32-bit lanes (R, G, B, A), alpha always stays 0
+struct Sse4Ops
+{
+	struct Spread
+	{
+		__m128i error[ERROR_PROPAGATION_DIRECTION_NUM];
+	};
+
+	static inline __m128i unpack(uint32_t pixel)
+	{
+		return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(pixel));
+	}
+
+	// Round towards zero like the scalar division, add 15 to negative values before shifting
+	static inline __m128i divide16(__m128i value)
+	{
+		value = _mm_add_epi32(value, _mm_set1_epi32(8));
+		value = _mm_add_epi32(value, _mm_and_si128(_mm_srai_epi32(value, 31), _mm_set1_epi32(15)));
+		return _mm_srai_epi32(value, 4);
+	}
+
+	// Weights 7, 3, 5 and 1 as shifts and adds, pmulld is slow
+	static inline Spread spread(uint32_t rgb, uint32_t color)
+	{
+		Spread spread;
+		__m128i diff = _mm_sub_epi32(unpack(rgb), unpack(color));
+		spread.error[0] = divide16(_mm_sub_epi32(_mm_slli_epi32(diff, 3), diff));
+		spread.error[1] = divide16(_mm_add_epi32(_mm_slli_epi32(diff, 1), diff));
+		spread.error[2] = divide16(_mm_add_epi32(_mm_slli_epi32(diff, 2), diff));
+		spread.error[3] = divide16(diff);
+		return spread;
+	}
+
+	typedef __m128i Pixel;
+
+	static inline Pixel load(uint32_t pixel)
+	{
+		return unpack(pixel);
+	}
+
+	static inline uint32_t store(Pixel pixel)
+	{
+		pixel = _mm_packus_epi32(pixel, pixel);
+		return _mm_cvtsi128_si32(_mm_packus_epi16(pixel, pixel));
+	}
+
+	static inline Pixel diffuse(Pixel pixel, const Spread& spread, int32_t directionId)
+	{
+		Pixel value = _mm_add_epi32(pixel, spread.error[directionId]);
+		return _mm_min_epi32(_mm_max_epi32(value, _mm_setzero_si128()), _mm_set1_epi32(255));
+	}
+
+	// Squared distance of 4 packed colors to rgb
+	static inline __m128i distance(__m128i colors, __m128i rgb)
+	{
+		__m128i diff = _mm_or_si128(_mm_subs_epu8(colors, rgb), _mm_subs_epu8(rgb, colors));
+		__m128i low = _mm_unpacklo_epi8(diff, _mm_setzero_si128());
+		__m128i high = _mm_unpackhi_epi8(diff, _mm_setzero_si128());
+		return _mm_hadd_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high));
+	}
+
+	static inline uint32_t minimum(__m128i keys)
+	{
+		keys = _mm_min_epu32(keys, _mm_shuffle_epi32(keys, _MM_SHUFFLE(1, 0, 3, 2)));
+		keys = _mm_min_epu32(keys, _mm_shuffle_epi32(keys, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtsi128_si32(keys);
+	}
+
+	static inline uint32_t search(const uint8_t* indices, const uint32_t* colors, uint32_t count, uint32_t rgb)
+	{
+		__m128i target = _mm_set1_epi32(rgb);
+		__m128i closest = _mm_set1_epi32(-1);
+		for (uint32_t i = 0; i < count; i += 4) {
+			uint32_t packedIndices;
+			memcpy(&packedIndices, indices + i, sizeof(packedIndices));
+			__m128i distances = distance(_mm_loadu_si128((const __m128i*)(colors + i)), target);
+			__m128i keys = _mm_or_si128(_mm_slli_epi32(distances, 8), unpack(packedIndices));
+			closest = _mm_min_epu32(closest, keys);
+		}
+		return minimum(closest) & 0xFF;
+	}
+};
+
+#ifdef __AVX2__
+
+// Candidate lists are padded to 8, so the search always takes whole 256-bit vectors
+struct Avx2Ops : public Sse4Ops
+{
+	static inline uint32_t search(const uint8_t* indices, const uint32_t* colors, uint32_t count, uint32_t rgb)
+	{
+		__m256i target = _mm256_set1_epi32(rgb);
+		__m256i closest = _mm256_set1_epi32(-1);
+		for (uint32_t i = 0; i < count; i += 8) {
+			__m256i candidates = _mm256_loadu_si256((const __m256i*)(colors + i));
+			__m256i diff = _mm256_or_si256(_mm256_subs_epu8(candidates, target), _mm256_subs_epu8(target, candidates));
+			// unpack works within 128-bit lanes, so the result is in order again after hadd
+			__m256i low = _mm256_unpacklo_epi8(diff, _mm256_setzero_si256());
+			__m256i high = _mm256_unpackhi_epi8(diff, _mm256_setzero_si256());
+			__m256i distances = _mm256_hadd_epi32(_mm256_madd_epi16(low, low), _mm256_madd_epi16(high, high));
+			__m256i keys = _mm256_or_si256(_mm256_slli_epi32(distances, 8), _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(indices + i))));
+			closest = _mm256_min_epu32(closest, keys);
+		}
+		return minimum(_mm_min_epu32(_mm256_castsi256_si128(closest), _mm256_extracti128_si256(closest, 1))) & 0xFF;
+	}
+};
+
+#endif
+
+} // namespace
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include "BaseGifEncoder.h"
+#include "FrameDelta.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define FRAME_DELTA_SIMD
+// movemask gives a bit per byte
+static const int32_t MASK_BITS_PER_BYTE = 1;
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define FRAME_DELTA_SIMD
+// Narrowing the compare result by 4 bits gives a nibble per byte
+static const int32_t MASK_BITS_PER_BYTE = 4;
+#endif
+
+static const int32_t VECTOR_SIZE = 16;
+
+#ifdef FRAME_DELTA_SIMD
+
+// Non-zero bits for the bytes that differ among the 16 at a and b
+static inline uint64_t differences(const uint8_t* a, const uint8_t* b)
+{
+#if defined(__SSE2__)
+	__m128i same = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+	return ~_mm_movemask_epi8(same) & 0xFFFF;
+#else
+	uint8x16_t same = vceqq_u8(vld1q_u8(a), vld1q_u8(b));
+	uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(same), 4);
+	return ~vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+#endif
+}
+
+#endif
+
+// First x from begin where the rows differ, end if they don't
+static inline int32_t firstDifference(const uint8_t* a, const uint8_t* b, int32_t begin, int32_t end)
+{
+	int32_t x = begin;
+#ifdef FRAME_DELTA_SIMD
+	for (; x + VECTOR_SIZE <= end; x += VECTOR_SIZE) {
+		uint64_t mask = differences(a + x, b + x);
+		if (0 != mask) {
+			return x + __builtin_ctzll(mask) / MASK_BITS_PER_BYTE;
+		}
+	}
+#endif
+	for (; x < end; ++x) {
+		if (a[x] != b[x]) {
+			return x;
+		}
+	}
+	return end;
+}
+
+// Last x before end where the rows differ, begin - 1 if they don't
+static inline int32_t lastDifference(const uint8_t* a, const uint8_t* b, int32_t begin, int32_t end)
+{
+	int32_t x = end;
+#ifdef FRAME_DELTA_SIMD
+	for (; x - VECTOR_SIZE >= begin; x -= VECTOR_SIZE) {
+		uint64_t mask = differences(a + x - VECTOR_SIZE, b + x - VECTOR_SIZE);
+		if (0 != mask) {
+			return x - VECTOR_SIZE + (63 - __builtin_clzll(mask)) / MASK_BITS_PER_BYTE;
+		}
+	}
+#endif
+	for (; x > begin; --x) {
+		if (a[x - 1] != b[x - 1]) {
+			return x - 1;
+		}
+	}
+	return begin - 1;
+}
+
+bool findChangedRect(const uint8_t* previous, const uint8_t* current, uint16_t width, uint16_t height, EncodeRect* rect)
+{
+	int32_t left = width;
+	int32_t right = -1;
+	int32_t top = -1;
+	int32_t bottom = -1;
+	for (int32_t y = 0; y < height; ++y) {
+		const uint8_t* previousRow = previous + y * width;
+		const uint8_t* currentRow = current + y * width;
+		int32_t first = firstDifference(previousRow, currentRow, 0, width);
+		if (width == first) {
+			continue;
+		}
+		if (0 > top) {
+			top = y;
+		}
+		bottom = y;
+		left = MIN(left, first);
+		// Each byte is read once, the backward scan stops where the forward one or the rect ends
+		right = MAX(right, lastDifference(previousRow, currentRow, MAX(first, right + 1), width));
+	}
+	if (0 > top) {
+		return false;
+	}
+
+	rect->x = left;
+	rect->y = top;
+	rect->width = right - left + 1;
+	rect->height = bottom - top + 1;
+	return true;
+}
+
+void maskUnchangedPixels(const uint8_t* previous, const uint8_t* current, uint16_t width, const EncodeRect& rect,
+		uint8_t transparentIndex, uint8_t* out)
+{
+	for (int32_t y = 0; y < rect.height; ++y) {
+		const uint8_t* previousRow = previous + (rect.y + y) * width + rect.x;
+		const uint8_t* currentRow = current + (rect.y + y) * width + rect.x;
+		uint8_t* outRow = out + y * rect.width;
+		int32_t x = 0;
+#if defined(__SSE2__)
+		__m128i transparent = _mm_set1_epi8(transparentIndex);
+		for (; x + VECTOR_SIZE <= rect.width; x += VECTOR_SIZE) {
+			__m128i pixels = _mm_loadu_si128((const __m128i*)(currentRow + x));
+			__m128i same = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(previousRow + x)), pixels);
+			_mm_storeu_si128((__m128i*)(outRow + x), _mm_or_si128(_mm_and_si128(same, transparent), _mm_andnot_si128(same, pixels)));
+		}
+#elif defined(__aarch64__)
+		uint8x16_t transparent = vdupq_n_u8(transparentIndex);
+		for (; x + VECTOR_SIZE <= rect.width; x += VECTOR_SIZE) {
+			uint8x16_t pixels = vld1q_u8(currentRow + x);
+			vst1q_u8(outRow + x, vbslq_u8(vceqq_u8(vld1q_u8(previousRow + x), pixels), transparent, pixels));
+		}
+#endif
+		for (; x < rect.width; ++x) {
+			outRow[x] = previousRow[x] == currentRow[x] ? transparentIndex : currentRow[x];
+		}
+	}
+}
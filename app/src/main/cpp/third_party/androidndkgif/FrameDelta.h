@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include "BaseGifEncoder.h"
+
+// Inter-frame differences of palette index frames, width bytes per row. Rows are compared 16 bytes
+// at a time with SSE2 or Advanced SIMD where the target has them.
+
+// Smallest rect holding every pixel that differs between the frames. False if the frames are the
+// same, rect is then left alone.
+bool findChangedRect(const uint8_t* previous, const uint8_t* current, uint16_t width, uint16_t height, EncodeRect* rect);
+
+// Copies rect of current to out, rect.width bytes per row, with the pixels previous already shows
+// replaced by transparentIndex
+void maskUnchangedPixels(const uint8_t* previous, const uint8_t* current, uint16_t width, const EncodeRect& rect,
+		uint8_t transparentIndex, uint8_t* out);
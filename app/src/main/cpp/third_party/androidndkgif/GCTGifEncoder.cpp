@@ -1,10 +1,14 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <pthread.h>
+#include <map>
 #include <vector>
 #include "BaseGifEncoder.h"
 #include "GCTGifEncoder.h"
 #include "BitWritingBlock.h"
+#include "FrameDelta.h"
+#include "WorkerPool.h"
 
 using namespace std;
 
@@ -13,26 +17,35 @@ GCTGifEncoder::GCTGifEncoder() {
 	width = 1;
 	height = 1;
 
-	useDither = true;
+	ditherMode = DITHER_FLOYD_STEINBERG;
 	frameNum = 0;
 	lastPixels = NULL;
 	lastColorReducedPixels = NULL;
-	fp = NULL;
+	output = NULL;
 	lastRootColor = GREEN;
+	threadCount = 1;
+	useFrameDelta = true;
+	frameWrittenCallback = NULL;
+	frameWrittenUserData = NULL;
+	streamPaletteFrames = 0;
+	streamStarted = false;
+	streamStopped = false;
+	streamReduced = 0;
+	streamWritten = 0;
 }
 
 GCTGifEncoder::~GCTGifEncoder() {
 	release();
 }
 
-bool GCTGifEncoder::init(uint16_t width, uint16_t height, const char* fileName) {
+bool GCTGifEncoder::init(uint16_t width, uint16_t height, GifOutput* output) {
+	if (NULL == output) {
+		return false;
+	}
 	this->width = width;
 	this->height = height;
+	this->output = output;
 
-	fp = fopen(fileName, "wb");
-	if (NULL == fp) {
-		return false;
-	}
 	if (NULL != lastPixels) {
 		delete[] lastPixels;
 	}
@@ -46,30 +59,39 @@ bool GCTGifEncoder::init(uint16_t width, uint16_t height, const char* fileName)
 }
 
 void GCTGifEncoder::release() {
-	Cube cubes[256] = {0, };
-	buildColorTable(cubes);
-	writeHeader(cubes);
-
-	for (std::vector<FrameInfo*>::iterator i = images.begin(); i != images.end(); ++i) {
-		uint32_t pixelNum = width * height;
-		uint32_t* pixels = (*i)->pixels;
-		EncodeRect imageRect;
-		imageRect.x = 0;
-		imageRect.y = 0;
-		imageRect.width = width;
-		imageRect.height = height;
-
-		memcpy(lastPixels, pixels, pixelNum * sizeof(uint32_t));
-
-		reduceColor(cubes, 255, pixels);
-		writeContents((uint8_t*)pixels, (*i)->delayMs / 10, imageRect);
-
-		++frameNum;
+	// Already released (the destructor calls release() again)
+	if (NULL == output) {
+		images.clear();
+		playback.clear();
+		return;
+	}
 
-		delete (*i)->pixels;
-		delete (*i);
+	if (0 != streamPaletteFrames) {
+		// Fewer frames than the palette was to be built from
+		if (!streamStarted) {
+			streamFrames(images.size());
+		}
+		// The last frame is shown before the first one again
+		for (uint32_t i = streamWritten; i < playback.size() && !streamStopped; ++i) {
+			streamShow(i);
+		}
+		for (map<pair<int32_t, uint32_t>, ImagePart>::iterator i = streamParts.begin(); i != streamParts.end(); ++i) {
+			delete i->second.imageData;
+		}
+		streamParts.clear();
+		streamStarted = false;
+		streamStopped = false;
+		streamReduced = 0;
+		streamWritten = 0;
+	} else {
+		Cube cubes[256] = {};
+		buildColorTable(cubes);
+		writeHeader(cubes);
+
+		encodeFrames(cubes);
 	}
 	images.clear();
+	playback.clear();
 
 	if (NULL != lastPixels) {
 		delete[] lastPixels;
@@ -81,16 +103,16 @@ void GCTGifEncoder::release() {
 		lastColorReducedPixels = NULL;
 	}
 
-	if (NULL != fp) {
+	if (NULL != output) {
 		uint8_t gifFileTerminator = 0x3B;
-		fwrite(&gifFileTerminator, 1, 1, fp);
-		fclose(fp);
-		fp = NULL;
+		output->write(&gifFileTerminator, 1);
+		output->close();
+		output = NULL;
 	}
 }
 
 void GCTGifEncoder::setDither(bool useDither) {
-	this->useDither = useDither;
+	ditherMode = useDither ? DITHER_FLOYD_STEINBERG : DITHER_NONE;
 }
 
 uint16_t GCTGifEncoder::getWidth() {
@@ -101,74 +123,389 @@ uint16_t GCTGifEncoder::getHeight() {
 	return height;
 }
 
-void GCTGifEncoder::setThreadCount(int32_t threadCount) { }
+void GCTGifEncoder::setThreadCount(int32_t threadCount) {
+	this->threadCount = threadCount < 1 ? 1 : (threadCount > MAX_THREADS ? MAX_THREADS : threadCount);
+	colorHistogram.setThreadCount(threadCount);
+}
+
+void GCTGifEncoder::setLzwStripCount(int32_t stripCount) {
+	lzwEncoder.setStripCount(stripCount);
+}
+
+void GCTGifEncoder::setFrameDelta(bool useFrameDelta) {
+	this->useFrameDelta = useFrameDelta;
+}
+
+void GCTGifEncoder::setFrameWrittenCallback(FrameWrittenCallback callback, void* userData) {
+	frameWrittenCallback = callback;
+	frameWrittenUserData = userData;
+}
+
+void GCTGifEncoder::setStreaming(uint32_t paletteFrames) {
+	streamPaletteFrames = paletteFrames;
+}
+
+void GCTGifEncoder::prepareShow(uint32_t frameIndex, uint32_t afterFrameIndex) {
+	if (0 != streamPaletteFrames && streamStarted && !streamStopped && MAX(frameIndex, afterFrameIndex) < images.size()) {
+		streamPart(afterFrameIndex, frameIndex);
+	}
+}
+
+uint32_t GCTGifEncoder::getStreamPalette(uint32_t colors[256]) {
+	if (!streamStarted) {
+		return 0;
+	}
+	// The last entry is left for transparent pixels
+	for (uint32_t i = 0; i < 255; ++i) {
+		colors[i] = 0xFF000000 | streamCubes[i].color[RED] | (streamCubes[i].color[GREEN] << 8) | (streamCubes[i].color[BLUE] << 16);
+	}
+	return 255;
+}
+
+void GCTGifEncoder::setColorCounts(const uint32_t* counts) {
+	if (NULL == counts) {
+		colorCounts.clear();
+	} else {
+		colorCounts.assign(counts, counts + ColorHistogram::BIN_NUM * ColorHistogram::COUNT_NUM);
+	}
+}
+
+void GCTGifEncoder::countColors(uint32_t frameNum, bool byShowCount) {
+	colorHistogram.clear();
+	if (!colorCounts.empty()) {
+		colorHistogram.addCounts(&colorCounts[0]);
+		return;
+	}
+
+	// One histogram over every frame, nothing is copied
+	for (uint32_t i = 0; i < frameNum; ++i) {
+		const FrameInfo& frame = images[i];
+		uint32_t weight = byShowCount ? frame.showCount : 1;
+		if (0 == weight) {
+			continue;
+		}
+		if (NULL != frame.rgb565Pixels) {
+			colorHistogram.add(frame.rgb565Pixels, width * height, weight);
+		} else {
+			colorHistogram.add(frame.pixels, width * height, weight);
+		}
+	}
+}
 
 void GCTGifEncoder::buildColorTable(Cube cubes[256]) {
-	uint32_t pixelNum = width * height * images.size();
-	uint32_t* allPixels = new uint32_t[pixelNum];
+	// Frames count as often as they are shown
+	countColors(images.size(), true);
+	computeColorTable(cubes);
+}
+
+EncodeRect GCTGifEncoder::getImageRect()
+{
+	EncodeRect imageRect;
+	imageRect.x = 0;
+	imageRect.y = 0;
+	imageRect.width = width;
+	imageRect.height = height;
+	return imageRect;
+}
+
+static bool hasTransparentPixels(const FrameInfo& frame, uint32_t pixelNum)
+{
+	// RGB565 has no alpha
+	const uint32_t* pixels = frame.pixels;
+	if (NULL == pixels) {
+		return false;
+	}
+	for (uint32_t i = 0; i < pixelNum; ++i) {
+		if (0 == (pixels[i] >> 24)) {
+			return true;
+		}
+	}
+	return false;
+}
 
-	int32_t idx = 0;
-	for (std::vector<FrameInfo*>::iterator i = images.begin(); i != images.end(); ++i, ++idx) {
-		memcpy(allPixels + width * height * idx, (*i)->pixels, width * height * sizeof(allPixels[0]));
+void GCTGifEncoder::planImageParts(FrameEncodeJob* job)
+{
+	if (useFrameDelta) {
+		for (std::vector<FrameInfo>::iterator i = images.begin(); i != images.end(); ++i) {
+			i->hasTransparency = 0 != i->showCount && hasTransparentPixels(*i, width * height);
+		}
 	}
 
-	computeColorTable(allPixels, cubes, pixelNum);
+	// A frame shown again after the same frame reuses the part encoded the first time
+	map<pair<int32_t, uint32_t>, uint32_t> partIds;
+	for (uint32_t i = 0; i < playback.size(); ++i) {
+		uint32_t frame = playback[i].frameIndex;
+		int32_t previous = 0 == i ? -1 : playback[i - 1].frameIndex;
+		uint32_t next = playback[(i + 1) % playback.size()].frameIndex;
+		// Transparent pixels have to show the background, so the frame before clears the whole screen
+		if (!useFrameDelta || images[frame].hasTransparency || images[next].hasTransparency) {
+			previous = -1;
+		}
 
-	delete[] allPixels;
+		pair<int32_t, uint32_t> key(previous, frame);
+		map<pair<int32_t, uint32_t>, uint32_t>::iterator found = partIds.find(key);
+		if (partIds.end() == found) {
+			ImagePart part;
+			part.frameIndex = frame;
+			part.previousFrameIndex = previous;
+			part.rect = getImageRect();
+			part.imageData = NULL;
+			found = partIds.insert(make_pair(key, (uint32_t)job->parts.size())).first;
+			job->parts.push_back(part);
+		}
+		job->parts[found->second].lastShow = i;
+		job->showParts.push_back(found->second);
+	}
 }
 
-void GCTGifEncoder::removeSamePixels(uint8_t* src1, uint8_t* src2, EncodeRect* rect)
+void GCTGifEncoder::reduceFrame(FrameInfo* frame, Cube* cubes, uint32_t* pixels, PaletteLookupTable* table, uint32_t threadNum)
 {
-	int32_t bytesPerLine = width * 4;
-	int32_t beginY = 0;
-	for (; beginY < height - 1; ++beginY) {
-		if (0 != memcmp(src1 + bytesPerLine * beginY, src2 + bytesPerLine * beginY, bytesPerLine)) {
-			break;
+	if (NULL != frame->paletteIndices) {
+		frame->indices.assign(frame->paletteIndices, frame->paletteIndices + width * height);
+		return;
+	}
+	frame->indices.resize(width * height);
+	if (NULL != frame->rgb565Pixels) {
+		reduceColor(table, cubes, 255, frame->rgb565Pixels, pixels, &frame->indices[0], NULL, threadNum);
+		return;
+	}
+	// Frames are borrowed from the caller, color reduce a copy
+	memcpy(pixels, frame->pixels, width * height * sizeof(uint32_t));
+	reduceColor(table, cubes, 255, pixels, &frame->indices[0], NULL, threadNum);
+}
+
+BitWritingBlock* GCTGifEncoder::encodeImagePart(ImagePart* part, uint8_t* pixels, LzwDictionary* dictionary)
+{
+	const uint8_t* current = &images[part->frameIndex].indices[0];
+	EncodeRect encodingRect = getImageRect();
+	uint16_t stride = width;
+	if (0 <= part->previousFrameIndex) {
+		const uint8_t* previous = &images[part->previousFrameIndex].indices[0];
+		if (!findChangedRect(previous, current, width, height, &part->rect)) {
+			// Nothing changed, a single transparent pixel still shows the frame for its delay
+			part->rect.width = 1;
+			part->rect.height = 1;
 		}
+		maskUnchangedPixels(previous, current, width, part->rect, 255, pixels);
+		current = pixels;
+		stride = part->rect.width;
+		encodingRect.width = part->rect.width;
+		encodingRect.height = part->rect.height;
 	}
-	int32_t endY = height - 1;
-	for (; beginY + 1 <= endY; --endY) {
-		if (0 != memcmp(src1 + bytesPerLine * endY, src2 + bytesPerLine * endY, bytesPerLine)) {
-			break;
+
+	BitWritingBlock* imageData = new BitWritingBlock();
+	if (1 == threadCount || 0 != streamPaletteFrames) {
+		lzwEncoder.encode(current, stride, encodingRect, imageData);
+	} else {
+		// A single strip, so the file is the same whichever thread encodes the part
+		LzwEncoder::encodeStrip(current, stride, encodingRect, 0, encodingRect.height, true, true, dictionary, imageData);
+	}
+	return imageData;
+}
+
+bool GCTGifEncoder::runNextTask(FrameEncodeJob* job, uint32_t* pixels, PaletteLookupTable* table, LzwDictionary* dictionary)
+{
+	pthread_mutex_lock(&job->lock);
+	while (job->nextTask < images.size() && 0 == images[job->nextTask].showCount) {
+		++job->nextTask;
+	}
+	uint32_t task = job->nextTask;
+	if (task >= images.size() + job->parts.size()) {
+		pthread_mutex_unlock(&job->lock);
+		return false;
+	}
+	++job->nextTask;
+	ImagePart* part = NULL;
+	if (task >= images.size()) {
+		// Every frame is handed out before the first part, wait for the threads still reducing them
+		part = &job->parts[task - images.size()];
+		while (!job->reduced[part->frameIndex] || (0 <= part->previousFrameIndex && !job->reduced[part->previousFrameIndex])) {
+			pthread_cond_wait(&job->condition, &job->lock);
 		}
 	}
-	++endY;
+	pthread_mutex_unlock(&job->lock);
 
-	int32_t lastY = width * height;
-	bool isSame = true;
-	int32_t beginX = 0;
-	for (; beginX < width - 1 && isSame; ++beginX) {
-		isSame = true;
-		for (int32_t y = 0; y < lastY; y += width) {
-			if (((uint32_t*)src1)[y + beginX] != ((uint32_t*)src2)[y + beginX]) {
-				isSame = false;
+	BitWritingBlock* imageData = NULL;
+	if (NULL == part) {
+		reduceFrame(&images[task], job->cubes, pixels, table, 1);
+	} else {
+		imageData = encodeImagePart(part, (uint8_t*)pixels, dictionary);
+	}
+
+	pthread_mutex_lock(&job->lock);
+	if (NULL == part) {
+		job->reduced[task] = true;
+	} else {
+		part->imageData = imageData;
+	}
+	pthread_cond_broadcast(&job->condition);
+	pthread_mutex_unlock(&job->lock);
+	return true;
+}
+
+void GCTGifEncoder::frameWorker(FrameWorker* worker)
+{
+	while (worker->encoder->runNextTask(worker->job, worker->pixels, &worker->paletteLookupTable, &worker->lzwDictionary)) {
+	}
+}
+
+void GCTGifEncoder::encodeFrames(Cube* cubes)
+{
+	FrameEncodeJob job;
+	job.cubes = cubes;
+	job.nextTask = 0;
+	job.reduced.assign(images.size(), false);
+	planImageParts(&job);
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.condition, NULL);
+
+	// Every thread mapping RGB565 frames shares the one table
+	if (DITHER_NONE == ditherMode) {
+		for (std::vector<FrameInfo>::iterator i = images.begin(); i != images.end(); ++i) {
+			if (NULL != i->rgb565Pixels && 0 != i->showCount) {
+				rgb565Table.build(&paletteLookupTable, cubes, 255, threadCount);
 				break;
 			}
 		}
 	}
-	--beginX;
-	isSame = true;
-	int32_t endX = width - 1;
-	for (; beginX + 1 <= endX && isSame; --endX) {
-		isSame = true;
-		for (int32_t y = 0; y < lastY; y += width) {
-			if (((uint32_t*)src1)[y + endX] != ((uint32_t*)src2)[y + endX]) {
-				isSame = false;
-				break;
+
+	// Workers the pool does not get to before every task is handed out find nothing left to do
+	int32_t workerNum = MIN((int32_t)job.parts.size(), threadCount) - 1;
+	FrameWorker workers[MAX_THREADS];
+	WorkerPool::TaskGroup workerGroup;
+	for (int32_t i = 0; i < workerNum; ++i) {
+		workers[i].encoder = this;
+		workers[i].job = &job;
+		workers[i].pixels = new uint32_t[width * height];
+		FrameWorker* worker = &workers[i];
+		WorkerPool::shared().run(&workerGroup, [worker]() { frameWorker(worker); });
+	}
+
+	// Write the frames in playback order as they finish, encoding more here while the next one isn't ready
+	uint32_t written = 0;
+	for (uint32_t i = 0; i < playback.size(); ++i) {
+		ImagePart* part = &job.parts[job.showParts[i]];
+		pthread_mutex_lock(&job.lock);
+		while (NULL == part->imageData) {
+			if (job.nextTask < images.size() + job.parts.size()) {
+				pthread_mutex_unlock(&job.lock);
+				runNextTask(&job, lastPixels, &paletteLookupTable, &lzwDictionary);
+				pthread_mutex_lock(&job.lock);
+			} else {
+				pthread_cond_wait(&job.condition, &job.lock);
 			}
 		}
+		pthread_mutex_unlock(&job.lock);
+
+		// Leave the frame for the next one to draw over, unless that one has transparent pixels
+		uint32_t next = playback[(i + 1) % playback.size()].frameIndex;
+		uint8_t disposalMethod = useFrameDelta && !images[next].hasTransparency ? 1 : 2;
+		writeContents(*part->imageData, playback[i].delayMs / 10, disposalMethod, part->rect);
+		if (part->lastShow == i) {
+			delete part->imageData;
+		}
+		++frameNum;
+		written = i + 1;
+		if (NULL != frameWrittenCallback && !frameWrittenCallback(frameWrittenUserData, written, playback.size())) {
+			break;
+		}
+	}
+	if (written < playback.size()) {
+		// Stopped, hand out no more tasks
+		pthread_mutex_lock(&job.lock);
+		job.nextTask = images.size() + job.parts.size();
+		pthread_mutex_unlock(&job.lock);
+	}
+
+	WorkerPool::shared().wait(&workerGroup);
+	for (int32_t i = 0; i < workerNum; ++i) {
+		delete[] workers[i].pixels;
+	}
+	// Parts encoded for shows that were not written
+	for (std::vector<ImagePart>::iterator part = job.parts.begin(); part != job.parts.end(); ++part) {
+		if (part->lastShow >= written) {
+			delete part->imageData;
+		}
+	}
+	pthread_cond_destroy(&job.condition);
+	pthread_mutex_destroy(&job.lock);
+}
+
+void GCTGifEncoder::streamFrames(uint32_t paletteFrames)
+{
+	if (!streamStarted) {
+		if (images.size() < paletteFrames) {
+			return;
+		}
+		countColors(paletteFrames, false);
+		memset(streamCubes, 0, sizeof(streamCubes));
+		computeColorTable(streamCubes);
+		writeHeader(streamCubes);
+		streamStarted = true;
 	}
-	++endX;
 
-	rect->x = beginX;
-	rect->y = beginY;
-	rect->width = endX - beginX + 1;
-	rect->height = endY - beginY;
+	for (; streamReduced < images.size(); ++streamReduced) {
+		FrameInfo* frame = &images[streamReduced];
+		frame->hasTransparency = useFrameDelta && hasTransparentPixels(*frame, width * height);
+		if (NULL != frame->rgb565Pixels && DITHER_NONE == ditherMode) {
+			rgb565Table.build(&paletteLookupTable, streamCubes, 255, threadCount);
+		}
+		// Frames come one at a time, their rows are split between the threads instead
+		reduceFrame(frame, streamCubes, lastPixels, &paletteLookupTable, threadCount);
+	}
+
+	// Whether a frame is left on screen depends on the one after it, so the newest one waits
+	for (; streamWritten + 1 < playback.size() && !streamStopped; ) {
+		streamShow(streamWritten);
+	}
+	if (!streamStopped && streamWritten < playback.size()) {
+		// Encoded ahead, guessing the next frame has no transparent pixels
+		uint32_t show = playback.size() - 1;
+		streamPart(0 == show ? -1 : playback[show - 1].frameIndex, playback[show].frameIndex);
+	}
+}
+
+ImagePart* GCTGifEncoder::streamPart(int32_t previousFrameIndex, uint32_t frameIndex)
+{
+	if (!useFrameDelta || images[frameIndex].hasTransparency) {
+		previousFrameIndex = -1;
+	}
+	pair<int32_t, uint32_t> key(previousFrameIndex, frameIndex);
+	map<pair<int32_t, uint32_t>, ImagePart>::iterator found = streamParts.find(key);
+	if (streamParts.end() == found) {
+		ImagePart part;
+		part.frameIndex = frameIndex;
+		part.previousFrameIndex = previousFrameIndex;
+		part.lastShow = 0;
+		part.rect = getImageRect();
+		part.imageData = encodeImagePart(&part, (uint8_t*)lastPixels, &lzwDictionary);
+		found = streamParts.insert(make_pair(key, part)).first;
+	}
+	return &found->second;
+}
+
+void GCTGifEncoder::streamShow(uint32_t show)
+{
+	uint32_t frame = playback[show].frameIndex;
+	int32_t previous = 0 == show ? -1 : playback[show - 1].frameIndex;
+	uint32_t next = playback[(show + 1) % playback.size()].frameIndex;
+	// Same choices as planImageParts() and encodeFrames()
+	if (images[next].hasTransparency) {
+		previous = -1;
+	}
+	ImagePart* part = streamPart(previous, frame);
+	uint8_t disposalMethod = useFrameDelta && !images[next].hasTransparency ? 1 : 2;
+	writeContents(*part->imageData, playback[show].delayMs / 10, disposalMethod, part->rect);
+	++frameNum;
+	++streamWritten;
+	if (NULL != frameWrittenCallback && !frameWrittenCallback(frameWrittenUserData, streamWritten, playback.size())) {
+		streamStopped = true;
+	}
 }
 
 void GCTGifEncoder::writeHeader(Cube* cubes)
 {
-	fwrite("GIF89a", 6, 1, fp);
+	output->write("GIF89a", 6);
 	writeLSD();
 	writeGCT(cubes);
 }
@@ -176,8 +513,8 @@ void GCTGifEncoder::writeHeader(Cube* cubes)
 bool GCTGifEncoder::writeLSD()
 {
 	// logical screen size
-	fwrite(&width, 2, 1, fp);
-	fwrite(&height, 2, 1, fp);
+	output->write(&width, 2);
+	output->write(&height, 2);
 
 	// packed fields
 	uint8_t gctFlag = 1; // 1 : global color table flag
@@ -185,13 +522,13 @@ bool GCTGifEncoder::writeLSD()
 	uint8_t oderedFlag = 0;
 	uint8_t gctSize = 7;
 	uint8_t packed = (gctFlag << 7) | ((colorResolution - 1) << 4) | (oderedFlag << 3) | gctSize;
-	fwrite(&packed, 1, 1, fp);
+	output->write(&packed, 1);
 
 	uint8_t backgroundColorIndex = 0xFF;
-	fwrite(&backgroundColorIndex, 1, 1, fp);
+	output->write(&backgroundColorIndex, 1);
 
 	uint8_t aspectRatio = 0;
-	fwrite(&aspectRatio, 1, 1, fp);
+	output->write(&aspectRatio, 1);
 
 	return true;
 }
@@ -203,15 +540,15 @@ void GCTGifEncoder::writeGCT(Cube* cubes)  {
 		colorTable[idx][1] = cubes->color[1];
 		colorTable[idx][2] = cubes->color[2];
 	}
-	fwrite(colorTable, 256 * 3, 1, fp);
+	output->write(colorTable, 256 * 3);
 }
 
-bool GCTGifEncoder::writeContents(uint8_t* pixels, uint16_t delay, const EncodeRect& encodingRect)
+bool GCTGifEncoder::writeContents(BitWritingBlock& imageData, uint16_t delay, uint8_t disposalMethod, const EncodeRect& encodingRect)
 {
 	writeNetscapeExt();
 
-	writeGraphicControlExt(delay);
-	writeFrame(pixels, encodingRect);
+	writeGraphicControlExt(delay, disposalMethod);
+	writeFrame(imageData, encodingRect);
 
 	return true;
 }
@@ -220,27 +557,27 @@ bool GCTGifEncoder::writeNetscapeExt()
 {
 	//                                   code extCode,                                                            size,       loop count, end
 	const uint8_t netscapeExt[] = {0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00};
-	fwrite(netscapeExt, sizeof(netscapeExt), 1, fp);
+	output->write(netscapeExt, sizeof(netscapeExt));
 	return true;
 }
 
-bool GCTGifEncoder::writeGraphicControlExt(uint16_t delay)
+bool GCTGifEncoder::writeGraphicControlExt(uint16_t delay, uint8_t disposalMethod)
 {
-	uint8_t disposalMethod = 2; // dispose
+	// disposalMethod 1 : leave the frame in place, 2 : restore to background
 	uint8_t userInputFlag = 0; // User input is not expected.
 	uint8_t transparencyFlag = 1; // Transparent Index is given.
 
 	uint8_t packed = (disposalMethod << 2) | (userInputFlag << 1) | transparencyFlag;
 	//                                                     size, packed, delay(2), transIndex, terminator
 	const uint8_t graphicControlExt[] = {0x21, 0xF9, 0x04, packed, (uint8_t)(delay & 0xFF), (uint8_t)(delay >> 8), 0xFF, 0x00};
-	fwrite(graphicControlExt, sizeof(graphicControlExt), 1, fp);
+	output->write(graphicControlExt, sizeof(graphicControlExt));
 	return true;
 }
 
-bool GCTGifEncoder::writeFrame(uint8_t* pixels, const EncodeRect& encodingRect)
+bool GCTGifEncoder::writeFrame(BitWritingBlock& imageData, const EncodeRect& encodingRect)
 {
 	uint8_t code = 0x2C;
-	fwrite(&code, 1, 1, fp);
+	output->write(&code, 1);
 	uint16_t ix = encodingRect.x;
 	uint16_t iy = encodingRect.y;
 	uint16_t iw = encodingRect.width;
@@ -250,13 +587,13 @@ bool GCTGifEncoder::writeFrame(uint8_t* pixels, const EncodeRect& encodingRect)
 	uint8_t sortFlag = 0;
 	uint8_t sizeOfLocalColorTable = 7;
 	uint8_t packed = (localColorTableFlag << 7) | (interlaceFlag << 6) | (sortFlag << 5) | sizeOfLocalColorTable;
-	fwrite(&ix, 2, 1, fp);
-	fwrite(&iy, 2, 1, fp);
-	fwrite(&iw, 2, 1, fp);
-	fwrite(&ih, 2, 1, fp);
-	fwrite(&packed, 1, 1, fp);
+	output->write(&ix, 2);
+	output->write(&iy, 2);
+	output->write(&iw, 2);
+	output->write(&ih, 2);
+	output->write(&packed, 1);
 
-	writeBitmapData(pixels, encodingRect);
+	writeBitmapData(imageData);
 	return true;
 }
 
@@ -267,83 +604,65 @@ bool GCTGifEncoder::writeLCT(int32_t colorNum, Cube* cubes)
 	for (int32_t i = 0; i < colorNum; ++i) {
 		cube = cubes + i;
 		color = cube->color[RED] | (cube->color[GREEN] << 8) | (cube->color[BLUE] << 16);
-		fwrite(&color, 3, 1, fp);
+		output->write(&color, 3);
 	}
 	return true;
 }
 
-bool GCTGifEncoder::writeBitmapData(uint8_t* pixels, const EncodeRect& encodingRect)
+bool GCTGifEncoder::writeBitmapData(BitWritingBlock& imageData)
 {
-	uint32_t pixelNum = width * height;
-	uint8_t* endPixels = pixels + (encodingRect.y + encodingRect.height - 1) * width + encodingRect.x + encodingRect.width;
-	uint8_t dataSize = 8;
-	uint32_t codeSize = dataSize + 1;
-	uint32_t codeMask = (1 << codeSize) - 1;
-	BitWritingBlock writingBlock;
-	fwrite(&dataSize, 1, 1, fp);
-
-	vector<uint16_t> lzwInfoHolder;
-	lzwInfoHolder.resize(MAX_STACK_SIZE * BYTE_NUM);
-	uint16_t* lzwInfos = &lzwInfoHolder[0];
-
-	pixels = pixels + width * encodingRect.y + encodingRect.x;
-	uint8_t* rowStart = pixels;
-	uint32_t clearCode = 1 << dataSize;
-	writingBlock.writeBits(clearCode, codeSize);
-	uint32_t infoNum = clearCode + 2;
-	uint16_t current = *pixels;
-	uint8_t endOfImageData = 0;
-
-	++pixels;
-	if (encodingRect.width <= pixels - rowStart) {
-		rowStart = rowStart + width;
-		pixels = rowStart;
-	}
-
-	uint16_t* next;
-	while (endPixels > pixels) {
-		next = &lzwInfos[current * BYTE_NUM + *pixels];
-		if (0 == *next || *next >= MAX_STACK_SIZE) {
-			writingBlock.writeBits(current, codeSize);
-
-			*next = infoNum;
-			if (infoNum < MAX_STACK_SIZE) {
-				++infoNum;
-			} else {
-				writingBlock.writeBits(clearCode, codeSize);
-				infoNum = clearCode + 2;
-				codeSize = dataSize + 1;
-				codeMask = (1 << codeSize) - 1;
-				memset(lzwInfos, 0, MAX_STACK_SIZE * BYTE_NUM * sizeof(uint16_t));
-			}
-			if (codeMask < infoNum - 1 && infoNum < MAX_STACK_SIZE) {
-				++codeSize;
-				codeMask = (1 << codeSize) - 1;
-			}
-			if (endPixels <= pixels) {
-				break;
-			}
-			current = *pixels;
-		} else {
-			current = *next;
-		}
-		++pixels;
-		if (encodingRect.width <= pixels - rowStart) {
-			rowStart = rowStart + width;
-			pixels = rowStart;
-		}
-	}
-	writingBlock.writeBits(current, codeSize);
-	writingBlock.toFile(fp);
-	fwrite(&endOfImageData, 1, 1, fp);
-
-	return true;
+	return LzwEncoder::writeImageData(output, imageData);
 }
 
 void GCTGifEncoder::encodeFrame(uint32_t* pixels, int32_t delayMs) {
-	FrameInfo* frameInfo = new FrameInfo();
-	frameInfo->delayMs = delayMs;
-	frameInfo->pixels = new uint32_t[width * height];
-	memcpy(frameInfo->pixels, pixels, width * height * sizeof(uint32_t));
+	showFrame(addFrame(pixels), delayMs);
+}
+
+void GCTGifEncoder::encodeFrame(const uint16_t* pixels, int32_t delayMs) {
+	showFrame(addFrame(pixels), delayMs);
+}
+
+void GCTGifEncoder::encodeFrame(const uint8_t* paletteIndices, int32_t delayMs) {
+	showFrame(addFrame(paletteIndices), delayMs);
+}
+
+uint32_t GCTGifEncoder::addFrame(uint32_t* pixels) {
+	FrameInfo frameInfo;
+	frameInfo.pixels = pixels;
+	frameInfo.rgb565Pixels = NULL;
+	frameInfo.paletteIndices = NULL;
+	frameInfo.showCount = 0;
+	frameInfo.hasTransparency = false;
 	images.push_back(frameInfo);
+	return images.size() - 1;
+}
+
+uint32_t GCTGifEncoder::addFrame(const uint16_t* pixels) {
+	uint32_t frameIndex = addFrame((uint32_t*)NULL);
+	images[frameIndex].rgb565Pixels = pixels;
+	return frameIndex;
+}
+
+uint32_t GCTGifEncoder::addFrame(const uint8_t* paletteIndices) {
+	// Only the stream palette is known before release(), showFrame() ignores the index
+	if (!streamStarted) {
+		return images.size();
+	}
+	uint32_t frameIndex = addFrame((uint32_t*)NULL);
+	images[frameIndex].paletteIndices = paletteIndices;
+	return frameIndex;
+}
+
+void GCTGifEncoder::showFrame(uint32_t frameIndex, int32_t delayMs) {
+	if (frameIndex >= images.size()) {
+		return;
+	}
+	PlaybackFrame playbackFrame;
+	playbackFrame.frameIndex = frameIndex;
+	playbackFrame.delayMs = delayMs;
+	playback.push_back(playbackFrame);
+	++images[frameIndex].showCount;
+	if (0 != streamPaletteFrames) {
+		streamFrames(streamPaletteFrames);
+	}
 }
@@ -1,48 +1,166 @@
 
 #pragma once
 
+#include <pthread.h>
+#include <map>
+#include <utility>
 #include <vector>
 #include "BaseGifEncoder.h"
 
+class GCTGifEncoder;
+
+// Called after each frame is written with the number written so far, return false to stop writing
+typedef bool (*FrameWrittenCallback)(void* userData, uint32_t framesWritten, uint32_t frameCount);
+
 struct FrameInfo
 {
 	uint32_t* pixels;
+	const uint16_t* rgb565Pixels; // Instead of pixels for RGB565 frames
+	const uint8_t* paletteIndices; // Instead of pixels for frames already mapped to the stream palette
+	uint32_t showCount;
+	bool hasTransparency;
+	// Palette indices, filled in by release(), or as frames are added when streaming
+	std::vector<uint8_t> indices;
+};
+
+struct PlaybackFrame
+{
+	uint32_t frameIndex;
 	int32_t delayMs;
 };
 
+// Image data of a frame, either whole or only what changed since the frame shown before it
+struct ImagePart
+{
+	uint32_t frameIndex;
+	int32_t previousFrameIndex; // -1 for the whole frame
+	uint32_t lastShow;
+	EncodeRect rect;
+	BitWritingBlock* imageData; // NULL until the part is encoded
+};
+
+// Tasks handed out to the threads of GCTGifEncoder::encodeFrames: first every shown frame is color
+// reduced, then every part encoded
+struct FrameEncodeJob
+{
+	Cube* cubes;
+	pthread_mutex_t lock;
+	pthread_cond_t condition;
+	uint32_t nextTask;
+	std::vector<bool> reduced;
+	std::vector<ImagePart> parts;
+	std::vector<uint32_t> showParts; // Part of each playback frame
+};
+
+struct FrameWorker
+{
+	GCTGifEncoder* encoder;
+	FrameEncodeJob* job;
+	uint32_t* pixels;
+	PaletteLookupTable paletteLookupTable;
+	LzwDictionary lzwDictionary;
+};
+
 class GCTGifEncoder : public BaseGifEncoder
 {
-	static const int32_t MAX_STACK_SIZE = 4096;
-	static const int32_t BYTE_NUM = 256;
 	static const int R_RANGE = 6;
 	static const int G_RANGE = 7;
 	static const int B_RANGE = 6;
+	static const int32_t MAX_THREADS = 8;
 
+	int32_t threadCount;
+	bool useFrameDelta;
+	FrameWrittenCallback frameWrittenCallback;
+	void* frameWrittenUserData;
 	uint32_t* lastPixels;
-	std::vector<FrameInfo*> images;
+	LzwDictionary lzwDictionary; // The calling thread's, for the parts it encodes
+	std::vector<FrameInfo> images;
+	std::vector<PlaybackFrame> playback;
+	std::vector<uint32_t> colorCounts; // See setColorCounts(), empty to count the frames
+
+	// Streaming, see setStreaming()
+	uint32_t streamPaletteFrames; // 0 when not streaming
+	bool streamStarted; // Palette built and header written
+	bool streamStopped; // The frame written callback returned false
+	uint32_t streamReduced;
+	uint32_t streamWritten;
+	Cube streamCubes[256];
+	std::map<std::pair<int32_t, uint32_t>, ImagePart> streamParts;
 
 	void buildColorTable(Cube cubes[256]);
-	void removeSamePixels(uint8_t* src1, uint8_t* src2, EncodeRect* rect);
+	// The first frameNum frames, as often as they are shown or once each, or colorCounts when set
+	void countColors(uint32_t frameNum, bool byShowCount);
+	EncodeRect getImageRect();
+	// Every frame uses the same palette, so frames are encoded at once on threadCount threads, the
+	// calling one and WorkerPool ones
+	void encodeFrames(Cube* cubes);
+	void planImageParts(FrameEncodeJob* job);
+	void reduceFrame(FrameInfo* frame, Cube* cubes, uint32_t* pixels, PaletteLookupTable* table, uint32_t threadNum);
+	BitWritingBlock* encodeImagePart(ImagePart* part, uint8_t* pixels, LzwDictionary* dictionary);
+	bool runNextTask(FrameEncodeJob* job, uint32_t* pixels, PaletteLookupTable* table, LzwDictionary* dictionary);
+	static void frameWorker(FrameWorker* worker);
+	// Builds the palette once paletteFrames are added, then encodes and writes what it can
+	void streamFrames(uint32_t paletteFrames);
+	ImagePart* streamPart(int32_t previousFrameIndex, uint32_t frameIndex);
+	void streamShow(uint32_t show);
 
 	void writeHeader(Cube* cubes);
 	bool writeLSD();
 	void writeGCT(Cube* cubes);
-	bool writeContents(uint8_t* pixels, uint16_t delay, const EncodeRect& encodingRect);
+	bool writeContents(BitWritingBlock& imageData, uint16_t delay, uint8_t disposalMethod, const EncodeRect& encodingRect);
 	bool writeNetscapeExt();
-	bool writeGraphicControlExt(uint16_t delay);
-	bool writeFrame(uint8_t* pixels, const EncodeRect& encodingRect);
+	bool writeGraphicControlExt(uint16_t delay, uint8_t disposalMethod);
+	bool writeFrame(BitWritingBlock& imageData, const EncodeRect& encodingRect);
 	bool writeLCT(int32_t colorNum, Cube* cubes);
-	bool writeBitmapData(uint8_t* pixels, const EncodeRect& encodingRect);
+	bool writeBitmapData(BitWritingBlock& imageData);
 public:
 	GCTGifEncoder();
 	virtual ~GCTGifEncoder();
 
-	virtual bool init(uint16_t width, uint16_t height, const char* fileName);
+	using BaseGifEncoder::init;
+	virtual bool init(uint16_t width, uint16_t height, GifOutput* output);
 	virtual void release();
 	virtual void setDither(bool useDither);
 	virtual uint16_t getWidth();
 	virtual uint16_t getHeight();
+	// More than one thread encodes whole frames in parallel, LZW strips are then not used
 	virtual void setThreadCount(int32_t threadCount);
+	virtual void setLzwStripCount(int32_t stripCount);
+	// On by default. Frames after the first only hold the rect that changed, with the pixels that
+	// did not change transparent, and are left on screen for the next one to draw over. Frames with
+	// transparent pixels of their own are always whole.
+	void setFrameDelta(bool useFrameDelta);
+	// Called from release(), or from the call adding frames when streaming, where frameCount is the
+	// number shown so far. When it stops the writing the file is still a valid GIF, of the frames
+	// written so far.
+	void setFrameWrittenCallback(FrameWrittenCallback callback, void* userData);
+	// Off (0) by default. Set before the first frame: the palette is built from the first
+	// paletteFrames frames, and from then on frames are encoded on the calling thread as they are
+	// added, each written once the frame shown after it is known. release() is left with the last
+	// frame to write. Use setLzwStripCount() for threads.
+	void setStreaming(uint32_t paletteFrames);
+	// Encodes the frame ahead of being shown right after afterFrameIndex, when streaming
+	void prepareShow(uint32_t frameIndex, uint32_t afterFrameIndex);
+	// The palette streaming built from the first frames, as opaque 0xFFBBGGRR colors, so frames can
+	// be mapped to it elsewhere, on the GPU say. Returns the number of colors, 0 until it is built.
+	uint32_t getStreamPalette(uint32_t colors[256]);
+	// The palette is built from colors counted elsewhere, on the GPU say, instead of the pixels of
+	// the frames, in the layout of ColorHistogram::addCounts(). Set before the palette is built:
+	// before the last palette frame when streaming, before release() otherwise. NULL counts the
+	// frames again.
+	void setColorCounts(const uint32_t* counts);
 
+	// pixels is not copied and must stay valid and unchanged until release()
 	virtual void encodeFrame(uint32_t* pixels, int32_t delayMs);
+	virtual void encodeFrame(const uint16_t* pixels, int32_t delayMs);
+	// One index below getStreamPalette()'s color count per pixel, the way the palette frames would be
+	// reduced with the same dither mode. Ignored until the stream palette is built.
+	void encodeFrame(const uint8_t* paletteIndices, int32_t delayMs);
+
+	// The GIF is the playback sequence built by showFrame(). encodeFrame() adds a frame and shows it
+	// once, a frame shown again is only encoded the first time and then copied.
+	uint32_t addFrame(uint32_t* pixels);
+	uint32_t addFrame(const uint16_t* pixels);
+	uint32_t addFrame(const uint8_t* paletteIndices);
+	void showFrame(uint32_t frameIndex, int32_t delayMs);
 };
\ No newline at end of file
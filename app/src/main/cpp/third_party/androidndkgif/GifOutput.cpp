@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <string.h>
+#include "GifOutput.h"
+
+GifOutput::GifOutput()
+{
+	size = 0;
+	failed = false;
+}
+
+bool GifOutput::close()
+{
+	return !failed;
+}
+
+size_t GifOutput::getSize() const
+{
+	return size;
+}
+
+bool GifOutput::hasFailed() const
+{
+	return failed;
+}
+
+FileGifOutput::FileGifOutput()
+{
+	fp = NULL;
+	buffer = NULL;
+	bufferNum = 0;
+}
+
+FileGifOutput::~FileGifOutput()
+{
+	close();
+	delete[] buffer;
+}
+
+bool FileGifOutput::open(const char* fileName)
+{
+	close();
+	fp = fopen(fileName, "wb");
+	if (NULL == fp) {
+		return false;
+	}
+	if (NULL == buffer) {
+		buffer = new uint8_t[BUFFER_SIZE];
+	}
+	size = 0;
+	failed = false;
+	return true;
+}
+
+bool FileGifOutput::flush()
+{
+	if (0 < bufferNum && bufferNum != fwrite(buffer, 1, bufferNum, fp)) {
+		failed = true;
+	}
+	bufferNum = 0;
+	return !failed;
+}
+
+bool FileGifOutput::write(const void* data, size_t dataSize)
+{
+	if (NULL == fp) {
+		failed = true;
+		return false;
+	}
+	size += dataSize;
+	if (bufferNum + dataSize <= BUFFER_SIZE) {
+		memcpy(buffer + bufferNum, data, dataSize);
+		bufferNum += dataSize;
+		return true;
+	}
+	// Too big for what is left, large image data goes straight to the file
+	if (!flush()) {
+		return false;
+	}
+	if (dataSize < BUFFER_SIZE) {
+		memcpy(buffer, data, dataSize);
+		bufferNum = dataSize;
+		return true;
+	}
+	if (dataSize != fwrite(data, 1, dataSize, fp)) {
+		failed = true;
+	}
+	return !failed;
+}
+
+bool FileGifOutput::close()
+{
+	if (NULL != fp) {
+		flush();
+		if (0 != fclose(fp)) {
+			failed = true;
+		}
+		fp = NULL;
+	}
+	return !failed;
+}
+
+MemoryGifOutput::MemoryGifOutput(size_t initialCapacity)
+{
+	data = NULL;
+	capacity = 0;
+	if (0 < initialCapacity) {
+		data = (uint8_t*)malloc(initialCapacity);
+		capacity = NULL == data ? 0 : initialCapacity;
+	}
+}
+
+MemoryGifOutput::~MemoryGifOutput()
+{
+	free(data);
+}
+
+bool MemoryGifOutput::write(const void* src, size_t dataSize)
+{
+	if (size + dataSize > capacity) {
+		size_t newCapacity = 0 == capacity ? 64 * 1024 : capacity;
+		while (newCapacity < size + dataSize) {
+			newCapacity *= 2;
+		}
+		uint8_t* newData = (uint8_t*)realloc(data, newCapacity);
+		if (NULL == newData) {
+			failed = true;
+			return false;
+		}
+		data = newData;
+		capacity = newCapacity;
+	}
+	memcpy(data + size, src, dataSize);
+	size += dataSize;
+	return true;
+}
+
+const uint8_t* MemoryGifOutput::getData() const
+{
+	return data;
+}
+
+uint8_t* MemoryGifOutput::releaseData()
+{
+	uint8_t* released = data;
+	data = NULL;
+	capacity = 0;
+	size = 0;
+	return released;
+}
+
+BufferGifOutput::BufferGifOutput(uint8_t* buffer, size_t capacity)
+{
+	this->buffer = buffer;
+	this->capacity = capacity;
+}
+
+bool BufferGifOutput::write(const void* data, size_t dataSize)
+{
+	if (failed || size + dataSize > capacity) {
+		failed = true;
+		return false;
+	}
+	memcpy(buffer + size, data, dataSize);
+	size += dataSize;
+	return true;
+}
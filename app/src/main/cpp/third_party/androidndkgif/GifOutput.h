@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+// Where an encoder writes its GIF. The encoders write many headers of a few bytes each, so every
+// output takes small writes cheaply. A failed write is remembered, the encoders don't check each one.
+class GifOutput {
+protected:
+	size_t size;
+	bool failed;
+
+public:
+	GifOutput();
+	virtual ~GifOutput() {}
+
+	virtual bool write(const void* data, size_t dataSize) = 0;
+	// After the GIF terminator. False if anything could not be written.
+	virtual bool close();
+
+	// Bytes written so far
+	size_t getSize() const;
+	bool hasFailed() const;
+};
+
+// Collects writes in a buffer and hands them to fwrite in large pieces
+class FileGifOutput : public GifOutput {
+	static const size_t BUFFER_SIZE = 64 * 1024;
+
+	FILE* fp;
+	uint8_t* buffer;
+	size_t bufferNum;
+
+	bool flush();
+public:
+	FileGifOutput();
+	virtual ~FileGifOutput();
+
+	bool open(const char* fileName);
+	virtual bool write(const void* data, size_t dataSize);
+	virtual bool close();
+};
+
+// Grows as needed. The data is malloc()ed so it can be taken over with releaseData() and later
+// given to free() by whoever ends up with it, without another copy.
+class MemoryGifOutput : public GifOutput {
+	uint8_t* data;
+	size_t capacity;
+
+public:
+	// initialCapacity saves reallocations when the GIF's size is about known
+	MemoryGifOutput(size_t initialCapacity = 0);
+	virtual ~MemoryGifOutput();
+
+	virtual bool write(const void* src, size_t dataSize);
+
+	const uint8_t* getData() const;
+	// The caller owns the data from now on and frees it with free(). NULL if nothing was written.
+	uint8_t* releaseData();
+};
+
+// Writes into memory owned by the caller. Writes that don't fit fail, and leave what was written
+// before intact.
+class BufferGifOutput : public GifOutput {
+	uint8_t* buffer;
+	size_t capacity;
+
+public:
+	BufferGifOutput(uint8_t* buffer, size_t capacity);
+
+	virtual bool write(const void* data, size_t dataSize);
+};
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "BaseGifEncoder.h"
+#include "BitWritingBlock.h"
+#include "LzwEncoder.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+LzwDictionary::LzwDictionary()
+{
+}
+
+void LzwDictionary::clear()
+{
+	if (slots.empty()) {
+		slots.assign(SLOT_NUM, 0);
+		filled.reserve(LzwEncoder::MAX_STACK_SIZE);
+	}
+	for (vector<uint16_t>::iterator i = filled.begin(); i != filled.end(); ++i) {
+		slots[*i] = 0;
+	}
+	filled.clear();
+}
+
+uint32_t LzwDictionary::find(uint32_t prefix, uint32_t byte, uint32_t* slot) const
+{
+	uint32_t key = (prefix << 8) | byte;
+	// Fibonacci hashing, neighbouring keys land far apart
+	uint32_t i = (key * 2654435761u) >> (32 - SLOT_BITS);
+	while (0 != slots[i]) {
+		if (key == slots[i] >> 12) {
+			return slots[i] & 0xFFF;
+		}
+		i = (i + 1) & (SLOT_NUM - 1);
+	}
+	*slot = i;
+	return 0;
+}
+
+void LzwDictionary::add(uint32_t slot, uint32_t prefix, uint32_t byte, uint32_t code)
+{
+	slots[slot] = (((prefix << 8) | byte) << 12) | code;
+	filled.push_back(slot);
+}
+
+LzwEncoder::LzwEncoder()
+{
+	stripCount = 1;
+}
+
+void LzwEncoder::setStripCount(int32_t stripCount)
+{
+	if (stripCount < 1) {
+		stripCount = 1;
+	} else if (stripCount > MAX_STRIPS) {
+		stripCount = MAX_STRIPS;
+	}
+	this->stripCount = stripCount;
+}
+
+int32_t LzwEncoder::getStripCount()
+{
+	return stripCount;
+}
+
+void LzwEncoder::encodeStrip(const uint8_t* pixels, uint16_t width, const EncodeRect& encodingRect,
+		uint32_t beginY, uint32_t endY, bool isFirst, bool isLast, LzwDictionary* dictionary,
+		BitWritingBlock* writingBlock)
+{
+	const uint8_t* endPixels = pixels + (encodingRect.y + endY - 1) * width + encodingRect.x + encodingRect.width;
+	uint8_t dataSize = 8;
+	uint32_t codeSize = dataSize + 1;
+	uint32_t codeMask = (1 << codeSize) - 1;
+
+	dictionary->clear();
+
+	pixels = pixels + width * (encodingRect.y + beginY) + encodingRect.x;
+	const uint8_t* rowStart = pixels;
+	uint32_t clearCode = 1 << dataSize;
+	// Later strips start right after the clear code the one before wrote
+	if (isFirst) {
+		writingBlock->writeBits(clearCode, codeSize);
+	}
+	uint32_t infoNum = clearCode + 2;
+	uint16_t current = *pixels;
+
+	++pixels;
+	if (encodingRect.width <= pixels - rowStart) {
+		rowStart = rowStart + width;
+		pixels = rowStart;
+	}
+
+	uint32_t slot = 0;
+	while (endPixels > pixels) {
+		uint32_t next = dictionary->find(current, *pixels, &slot);
+		if (0 == next) {
+			writingBlock->writeBits(current, codeSize);
+
+			if (infoNum < MAX_STACK_SIZE) {
+				dictionary->add(slot, current, *pixels, infoNum);
+				++infoNum;
+			} else {
+				writingBlock->writeBits(clearCode, codeSize);
+				infoNum = clearCode + 2;
+				codeSize = dataSize + 1;
+				codeMask = (1 << codeSize) - 1;
+				dictionary->clear();
+			}
+			if (codeMask < infoNum - 1 && infoNum < MAX_STACK_SIZE) {
+				++codeSize;
+				codeMask = (1 << codeSize) - 1;
+			}
+			if (endPixels <= pixels) {
+				break;
+			}
+			current = *pixels;
+		} else {
+			current = next;
+		}
+		++pixels;
+		if (encodingRect.width <= pixels - rowStart) {
+			rowStart = rowStart + width;
+			pixels = rowStart;
+		}
+	}
+	writingBlock->writeBits(current, codeSize);
+
+	if (!isLast) {
+		// The decoder adds a dictionary entry on reading the last code, which may widen the codes
+		if (codeMask < infoNum && infoNum < MAX_STACK_SIZE) {
+			++codeSize;
+		}
+		writingBlock->writeBits(clearCode, codeSize);
+	}
+}
+
+bool LzwEncoder::write(GifOutput* output, const uint8_t* pixels, uint16_t width, const EncodeRect& encodingRect)
+{
+	BitWritingBlock writingBlock;
+	encode(pixels, width, encodingRect, &writingBlock);
+	return writeImageData(output, writingBlock);
+}
+
+void LzwEncoder::encode(const uint8_t* pixels, uint16_t width, const EncodeRect& encodingRect, BitWritingBlock* writingBlock)
+{
+	uint32_t strips = MIN((uint32_t)stripCount, (uint32_t)encodingRect.height);
+	if (strips <= 1) {
+		encodeStrip(pixels, width, encodingRect, 0, encodingRect.height, true, true, &dictionaries[0], writingBlock);
+		return;
+	}
+
+	// The calling thread takes the first strip, straight into writingBlock
+	BitWritingBlock writingBlocks[MAX_STRIPS];
+	WorkerPool::shared().parallelFor(0, encodingRect.height, strips, [&](uint32_t strip, uint32_t beginY, uint32_t endY) {
+		encodeStrip(pixels, width, encodingRect, beginY, endY, 0 == strip, strips - 1 == strip,
+				&dictionaries[strip], 0 == strip ? writingBlock : &writingBlocks[strip]);
+	});
+	for (uint32_t i = 1; i < strips; ++i) {
+		writingBlock->append(writingBlocks[i]);
+	}
+}
+
+bool LzwEncoder::writeImageData(GifOutput* output, BitWritingBlock& writingBlock)
+{
+	// Minimum code size, sub-blocks and terminator in a single write
+	vector<uint8_t> data;
+	data.push_back(8);
+	writingBlock.appendSubBlocks(data);
+	data.push_back(0);
+	return output->write(&data[0], data.size());
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+struct EncodeRect;
+class BitWritingBlock;
+class GifOutput;
+
+// Codes added since the last clear code, keyed by the code they extend and the byte after it.
+// An open addressing table of 32 KB that stays in cache, instead of a 2 MB table of every code and
+// byte that had to be allocated and zeroed for every strip. Allocated on first use and kept, a
+// clear only empties the slots that were filled. Not thread safe, each thread encoding needs its own.
+class LzwDictionary
+{
+public:
+	LzwDictionary();
+
+	void clear();
+	// The code of prefix followed by byte, or 0 when there is none yet and slot is where add() puts it
+	uint32_t find(uint32_t prefix, uint32_t byte, uint32_t* slot) const;
+	void add(uint32_t slot, uint32_t prefix, uint32_t byte, uint32_t code);
+
+private:
+	static const uint32_t SLOT_BITS = 13; // Room for the 4096 codes at half load
+	static const uint32_t SLOT_NUM = 1 << SLOT_BITS;
+
+	std::vector<uint32_t> slots; // (prefix << 8 | byte) << 12 | code, 0 when empty
+	std::vector<uint16_t> filled;
+};
+
+// GIF image data: LZW codes of 8 bit palette indices in 255 byte sub-blocks.
+// With more than one strip the rows of a frame are split between strips that start over from an
+// empty dictionary. Strips are encoded on WorkerPool threads and joined by a clear code, so each
+// strip costs a little compression for having to learn the dictionary again.
+class LzwEncoder
+{
+public:
+	static const int32_t MAX_STACK_SIZE = 4096;
+	static const int32_t BYTE_NUM = 256;
+	static const int32_t MAX_STRIPS = 8;
+
+	LzwEncoder();
+
+	void setStripCount(int32_t stripCount);
+	int32_t getStripCount();
+
+	// encode() then writeImageData()
+	bool write(GifOutput* output, const uint8_t* pixels, uint16_t width, const EncodeRect& encodingRect);
+
+	// Codes of the whole rect, split into the strips. Not thread safe, the strips reuse the
+	// encoder's dictionaries.
+	void encode(const uint8_t* pixels, uint16_t width, const EncodeRect& encodingRect, BitWritingBlock* writingBlock);
+
+	// Writes the minimum code size, the sub-blocks and the block terminator
+	static bool writeImageData(GifOutput* output, BitWritingBlock& writingBlock);
+
+	// Codes of rows beginY to endY of the rect. Every strip but the last ends with the clear code
+	// that starts the next one.
+	static void encodeStrip(const uint8_t* pixels, uint16_t width, const EncodeRect& encodingRect,
+			uint32_t beginY, uint32_t endY, bool isFirst, bool isLast, LzwDictionary* dictionary,
+			BitWritingBlock* writingBlock);
+
+private:
+	int32_t stripCount;
+	LzwDictionary dictionaries[MAX_STRIPS];
+};
@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <cmath>
+#include <vector>
+#include "OrderedDither.h"
+
+using namespace std;
+
+static const int32_t MAP_SIZE = ORDERED_DITHER_SIZE;
+static const int32_t CELL_NUM = MAP_SIZE * MAP_SIZE;
+
+struct OrderedDitherMaps
+{
+	int8_t rows[2][MAP_SIZE][MAP_SIZE * 4]; // Bayer, blue noise
+};
+
+// Rank 0..63 of the recursive 2x2 pattern, the lowest bits of x and y pick the coarsest level
+static uint32_t bayerRank(uint32_t x, uint32_t y)
+{
+	uint32_t rank = 0;
+	for (uint32_t bit = 0; bit < 3; ++bit) {
+		uint32_t xBit = (x >> bit) & 1;
+		uint32_t yBit = (y >> bit) & 1;
+		rank |= (((xBit ^ yBit) << 1) | yBit) << (2 * (2 - bit));
+	}
+	return rank;
+}
+
+// Ulichney's void-and-cluster on a torus. Points go in one by one where they are furthest from
+// the others, their order is the rank.
+class VoidAndCluster
+{
+	float kernel[MAP_SIZE][MAP_SIZE];
+	vector<bool> points;
+	vector<float> energy;
+
+	void toggle(int32_t cell, bool set)
+	{
+		points[cell] = set;
+		float sign = set ? 1.0f : -1.0f;
+		int32_t cellX = cell % MAP_SIZE;
+		int32_t cellY = cell / MAP_SIZE;
+		for (int32_t y = 0; y < MAP_SIZE; ++y) {
+			const float* kernelRow = kernel[(y - cellY + MAP_SIZE) % MAP_SIZE];
+			float* energyRow = &energy[y * MAP_SIZE];
+			for (int32_t x = 0; x < MAP_SIZE; ++x) {
+				energyRow[x] += sign * kernelRow[(x - cellX + MAP_SIZE) % MAP_SIZE];
+			}
+		}
+	}
+
+	// The point with the most points around it
+	int32_t tightestCluster()
+	{
+		int32_t found = -1;
+		for (int32_t i = 0; i < CELL_NUM; ++i) {
+			if (points[i] && (0 > found || energy[i] > energy[found])) {
+				found = i;
+			}
+		}
+		return found;
+	}
+
+	// The empty cell with the fewest points around it
+	int32_t largestVoid()
+	{
+		int32_t found = -1;
+		for (int32_t i = 0; i < CELL_NUM; ++i) {
+			if (!points[i] && (0 > found || energy[i] < energy[found])) {
+				found = i;
+			}
+		}
+		return found;
+	}
+
+public:
+	void rank(uint32_t ranks[CELL_NUM])
+	{
+		const float sigma = 1.5f;
+		for (int32_t y = 0; y < MAP_SIZE; ++y) {
+			for (int32_t x = 0; x < MAP_SIZE; ++x) {
+				int32_t dx = x < MAP_SIZE - x ? x : MAP_SIZE - x;
+				int32_t dy = y < MAP_SIZE - y ? y : MAP_SIZE - y;
+				kernel[y][x] = exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+			}
+		}
+		points.assign(CELL_NUM, false);
+		energy.assign(CELL_NUM, 0.0f);
+
+		// A tenth of the cells at fixed pseudo random places to start from
+		const int32_t initialNum = CELL_NUM / 10;
+		uint32_t seed = 1;
+		for (int32_t placed = 0; placed < initialNum;) {
+			seed = seed * 1664525 + 1013904223;
+			int32_t cell = (seed >> 8) % CELL_NUM;
+			if (!points[cell]) {
+				toggle(cell, true);
+				++placed;
+			}
+		}
+		// Move the tightest cluster to the largest void until it stays where it is
+		for (int32_t i = 0; i < CELL_NUM; ++i) {
+			int32_t cluster = tightestCluster();
+			toggle(cluster, false);
+			int32_t emptiest = largestVoid();
+			toggle(emptiest, true);
+			if (emptiest == cluster) {
+				break;
+			}
+		}
+
+		// The starting points ranked from the last to leave, then the rest as they fill the voids
+		vector<bool> initialPoints = points;
+		vector<float> initialEnergy = energy;
+		for (int32_t rank = initialNum - 1; rank >= 0; --rank) {
+			int32_t cluster = tightestCluster();
+			toggle(cluster, false);
+			ranks[cluster] = rank;
+		}
+		points = initialPoints;
+		energy = initialEnergy;
+		for (int32_t rank = initialNum; rank < CELL_NUM; ++rank) {
+			int32_t emptiest = largestVoid();
+			toggle(emptiest, true);
+			ranks[emptiest] = rank;
+		}
+	}
+};
+
+static void fillRows(int8_t rows[MAP_SIZE][MAP_SIZE * 4], const uint32_t* ranks, uint32_t rankNum)
+{
+	for (int32_t y = 0; y < MAP_SIZE; ++y) {
+		for (int32_t x = 0; x < MAP_SIZE; ++x) {
+			// Ranks spread evenly over the strength, centered on 0
+			uint32_t rank = ranks[y * MAP_SIZE + x];
+			int32_t offset = (int32_t)((2 * rank + 1) * ORDERED_DITHER_STRENGTH / (2 * rankNum)) - ORDERED_DITHER_STRENGTH / 2;
+			int8_t* bytes = &rows[y][x * 4];
+			bytes[0] = offset;
+			bytes[1] = offset;
+			bytes[2] = offset;
+			bytes[3] = 0;
+		}
+	}
+}
+
+static OrderedDitherMaps* buildMaps()
+{
+	OrderedDitherMaps* maps = new OrderedDitherMaps();
+	uint32_t ranks[CELL_NUM];
+
+	for (int32_t y = 0; y < MAP_SIZE; ++y) {
+		for (int32_t x = 0; x < MAP_SIZE; ++x) {
+			ranks[y * MAP_SIZE + x] = bayerRank(x, y);
+		}
+	}
+	fillRows(maps->rows[0], ranks, 64);
+
+	VoidAndCluster().rank(ranks);
+	fillRows(maps->rows[1], ranks, CELL_NUM);
+	return maps;
+}
+
+const int8_t* getOrderedDitherRow(DitherMode mode, uint32_t y)
+{
+	if (DITHER_BAYER != mode && DITHER_BLUE_NOISE != mode) {
+		return NULL;
+	}
+	// Built on first use, about a million multiply-adds for the blue noise
+	static const OrderedDitherMaps* maps = buildMaps();
+	return maps->rows[DITHER_BAYER == mode ? 0 : 1][y % MAP_SIZE];
+}
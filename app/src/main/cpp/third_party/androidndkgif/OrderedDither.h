@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include "ColorReduceKernels.h"
+
+// Threshold maps of DITHER_BAYER and DITHER_BLUE_NOISE. A pixel's threshold only depends on where it
+// is, so rows can be split between threads any way and the offsets are added a whole row at once.
+// Bayer is an 8x8 ordered matrix, blue noise a void-and-cluster texture without Bayer's cross
+// hatching. Both tile ORDERED_DITHER_SIZE pixels square.
+const uint32_t ORDERED_DITHER_SIZE = 32;
+// Offsets run from -STRENGTH / 2 to STRENGTH / 2. Stronger hides more banding on camera frames, but
+// adds visible noise where a smooth frame's palette colors are close together.
+const int32_t ORDERED_DITHER_STRENGTH = 16;
+
+// Offset of each byte of ORDERED_DITHER_SIZE pixels of row y, the same one for R, G and B and 0 for
+// alpha. NULL for the other modes.
+const int8_t* getOrderedDitherRow(DitherMode mode, uint32_t y);
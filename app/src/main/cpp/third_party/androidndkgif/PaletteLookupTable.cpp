@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "BaseGifEncoder.h"
+#include "PaletteLookupTable.h"
+
+using namespace std;
+
+const uint32_t PaletteLookupTable::EMPTY_CELL;
+
+PaletteLookupTable::PaletteLookupTable() {
+	colorNum = 0;
+	memset(colors, 0, sizeof(colors));
+	cells.resize(CELL_NUM, EMPTY_CELL);
+	nearDistances.resize(COLOR_MAX * CELL_RANGE * MAX_COLOR_NUM);
+	farDistances.resize(COLOR_MAX * CELL_RANGE * MAX_COLOR_NUM);
+	nearest.resize(MAX_COLOR_NUM);
+}
+
+void PaletteLookupTable::build(const Cube* cubes, uint32_t cubeNum)
+{
+	cubeNum = MIN(MAX(cubeNum, 1u), (uint32_t)MAX_COLOR_NUM);
+
+	bool isSame = 0 != colorNum && colorNum == cubeNum;
+	for (uint32_t i = 0; i < cubeNum; ++i) {
+		for (int32_t c = 0; c < COLOR_MAX; ++c) {
+			int32_t value = cubes[i].color[c];
+			int32_t& color = colors[c * MAX_COLOR_NUM + i];
+			isSame = isSame && color == value;
+			color = value;
+		}
+	}
+	if (isSame) {
+		return;
+	}
+	colorNum = cubeNum;
+
+	for (int32_t c = 0; c < COLOR_MAX; ++c) {
+		for (int32_t row = 0; row < CELL_RANGE; ++row) {
+			int32_t low = row << CELL_SHIFT;
+			int32_t high = low + (1 << CELL_SHIFT) - 1;
+			int32_t* nearOut = &nearDistances[(c * CELL_RANGE + row) * MAX_COLOR_NUM];
+			int32_t* farOut = &farDistances[(c * CELL_RANGE + row) * MAX_COLOR_NUM];
+			for (uint32_t i = 0; i < colorNum; ++i) {
+				int32_t value = colors[c * MAX_COLOR_NUM + i];
+				int32_t nearDiff = value < low ? low - value : (value > high ? value - high : 0);
+				int32_t farDiff = MAX(ABS(value - low), ABS(value - high));
+				nearOut[i] = nearDiff * nearDiff;
+				farOut[i] = farDiff * farDiff;
+			}
+		}
+	}
+
+	palette.clear();
+	paletteColors.clear();
+	for (uint32_t i = 0; i < colorNum || 0 != palette.size() % CANDIDATE_ALIGN; ++i) {
+		uint32_t color = i < colorNum ? i : 0;
+		palette.push_back(color);
+		paletteColors.push_back(colors[RED_OFFSET + color] | (colors[GREEN_OFFSET + color] << 8) | (colors[BLUE_OFFSET + color] << 16));
+	}
+
+	fill(cells.begin(), cells.end(), EMPTY_CELL);
+	candidates.clear();
+	candidateColors.clear();
+}
+
+void PaletteLookupTable::fillCells(const uint32_t* pixels, uint32_t pixelNum)
+{
+	const uint32_t* last = pixels + pixelNum;
+	for (; pixels != last; ++pixels) {
+		uint32_t cell = cellIndex((*pixels) & 0xFF, ((*pixels) >> 8) & 0xFF, ((*pixels) >> 16) & 0xFF);
+		if (0 != (*pixels >> 24) && EMPTY_CELL == cells[cell]) {
+			fillCell(cell);
+		}
+	}
+}
+
+uint32_t PaletteLookupTable::linearSearch(uint32_t r, uint32_t g, uint32_t b) const
+{
+	uint32_t closestColor = 0;
+	uint32_t closestDifference = difference(0, r, g, b);
+	for (uint32_t i = 1; i < colorNum && 0 != closestDifference; ++i) {
+		uint32_t diff = difference(i, r, g, b);
+		if (diff < closestDifference) {
+			closestDifference = diff;
+			closestColor = i;
+		}
+	}
+	return closestColor;
+}
+
+void PaletteLookupTable::fillCell(uint32_t cell)
+{
+	uint32_t r = cell >> (CELL_BITS * 2);
+	uint32_t g = (cell >> CELL_BITS) & (CELL_RANGE - 1);
+	uint32_t b = cell & (CELL_RANGE - 1);
+	const int32_t* nearR = &nearDistances[(RED * CELL_RANGE + r) * MAX_COLOR_NUM];
+	const int32_t* nearG = &nearDistances[(GREEN * CELL_RANGE + g) * MAX_COLOR_NUM];
+	const int32_t* nearB = &nearDistances[(BLUE * CELL_RANGE + b) * MAX_COLOR_NUM];
+	const int32_t* farR = &farDistances[(RED * CELL_RANGE + r) * MAX_COLOR_NUM];
+	const int32_t* farG = &farDistances[(GREEN * CELL_RANGE + g) * MAX_COLOR_NUM];
+	const int32_t* farB = &farDistances[(BLUE * CELL_RANGE + b) * MAX_COLOR_NUM];
+
+	// A color is a candidate if it can be closer than the best worst case of any color
+	int32_t bound = farR[0] + farG[0] + farB[0];
+	for (uint32_t i = 0; i < colorNum; ++i) {
+		bound = MIN(bound, farR[i] + farG[i] + farB[i]);
+		nearest[i] = nearR[i] + nearG[i] + nearB[i];
+	}
+
+	uint32_t offset = candidates.size();
+	for (uint32_t i = 0; i < colorNum; ++i) {
+		if (nearest[i] <= bound) {
+			addCandidate(i);
+		}
+	}
+	while (0 != (candidates.size() - offset) % CANDIDATE_ALIGN) {
+		addCandidate(candidates[offset]);
+	}
+	cells[cell] = (offset << 8) | (candidates.size() - offset - 1);
+}
+
+void PaletteLookupTable::addCandidate(uint32_t color)
+{
+	candidates.push_back(color);
+	candidateColors.push_back(paletteColors[color]);
+}
+
+PaletteLookupTable::View PaletteLookupTable::getView() const
+{
+	View view;
+	view.cells = &cells[0];
+	view.candidates = candidates.empty() ? NULL : &candidates[0];
+	view.candidateColors = candidateColors.empty() ? NULL : &candidateColors[0];
+	view.palette = palette.empty() ? NULL : &palette[0];
+	view.paletteColors = paletteColors.empty() ? NULL : &paletteColors[0];
+	view.paletteCount = palette.size();
+	return view;
+}
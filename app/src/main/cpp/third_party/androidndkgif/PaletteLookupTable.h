@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+struct Cube;
+
+// Inverse colormap for nearest palette color search.
+// RGB space is split into CELL_NUM cells. Each cell keeps the palette entries that can be the nearest
+// color of at least one RGB value inside it, so a lookup only measures a handful of candidates instead
+// of the whole palette. Results are identical to a linear scan, ties go to the lowest index.
+// Cells are filled the first time a color inside them is looked up.
+class PaletteLookupTable
+{
+public:
+	static const int32_t CELL_BITS = 5;
+	static const int32_t CELL_SHIFT = 8 - CELL_BITS;
+	static const int32_t CELL_RANGE = 1 << CELL_BITS;
+	static const int32_t CELL_NUM = CELL_RANGE * CELL_RANGE * CELL_RANGE;
+	static const int32_t MAX_COLOR_NUM = 256;
+
+	// Candidate lists are padded to a multiple of this by repeating their first entry, so SIMD
+	// searches never need a tail loop
+	static const int32_t CANDIDATE_ALIGN = 8;
+
+	// A cell holds (offset of its first candidate << 8) | (candidate count - 1)
+	static const uint32_t EMPTY_CELL = 0xFFFFFFFF;
+
+	// Raw arrays for the ColorReduceKernels, valid until the next build() or fillCell()
+	struct View
+	{
+		const uint32_t* cells;
+		const uint8_t* candidates;
+		const uint32_t* candidateColors; // 0x00BBGGRR
+		const uint8_t* palette;
+		const uint32_t* paletteColors;
+		uint32_t paletteCount;
+	};
+
+	PaletteLookupTable();
+
+	// Sets the palette and empties every cell, unless cubes holds the same colors as the last call
+	void build(const Cube* cubes, uint32_t cubeNum);
+
+	// Fills the cells of every opaque pixel ahead of lookupShared()
+	void fillCells(const uint32_t* pixels, uint32_t pixelNum);
+	void fillCell(uint32_t cell);
+	View getView() const;
+
+	// Fills the cell on first use, not thread safe
+	inline uint32_t lookup(uint32_t r, uint32_t g, uint32_t b)
+	{
+		uint32_t cell = cellIndex(r, g, b);
+		if (EMPTY_CELL == cells[cell]) {
+			fillCell(cell);
+		}
+		return search(cells[cell], r, g, b);
+	}
+
+	// Thread safe, falls back to a linear scan for cells not filled yet
+	inline uint32_t lookupShared(uint32_t r, uint32_t g, uint32_t b) const
+	{
+		uint32_t cell = cells[cellIndex(r, g, b)];
+		if (EMPTY_CELL == cell) {
+			return linearSearch(r, g, b);
+		}
+		return search(cell, r, g, b);
+	}
+
+	static inline uint32_t cellIndex(uint32_t r, uint32_t g, uint32_t b)
+	{
+		return ((r >> CELL_SHIFT) << (CELL_BITS * 2)) | ((g >> CELL_SHIFT) << CELL_BITS) | (b >> CELL_SHIFT);
+	}
+
+	inline uint32_t getColorNum() const
+	{
+		return colorNum;
+	}
+
+private:
+	static const int32_t RED_OFFSET = 0;
+	static const int32_t GREEN_OFFSET = MAX_COLOR_NUM;
+	static const int32_t BLUE_OFFSET = MAX_COLOR_NUM * 2;
+
+	inline uint32_t difference(uint32_t color, int32_t r, int32_t g, int32_t b) const
+	{
+		int32_t diffR = colors[RED_OFFSET + color] - r;
+		int32_t diffG = colors[GREEN_OFFSET + color] - g;
+		int32_t diffB = colors[BLUE_OFFSET + color] - b;
+		return diffR * diffR + diffG * diffG + diffB * diffB;
+	}
+
+	inline uint32_t search(uint32_t cell, uint32_t r, uint32_t g, uint32_t b) const
+	{
+		const uint8_t* candidate = &candidates[0] + (cell >> 8);
+		const uint8_t* lastCandidate = candidate + (cell & 0xFF) + 1;
+
+		// Difference in the high bits and index in the low 8 bits, so the minimum is also the lowest index on a tie
+		uint32_t closest = 0xFFFFFFFF;
+		for (; candidate != lastCandidate; ++candidate) {
+			uint32_t key = (difference(*candidate, r, g, b) << 8) | *candidate;
+			closest = key < closest ? key : closest;
+		}
+		return closest & 0xFF;
+	}
+
+	uint32_t linearSearch(uint32_t r, uint32_t g, uint32_t b) const;
+	void addCandidate(uint32_t color);
+
+	uint32_t colorNum;
+	int32_t colors[MAX_COLOR_NUM * 3];
+	std::vector<uint32_t> cells;
+	std::vector<uint8_t> candidates;
+	std::vector<uint32_t> candidateColors;
+	std::vector<uint8_t> palette;
+	std::vector<uint32_t> paletteColors;
+
+	// Squared distance from each palette color to the nearest and farthest value of each cell row, per channel
+	std::vector<int32_t> nearDistances;
+	std::vector<int32_t> farDistances;
+	std::vector<int32_t> nearest;
+};
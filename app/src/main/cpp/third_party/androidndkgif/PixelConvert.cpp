@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "PixelConvert.h"
+#include "PixelConvertImpl.h"
+
+#ifdef COLOR_REDUCE_X86_KERNELS
+const PixelConvertKernels* getPixelConvertKernelsSse4();
+const PixelConvertKernels* getPixelConvertKernelsAvx2();
+#endif
+#ifdef __aarch64__
+const PixelConvertKernels* getPixelConvertKernelsNeon();
+#endif
+
+static const PixelConvertKernels SCALAR_KERNELS = {
+	rgb565ToRgbaScalar,
+	rgbaToRgb565Scalar,
+	swapRedBlueScalar,
+	rgbaToPlanarScalar,
+};
+
+const PixelConvertKernels* getPixelConvertKernels(PixelConvertKernelType type)
+{
+	switch (type) {
+	case PIXEL_CONVERT_SCALAR:
+		return &SCALAR_KERNELS;
+#ifdef COLOR_REDUCE_X86_KERNELS
+	case PIXEL_CONVERT_SSE4:
+		return __builtin_cpu_supports("sse4.1") ? getPixelConvertKernelsSse4() : NULL;
+	case PIXEL_CONVERT_AVX2:
+		return __builtin_cpu_supports("avx2") ? getPixelConvertKernelsAvx2() : NULL;
+#endif
+#ifdef __aarch64__
+	case PIXEL_CONVERT_NEON:
+		// Advanced SIMD is mandatory on arm64
+		return getPixelConvertKernelsNeon();
+#endif
+	default:
+		return NULL;
+	}
+}
+
+static const PixelConvertKernels* pickPixelConvertKernels()
+{
+	const PixelConvertKernelType preferred[] = {PIXEL_CONVERT_AVX2, PIXEL_CONVERT_NEON, PIXEL_CONVERT_SSE4, PIXEL_CONVERT_SCALAR};
+	for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); ++i) {
+		const PixelConvertKernels* kernels = getPixelConvertKernels(preferred[i]);
+		if (NULL != kernels) {
+			return kernels;
+		}
+	}
+	return &SCALAR_KERNELS;
+}
+
+const PixelConvertKernels& getPixelConvertKernels()
+{
+	static const PixelConvertKernels* kernels = pickPixelConvertKernels();
+	return *kernels;
+}
+
+const char* getPixelConvertKernelName(PixelConvertKernelType type)
+{
+	const char* names[] = {"scalar", "sse4", "avx2", "neon"};
+	return type < PIXEL_CONVERT_KERNEL_MAX ? names[type] : "unknown";
+}
+
+// Calls convert for each row, or once for the whole image when no row is padded
+template <class Src, class Dst, class Convert>
+static void convertRows(const Src* src, size_t srcPitch, Dst* dst, size_t dstPitch, uint32_t width, uint32_t height, Convert convert)
+{
+	srcPitch = 0 == srcPitch ? width * sizeof(Src) : srcPitch;
+	dstPitch = 0 == dstPitch ? width * sizeof(Dst) : dstPitch;
+	if (srcPitch == width * sizeof(Src) && dstPitch == width * sizeof(Dst)) {
+		convert(src, dst, width * height);
+		return;
+	}
+	for (uint32_t y = 0; y < height; ++y) {
+		convert((const Src*)((const uint8_t*)src + y * srcPitch), (Dst*)((uint8_t*)dst + y * dstPitch), width);
+	}
+}
+
+void convertRgb565ToRgba(const uint16_t* src, size_t srcPitch, uint32_t* dst, size_t dstPitch, uint32_t width, uint32_t height)
+{
+	convertRows(src, srcPitch, dst, dstPitch, width, height, getPixelConvertKernels().rgb565ToRgba);
+}
+
+void convertRgbaToRgb565(const uint32_t* src, size_t srcPitch, uint16_t* dst, size_t dstPitch, uint32_t width, uint32_t height)
+{
+	convertRows(src, srcPitch, dst, dstPitch, width, height, getPixelConvertKernels().rgbaToRgb565);
+}
+
+void swapRedBlue(const uint32_t* src, size_t srcPitch, uint32_t* dst, size_t dstPitch, uint32_t width, uint32_t height)
+{
+	convertRows(src, srcPitch, dst, dstPitch, width, height, getPixelConvertKernels().swapRedBlue);
+}
+
+void convertRgbaToPlanar(const uint32_t* src, size_t srcPitch, uint8_t* planes, uint32_t planeNum, uint32_t width, uint32_t height)
+{
+	void (*convert)(const uint32_t*, uint8_t*, uint8_t*, uint8_t*, uint8_t*, uint32_t) = getPixelConvertKernels().rgbaToPlanar;
+	size_t planeSize = (size_t)width * height;
+	uint8_t* alpha = 4 <= planeNum ? planes + planeSize * 3 : NULL;
+	srcPitch = 0 == srcPitch ? width * sizeof(uint32_t) : srcPitch;
+	uint32_t rowNum = srcPitch == width * sizeof(uint32_t) ? 1 : height;
+	uint32_t rowSize = 1 == rowNum ? width * height : width;
+	for (uint32_t y = 0; y < rowNum; ++y) {
+		size_t offset = (size_t)y * width;
+		convert((const uint32_t*)((const uint8_t*)src + y * srcPitch), planes + offset, planes + planeSize + offset,
+				planes + planeSize * 2 + offset, NULL != alpha ? alpha + offset : NULL, rowSize);
+	}
+}
+
+void copyPixelRows(const void* src, size_t srcPitch, void* dst, size_t dstPitch, size_t rowBytes, uint32_t height)
+{
+	srcPitch = 0 == srcPitch ? rowBytes : srcPitch;
+	dstPitch = 0 == dstPitch ? rowBytes : dstPitch;
+	if (srcPitch == rowBytes && dstPitch == rowBytes) {
+		memcpy(dst, src, rowBytes * height);
+		return;
+	}
+	for (uint32_t y = 0; y < height; ++y) {
+		memcpy((uint8_t*)dst + y * dstPitch, (const uint8_t*)src + y * srcPitch, rowBytes);
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Conversions between the pixel formats frames pass through: RGB565 as the renderer reads it back,
+// RGBA8888 (0xAABBGGRR) the encoders work on, BGRA and planar R, G, B and A bytes.
+// Every kernel gives the same result as the scalar one, they only differ in speed.
+
+// RGB565 the way VK_FORMAT_R5G6B5_UNORM_PACK16 and Android's RGB_565 store it, red in the top bits.
+// Expands to opaque RGBA, repeating the top bits in the ones below like the GPU does.
+static inline uint32_t rgb565ToPixel(uint16_t color)
+{
+	uint32_t r = color >> 11;
+	uint32_t g = (color >> 5) & 0x3F;
+	uint32_t b = color & 0x1F;
+	return 0xFF000000 | (((b << 3) | (b >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | ((r << 3) | (r >> 2));
+}
+
+// Drops the low bits and alpha, so expanding again gives the pixel back for any RGB565 color
+static inline uint16_t pixelToRgb565(uint32_t pixel)
+{
+	return ((pixel & 0xF8) << 8) | ((pixel >> 5) & 0x7E0) | ((pixel >> 19) & 0x1F);
+}
+
+// Row kernels, pixelNum pixels each
+struct PixelConvertKernels
+{
+	void (*rgb565ToRgba)(const uint16_t* src, uint32_t* dst, uint32_t pixelNum);
+	void (*rgbaToRgb565)(const uint32_t* src, uint16_t* dst, uint32_t pixelNum);
+	// Swaps the first and third byte, RGBA to BGRA and back. src and dst may be the same.
+	void (*swapRedBlue)(const uint32_t* src, uint32_t* dst, uint32_t pixelNum);
+	// a may be NULL to drop alpha
+	void (*rgbaToPlanar)(const uint32_t* src, uint8_t* r, uint8_t* g, uint8_t* b, uint8_t* a, uint32_t pixelNum);
+};
+
+enum PixelConvertKernelType
+{
+	PIXEL_CONVERT_SCALAR = 0,
+	PIXEL_CONVERT_SSE4,
+	PIXEL_CONVERT_AVX2,
+	PIXEL_CONVERT_NEON,
+	PIXEL_CONVERT_KERNEL_MAX
+};
+
+// The fastest kernels the CPU supports, picked once
+const PixelConvertKernels& getPixelConvertKernels();
+
+// NULL if the kernels were not built for this architecture or the CPU does not support them
+const PixelConvertKernels* getPixelConvertKernels(PixelConvertKernelType type);
+const char* getPixelConvertKernelName(PixelConvertKernelType type);
+
+// Whole images with the fastest kernels. Rows are pitch bytes apart, or follow each other when the
+// pitch is 0. Images whose rows follow each other on both sides are converted in a single call, so
+// padded rows are compacted on the way.
+void convertRgb565ToRgba(const uint16_t* src, size_t srcPitch, uint32_t* dst, size_t dstPitch, uint32_t width, uint32_t height);
+void convertRgbaToRgb565(const uint32_t* src, size_t srcPitch, uint16_t* dst, size_t dstPitch, uint32_t width, uint32_t height);
+void swapRedBlue(const uint32_t* src, size_t srcPitch, uint32_t* dst, size_t dstPitch, uint32_t width, uint32_t height);
+// planes holds the R, G and B planes of width * height bytes back to back, then A when planeNum is 4
+void convertRgbaToPlanar(const uint32_t* src, size_t srcPitch, uint8_t* planes, uint32_t planeNum, uint32_t width, uint32_t height);
+// Same format on both sides, only the pitch changes
+void copyPixelRows(const void* src, size_t srcPitch, void* dst, size_t dstPitch, size_t rowBytes, uint32_t height);
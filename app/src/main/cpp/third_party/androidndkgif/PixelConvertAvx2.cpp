@@ -0,0 +1,105 @@
+#include "PixelConvertImpl.h"
+
+#ifdef COLOR_REDUCE_X86_KERNELS
+
+#include <immintrin.h>
+
+namespace {
+
+// Unpacking works within 128-bit lanes, the two halves of the result are put back in order
+void rgb565ToRgbaAvx2(const uint16_t* src, uint32_t* dst, uint32_t pixelNum)
+{
+	uint32_t i = 0;
+	for (; i + 16 <= pixelNum; i += 16) {
+		__m256i color = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i r = _mm256_srli_epi16(color, 11);
+		__m256i g = _mm256_and_si256(_mm256_srli_epi16(color, 5), _mm256_set1_epi16(0x3F));
+		__m256i b = _mm256_and_si256(color, _mm256_set1_epi16(0x1F));
+		r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+		g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+		b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+		__m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+		__m256i ba = _mm256_or_si256(b, _mm256_set1_epi16((short)0xFF00));
+		__m256i low = _mm256_unpacklo_epi16(rg, ba);
+		__m256i high = _mm256_unpackhi_epi16(rg, ba);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute2x128_si256(low, high, 0x20));
+		_mm256_storeu_si256((__m256i*)(dst + i + 8), _mm256_permute2x128_si256(low, high, 0x31));
+	}
+	rgb565ToRgbaScalar(src + i, dst + i, pixelNum - i);
+}
+
+inline __m256i packRgb565(__m256i pixels)
+{
+	__m256i r = _mm256_slli_epi32(_mm256_and_si256(pixels, _mm256_set1_epi32(0xF8)), 8);
+	__m256i g = _mm256_and_si256(_mm256_srli_epi32(pixels, 5), _mm256_set1_epi32(0x7E0));
+	__m256i b = _mm256_and_si256(_mm256_srli_epi32(pixels, 19), _mm256_set1_epi32(0x1F));
+	return _mm256_or_si256(_mm256_or_si256(r, g), b);
+}
+
+void rgbaToRgb565Avx2(const uint32_t* src, uint16_t* dst, uint32_t pixelNum)
+{
+	uint32_t i = 0;
+	for (; i + 16 <= pixelNum; i += 16) {
+		__m256i low = packRgb565(_mm256_loadu_si256((const __m256i*)(src + i)));
+		__m256i high = packRgb565(_mm256_loadu_si256((const __m256i*)(src + i + 8)));
+		__m256i packed = _mm256_packus_epi32(low, high);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	rgbaToRgb565Scalar(src + i, dst + i, pixelNum - i);
+}
+
+void swapRedBlueAvx2(const uint32_t* src, uint32_t* dst, uint32_t pixelNum)
+{
+	const __m256i order = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	uint32_t i = 0;
+	for (; i + 8 <= pixelNum; i += 8) {
+		__m256i pixels = _mm256_loadu_si256((const __m256i*)(src + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(pixels, order));
+	}
+	swapRedBlueScalar(src + i, dst + i, pixelNum - i);
+}
+
+void rgbaToPlanarAvx2(const uint32_t* src, uint8_t* r, uint8_t* g, uint8_t* b, uint8_t* a, uint32_t pixelNum)
+{
+	// Each vector to R0-7 G0-7 B0-7 A0-7, then four of them are merged 64 bits at a time
+	const __m256i order = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+			0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	const __m256i groups = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	uint32_t i = 0;
+	for (; i + 32 <= pixelNum; i += 32) {
+		__m256i p[4];
+		for (int32_t n = 0; n < 4; ++n) {
+			__m256i pixels = _mm256_loadu_si256((const __m256i*)(src + i + n * 8));
+			p[n] = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(pixels, order), groups);
+		}
+		// Within each 128-bit lane: R and B of 16 pixels, then G and A
+		__m256i rb01 = _mm256_unpacklo_epi64(p[0], p[1]);
+		__m256i ga01 = _mm256_unpackhi_epi64(p[0], p[1]);
+		__m256i rb23 = _mm256_unpacklo_epi64(p[2], p[3]);
+		__m256i ga23 = _mm256_unpackhi_epi64(p[2], p[3]);
+		_mm256_storeu_si256((__m256i*)(r + i), _mm256_permute2x128_si256(rb01, rb23, 0x20));
+		_mm256_storeu_si256((__m256i*)(g + i), _mm256_permute2x128_si256(ga01, ga23, 0x20));
+		_mm256_storeu_si256((__m256i*)(b + i), _mm256_permute2x128_si256(rb01, rb23, 0x31));
+		if (NULL != a) {
+			_mm256_storeu_si256((__m256i*)(a + i), _mm256_permute2x128_si256(ga01, ga23, 0x31));
+		}
+	}
+	rgbaToPlanarScalar(src + i, r + i, g + i, b + i, NULL != a ? a + i : NULL, pixelNum - i);
+}
+
+const PixelConvertKernels AVX2_KERNELS = {
+	rgb565ToRgbaAvx2,
+	rgbaToRgb565Avx2,
+	swapRedBlueAvx2,
+	rgbaToPlanarAvx2,
+};
+
+} // namespace
+
+const PixelConvertKernels* getPixelConvertKernelsAvx2()
+{
+	return &AVX2_KERNELS;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+// Shared by the PixelConvert*.cpp files only. The SIMD kernels finish their rows with these, see
+// ColorReduceKernelsImpl.h for why everything has internal linkage.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PixelConvert.h"
+
+namespace {
+
+inline void rgb565ToRgbaScalar(const uint16_t* src, uint32_t* dst, uint32_t pixelNum)
+{
+	for (uint32_t i = 0; i < pixelNum; ++i) {
+		dst[i] = rgb565ToPixel(src[i]);
+	}
+}
+
+inline void rgbaToRgb565Scalar(const uint32_t* src, uint16_t* dst, uint32_t pixelNum)
+{
+	for (uint32_t i = 0; i < pixelNum; ++i) {
+		dst[i] = pixelToRgb565(src[i]);
+	}
+}
+
+inline void swapRedBlueScalar(const uint32_t* src, uint32_t* dst, uint32_t pixelNum)
+{
+	for (uint32_t i = 0; i < pixelNum; ++i) {
+		uint32_t pixel = src[i];
+		dst[i] = (pixel & 0xFF00FF00) | ((pixel & 0xFF) << 16) | ((pixel >> 16) & 0xFF);
+	}
+}
+
+inline void rgbaToPlanarScalar(const uint32_t* src, uint8_t* r, uint8_t* g, uint8_t* b, uint8_t* a, uint32_t pixelNum)
+{
+	for (uint32_t i = 0; i < pixelNum; ++i) {
+		uint32_t pixel = src[i];
+		r[i] = pixel;
+		g[i] = pixel >> 8;
+		b[i] = pixel >> 16;
+	}
+	if (NULL != a) {
+		for (uint32_t i = 0; i < pixelNum; ++i) {
+			a[i] = src[i] >> 24;
+		}
+	}
+}
+
+} // namespace
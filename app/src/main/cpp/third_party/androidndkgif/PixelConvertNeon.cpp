@@ -0,0 +1,83 @@
+#include "PixelConvertImpl.h"
+
+#ifdef __aarch64__
+
+#include <arm_neon.h>
+
+namespace {
+
+// vld4 and vst4 split and interleave the channels for free
+void rgb565ToRgbaNeon(const uint16_t* src, uint32_t* dst, uint32_t pixelNum)
+{
+	uint32_t i = 0;
+	for (; i + 8 <= pixelNum; i += 8) {
+		uint16x8_t color = vld1q_u16(src + i);
+		uint16x8_t r = vshrq_n_u16(color, 11);
+		uint16x8_t g = vandq_u16(vshrq_n_u16(color, 5), vdupq_n_u16(0x3F));
+		uint16x8_t b = vandq_u16(color, vdupq_n_u16(0x1F));
+		uint8x8x4_t pixels;
+		pixels.val[0] = vmovn_u16(vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2)));
+		pixels.val[1] = vmovn_u16(vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4)));
+		pixels.val[2] = vmovn_u16(vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2)));
+		pixels.val[3] = vdup_n_u8(0xFF);
+		vst4_u8((uint8_t*)(dst + i), pixels);
+	}
+	rgb565ToRgbaScalar(src + i, dst + i, pixelNum - i);
+}
+
+void rgbaToRgb565Neon(const uint32_t* src, uint16_t* dst, uint32_t pixelNum)
+{
+	uint32_t i = 0;
+	for (; i + 8 <= pixelNum; i += 8) {
+		uint8x8x4_t pixels = vld4_u8((const uint8_t*)(src + i));
+		uint16x8_t r = vshll_n_u8(vand_u8(pixels.val[0], vdup_n_u8(0xF8)), 8);
+		uint16x8_t g = vshll_n_u8(vand_u8(pixels.val[1], vdup_n_u8(0xFC)), 3);
+		uint16x8_t b = vmovl_u8(vshr_n_u8(pixels.val[2], 3));
+		vst1q_u16(dst + i, vorrq_u16(vorrq_u16(r, g), b));
+	}
+	rgbaToRgb565Scalar(src + i, dst + i, pixelNum - i);
+}
+
+void swapRedBlueNeon(const uint32_t* src, uint32_t* dst, uint32_t pixelNum)
+{
+	uint32_t i = 0;
+	for (; i + 16 <= pixelNum; i += 16) {
+		uint8x16x4_t pixels = vld4q_u8((const uint8_t*)(src + i));
+		uint8x16_t red = pixels.val[0];
+		pixels.val[0] = pixels.val[2];
+		pixels.val[2] = red;
+		vst4q_u8((uint8_t*)(dst + i), pixels);
+	}
+	swapRedBlueScalar(src + i, dst + i, pixelNum - i);
+}
+
+void rgbaToPlanarNeon(const uint32_t* src, uint8_t* r, uint8_t* g, uint8_t* b, uint8_t* a, uint32_t pixelNum)
+{
+	uint32_t i = 0;
+	for (; i + 16 <= pixelNum; i += 16) {
+		uint8x16x4_t pixels = vld4q_u8((const uint8_t*)(src + i));
+		vst1q_u8(r + i, pixels.val[0]);
+		vst1q_u8(g + i, pixels.val[1]);
+		vst1q_u8(b + i, pixels.val[2]);
+		if (NULL != a) {
+			vst1q_u8(a + i, pixels.val[3]);
+		}
+	}
+	rgbaToPlanarScalar(src + i, r + i, g + i, b + i, NULL != a ? a + i : NULL, pixelNum - i);
+}
+
+const PixelConvertKernels NEON_KERNELS = {
+	rgb565ToRgbaNeon,
+	rgbaToRgb565Neon,
+	swapRedBlueNeon,
+	rgbaToPlanarNeon,
+};
+
+} // namespace
+
+const PixelConvertKernels* getPixelConvertKernelsNeon()
+{
+	return &NEON_KERNELS;
+}
+
+#endif
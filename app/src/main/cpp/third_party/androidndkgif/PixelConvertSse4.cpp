@@ -0,0 +1,96 @@
+#include "PixelConvertImpl.h"
+
+#ifdef COLOR_REDUCE_X86_KERNELS
+
+#include <immintrin.h>
+
+namespace {
+
+void rgb565ToRgbaSse4(const uint16_t* src, uint32_t* dst, uint32_t pixelNum)
+{
+	uint32_t i = 0;
+	for (; i + 8 <= pixelNum; i += 8) {
+		__m128i color = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i r = _mm_srli_epi16(color, 11);
+		__m128i g = _mm_and_si128(_mm_srli_epi16(color, 5), _mm_set1_epi16(0x3F));
+		__m128i b = _mm_and_si128(color, _mm_set1_epi16(0x1F));
+		r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+		g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+		b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+		__m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+		__m128i ba = _mm_or_si128(b, _mm_set1_epi16((short)0xFF00));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(rg, ba));
+	}
+	rgb565ToRgbaScalar(src + i, dst + i, pixelNum - i);
+}
+
+inline __m128i packRgb565(__m128i pixels)
+{
+	__m128i r = _mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0xF8)), 8);
+	__m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 5), _mm_set1_epi32(0x7E0));
+	__m128i b = _mm_and_si128(_mm_srli_epi32(pixels, 19), _mm_set1_epi32(0x1F));
+	return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+void rgbaToRgb565Sse4(const uint32_t* src, uint16_t* dst, uint32_t pixelNum)
+{
+	uint32_t i = 0;
+	for (; i + 8 <= pixelNum; i += 8) {
+		__m128i low = packRgb565(_mm_loadu_si128((const __m128i*)(src + i)));
+		__m128i high = packRgb565(_mm_loadu_si128((const __m128i*)(src + i + 4)));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi32(low, high));
+	}
+	rgbaToRgb565Scalar(src + i, dst + i, pixelNum - i);
+}
+
+void swapRedBlueSse4(const uint32_t* src, uint32_t* dst, uint32_t pixelNum)
+{
+	const __m128i order = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	uint32_t i = 0;
+	for (; i + 4 <= pixelNum; i += 4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(pixels, order));
+	}
+	swapRedBlueScalar(src + i, dst + i, pixelNum - i);
+}
+
+void rgbaToPlanarSse4(const uint32_t* src, uint8_t* r, uint8_t* g, uint8_t* b, uint8_t* a, uint32_t pixelNum)
+{
+	// Each vector to R0-3 G0-3 B0-3 A0-3, then a 4x4 transpose of the 32-bit groups
+	const __m128i order = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	uint32_t i = 0;
+	for (; i + 16 <= pixelNum; i += 16) {
+		__m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), order);
+		__m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i + 4)), order);
+		__m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i + 8)), order);
+		__m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i + 12)), order);
+		__m128i rg01 = _mm_unpacklo_epi32(p0, p1);
+		__m128i rg23 = _mm_unpacklo_epi32(p2, p3);
+		__m128i ba01 = _mm_unpackhi_epi32(p0, p1);
+		__m128i ba23 = _mm_unpackhi_epi32(p2, p3);
+		_mm_storeu_si128((__m128i*)(r + i), _mm_unpacklo_epi64(rg01, rg23));
+		_mm_storeu_si128((__m128i*)(g + i), _mm_unpackhi_epi64(rg01, rg23));
+		_mm_storeu_si128((__m128i*)(b + i), _mm_unpacklo_epi64(ba01, ba23));
+		if (NULL != a) {
+			_mm_storeu_si128((__m128i*)(a + i), _mm_unpackhi_epi64(ba01, ba23));
+		}
+	}
+	rgbaToPlanarScalar(src + i, r + i, g + i, b + i, NULL != a ? a + i : NULL, pixelNum - i);
+}
+
+const PixelConvertKernels SSE4_KERNELS = {
+	rgb565ToRgbaSse4,
+	rgbaToRgb565Sse4,
+	swapRedBlueSse4,
+	rgbaToPlanarSse4,
+};
+
+} // namespace
+
+const PixelConvertKernels* getPixelConvertKernelsSse4()
+{
+	return &SSE4_KERNELS;
+}
+
+#endif
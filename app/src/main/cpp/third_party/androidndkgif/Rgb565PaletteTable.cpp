@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "BaseGifEncoder.h"
+#include "ColorReduceKernels.h"
+#include "Rgb565PaletteTable.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+// Colors searched by a kernel call
+static const uint32_t ROW_SIZE = 256;
+
+Rgb565PaletteTable::Rgb565PaletteTable()
+{
+}
+
+void Rgb565PaletteTable::build(PaletteLookupTable* table, const Cube* cubes, uint32_t cubeNum, uint32_t threadNum)
+{
+	cubeNum = MIN(MAX(cubeNum, 1u), (uint32_t)PaletteLookupTable::MAX_COLOR_NUM);
+
+	bool isSame = !indices.empty() && paletteColors.size() == cubeNum;
+	paletteColors.resize(cubeNum);
+	for (uint32_t i = 0; i < cubeNum; ++i) {
+		uint32_t color = 0xFF000000 | cubes[i].color[RED] | (cubes[i].color[GREEN] << 8) | (cubes[i].color[BLUE] << 16);
+		isSame = isSame && paletteColors[i] == color;
+		paletteColors[i] = color;
+	}
+	if (isSame) {
+		return;
+	}
+
+	if (colors.empty()) {
+		colors.resize(COLOR_NUM);
+		for (uint32_t color = 0; color < COLOR_NUM; ++color) {
+			colors[color] = rgb565ToPixel(color);
+		}
+	}
+
+	// Every color would fill every one of the table's cells, a search of the whole palette with
+	// the fastest kernel is quicker, and leaves the table read-only for the threads
+	table->build(cubes, cubeNum);
+	indices.resize(COLOR_NUM);
+	uint32_t* colorIn = &colors[0];
+	uint8_t* indexOut = &indices[0];
+	threadNum = MAX(1u, threadNum);
+	WorkerPool::shared().parallelFor(0, COLOR_NUM / ROW_SIZE, threadNum, [=](uint32_t, uint32_t begin, uint32_t end) {
+		ColorReduceKernel kernel = getColorReduceKernel();
+		ColorReduceRow row;
+		row.table = table;
+		row.width = ROW_SIZE;
+		for (uint32_t y = begin; y < end; ++y) {
+			row.pixels = colorIn + y * ROW_SIZE;
+			row.indexOut = indexOut + y * ROW_SIZE;
+			kernel(row);
+		}
+	});
+}
+
+void Rgb565PaletteTable::map(const uint16_t* pixels, uint32_t pixelNum, uint8_t* indexOut, uint32_t* colorOut) const
+{
+	const uint8_t* table = &indices[0];
+	for (uint32_t i = 0; i < pixelNum; ++i) {
+		indexOut[i] = table[pixels[i]];
+	}
+	if (NULL != colorOut) {
+		const uint32_t* colors = &paletteColors[0];
+		for (uint32_t i = 0; i < pixelNum; ++i) {
+			colorOut[i] = colors[indexOut[i]];
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "PixelConvert.h"
+
+struct Cube;
+class PaletteLookupTable;
+
+// Palette index of every one of the 65536 RGB565 colors, so mapping a frame without dither is a
+// single load per pixel. The indices are the ones PaletteLookupTable finds for the expanded colors.
+class Rgb565PaletteTable
+{
+public:
+	static const uint32_t COLOR_NUM = 1 << 16;
+
+	Rgb565PaletteTable();
+
+	// Searches table, set to the cubes first, for every color on threadNum WorkerPool threads. Does
+	// nothing when cubes hold the same colors as the last call. Build before the table is shared.
+	void build(PaletteLookupTable* table, const Cube* cubes, uint32_t cubeNum, uint32_t threadNum = 1);
+
+	inline uint8_t lookup(uint16_t color) const
+	{
+		return indices[color];
+	}
+
+	// Thread safe. colorOut, when not NULL, gets the opaque palette color of each pixel.
+	void map(const uint16_t* pixels, uint32_t pixelNum, uint8_t* indexOut, uint32_t* colorOut) const;
+
+private:
+	std::vector<uint8_t> indices;
+	std::vector<uint32_t> colors; // Every RGB565 color expanded, for the kernels
+	std::vector<uint32_t> paletteColors; // 0xFFBBGGRR of the cubes it was built for
+};
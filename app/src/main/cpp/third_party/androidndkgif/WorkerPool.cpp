@@ -0,0 +1,212 @@
+#include <unistd.h>
+#include "WorkerPool.h"
+
+using namespace std;
+
+// The pool and worker the current thread belongs to
+static __thread WorkerPool* currentPool = NULL;
+static __thread int32_t currentWorker = -1;
+
+static int32_t defaultWorkerCount()
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cores <= 1) {
+		return 0;
+	}
+	return cores - 1 > WorkerPool::MAX_WORKERS ? WorkerPool::MAX_WORKERS : (int32_t)cores - 1;
+}
+
+WorkerPool& WorkerPool::shared()
+{
+	// Never deleted, workers may still be running when the process exits
+	static WorkerPool* pool = new WorkerPool(defaultWorkerCount());
+	return *pool;
+}
+
+WorkerPool::WorkerPool(int32_t workerNum) : queued(0), nextQueue(0)
+{
+	workerNum = workerNum < 0 ? 0 : (workerNum > MAX_WORKERS ? MAX_WORKERS : workerNum);
+	shutdown = false;
+	pthread_mutex_init(&sleepLock, NULL);
+	pthread_cond_init(&wake, NULL);
+
+	for (int32_t i = 0; i < (0 == workerNum ? 1 : workerNum); ++i) {
+		TaskQueue* queue = new TaskQueue();
+		pthread_mutex_init(&queue->lock, NULL);
+		queues.push_back(queue);
+	}
+	workers.resize(workerNum);
+	for (int32_t i = 0; i < workerNum; ++i) {
+		workers[i].pool = this;
+		workers[i].index = i;
+		// Tasks of a worker that did not start are stolen by the others, or run by the waiting thread
+		workers[i].started = 0 == pthread_create(&workers[i].thread, NULL, workerThread, &workers[i]);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	pthread_mutex_lock(&sleepLock);
+	shutdown = true;
+	pthread_cond_broadcast(&wake);
+	pthread_mutex_unlock(&sleepLock);
+	for (vector<Worker>::iterator i = workers.begin(); i != workers.end(); ++i) {
+		if (i->started) {
+			pthread_join(i->thread, NULL);
+		}
+	}
+	for (vector<TaskQueue*>::iterator i = queues.begin(); i != queues.end(); ++i) {
+		pthread_mutex_destroy(&(*i)->lock);
+		delete *i;
+	}
+	pthread_cond_destroy(&wake);
+	pthread_mutex_destroy(&sleepLock);
+}
+
+int32_t WorkerPool::getWorkerCount() const
+{
+	return workers.size();
+}
+
+void WorkerPool::push(const Task& task)
+{
+	// Workers keep their own tasks, other threads spread theirs
+	uint32_t queue = this == currentPool ? currentWorker : nextQueue.fetch_add(1, memory_order_relaxed) % queues.size();
+	pthread_mutex_lock(&queues[queue]->lock);
+	queues[queue]->tasks.push_back(task);
+	queued.fetch_add(1, memory_order_release);
+	pthread_mutex_unlock(&queues[queue]->lock);
+}
+
+void WorkerPool::wakeAll()
+{
+	// Sleepers check for work under sleepLock, taking it here means none of them misses this
+	pthread_mutex_lock(&sleepLock);
+	pthread_cond_broadcast(&wake);
+	pthread_mutex_unlock(&sleepLock);
+}
+
+bool WorkerPool::runQueuedTask()
+{
+	int32_t self = this == currentPool ? currentWorker : -1;
+	int32_t queueNum = queues.size();
+	int32_t first = 0 <= self ? self : nextQueue.load(memory_order_relaxed) % queueNum;
+	Task task;
+	bool found = false;
+	for (int32_t i = 0; i < queueNum && !found; ++i) {
+		TaskQueue* queue = queues[(first + i) % queueNum];
+		pthread_mutex_lock(&queue->lock);
+		if (!queue->tasks.empty()) {
+			// Newest first from our own queue while it is still in cache, oldest first when stealing
+			if (0 == i && 0 <= self) {
+				task = queue->tasks.back();
+				queue->tasks.pop_back();
+			} else {
+				task = queue->tasks.front();
+				queue->tasks.pop_front();
+			}
+			queued.fetch_sub(1, memory_order_relaxed);
+			found = true;
+		}
+		pthread_mutex_unlock(&queue->lock);
+	}
+	if (!found) {
+		return false;
+	}
+
+	task.run();
+	finish(task.group);
+	return true;
+}
+
+void WorkerPool::finish(TaskGroup* group)
+{
+	// The group may be gone as soon as pending is 0
+	if (1 == group->pending.fetch_sub(1, memory_order_acq_rel)) {
+		wakeAll();
+	}
+}
+
+void* WorkerPool::workerThread(void* data)
+{
+	Worker* worker = (Worker*)data;
+	WorkerPool* pool = worker->pool;
+	currentPool = pool;
+	currentWorker = worker->index;
+
+	while (true) {
+		if (pool->runQueuedTask()) {
+			continue;
+		}
+		pthread_mutex_lock(&pool->sleepLock);
+		while (0 >= pool->queued.load(memory_order_acquire) && !pool->shutdown) {
+			pthread_cond_wait(&pool->wake, &pool->sleepLock);
+		}
+		bool stop = pool->shutdown && 0 >= pool->queued.load(memory_order_acquire);
+		pthread_mutex_unlock(&pool->sleepLock);
+		if (stop) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+void WorkerPool::run(TaskGroup* group, const function<void()>& task)
+{
+	Task queuedTask;
+	queuedTask.run = task;
+	queuedTask.group = group;
+	group->pending.fetch_add(1, memory_order_relaxed);
+	push(queuedTask);
+	wakeAll();
+}
+
+void WorkerPool::wait(TaskGroup* group)
+{
+	while (0 < group->pending.load(memory_order_acquire)) {
+		if (runQueuedTask()) {
+			continue;
+		}
+		pthread_mutex_lock(&sleepLock);
+		while (0 < group->pending.load(memory_order_acquire) && 0 >= queued.load(memory_order_acquire)) {
+			pthread_cond_wait(&wake, &sleepLock);
+		}
+		pthread_mutex_unlock(&sleepLock);
+	}
+}
+
+void WorkerPool::parallelFor(uint32_t count, const function<void(uint32_t i)>& body)
+{
+	if (0 == count) {
+		return;
+	}
+	TaskGroup group;
+	if (1 < count) {
+		group.pending.store(count - 1, memory_order_relaxed);
+		for (uint32_t i = 1; i < count; ++i) {
+			Task task;
+			task.run = [&body, i]() { body(i); };
+			task.group = &group;
+			push(task);
+		}
+		wakeAll();
+	}
+	body(0);
+	wait(&group);
+}
+
+void WorkerPool::parallelFor(uint32_t begin, uint32_t end, uint32_t chunkNum,
+		const function<void(uint32_t chunk, uint32_t chunkBegin, uint32_t chunkEnd)>& body)
+{
+	if (end <= begin || 0 == chunkNum) {
+		return;
+	}
+	uint64_t count = end - begin;
+	parallelFor(chunkNum, [&](uint32_t chunk) {
+		uint32_t chunkBegin = begin + (uint32_t)(count * chunk / chunkNum);
+		uint32_t chunkEnd = begin + (uint32_t)(count * (chunk + 1) / chunkNum);
+		if (chunkBegin < chunkEnd) {
+			body(chunk, chunkBegin, chunkEnd);
+		}
+	});
+}
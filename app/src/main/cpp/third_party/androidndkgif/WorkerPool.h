@@ -0,0 +1,84 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Worker threads kept for the life of the process and shared by every encoder, so encoding a GIF
+// starts no threads of its own. Each worker runs its own queue newest first and steals the oldest
+// task of another queue when it runs out. A thread waiting for tasks runs queued ones meanwhile,
+// so tasks may wait for tasks of their own and pool threads may call parallelFor() too.
+class WorkerPool
+{
+public:
+	static const int32_t MAX_WORKERS = 15;
+
+	// Tasks waited for together, lives on the waiting thread's stack
+	class TaskGroup
+	{
+	public:
+		TaskGroup() : pending(0) {}
+	private:
+		friend class WorkerPool;
+		std::atomic<int32_t> pending;
+	};
+
+	// A worker per core besides the thread handing out the work, created on first use and never
+	// destroyed
+	static WorkerPool& shared();
+
+	explicit WorkerPool(int32_t workerNum);
+	~WorkerPool();
+
+	// The calling thread works as well, so up to one more thread than this runs a parallelFor()
+	int32_t getWorkerCount() const;
+
+	void run(TaskGroup* group, const std::function<void()>& task);
+	// Returns once every task of the group has run
+	void wait(TaskGroup* group);
+
+	// body(i) for every i below count, the calling thread takes i = 0. Returns once all are done.
+	void parallelFor(uint32_t count, const std::function<void(uint32_t i)>& body);
+	// body(chunk, chunkBegin, chunkEnd) for chunkNum even slices of [begin, end), like rows of a
+	// frame or frames of a GIF. Empty slices are skipped.
+	void parallelFor(uint32_t begin, uint32_t end, uint32_t chunkNum,
+			const std::function<void(uint32_t chunk, uint32_t chunkBegin, uint32_t chunkEnd)>& body);
+
+private:
+	struct Task
+	{
+		std::function<void()> run;
+		TaskGroup* group;
+	};
+
+	struct TaskQueue
+	{
+		pthread_mutex_t lock;
+		std::deque<Task> tasks;
+	};
+
+	struct Worker
+	{
+		WorkerPool* pool;
+		int32_t index;
+		pthread_t thread;
+		bool started;
+	};
+
+	std::vector<TaskQueue*> queues; // One per worker, or one the waiting threads run without any
+	std::vector<Worker> workers;
+	std::atomic<int32_t> queued;
+	std::atomic<uint32_t> nextQueue;
+	pthread_mutex_t sleepLock;
+	pthread_cond_t wake;
+	bool shutdown;
+
+	void push(const Task& task);
+	void wakeAll();
+	bool runQueuedTask();
+	void finish(TaskGroup* group);
+	static void* workerThread(void* data);
+};
@@ -14,9 +14,11 @@
 
 #include <cstdlib>
 #include <cstring>
-#include <jni.h>
 #include <vulkan/vulkan_core.h>
+#ifdef ANDROID
+#include <jni.h>
 #include <vulkan/vulkan_android.h>
+#endif
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <string>
@@ -18,14 +18,15 @@
 #define VULKAN_PHOTO_BOOTH_VULKANAHARDWAREBUFFERIMAGE_H
 
 #include "VulkanInstance.h"
+#include "VulkanInputImage.h"
 
 /**
  * Class to allow importing an AHardwareBuffer into Vulkan
  */
-class VulkanAHardwareBufferImage {
+class VulkanAHardwareBufferImage : public VulkanInputImage {
 public:
     VulkanAHardwareBufferImage(VulkanInstance *init);
-    ~VulkanAHardwareBufferImage();
+    ~VulkanAHardwareBufferImage() override;
 
     /**
      * Setup the Vulkan AHB
@@ -36,11 +37,12 @@ public:
      * @return
      */
     bool init(AHardwareBuffer *buffer, bool useExternalFormat, int syncFd = -1);
-    VkImage image() { return mImage; }
-    VkSampler sampler() { return mSampler; }
-    VkImageView view() { return mView; }
-    VkSemaphore semaphore() { return mSemaphore; }
-    bool isSamplerImmutable() { return mConversion != VK_NULL_HANDLE; }
+    VkImage image() override { return mImage; }
+    VkSampler sampler() override { return mSampler; }
+    VkImageView view() override { return mView; }
+    VkSemaphore semaphore() override { return mSemaphore; }
+    bool isSamplerImmutable() override { return mConversion != VK_NULL_HANDLE; }
+    bool isExternal() override { return true; }
 
 private:
     VulkanInstance *const mInstance;
@@ -0,0 +1,233 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include "VulkanHostImage.h"
+#include "vulkan_utils.h"
+
+VulkanHostImage::VulkanHostImage(VulkanInstance *instance) : mInstance(instance) {
+}
+
+VulkanHostImage::~VulkanHostImage() {
+    if (mUploadFence != VK_NULL_HANDLE) {
+        vkDestroyFence(mInstance->device(), mUploadFence, nullptr);
+        mUploadFence = VK_NULL_HANDLE;
+    }
+    if (mCmdPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(mInstance->device(), mCmdPool, nullptr);
+        mCmdPool = VK_NULL_HANDLE;
+    }
+    if (mStagingData != nullptr) {
+        vkUnmapMemory(mInstance->device(), mStagingMemory);
+        mStagingData = nullptr;
+    }
+    if (mStagingBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(mInstance->device(), mStagingBuffer, nullptr);
+        mStagingBuffer = VK_NULL_HANDLE;
+    }
+    if (mStagingMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(mInstance->device(), mStagingMemory, nullptr);
+        mStagingMemory = VK_NULL_HANDLE;
+    }
+    if (mSampler != VK_NULL_HANDLE) {
+        vkDestroySampler(mInstance->device(), mSampler, nullptr);
+        mSampler = VK_NULL_HANDLE;
+    }
+    if (mView != VK_NULL_HANDLE) {
+        vkDestroyImageView(mInstance->device(), mView, nullptr);
+        mView = VK_NULL_HANDLE;
+    }
+    if (mImage != VK_NULL_HANDLE) {
+        vkDestroyImage(mInstance->device(), mImage, nullptr);
+        mImage = VK_NULL_HANDLE;
+    }
+    if (mMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(mInstance->device(), mMemory, nullptr);
+        mMemory = VK_NULL_HANDLE;
+    }
+}
+
+bool VulkanHostImage::init(uint32_t width, uint32_t height) {
+    mWidth = width;
+    mHeight = height;
+
+    VkImageCreateInfo createInfo{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = VK_FORMAT_R8G8B8A8_UNORM,
+            .extent = { width, height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = nullptr,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    VK_CALL(vkCreateImage(mInstance->device(), &createInfo, nullptr, &mImage));
+
+    VkMemoryRequirements memReq;
+    vkGetImageMemoryRequirements(mInstance->device(), mImage, &memReq);
+    VkMemoryAllocateInfo allocInfo{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .allocationSize = memReq.size,
+            .memoryTypeIndex = mInstance->findMemoryType(memReq.memoryTypeBits,
+                                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+    };
+    VK_CALL(vkAllocateMemory(mInstance->device(), &allocInfo, nullptr, &mMemory));
+    VK_CALL(vkBindImageMemory(mInstance->device(), mImage, mMemory, 0));
+
+    VkImageViewCreateInfo viewCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .image = mImage,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = VK_FORMAT_R8G8B8A8_UNORM,
+            .components = {VK_COMPONENT_SWIZZLE_IDENTITY,
+                           VK_COMPONENT_SWIZZLE_IDENTITY,
+                           VK_COMPONENT_SWIZZLE_IDENTITY,
+                           VK_COMPONENT_SWIZZLE_IDENTITY},
+            .subresourceRange = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+            },
+    };
+    VK_CALL(vkCreateImageView(mInstance->device(), &viewCreateInfo, nullptr, &mView));
+
+    // Match the camera sampler: linear filtering, no wrapping at the frame edges
+    VkSamplerCreateInfo samplerCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .pNext = nullptr,
+            .magFilter = VK_FILTER_LINEAR,
+            .minFilter = VK_FILTER_LINEAR,
+            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .mipLodBias = 0.0f,
+            .anisotropyEnable = VK_FALSE,
+            .maxAnisotropy = 1,
+            .compareEnable = VK_FALSE,
+            .compareOp = VK_COMPARE_OP_NEVER,
+            .minLod = 0.0f,
+            .maxLod = 0.0f,
+            .borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK,
+            .unnormalizedCoordinates = VK_FALSE,
+    };
+    VK_CALL(vkCreateSampler(mInstance->device(), &samplerCreateInfo, nullptr, &mSampler));
+
+    // Persistently mapped staging buffer
+    ASSERT(createBuffer(mInstance, VkDeviceSize(width) * height * 4, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        &mStagingBuffer, &mStagingMemory));
+    VK_CALL(vkMapMemory(mInstance->device(), mStagingMemory, 0, VK_WHOLE_SIZE, 0, &mStagingData));
+
+    VkCommandPoolCreateInfo cmdPoolCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = mInstance->queueFamilyIndex(),
+    };
+    VK_CALL(vkCreateCommandPool(mInstance->device(), &cmdPoolCreateInfo, nullptr, &mCmdPool));
+
+    VkCommandBufferAllocateInfo cmdBufferAllocateInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .commandPool = mCmdPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+    };
+    VK_CALL(vkAllocateCommandBuffers(mInstance->device(), &cmdBufferAllocateInfo, &mCmdBuffer));
+
+    VkFenceCreateInfo fenceCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+    };
+    VK_CALL(vkCreateFence(mInstance->device(), &fenceCreateInfo, nullptr, &mUploadFence));
+
+    return true;
+}
+
+bool VulkanHostImage::upload(const uint32_t *pixels) {
+    memcpy(mStagingData, pixels, size_t(mWidth) * mHeight * 4);
+
+    VkCommandBufferBeginInfo cmdBufferBeginInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext = nullptr,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = nullptr,
+    };
+    VK_CALL(vkBeginCommandBuffer(mCmdBuffer, &cmdBufferBeginInfo));
+
+    // The previous contents are always fully overwritten, but earlier frames may still be sampling
+    addImageTransitionBarrier(
+            mCmdBuffer, mImage,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    VkBufferImageCopy region{
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = 0,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+            },
+            .imageOffset = { 0, 0, 0 },
+            .imageExtent = { mWidth, mHeight, 1 },
+    };
+    vkCmdCopyBufferToImage(mCmdBuffer, mStagingBuffer, mImage,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    // VulkanImageRenderer expects input images in the GENERAL layout, as camera AHBs arrive
+    addImageTransitionBarrier(
+            mCmdBuffer, mImage,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+
+    VK_CALL(vkEndCommandBuffer(mCmdBuffer));
+
+    VkSubmitInfo submitInfo{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = nullptr,
+            .waitSemaphoreCount = 0,
+            .pWaitSemaphores = nullptr,
+            .pWaitDstStageMask = nullptr,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &mCmdBuffer,
+            .signalSemaphoreCount = 0,
+            .pSignalSemaphores = nullptr,
+    };
+    VK_CALL(vkQueueSubmit(mInstance->queue(), 1, &submitInfo, mUploadFence));
+    VK_CALL(vkWaitForFences(mInstance->device(), 1, &mUploadFence, VK_TRUE, UINT64_MAX));
+    VK_CALL(vkResetFences(mInstance->device(), 1, &mUploadFence));
+
+    return true;
+}
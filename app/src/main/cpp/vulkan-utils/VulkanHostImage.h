@@ -0,0 +1,80 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_PHOTO_BOOTH_VULKANHOSTIMAGE_H
+#define VULKAN_PHOTO_BOOTH_VULKANHOSTIMAGE_H
+
+#include "VulkanInstance.h"
+#include "VulkanInputImage.h"
+
+/**
+ * RGBA8 texture filled from CPU memory
+ *
+ * Stands in for the camera AHB when the renderer is run on a host without a camera, e.g. when
+ * profiling renderImageAndReadback against lavapipe or SwiftShader.
+ */
+class VulkanHostImage : public VulkanInputImage {
+public:
+    VulkanHostImage(VulkanInstance *instance);
+    ~VulkanHostImage() override;
+
+    /**
+     * Create the image, its staging buffer and a sampler
+     *
+     * @param width
+     * @param height
+     * @return If initialization was successful
+     */
+    bool init(uint32_t width, uint32_t height);
+
+    /**
+     * Copy a new frame into the image. Blocks until the copy has completed on the GPU.
+     *
+     * @param pixels width * height RGBA8888 pixels, tightly packed
+     * @return If the upload was successful
+     */
+    bool upload(const uint32_t *pixels);
+
+    VkImage image() override { return mImage; }
+    VkSampler sampler() override { return mSampler; }
+    VkImageView view() override { return mView; }
+    VkSemaphore semaphore() override { return VK_NULL_HANDLE; }
+    bool isSamplerImmutable() override { return false; }
+    bool isExternal() override { return false; }
+
+    uint32_t width() { return mWidth; }
+    uint32_t height() { return mHeight; }
+
+private:
+    VulkanInstance *const mInstance;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+
+    VkImage mImage = VK_NULL_HANDLE;
+    VkDeviceMemory mMemory = VK_NULL_HANDLE;
+    VkImageView mView = VK_NULL_HANDLE;
+    VkSampler mSampler = VK_NULL_HANDLE;
+
+    VkBuffer mStagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory mStagingMemory = VK_NULL_HANDLE;
+    void *mStagingData = nullptr;
+
+    VkCommandPool mCmdPool = VK_NULL_HANDLE;
+    VkCommandBuffer mCmdBuffer = VK_NULL_HANDLE;
+    VkFence mUploadFence = VK_NULL_HANDLE;
+};
+
+#endif //VULKAN_PHOTO_BOOTH_VULKANHOSTIMAGE_H
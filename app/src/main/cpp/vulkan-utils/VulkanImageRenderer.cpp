@@ -15,13 +15,17 @@
  */
 
 #include <vulkan/vulkan.h>
+#ifdef ANDROID
 #include <android/native_window.h>
 #include <android/trace.h>
+#endif
 #include <chrono>
 #include <unistd.h>
 #include <cmath>
+#include <cstring>
 #include "VulkanImageRenderer.h"
 #include "vulkan_utils.h"
+#include "../third_party/androidndkgif/PixelConvert.h"
 
 // For validation we should use FOREIGN here, but EXTERNAL can be faster.
  const uint32_t VULKAN_QUEUE_FAMILY = VK_QUEUE_FAMILY_EXTERNAL_KHR;
@@ -29,22 +33,42 @@
 
 VulkanImageRenderer::VulkanImageRenderer(VulkanInstance *init,  uint32_t num_displays,
         uint32_t width, uint32_t height,
-                                         VkFormat format, VkColorSpaceKHR colorSpace)
+                                         VkFormat format, VkColorSpaceKHR colorSpace,
+                                         uint32_t framesInFlight)
         :   mInstance(init), VULKAN_RENDERER_NUM_DISPLAYS(num_displays),
-            mImageReaderWidth(width), mImageReaderHeight(height), mFormat(format), mColorSpace(colorSpace) {
+            mImageReaderWidth(width), mImageReaderHeight(height), mFormat(format), mColorSpace(colorSpace),
+            mFramesInFlight(framesInFlight > 0 ? framesInFlight : 1), mPaletteMapper(init) {
 
     // Set up vectors to be the size of the number of displays
     for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
         mSurfaces.push_back(VulkanSurface(mInstance, &mFormat, &mColorSpace));
         mPipelines.push_back(VK_NULL_HANDLE);
-        mCmdBuffers.push_back(VK_NULL_HANDLE);
         mDescriptorPools.push_back(VK_NULL_HANDLE);
     }
-
-    mDescriptorSets.resize(VULKAN_RENDERER_NUM_DISPLAYS);
 }
 
+#ifdef ANDROID
 bool VulkanImageRenderer::init(ANativeWindow *output_window, ANativeWindow *output_window_left, ANativeWindow *output_window_right, uint32_t rendererCopyWidth, uint32_t rendererCopyHeight) {
+    // Set up each output surface. 1 == Center. 2 == Left. 3 == Right
+    ASSERT(mSurfaces[0].init(output_window));
+    if (2 <= VULKAN_RENDERER_NUM_DISPLAYS)
+        ASSERT(mSurfaces[1].init(output_window_left));
+    if (3 <= VULKAN_RENDERER_NUM_DISPLAYS)
+        ASSERT(mSurfaces[2].init(output_window_right));
+
+    return initRenderer(rendererCopyWidth, rendererCopyHeight);
+}
+#else
+bool VulkanImageRenderer::initHeadless(uint32_t outputWidth, uint32_t outputHeight, uint32_t rendererCopyWidth, uint32_t rendererCopyHeight) {
+    for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
+        ASSERT(mSurfaces[surface_i].initHeadless(outputWidth, outputHeight));
+    }
+
+    return initRenderer(rendererCopyWidth, rendererCopyHeight);
+}
+#endif
+
+bool VulkanImageRenderer::initRenderer(uint32_t rendererCopyWidth, uint32_t rendererCopyHeight) {
     // Create render pass
     {
         VkAttachmentDescription attachmentDescs[1] {
@@ -170,13 +194,6 @@ bool VulkanImageRenderer::init(ANativeWindow *output_window, ANativeWindow *outp
                                         &mCmdPool));
         }
 
-        // Set up each output surface. 1 == Center. 2 == Left. 3 == Right
-        mSurfaces[0].init(output_window);
-        if (2 <= VULKAN_RENDERER_NUM_DISPLAYS)
-            mSurfaces[1].init(output_window_left);
-        if (3 <= VULKAN_RENDERER_NUM_DISPLAYS)
-            mSurfaces[2].init(output_window_right);
-
         // Setup a swapchain for each output surface
         mSwapchains = std::vector<VulkanSwapchain>(VULKAN_RENDERER_NUM_DISPLAYS, VulkanSwapchain(mInstance, &mCmdPool));
         for (int i = 0; i < VULKAN_RENDERER_NUM_DISPLAYS; i++) {
@@ -243,25 +260,25 @@ bool VulkanImageRenderer::init(ANativeWindow *output_window, ANativeWindow *outp
                     // New image sampler
                     {
                             .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                            .descriptorCount = mSwapchains[surface_i].mSwapchainLength,
+                            .descriptorCount = mFramesInFlight,
                     },
 
                     // Previous image sampler
                     {
                             .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                            .descriptorCount = mSwapchains[surface_i].mSwapchainLength,
+                            .descriptorCount = mFramesInFlight,
                     },
 
                     // ShaderVars
                     {
                             .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                            .descriptorCount = mSwapchains[surface_i].mSwapchainLength,
+                            .descriptorCount = mFramesInFlight,
                     },
             };
             const VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{
                     .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
                     .pNext = nullptr,
-                    .maxSets = mSwapchains[surface_i].mSwapchainLength,
+                    .maxSets = mFramesInFlight,
                     .poolSizeCount = 3,
                     .pPoolSizes = descriptorPoolSizes,
             };
@@ -293,11 +310,21 @@ bool VulkanImageRenderer::init(ANativeWindow *output_window, ANativeWindow *outp
     };
     VK_CALL(vkCreateSampler(mInstance->device(), &samplerCreateInfo, nullptr, &mRgbSampler));
 
+    // Command buffers, uniform buffers and sync objects for each frame in flight
+    ASSERT(createFrameContexts());
+
+    // Optional, GIF frames are read back as RGB565 without it
+    mPaletteMapper.init(VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH, VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT,
+                        mFramesInFlight);
 
     return true;
 }
 
 VulkanImageRenderer::~VulkanImageRenderer() {
+    // Nothing can be destroyed while frames are still in flight
+    vkDeviceWaitIdle(mInstance->device());
+    destroyFrameContexts();
+
     for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
         if (mDescriptorPools[surface_i] != VK_NULL_HANDLE) {
             vkDestroyDescriptorPool(mInstance->device(), mDescriptorPools[surface_i], nullptr);
@@ -543,226 +570,149 @@ bool VulkanImageRenderer::createPipeline(VkSampler sampler,
         } // For all surfaces
     }
 
-    // Create a command buffers and descriptor sets
+    // Create descriptor sets. One for each frame in flight, so a set is never updated while the GPU reads it
     for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
+        for (FrameContext &frameContext : mFrameContexts) {
+            VkDescriptorSetAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = mDescriptorPools[surface_i];
+            allocInfo.descriptorSetCount = 1;
+            allocInfo.pSetLayouts = &mDescriptorLayout;
+            VK_CALL(vkAllocateDescriptorSets(mInstance->device(), &allocInfo, &frameContext.descriptorSets[surface_i]));
+        }
+    }
+
+    return true;
+}
+
+bool VulkanImageRenderer::createFrameContexts() {
+    mFrameContexts.resize(mFramesInFlight);
+
+    for (uint32_t i = 0; i < mFramesInFlight; i++) {
+        FrameContext &frameContext = mFrameContexts[i];
+        frameContext.index = i;
+
+        // Start signalled so the first use of each context does not wait
+        VkFenceCreateInfo fenceCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+        };
+        VK_CALL(vkCreateFence(mInstance->device(), &fenceCreateInfo, nullptr, &frameContext.fence));
+        frameContext.aimage = nullptr;
+        frameContext.readbackDestination = nullptr;
+        frameContext.readbackImage = nullptr;
+        frameContext.readbackIndices = false;
+
+        frameContext.cmdBuffers.resize(VULKAN_RENDERER_NUM_DISPLAYS, VK_NULL_HANDLE);
+        frameContext.acquireSemaphores.resize(VULKAN_RENDERER_NUM_DISPLAYS, VK_NULL_HANDLE);
+        frameContext.shaderVarsBuffers.resize(VULKAN_RENDERER_NUM_DISPLAYS, VK_NULL_HANDLE);
+        frameContext.shaderVarsMemory.resize(VULKAN_RENDERER_NUM_DISPLAYS, VK_NULL_HANDLE);
+        frameContext.shaderVarsMapped.resize(VULKAN_RENDERER_NUM_DISPLAYS, nullptr);
+        frameContext.descriptorSets.resize(VULKAN_RENDERER_NUM_DISPLAYS, VK_NULL_HANDLE);
 
         VkCommandBufferAllocateInfo cmdBufferCreateInfo{
                 .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
                 .pNext = nullptr,
                 .commandPool = mCmdPool,
                 .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-                .commandBufferCount = 1,
+                .commandBufferCount = VULKAN_RENDERER_NUM_DISPLAYS,
         };
         VK_CALL(vkAllocateCommandBuffers(mInstance->device(), &cmdBufferCreateInfo,
-                                         &mCmdBuffers[surface_i]));
-
-        // One descriptor set for each swapchain image
-        std::vector<VkDescriptorSetLayout> layouts(mSwapchains[surface_i].mSwapchainLength, mDescriptorLayout);
-        VkDescriptorSetAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = mDescriptorPools[surface_i];
-        allocInfo.descriptorSetCount = mSwapchains[surface_i].mSwapchainLength;
-        allocInfo.pSetLayouts = layouts.data();
-        mDescriptorSets[surface_i].resize(mSwapchains[surface_i].mSwapchainLength);
-        VK_CALL(vkAllocateDescriptorSets(mInstance->device(), &allocInfo, mDescriptorSets[surface_i].data()));
+                                         frameContext.cmdBuffers.data()));
+
+        for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
+            VkSemaphoreCreateInfo semaphoreCreateInfo = {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            };
+            VK_CALL(vkCreateSemaphore(mInstance->device(), &semaphoreCreateInfo, nullptr,
+                                      &frameContext.acquireSemaphores[surface_i]));
+
+            // Uniform buffers stay mapped for the lifetime of the renderer
+            ASSERT(createBuffer(mInstance, sizeof(ShaderVars), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                &frameContext.shaderVarsBuffers[surface_i], &frameContext.shaderVarsMemory[surface_i]));
+            VK_CALL(vkMapMemory(mInstance->device(), frameContext.shaderVarsMemory[surface_i], 0,
+                                sizeof(ShaderVars), 0, &frameContext.shaderVarsMapped[surface_i]));
+        }
     }
 
+    logd("Renderer using %d frames in flight.", mFramesInFlight);
     return true;
 }
 
-double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *vkAHB,
-                                                    FilterParams *filter_params,
-                                                   AImage *new_aimage,
-                                                   bool draw_to_screen, bool surface_ready_left, bool surface_ready_right,
-                                                   RENDERER_RETURN_CODE &render_state,
-                                                   uint32_t *image_copy_data) {
-
-    // Define button for blur / multi-frame effects, if engaged, do an extra blit-out
-    const int BLUR_BUTTON = 5;
-
-    // If Kotlin needs the screen, free up all images and return
-    // TODO: this should be a seperate function from renderImageAndReadback with boolean check in native-lib.cpp
-    if (!draw_to_screen) {
-        AImage_delete(new_aimage);
-
-        // Wait for all surfaces to be done rendering and free up resources
+void VulkanImageRenderer::destroyFrameContexts() {
+    for (FrameContext &frameContext : mFrameContexts) {
+        if (frameContext.aimage != nullptr) {
+            AImage_delete(frameContext.aimage);
+            frameContext.aimage = nullptr;
+        }
         for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
-
-            SwapchainImage *swapchainImage = &mSwapchains[surface_i].mSwapchainImages[mSwapchains[surface_i].mSwapchainIndex];
-
-            // Wait for any Vulkan rendering to finish
-            // Note: these may be out of order from mSwapchainImages. This doesn't matter, wait for them all
-            for (int fence_index = 0; fence_index < mSwapchains[surface_i].mSwapchainLength; fence_index++) {
-                VK_CALL(vkWaitForFences(mInstance->device(), 1, &mSwapchains[surface_i].mSwapchainFences[fence_index], true, UINT64_MAX));
+            if (frameContext.shaderVarsMapped[surface_i] != nullptr) {
+                vkUnmapMemory(mInstance->device(), frameContext.shaderVarsMemory[surface_i]);
+                frameContext.shaderVarsMapped[surface_i] = nullptr;
             }
-
-            //Delete any AImages
-            // Each active surface depends on the camera image/ahb, free them when the last surface is done with it.
-            for (int swapchain_index = 0; swapchain_index < mSwapchains[surface_i].mSwapchainLength; swapchain_index++) {
-                if (swapchainImage->old_aimage != nullptr) {
-                    if (surface_i >= (VULKAN_RENDERER_NUM_DISPLAYS - 1)) {
-                        AImage_delete(swapchainImage->old_aimage);
-                    }
-                    swapchainImage->old_aimage = nullptr;
-                }
+            if (frameContext.shaderVarsBuffers[surface_i] != VK_NULL_HANDLE) {
+                vkDestroyBuffer(mInstance->device(), frameContext.shaderVarsBuffers[surface_i], nullptr);
+                frameContext.shaderVarsBuffers[surface_i] = VK_NULL_HANDLE;
+            }
+            if (frameContext.shaderVarsMemory[surface_i] != VK_NULL_HANDLE) {
+                vkFreeMemory(mInstance->device(), frameContext.shaderVarsMemory[surface_i], nullptr);
+                frameContext.shaderVarsMemory[surface_i] = VK_NULL_HANDLE;
+            }
+            if (frameContext.acquireSemaphores[surface_i] != VK_NULL_HANDLE) {
+                vkDestroySemaphore(mInstance->device(), frameContext.acquireSemaphores[surface_i], nullptr);
+                frameContext.acquireSemaphores[surface_i] = VK_NULL_HANDLE;
+            }
+            if (frameContext.cmdBuffers[surface_i] != VK_NULL_HANDLE) {
+                vkFreeCommandBuffers(mInstance->device(), mCmdPool, 1, &frameContext.cmdBuffers[surface_i]);
+                frameContext.cmdBuffers[surface_i] = VK_NULL_HANDLE;
             }
         }
-
-        render_state = RENDER_QUEUE_EMPTY;
-        return 0.0;
+        if (frameContext.fence != VK_NULL_HANDLE) {
+            vkDestroyFence(mInstance->device(), frameContext.fence, nullptr);
+            frameContext.fence = VK_NULL_HANDLE;
+        }
     }
+    mFrameContexts.clear();
+}
 
+double VulkanImageRenderer::waitForFrameContext(FrameContext &frameContext) {
+    double wait_ms = 0;
 
-    // Render image to all surfaces
-    ATrace_beginSection("VULKAN_PHOTOBOOTH: render wait for fences");
-    for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
-
-        // Grab the next swapchain image for each surface, wait for them to be done presenting
-        mSwapchains[surface_i].mSwapchainFenceIndex =
-                (mSwapchains[surface_i].mSwapchainFenceIndex + 1) % mSwapchains[surface_i].mSwapchainLength;
-        VK_CALL(vkResetFences(mInstance->device(), 1,
-                              &mSwapchains[surface_i].mSwapchainFences[mSwapchains[surface_i].mSwapchainFenceIndex]));
-
-        ATrace_beginSection("VULKAN_PHOTOBOOTH: render acquire next image KHR");
-
-        VK_CALL(vkAcquireNextImageKHR(mInstance->device(), mSwapchains[surface_i].mVkSwapchain,
-                /*timeout*/ UINT64_MAX,
-                /*semaphore*/ VK_NULL_HANDLE,
-                mSwapchains[surface_i].mSwapchainFences[mSwapchains[surface_i].mSwapchainFenceIndex],
-                &mSwapchains[surface_i].mSwapchainIndex));
-        ATrace_endSection();
-        ATrace_beginSection("VULKAN_PHOTOBOOTH: render wait for present fences...");
-
-        // TODO: performance: get a semaphore here instead and pass it into VkQueueSubmit
-
-        // Wait until the swapchain image is ready to use
-        VK_CALL(vkWaitForFences(mInstance->device(), 1,
-                                &mSwapchains[surface_i].mSwapchainFences[mSwapchains[surface_i].mSwapchainFenceIndex],
-                                VK_TRUE, UINT64_MAX));
+    if (VK_NOT_READY == vkGetFenceStatus(mInstance->device(), frameContext.fence)) {
+        // The CPU has lapped the GPU
+        ATrace_beginSection("VULKAN_PHOTOBOOTH: render wait for frame in flight");
+        double wait_start = now_ms();
+        vkWaitForFences(mInstance->device(), 1, &frameContext.fence, VK_TRUE, UINT64_MAX);
+        wait_ms = now_ms() - wait_start;
         ATrace_endSection();
-        // Wait for any Vulkan rendering to finish
-
-//        SwapchainImage *swapchainImage = &mSwapchains[surface_i].mSwapchainImages[mSwapchains[surface_i].mSwapchainIndex];
-
-        // TODO Shouldn't need the imageFenceSet because we're waiting above
-
-        // Make sure the display is done with the image buffer from the previous time this swapchain image was used
-//        if (swapchainImage->imageFenceSet) {
-//            VK_CALL(vkWaitForFences(mInstance->device(), 1, &swapchainImage->imageFence, true, UINT64_MAX));
-//            swapchainImage->imageFenceSet = false;
-//        }
-    } // for all surfaces
-    ATrace_endSection();
-
-    /**
-     * The next section copies the frame in this swapchain if it is required for GIF creation.
-     *
-     * Adapted from: https://github.com/SaschaWillems/Vulkan/blob/master/examples/screenshot/screenshot.cpp#L230
-     */
-    if (nullptr != image_copy_data) {
-        ATrace_beginSection("VULKAN_PHOTOBOOTH: copy out frame for animated gif buffer");
-        SwapchainImage *swapchainImage = &mSwapchains[0].mSwapchainImages[mSwapchains[0].mSwapchainIndex];
-
-        /*
-        // Check if blitting is supported
-        bool supportsBlit = true;
-
-        // Check blit support for source and destination
-        VkFormatProperties formatProps;
-
-         // Check if the device supports blitting from optimal images (the swapchain images are in optimal format)
-        vkGetPhysicalDeviceFormatProperties(mInstance->gpu(), VK_FORMAT_R5G6B5_UNORM_PACK16, &formatProps);
-        if (!(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT)) {
-            logd("Device does not support blitting from optimal tiled images");
-            supportsBlit = false;
-        } else {
-            logd("Supports blitting FROM");
-        }
+    }
 
-        // Check if the device supports blitting to linear images
-        vkGetPhysicalDeviceFormatProperties(mInstance->gpu(), VK_FORMAT_A8B8G8R8_UINT_PACK32, &formatProps);
-        if (!(formatProps.linearTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
-            logd("Device does not support blitting to linear tiled images");
-            supportsBlit = false;
-        } else {
-            logd("Supports blitting TO");
-        }
-        */
+    harvestReadback(frameContext);
 
-        VkCommandBufferBeginInfo cmdBufferBeginInfo{
-                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-                .pNext = nullptr,
-                .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-                .pInheritanceInfo = nullptr,
-        };
-        VK_CALL(vkBeginCommandBuffer(swapchainImage->cmdBuffer, &cmdBufferBeginInfo));
-
-        // Do the actual blit from the swapchain image to host visible destination image
-        // Transition destination image to transfer destination layout
-        addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, swapchainImage->imageCopy,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                0, VK_ACCESS_TRANSFER_WRITE_BIT,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                mInstance->queueFamilyIndex(), mInstance->queueFamilyIndex());
+    // The GPU is done with the camera image, hand it back to the ImageReader
+    if (frameContext.aimage != nullptr) {
+        AImage_delete(frameContext.aimage);
+        frameContext.aimage = nullptr;
+    }
 
-        // Transition swapchain image from present to transfer source layout
-        addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, swapchainImage->image,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_ACCESS_MEMORY_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT,
-                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-
-        // Define the region to blit (full size -> render size)
-        VkOffset3D blitSizeSource {
-            .x = (int32_t) mSurfaces[0].mOutputWidth,
-            .y = (int32_t) mSurfaces[0].mOutputHeight,
-            .z = 1,
-        };
-        VkOffset3D blitSizeDestination {
-            .x = (int32_t) VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH,
-            .y = (int32_t) VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT,
-            .z = 1,
-        };
-        VkImageBlit imageBlitRegion{
-            .srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .srcSubresource.layerCount = 1,
-            .srcOffsets[1] = blitSizeSource,
-            .dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .dstSubresource.layerCount = 1,
-            .dstOffsets[1] = blitSizeDestination,
-        };
+    return wait_ms;
+}
 
-        // Issue the blit command
-        vkCmdBlitImage(swapchainImage->cmdBuffer,
-                swapchainImage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                       swapchainImage->imageCopy, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                1, &imageBlitRegion, VK_FILTER_NEAREST);
+void VulkanImageRenderer::harvestReadback(FrameContext &frameContext) {
+    if (nullptr == frameContext.readbackDestination)
+        return;
 
-        // Transition destination image to general layout, which is the required layout for mapping the image memory later on
-        addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, swapchainImage->imageCopy,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+    ATrace_beginSection("VULKAN_PHOTOBOOTH: read back frame for animated gif buffer");
+    double copy_start = now_ms();
 
-        // Transition back the swap chain image after the blit is done
-        addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, swapchainImage->image,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_MEMORY_READ_BIT,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-
-        // Submit the transition and blit commands, wait for copy completion
-        VK_CALL(vkEndCommandBuffer(swapchainImage->cmdBuffer));
-        VkSubmitInfo queueSubmitInfo = {
-                .pNext = nullptr,
-                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                .commandBufferCount = 1,
-                .pCommandBuffers = &swapchainImage->cmdBuffer,
-        };
-        VK_CALL(vkQueueSubmit(mInstance->queue(), 1, &queueSubmitInfo, swapchainImage->imageCopyFence));
-        VK_CALL(vkWaitForFences(mInstance->device(), 1, &swapchainImage->imageCopyFence, true, UINT64_MAX));
+    if (frameContext.readbackIndices) {
+        // One byte per pixel with no padding, mapped cached where the GPU allows it
+        memcpy(frameContext.readbackDestination, mPaletteMapper.indices(frameContext.index),
+               mPaletteMapper.width() * mPaletteMapper.height());
+    } else {
+        SwapchainImage *swapchainImage = frameContext.readbackImage;
 
         // Get layout of the image (including row pitch)
         VkImageSubresource subResource { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0 };
@@ -771,126 +721,125 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
 
         // Map image memory to allow copying from it
         char* image_data;
-        VK_CALL(vkMapMemory(mInstance->device(), swapchainImage->imageCopyMemory, 0,
-                            VK_WHOLE_SIZE, 0, (void**) &image_data));
+        vkMapMemory(mInstance->device(), swapchainImage->imageCopyMemory, 0, VK_WHOLE_SIZE, 0, (void**) &image_data);
         image_data += subResourceLayout.offset;
 
-        char* image_copy_data_pointer = (char *) image_copy_data;
-        double start = now_ms();
-        int bytes_per_row = 4 * VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH;
-        for (int y = 0; y < VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT; y++) {
-            uint32_t *row = (uint32_t*) image_data;
-            memcpy(image_copy_data_pointer, row, bytes_per_row);
-            image_copy_data_pointer += bytes_per_row;
-            image_data += subResourceLayout.rowPitch;
-        }
-        // logd("Memcpy took: %fms. Offset: %d. Row pitch: %d. Width: %d.", now_ms() - start, (int) subResourceLayout.offset, (int) subResourceLayout.rowPitch, VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH);
+        // imageCopy is VK_FORMAT_R5G6B5_UNORM_PACK16, the frame is copied as is and only loses the
+        // padding rows may have, in a single copy when they have none
+        copyPixelRows(image_data, subResourceLayout.rowPitch, frameContext.readbackDestination, 0,
+                      sizeof(uint16_t) * VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH,
+                      VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT);
 
         vkUnmapMemory(mInstance->device(), swapchainImage->imageCopyMemory);
-        ATrace_endSection();
     }
 
-    /**
-     * The next section copies the frame in this swapchain if it is required for multi-pass effects
-     *
-     * Keep a copy of the previous frame for multi-pass effects.
-     *
-     * Note: Only use the 1st swapchain or else there will be jiggling from out-of-order frames
-     */
-    if (filter_params->use_filter[BLUR_BUTTON]) {
-        ATrace_beginSection("VULKAN_PHOTOBOOTH: previous frame copy");
+    mCompletedReadbacks.push_back(frameContext.readbackDestination);
+    frameContext.readbackDestination = nullptr;
+    frameContext.readbackImage = nullptr;
+    frameContext.readbackIndices = false;
 
-        // TODO: add every monitor
-        // Copy from the last rendered swapchain into this prev frame VkImage
-        SwapchainImage *swapchainImage = &mSwapchains[0].mSwapchainImages[mSwapchains[0].mSwapchainIndex];
-        SwapchainImage *prevSwapchainImage = &mSwapchains[0].mSwapchainImages[mPrevFrameSwapchainIndex];
+    mStats.readbacks_completed++;
+    mStats.readback_copy_ms_total += now_ms() - copy_start;
+    ATrace_endSection();
+}
 
-        VkCommandBufferBeginInfo cmdBufferBeginInfo{
-                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-                .pNext = nullptr,
-                .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-                .pInheritanceInfo = nullptr,
-        };
-        VK_CALL(vkBeginCommandBuffer(swapchainImage->cmdBuffer, &cmdBufferBeginInfo));
+void VulkanImageRenderer::harvestReadbacks(bool wait, const FrameContext *last) {
+    // Oldest frame first, so readbacks are handed back in the order they were requested
+    for (uint32_t i = 0; i < mFramesInFlight; i++) {
+        FrameContext &frameContext = mFrameContexts[(mFrameContextIndex + i) % mFramesInFlight];
+        if (nullptr == frameContext.readbackDestination) {
+            if (&frameContext == last)
+                return;
+            continue;
+        }
 
-        // Transition destination image to transfer destination layout
-        addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, swapchainImage->imagePrevious,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                0, VK_ACCESS_TRANSFER_WRITE_BIT,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        if (VK_NOT_READY == vkGetFenceStatus(mInstance->device(), frameContext.fence)) {
+            if (!wait)
+                return;
+            vkWaitForFences(mInstance->device(), 1, &frameContext.fence, VK_TRUE, UINT64_MAX);
+        }
+        harvestReadback(frameContext);
+        if (&frameContext == last)
+            return;
+    }
+}
 
-        // Transition N-1 swapchain image from present to transfer source layout
-        addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, prevSwapchainImage->image,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_ACCESS_MEMORY_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT,
-                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-
-        // Define the region to blit (full size -> render size)
-        VkImageBlit imageBlitRegion{
-                .srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .srcSubresource.layerCount = 1,
-                .srcOffsets[0] = VkOffset3D {
-                        .x = 0,
-                        .y = 0,
-                        .z = 0,
-                },
-                .srcOffsets[1] = VkOffset3D {
-                        .x = (int32_t) mSurfaces[0].mOutputWidth,
-                        .y = (int32_t) mSurfaces[0].mOutputHeight,
-                        .z = 1,
-                },
+void VulkanImageRenderer::getCompletedReadbacks(std::vector<uint16_t *> &completed) {
+    completed.insert(completed.end(), mCompletedReadbacks.begin(), mCompletedReadbacks.end());
+    mCompletedReadbacks.clear();
+}
 
-                .dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                .dstSubresource.layerCount = 1,
-                .dstOffsets[0] = VkOffset3D {
-                        .x = 0,
-                        .y = 0,
-                        .z = 0,
-                },
-                .dstOffsets[1] = VkOffset3D {
-                        .x = (int32_t) mSurfaces[0].mOutputWidth,
-                        .y = (int32_t) mSurfaces[0].mOutputHeight,
-                        .z = 1,
-                },
-        };
+void VulkanImageRenderer::flushReadbacks() {
+    harvestReadbacks(true);
+}
 
-        // Issue the blit command
-        vkCmdBlitImage(swapchainImage->cmdBuffer,
-                       prevSwapchainImage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                       swapchainImage->imagePrevious, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                       1, &imageBlitRegion, VK_FILTER_NEAREST);
+uint32_t VulkanImageRenderer::framesInFlightOnGpu() {
+    uint32_t frames_in_flight = 0;
+    for (FrameContext &frameContext : mFrameContexts) {
+        if (VK_NOT_READY == vkGetFenceStatus(mInstance->device(), frameContext.fence)) {
+            frames_in_flight++;
+        }
+    }
+    return frames_in_flight;
+}
 
-        // Transition destination image
-        addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, swapchainImage->imagePrevious,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+double VulkanImageRenderer::renderImageAndReadback(VulkanInputImage *inputImage,
+                                                    FilterParams *filter_params,
+                                                   AImage *new_aimage,
+                                                   bool draw_to_screen, bool surface_ready_left, bool surface_ready_right,
+                                                   RENDERER_RETURN_CODE &render_state,
+                                                   uint16_t *image_copy_data, bool palette_indices,
+                                                   bool count_colors) {
 
-        // Transition back the N-1 swap chain image after the blit is done
-        addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, prevSwapchainImage->image,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_MEMORY_READ_BIT,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-
-        // Submit the transition and blit commands, wait for copy completion
-        VK_CALL(vkEndCommandBuffer(swapchainImage->cmdBuffer));
-        VkSubmitInfo queueSubmitInfo = {
-                .pNext = nullptr,
-                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                .commandBufferCount = 1,
-                .pCommandBuffers = &swapchainImage->cmdBuffer,
-        };
-        VK_CALL(vkQueueSubmit(mInstance->queue(), 1, &queueSubmitInfo, swapchainImage->imagePreviousFence));
-        VK_CALL(vkWaitForFences(mInstance->device(), 1, &swapchainImage->imagePreviousFence, true, UINT64_MAX));
-        VK_CALL(vkResetFences(mInstance->device(), 1, &swapchainImage->imagePreviousFence));
+    // Define button for blur / multi-frame effects, if engaged, do an extra blit-out
+    const int BLUR_BUTTON = 5;
 
-        ATrace_endSection();
+    // Camera AHBs are owned by an external queue family and must be acquired / released each frame
+    const uint32_t inputSrcQueue = inputImage->isExternal() ? VULKAN_QUEUE_FAMILY : VK_QUEUE_FAMILY_IGNORED;
+    const uint32_t inputDstQueue = inputImage->isExternal() ? mInstance->queueFamilyIndex() : VK_QUEUE_FAMILY_IGNORED;
+
+    // If Kotlin needs the screen, free up all images and return
+    // TODO: this should be a seperate function from renderImageAndReadback with boolean check in native-lib.cpp
+    if (!draw_to_screen) {
+        AImage_delete(new_aimage);
+
+        // Wait for all frames in flight to be done rendering and free up resources
+        harvestReadbacks(true);
+        for (FrameContext &frameContext : mFrameContexts) {
+            waitForFrameContext(frameContext);
+        }
+
+        render_state = RENDER_QUEUE_EMPTY;
+        return 0.0;
     }
 
+    const double submit_start = now_ms();
+
+    // Pick up any GIF frames that finished since the last frame, without waiting for the GPU
+    harvestReadbacks(false);
+
+    // Grab the next frame context. If the GPU is still working on it, the CPU is a full ring of
+    // frames ahead: this is the only place the render loop blocks on the GPU.
+    FrameContext &frameContext = mFrameContexts[mFrameContextIndex];
+    mFrameContextIndex = (mFrameContextIndex + 1) % mFramesInFlight;
+
+    double wait_ms = waitForFrameContext(frameContext);
+    VK_CALL(vkResetFences(mInstance->device(), 1, &frameContext.fence));
+    frameContext.aimage = new_aimage;
+    render_state = RENDER_FRAME_SENT;
+
+    // Grab the next swapchain image for each surface. The GPU waits on the acquire semaphores,
+    // the CPU does not.
+    ATrace_beginSection("VULKAN_PHOTOBOOTH: render acquire next image KHR");
+    for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
+        VK_CALL(vkAcquireNextImageKHR(mInstance->device(), mSwapchains[surface_i].mVkSwapchain,
+                /*timeout*/ UINT64_MAX,
+                frameContext.acquireSemaphores[surface_i],
+                /*fence*/ VK_NULL_HANDLE,
+                &mSwapchains[surface_i].mSwapchainIndex));
+    } // for all surfaces
+    ATrace_endSection();
+
     /**
      * The next section sets up the render queue for each frame, to each surface.
      *
@@ -898,36 +847,205 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
      */
     for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
         SwapchainImage *swapchainImage = &mSwapchains[surface_i].mSwapchainImages[mSwapchains[surface_i].mSwapchainIndex];
+        VkCommandBuffer cmdBuffer = frameContext.cmdBuffers[surface_i];
+        VkDescriptorSet descriptorSet = frameContext.descriptorSets[surface_i];
+
+        ATrace_beginSection("VULKAN_PHOTOBOOTH: render begin command buffer");
+
+        // Begin Command Buffer (separate buffer for each surface)
+        {
+            VkCommandBufferBeginInfo cmdBufferBeginInfo{
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .pNext = nullptr,
+                    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                    .pInheritanceInfo = nullptr,
+            };
 
-        if (surface_i > 0) {
-            logd("Rendering a non-0 surface...");
+            VK_CALL(vkBeginCommandBuffer(cmdBuffer, &cmdBufferBeginInfo));
         }
 
-        ATrace_beginSection("VULKAN_PHOTOBOOTH: render delete old images");
-        // Free up old AImages for this swapchain image
-        // Each active surface depends on the same camera image/ahb, free them when the last surface is done with it.
-        if (surface_i >= (VULKAN_RENDERER_NUM_DISPLAYS - 1)) {
-            if (swapchainImage->old_aimage != nullptr) {
-                AImage_delete(swapchainImage->old_aimage);
+        ATrace_endSection();
+
+        /**
+         * The next section copies the frame in this swapchain if it is required for GIF creation.
+         *
+         * Adapted from: https://github.com/SaschaWillems/Vulkan/blob/master/examples/screenshot/screenshot.cpp#L230
+         */
+        if (0 == surface_i && nullptr != image_copy_data) {
+            ATrace_beginSection("VULKAN_PHOTOBOOTH: copy out frame for animated gif buffer");
+
+            // The copy image may still hold an older readback from this swapchain image that has
+            // not been harvested yet. Rare: GIF frames are normally many frames apart. Older
+            // readbacks are harvested along with it, so they are still handed back in order. Mapped
+            // frames go to this frame context's own slot, which is free once its fence signalled.
+            if (!palette_indices) {
+                for (FrameContext &pendingContext : mFrameContexts) {
+                    if (pendingContext.readbackImage == swapchainImage) {
+                        harvestReadbacks(true, &pendingContext);
+                        break;
+                    }
+                }
+            }
+            frameContext.readbackDestination = image_copy_data;
+            frameContext.readbackImage = palette_indices ? nullptr : swapchainImage;
+            frameContext.readbackIndices = palette_indices;
+
+            // Do the actual blit from the swapchain image to host visible destination image
+            // Transition destination image to transfer destination layout
+            if (!palette_indices) {
+                addImageTransitionBarrier(
+                        cmdBuffer, swapchainImage->imageCopy,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        0, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        mInstance->queueFamilyIndex(), mInstance->queueFamilyIndex());
+            }
+
+            // Transition swapchain image from present to transfer source layout
+            addImageTransitionBarrier(
+                    cmdBuffer, swapchainImage->image,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_MEMORY_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+            // Scaled to the GIF size for the GPU to map to the palette, then only the indices are read
+            // back, and to count its colors
+            count_colors = count_colors && mPaletteMapper.isInitialized();
+            if (palette_indices || count_colors) {
+                mPaletteMapper.recordFrame(cmdBuffer, frameContext.index, swapchainImage->image,
+                                           (int32_t) mSurfaces[0].mOutputWidth,
+                                           (int32_t) mSurfaces[0].mOutputHeight,
+                                           palette_indices, count_colors);
+            }
+            if (!palette_indices) {
+                // Define the region to blit (full size -> render size)
+                VkOffset3D blitSizeSource {
+                    .x = (int32_t) mSurfaces[0].mOutputWidth,
+                    .y = (int32_t) mSurfaces[0].mOutputHeight,
+                    .z = 1,
+                };
+                VkOffset3D blitSizeDestination {
+                    .x = (int32_t) VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH,
+                    .y = (int32_t) VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT,
+                    .z = 1,
+                };
+                VkImageBlit imageBlitRegion{
+                    .srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .srcSubresource.layerCount = 1,
+                    .srcOffsets[1] = blitSizeSource,
+                    .dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .dstSubresource.layerCount = 1,
+                    .dstOffsets[1] = blitSizeDestination,
+                };
+
+                // Issue the blit command
+                vkCmdBlitImage(cmdBuffer,
+                        swapchainImage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               swapchainImage->imageCopy, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        1, &imageBlitRegion, VK_FILTER_NEAREST);
+
+                // Transition destination image to general layout, which is the required layout for mapping the image memory later on
+                addImageTransitionBarrier(
+                        cmdBuffer, swapchainImage->imageCopy,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
             }
+
+            // Transition back the swap chain image after the blit is done, before it is rendered to
+            addImageTransitionBarrier(
+                    cmdBuffer, swapchainImage->image,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+            ATrace_endSection();
         }
 
-        swapchainImage->old_aimage = new_aimage;
-        render_state = RENDER_FRAME_SENT;
-        ATrace_endSection();
+        /**
+         * The next section copies the frame in this swapchain if it is required for multi-pass effects
+         *
+         * Keep a copy of the previous frame for multi-pass effects.
+         *
+         * Note: Only use the 1st swapchain or else there will be jiggling from out-of-order frames
+         */
+        if (0 == surface_i && filter_params->use_filter[BLUR_BUTTON]) {
+            ATrace_beginSection("VULKAN_PHOTOBOOTH: previous frame copy");
+
+            // TODO: add every monitor
+            // Copy from the last rendered swapchain into this prev frame VkImage
+            SwapchainImage *prevSwapchainImage = &mSwapchains[0].mSwapchainImages[mPrevFrameSwapchainIndex];
+
+            // Transition destination image to transfer destination layout
+            addImageTransitionBarrier(
+                    cmdBuffer, swapchainImage->imagePrevious,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    0, VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+            // Transition N-1 swapchain image from present to transfer source layout
+            addImageTransitionBarrier(
+                    cmdBuffer, prevSwapchainImage->image,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_MEMORY_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+            // Define the region to blit (full size -> render size)
+            VkImageBlit imageBlitRegion{
+                    .srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .srcSubresource.layerCount = 1,
+                    .srcOffsets[0] = VkOffset3D {
+                            .x = 0,
+                            .y = 0,
+                            .z = 0,
+                    },
+                    .srcOffsets[1] = VkOffset3D {
+                            .x = (int32_t) mSurfaces[0].mOutputWidth,
+                            .y = (int32_t) mSurfaces[0].mOutputHeight,
+                            .z = 1,
+                    },
+
+                    .dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .dstSubresource.layerCount = 1,
+                    .dstOffsets[0] = VkOffset3D {
+                            .x = 0,
+                            .y = 0,
+                            .z = 0,
+                    },
+                    .dstOffsets[1] = VkOffset3D {
+                            .x = (int32_t) mSurfaces[0].mOutputWidth,
+                            .y = (int32_t) mSurfaces[0].mOutputHeight,
+                            .z = 1,
+                    },
+            };
+
+            // Issue the blit command
+            vkCmdBlitImage(cmdBuffer,
+                           prevSwapchainImage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           swapchainImage->imagePrevious, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           1, &imageBlitRegion, VK_FILTER_NEAREST);
+
+            // Transition destination image, ready to be sampled by this frame's render pass
+            addImageTransitionBarrier(
+                    cmdBuffer, swapchainImage->imagePrevious,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+            // Transition back the N-1 swap chain image after the blit is done
+            addImageTransitionBarrier(
+                    cmdBuffer, prevSwapchainImage->image,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_MEMORY_READ_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+            ATrace_endSection();
+        }
 
         ATrace_beginSection("VULKAN_PHOTOBOOTH: render create descriptor sets");
         {
-    //        logd("Time value: %" PRIu64, time_value);
             // Update descriptor set with the ShaderVars uniform buffer
             mSwapchains[surface_i].shaderVars.panel_id = surface_i;
-//            mSwapchains[surface_i].shaderVars.imageWidth = mImageReaderWidth;
-//            mSwapchains[surface_i].shaderVars.imageHeight = mImageReaderHeight;
-
-            // NOTE: if we need to calculate this every frame, see algorithms in VulkanSwapchain.cpp
-//             mSwapchains[surface_i].shaderVars.distortion_correction_normal = mImageReaderHeight * mSwapchains[surface_i].shaderVars.windowHeight /  mImageReaderWidth * mSwapchains[surface_i].shaderVars.windowWidth; // (Ih * Wh) / (Iw * Ww);
-//             mSwapchains[surface_i].shaderVars.distortion_correction_rotated = mImageReaderHeight * mSwapchains[surface_i].shaderVars.windowHeight /  mImageReaderWidth * mSwapchains[surface_i].shaderVars.windowWidth; // (Ih * Wh) / (Iw * Ww);
-//logd("Image renderer reports rotation is: %d", filter_params->rotation);
 
             mSwapchains[surface_i].shaderVars.rotation = filter_params->rotation;
             mSwapchains[surface_i].shaderVars.seek_value1 = filter_params->seek_values[0];
@@ -936,14 +1054,6 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
             mSwapchains[surface_i].shaderVars.seek_value4 = filter_params->seek_values[3];
             mSwapchains[surface_i].shaderVars.seek_value5 = filter_params->seek_values[4];
             mSwapchains[surface_i].shaderVars.seek_value6 = filter_params->seek_values[5];
-//            mSwapchains[surface_i].shaderVars.seek_value7 = filter_params->seek_values[6];
-//            mSwapchains[surface_i].shaderVars.seek_value8 = filter_params->seek_values[7];
-//            mSwapchains[surface_i].shaderVars.seek_value9 = filter_params->seek_values[8];
-//            mSwapchains[surface_i].shaderVars.seek_value10 = filter_params->seek_values[9];
-
-//        logd("checking seek_value8: %d",mSwapchains[surface_i].shaderVars.seek_value8);
-//        logd("Surface %d Ima4geReader width: %d, height %d.", surface_i, mImageReaderWidth, mImageReaderHeight);
-//        logd("Surface %d Surface width: %d, height %d.", surface_i, mSwapchains[surface_i].shaderVars.windowWidth, mSwapchains[surface_i].shaderVars.windowHeight);
 
             // Create a bitmask of enabled filters using first NUM_FILTERS of the int
             mSwapchains[surface_i].shaderVars.use_filter = 0;
@@ -952,7 +1062,6 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
                 if (filter_params->use_filter[NUM_FILTERS - 1 - i]) {
                     mSwapchains[surface_i].shaderVars.use_filter += 1;
                 }
-//            logd("Filter %d is now set to: %d", i, mSwapchains[surface_i].shaderVars.use_filter);
             }
 
             // Current time value. Actually just a frame counter - shaders only need an increasing value, not real time
@@ -962,13 +1071,11 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
                 mTimeValue = 0;
             mSwapchains[surface_i].shaderVars.time_value = mTimeValue;
 
-            void* mappedShaderVarsData;
-            vkMapMemory(mInstance->device(), mSwapchains[surface_i].shaderVarsMemory[mSwapchains[surface_i].mSwapchainIndex], 0, sizeof(mSwapchains[surface_i].shaderVars), 0, &mappedShaderVarsData);
-            memcpy(mappedShaderVarsData, &mSwapchains[surface_i].shaderVars, sizeof(mSwapchains[surface_i].shaderVars));
-            vkUnmapMemory(mInstance->device(), mSwapchains[surface_i].shaderVarsMemory[mSwapchains[surface_i].mSwapchainIndex]);
+            // The uniform buffer is persistently mapped and owned by this frame context
+            memcpy(frameContext.shaderVarsMapped[surface_i], &mSwapchains[surface_i].shaderVars, sizeof(mSwapchains[surface_i].shaderVars));
 
             VkDescriptorBufferInfo shaderVarsDescriptorBufferInfo = {
-                    .buffer = mSwapchains[surface_i].shaderVarsBuffers[mSwapchains[surface_i].mSwapchainIndex],
+                    .buffer = frameContext.shaderVarsBuffers[surface_i],
                     .offset = 0,
                     .range = sizeof(ShaderVars),
             };
@@ -977,7 +1084,7 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
             shaderVarsWrite[0] = {};
             shaderVarsWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             shaderVarsWrite[0].pNext = NULL;
-            shaderVarsWrite[0].dstSet = mDescriptorSets[surface_i][mSwapchains[surface_i].mSwapchainIndex];
+            shaderVarsWrite[0].dstSet = descriptorSet;
             shaderVarsWrite[0].descriptorCount = 1;
             shaderVarsWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
             shaderVarsWrite[0].pBufferInfo = &shaderVarsDescriptorBufferInfo;
@@ -991,8 +1098,8 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
         {
             VkDescriptorImageInfo texDesc[2] {
                     {
-                        .sampler = vkAHB->sampler(),
-                        .imageView = vkAHB->view(),
+                        .sampler = inputImage->sampler(),
+                        .imageView = inputImage->view(),
                         .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
                     },
                     {
@@ -1007,7 +1114,7 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
                 {
                     .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
                     .pNext = nullptr,
-                    .dstSet = mDescriptorSets[surface_i][mSwapchains[surface_i].mSwapchainIndex],
+                    .dstSet = descriptorSet,
                     .dstBinding = 0,
                     .dstArrayElement = 0,
                     .descriptorCount = 1,
@@ -1020,7 +1127,7 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
                 {
                     .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
                     .pNext = nullptr,
-                    .dstSet = mDescriptorSets[surface_i][mSwapchains[surface_i].mSwapchainIndex],
+                    .dstSet = descriptorSet,
                     .dstBinding = 1,
                     .dstArrayElement = 0,
                     .descriptorCount = 1,
@@ -1039,37 +1146,20 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
         }
         ATrace_endSection();
 
-
-        ATrace_beginSection("VULKAN_PHOTOBOOTH: render begin command buffer");
-
-        // Begin Command Buffer (separate buffer for each surface
-        {
-            VkCommandBufferBeginInfo cmdBufferBeginInfo{
-                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-                    .pNext = nullptr,
-                    .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-                    .pInheritanceInfo = nullptr,
-            };
-
-            VK_CALL(vkBeginCommandBuffer(swapchainImage->cmdBuffer, &cmdBufferBeginInfo));
-        }
-
-        ATrace_endSection();
-
         ATrace_beginSection("VULKAN_PHOTOBOOTH: render transistion barriers");
 
         // Acquire the AHB image resource so it can be sampled from
         addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, vkAHB->image(),
+                cmdBuffer, inputImage->image(),
                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
                 0, VK_ACCESS_SHADER_READ_BIT,
                 VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                VULKAN_QUEUE_FAMILY, mInstance->queueFamilyIndex());
+                inputSrcQueue, inputDstQueue);
 
         if (filter_params->use_filter[BLUR_BUTTON]) {
             // Transition the N-1 frame to read from
             addImageTransitionBarrier(
-                    swapchainImage->cmdBuffer, swapchainImage->imagePrevious,
+                    cmdBuffer, swapchainImage->imagePrevious,
                     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
                     0, VK_ACCESS_SHADER_READ_BIT,
                     VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
@@ -1078,8 +1168,8 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
 
         // Transition the destination texture for use as a framebuffer.
         addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, swapchainImage->image,
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                cmdBuffer, swapchainImage->image,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
                 0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
                 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
                 VULKAN_QUEUE_FAMILY, mInstance->queueFamilyIndex());
@@ -1106,41 +1196,38 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
                     .clearValueCount = 1u,
                     .pClearValues = &clearValue,
             };
-            vkCmdBeginRenderPass(swapchainImage->cmdBuffer, &renderPassBeginInfo,
+            vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo,
                                  VK_SUBPASS_CONTENTS_INLINE);
 
         }
         ATrace_endSection();
         ATrace_beginSection("VULKAN_PHOTOBOOTH: render draw textures");
 
-//        logd("surface: %d, sets size: %u, swapchain index: %d", surface_i, (int) mDescriptorSets[surface_i].size(), mSwapchains[surface_i].mSwapchainIndex);
-
         /// Draw texture to renderpass.
-        vkCmdBindPipeline(swapchainImage->cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelines[surface_i]);
-        vkCmdBindDescriptorSets(swapchainImage->cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mLayout,
-                0, 1,
-                &mDescriptorSets[surface_i][mSwapchains[surface_i].mSwapchainIndex], 0, nullptr);
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelines[surface_i]);
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mLayout,
+                0, 1, &descriptorSet, 0, nullptr);
 
         VkDeviceSize offset = 0;
-        vkCmdBindVertexBuffers(swapchainImage->cmdBuffer, 0, 1, &mVertexBuffer, &offset);
-        vkCmdDraw(swapchainImage->cmdBuffer, 6, 1, 0, 0);
-        vkCmdEndRenderPass(swapchainImage->cmdBuffer);
+        vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &mVertexBuffer, &offset);
+        vkCmdDraw(cmdBuffer, 6, 1, 0, 0);
+        vkCmdEndRenderPass(cmdBuffer);
 
         ATrace_endSection();
         ATrace_beginSection("VULKAN_PHOTOBOOTH: render queue swapchain");
 
         // Finished reading the AHB
         addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, vkAHB->image(),
+                cmdBuffer, inputImage->image(),
                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
                 VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VULKAN_QUEUE_FAMILY, mInstance->queueFamilyIndex());
+                inputSrcQueue, inputDstQueue);
 
         // Finished reading from the N-1 frame
         if (filter_params->use_filter[BLUR_BUTTON]) {
             addImageTransitionBarrier(
-                    swapchainImage->cmdBuffer, swapchainImage->imagePrevious,
+                    cmdBuffer, swapchainImage->imagePrevious,
                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
                     VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -1149,47 +1236,69 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
 
         // Finished writing to the frame buffer
         addImageTransitionBarrier(
-                swapchainImage->cmdBuffer, swapchainImage->image,
+                cmdBuffer, swapchainImage->image,
                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
                 VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
                 VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
                 VULKAN_QUEUE_FAMILY, mInstance->queueFamilyIndex());
 
         ATrace_beginSection("VULKAN_PHOTOBOOTH: render end buffer");
-        VK_CALL(vkEndCommandBuffer(swapchainImage->cmdBuffer));
+        VK_CALL(vkEndCommandBuffer(cmdBuffer));
+        ATrace_endSection();
         ATrace_endSection();
+    } // For all surfaces
 
-        // Set up present semaphore
-        VkSemaphore semaphore = vkAHB->semaphore();
-        VkPipelineStageFlags semaphoreWaitFlags =
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-        VkSubmitInfo queueSubmitInfo = {
-                .pNext = nullptr,
+    // Submit all surfaces together. Each waits for its swapchain image to be acquired (the GIF and
+    // previous frame blits read from swapchain images, hence the transfer stage) and for the
+    // camera image, if it comes with a semaphore.
+    ATrace_beginSection("VULKAN_PHOTOBOOTH: render submit");
+    std::vector<VkSubmitInfo> submitInfos(VULKAN_RENDERER_NUM_DISPLAYS);
+    std::vector<VkSemaphore> waitSemaphores(2 * VULKAN_RENDERER_NUM_DISPLAYS);
+    std::vector<VkPipelineStageFlags> waitStages(2 * VULKAN_RENDERER_NUM_DISPLAYS);
+    VkSemaphore inputSemaphore = inputImage->semaphore();
+
+    for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
+        SwapchainImage *swapchainImage = &mSwapchains[surface_i].mSwapchainImages[mSwapchains[surface_i].mSwapchainIndex];
+        uint32_t waitCount = 0;
+
+        waitSemaphores[2 * surface_i] = frameContext.acquireSemaphores[surface_i];
+        waitStages[2 * surface_i] = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        waitCount++;
+
+        // The camera image semaphore can only be waited on once
+        if (0 == surface_i && inputSemaphore != VK_NULL_HANDLE) {
+            waitSemaphores[2 * surface_i + 1] = inputSemaphore;
+            waitStages[2 * surface_i + 1] = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            waitCount++;
+        }
+
+        submitInfos[surface_i] = {
                 .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                .waitSemaphoreCount = semaphore != VK_NULL_HANDLE ? 1u : 0u,
-                .pWaitSemaphores = semaphore != VK_NULL_HANDLE ? &semaphore : nullptr,
-                .pWaitDstStageMask = semaphore != VK_NULL_HANDLE ? &semaphoreWaitFlags : nullptr,
+                .pNext = nullptr,
+                .waitSemaphoreCount = waitCount,
+                .pWaitSemaphores = &waitSemaphores[2 * surface_i],
+                .pWaitDstStageMask = &waitStages[2 * surface_i],
                 .commandBufferCount = 1,
-                .pCommandBuffers = &swapchainImage->cmdBuffer,
+                .pCommandBuffers = &frameContext.cmdBuffers[surface_i],
                 .signalSemaphoreCount = 1,
                 .pSignalSemaphores = &swapchainImage->presentSemaphore,
         };
+    }
 
-        // Keep track of which swapchain being rendered to correct N-1 frame can be retrieved
-        mPrevFrameSwapchainIndex = mSwapchains[0].mSwapchainIndex;
+    // Keep track of which swapchain being rendered to correct N-1 frame can be retrieved
+    mPrevFrameSwapchainIndex = mSwapchains[0].mSwapchainIndex;
 
-        swapchainImage->imageFenceSet = true;
-        VK_CALL(vkQueueSubmit(mInstance->queue(), 1, &queueSubmitInfo, swapchainImage->imageFence));
-    } // For all surfaces
+    VK_CALL(vkQueueSubmit(mInstance->queue(), VULKAN_RENDERER_NUM_DISPLAYS, submitInfos.data(), frameContext.fence));
+    ATrace_endSection();
 
     // Queues have been set up and submitted. Now set up presentation semaphores
-    VkSemaphore *waitSemaphores = new VkSemaphore[VULKAN_RENDERER_NUM_DISPLAYS];
-    VkSwapchainKHR *presentSwapchains = new VkSwapchainKHR[VULKAN_RENDERER_NUM_DISPLAYS];
-    uint32_t *presentSwapchainIndices = new uint32_t[VULKAN_RENDERER_NUM_DISPLAYS];
+    std::vector<VkSemaphore> presentWaitSemaphores(VULKAN_RENDERER_NUM_DISPLAYS);
+    std::vector<VkSwapchainKHR> presentSwapchains(VULKAN_RENDERER_NUM_DISPLAYS);
+    std::vector<uint32_t> presentSwapchainIndices(VULKAN_RENDERER_NUM_DISPLAYS);
 
     for (int surface_i = 0; surface_i < VULKAN_RENDERER_NUM_DISPLAYS; surface_i++) {
         SwapchainImage *swapchainImage = &mSwapchains[surface_i].mSwapchainImages[mSwapchains[surface_i].mSwapchainIndex];
-        waitSemaphores[surface_i] = swapchainImage->presentSemaphore;
+        presentWaitSemaphores[surface_i] = swapchainImage->presentSemaphore;
         presentSwapchains[surface_i] = mSwapchains[surface_i].mVkSwapchain;
         presentSwapchainIndices[surface_i] = mSwapchains[surface_i].mSwapchainIndex;
     }
@@ -1198,13 +1307,15 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
     VkPresentInfoKHR presentInfo = {
             .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
             .waitSemaphoreCount = VULKAN_RENDERER_NUM_DISPLAYS,
-            .pWaitSemaphores = waitSemaphores,
+            .pWaitSemaphores = presentWaitSemaphores.data(),
             .swapchainCount = VULKAN_RENDERER_NUM_DISPLAYS,
-            .pSwapchains = presentSwapchains,
-            .pImageIndices = presentSwapchainIndices,
-            &swapchain_result,
+            .pSwapchains = presentSwapchains.data(),
+            .pImageIndices = presentSwapchainIndices.data(),
+            .pResults = nullptr,
     };
+    ATrace_beginSection("VULKAN_PHOTOBOOTH: render present");
     swapchain_result = vkQueuePresentKHR (mInstance->queue(), &presentInfo);
+    ATrace_endSection();
 
     switch (swapchain_result) {
         case VK_SUCCESS:
@@ -1215,11 +1326,20 @@ double VulkanImageRenderer::renderImageAndReadback(VulkanAHardwareBufferImage *v
             logd("vkQueuePresent FAILED and returned:: %d", swapchain_result);
     }
 
-    ATrace_endSection();
-
-    // TODO: measure this correctly
-    double fence_delay = 0;
-    return fence_delay;
+    // Statistics
+    double submit_ms = now_ms() - submit_start;
+    uint32_t queue_depth = framesInFlightOnGpu();
+    mStats.frames_submitted++;
+    if (wait_ms > 0)
+        mStats.frames_blocked++;
+    mStats.submit_ms_total += submit_ms;
+    mStats.submit_ms_max = std::max(mStats.submit_ms_max, submit_ms);
+    mStats.wait_ms_total += wait_ms;
+    mStats.queue_depth = queue_depth;
+    mStats.queue_depth_max = std::max(mStats.queue_depth_max, queue_depth);
+    mStats.queue_depth_total += queue_depth;
+
+    return submit_ms;
 }
 
 void VulkanImageRenderer::cleanUpPipelineTemporaries() {
@@ -1237,9 +1357,5 @@ void VulkanImageRenderer::cleanUpPipelineTemporaries() {
             vkDestroyPipeline(mInstance->device(), mPipelines[surface_i], nullptr);
             mPipelines[surface_i] = VK_NULL_HANDLE;
         }
-        if (mCmdBuffers[surface_i] != VK_NULL_HANDLE) {
-            vkFreeCommandBuffers(mInstance->device(), mCmdPool, 1, &mCmdBuffers[surface_i]);
-            mCmdBuffers[surface_i] = VK_NULL_HANDLE;
-        }
     }
 }
\ No newline at end of file
@@ -17,16 +17,61 @@
 #ifndef VULKAN_PHOTO_BOOTH_VULKANIMAGERENDERER_H
 #define VULKAN_PHOTO_BOOTH_VULKANIMAGERENDERER_H
 
+#ifdef ANDROID
 #include <media/NdkImage.h>
+#endif
 #include "VulkanInstance.h"
-#include "VulkanAHardwareBufferImage.h"
+#include "VulkanInputImage.h"
 #include "FilterParams.h"
 #include "VulkanSwapchain.h"
 #include "VulkanSurface.h"
+#include "VulkanPaletteMapper.h"
 
 
 enum RENDERER_RETURN_CODE { RENDER_STATE_NOT_SET, RENDER_FRAME_SENT, RENDER_QUEUE_NOT_EMPTY, RENDER_QUEUE_EMPTY };
 
+/**
+ * Everything needed to record and submit one frame to all displays
+ *
+ * The renderer cycles through a small ring of these so the CPU can record frame N+1 while the
+ * GPU is still working on frame N. A context is only reused once its fence has signalled.
+ */
+struct FrameContext {
+    uint32_t index; // Position in the ring, also the frame's palette mapping slot
+    VkFence fence; // Signalled when every display's work for this frame has completed
+
+    // One of each per display
+    std::vector<VkCommandBuffer> cmdBuffers;
+    std::vector<VkSemaphore> acquireSemaphores;
+    std::vector<VkBuffer> shaderVarsBuffers;
+    std::vector<VkDeviceMemory> shaderVarsMemory;
+    std::vector<void *> shaderVarsMapped;
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    AImage *aimage; // Camera image sampled by this frame, freed once the frame completes
+
+    // GIF frame blitted out by this frame, copied into readbackDestination once the fence signals
+    uint16_t *readbackDestination;
+    SwapchainImage *readbackImage;
+    bool readbackIndices; // The GIF frame was mapped to the palette, see VulkanPaletteMapper
+};
+
+/**
+ * Frame submission statistics, see VulkanImageRenderer::getStats
+ */
+struct RendererStats {
+    uint32_t frames_submitted = 0;
+    uint32_t frames_blocked = 0;      // Frames where the CPU had to wait for the GPU to catch up
+    double submit_ms_total = 0;       // CPU time in renderImageAndReadback, including waits
+    double submit_ms_max = 0;
+    double wait_ms_total = 0;         // Part of submit_ms_total spent waiting on frame fences
+    uint32_t queue_depth = 0;         // Frames in flight on the GPU after the last submit
+    uint32_t queue_depth_max = 0;
+    uint64_t queue_depth_total = 0;   // Sum over all frames, for the average
+    uint32_t readbacks_completed = 0;
+    double readback_copy_ms_total = 0; // CPU time copying GIF frames out of mapped memory
+};
+
 
 /**
  * Given an image, apply the desired effects and render to the screen
@@ -45,10 +90,12 @@ public:
      * @param height
      * @param format
      * @param colorSpace
+     * @param framesInFlight How many frames the CPU may queue ahead of the GPU (1 = fully serialized)
      */
     VulkanImageRenderer(VulkanInstance *instance, uint32_t num_displays,
                         uint32_t width, uint32_t height,
-                        VkFormat format, VkColorSpaceKHR);
+                        VkFormat format, VkColorSpaceKHR,
+                        uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT);
     ~VulkanImageRenderer();
 
     /**
@@ -63,7 +110,20 @@ public:
      * @param rendererCopyHeight Desired height of blit outs for GIF generation
      * @return If initialization was successful
      */
+#ifdef ANDROID
     bool init(ANativeWindow *output_window, ANativeWindow *output_window_left, ANativeWindow *output_window_right,  uint32_t rendererCopyWidth = 0, uint32_t rendererCopyHeight = 0);
+#else
+    /**
+     * Host equivalent of init: every display renders to an off-screen headless surface
+     *
+     * @param outputWidth Width of each virtual display
+     * @param outputHeight Height of each virtual display
+     * @param rendererCopyWidth Desired width of blit outs for GIF generation
+     * @param rendererCopyHeight Desired height of blit outs for GIF generation
+     * @return If initialization was successful
+     */
+    bool initHeadless(uint32_t outputWidth, uint32_t outputHeight, uint32_t rendererCopyWidth = 0, uint32_t rendererCopyHeight = 0);
+#endif
 
     /**
      * Set up the pipeline: shader setup, VkGraphicsPipeline, and VkCommandBuffer allocation
@@ -82,21 +142,86 @@ public:
      *
      * This is the main workhorse of the pipeline that processes each new frame image.
      *
-     * @param vkAHB VulkanAHardwareBufferImage ready to be used with the new AImaged
+     * @param inputImage Camera AHB (or host texture) ready to be used with the new AImage
      * @param filter_params Current filter paramters
      * @param new_aimage New AImage from the ImageReader
      * @param draw_to_screen Is Vulkan allowed to draw to the screen
      * @param surface_ready_left Is the left surface of 3 ready for drawing
      * @param surface_ready_right Is the right surface of 3 ready for drawing
      * @param render_state Current state (RENDER_STATE_NOT_SET, RENDER_FRAME_SENT, RENDER_QUEUE_NOT_EMPTY, RENDER_QUEUE_EMPTY)
-     * @param image_copy_data If not null, the frame should be copied into the given, pre-allocated, memory
-     * @return Time (in ms) that frame render took. NOTE: this does not work currently
+     * @param image_copy_data If not null, the frame should be copied into the given, pre-allocated,
+     * memory, as RGB565 pixels. The copy completes asynchronously, the pointer is handed back by getCompletedReadbacks
+     * once it has been filled and must stay valid until then.
+     * @param palette_indices Read the frame back as one palette index byte per pixel instead, mapped
+     * to the palette set by setGifPalette. Only the first half of image_copy_data is filled.
+     * @param count_colors Also add the frame to the GIF's color counts, see readGifColorCounts
+     * @return CPU time (in ms) spent recording and submitting the frame, including any wait for a free frame context
      */
-    double renderImageAndReadback(VulkanAHardwareBufferImage *vkAHB,
+    double renderImageAndReadback(VulkanInputImage *inputImage,
                                   FilterParams *filter_params, AImage *new_aimage,
                                   bool draw_to_screen, bool surface_ready_left, bool surface_ready_right,
                                   RENDERER_RETURN_CODE &render_state,
-                                  uint32_t *image_copy_data);
+                                  uint16_t *image_copy_data, bool palette_indices = false,
+                                  bool count_colors = false);
+
+    /**
+     * Palette GIF frames read back with palette_indices are mapped to, on the GPU
+     *
+     * @param colors Opaque 0xAABBGGRR colors, at most 256
+     * @param dither_mode Dither the GIF encoder would use. Only ordered dither can be done per pixel.
+     * @return False if the GPU can't map frames or can't use the dither mode, frames are then read
+     * back as RGB565
+     */
+    bool setGifPalette(const uint32_t *colors, uint32_t colorNum, DitherMode dither_mode) {
+        return mPaletteMapper.setPalette(colors, colorNum, dither_mode);
+    }
+    void clearGifPalette() { mPaletteMapper.clearPalette(); }
+    bool hasGifPalette() const { return mPaletteMapper.hasPalette(); }
+
+    /**
+     * The next GIF frame read back with count_colors starts the color counts over
+     */
+    void clearGifColorCounts() { mPaletteMapper.clearColorCounts(); }
+
+    /**
+     * Count the colors of a small proxy of each frame, downsampled on the GPU, instead of every
+     * pixel, off by default. Frames are still mapped at full size. Set before a GIF's first frame is
+     * counted.
+     */
+    void setGifColorProxy(bool proxy) { mPaletteMapper.setCountProxy(proxy); }
+
+    /**
+     * Colors of the GIF frames read back with count_colors since clearGifColorCounts, counted on
+     * the GPU for the GIF's palette. Valid once the last of those frames was handed back by
+     * getCompletedReadbacks.
+     *
+     * @param counts See ColorHistogram::addCounts
+     * @return False if the GPU can't count colors, or no frame was counted
+     */
+    bool readGifColorCounts(std::vector<uint32_t> &counts) { return mPaletteMapper.readColorCounts(counts); }
+
+    /**
+     * Collect GIF frame readbacks that have completed since the last call
+     *
+     * Readbacks are harvested without blocking at the start of each frame, or at the latest when
+     * their frame context is reused.
+     *
+     * @param completed image_copy_data pointers passed to renderImageAndReadback, in submission order
+     */
+    void getCompletedReadbacks(std::vector<uint16_t *> &completed);
+
+    /**
+     * Wait for all outstanding GIF frame readbacks to complete, see getCompletedReadbacks
+     */
+    void flushReadbacks();
+
+    /**
+     * Submission statistics since the last resetStats()
+     */
+    const RendererStats &getStats() { return mStats; }
+    void resetStats() { mStats = RendererStats(); }
+
+    static const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
 
     bool isPipelineInitialized = false;
 
@@ -107,6 +232,34 @@ public:
     const uint32_t mImageReaderHeight;
 
 private:
+    /**
+     * Everything init needs once the surfaces exist: render pass, swapchains, shaders and pools
+     */
+    bool initRenderer(uint32_t rendererCopyWidth, uint32_t rendererCopyHeight);
+    bool createFrameContexts();
+    void destroyFrameContexts();
+
+    /**
+     * Block until the given frame context is no longer in use by the GPU and release its resources
+     *
+     * @return Time spent waiting, in ms
+     */
+    double waitForFrameContext(FrameContext &frameContext);
+    uint32_t framesInFlightOnGpu();
+
+    /**
+     * Copy out the frame context's GIF frame, if any. The context's fence must have signalled.
+     */
+    void harvestReadback(FrameContext &frameContext);
+
+    /**
+     * Harvest every readback whose frame has completed
+     *
+     * @param wait Block on frames that are still in flight instead of skipping them
+     * @param last Stop after this frame context, older ones are still harvested first
+     */
+    void harvestReadbacks(bool wait, const FrameContext *last = nullptr);
+
     void cleanUpPipelineTemporaries();
 
     VulkanInstance *const mInstance;
@@ -124,10 +277,15 @@ private:
     std::vector<VulkanSwapchain> mSwapchains;
     std::vector<VulkanSurface> mSurfaces;
     std::vector<VkPipeline> mPipelines;
-    std::vector<VkCommandBuffer> mCmdBuffers;
-    std::vector<std::vector<VkDescriptorSet>> mDescriptorSets; // One per surface and one per swapchain image
     std::vector<VkDescriptorPool> mDescriptorPools;
 
+    const uint32_t mFramesInFlight;
+    std::vector<FrameContext> mFrameContexts;
+    uint32_t mFrameContextIndex = 0;
+    std::vector<uint16_t *> mCompletedReadbacks;
+    RendererStats mStats;
+    VulkanPaletteMapper mPaletteMapper;
+
     // Used for shader "time" - actually just a simple frame counter that always increases
     uint32_t mTimeValue = 0;
 
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_PHOTO_BOOTH_VULKANINPUTIMAGE_H
+#define VULKAN_PHOTO_BOOTH_VULKANINPUTIMAGE_H
+
+#include <vulkan/vulkan.h>
+
+/**
+ * A source image that VulkanImageRenderer can sample from
+ *
+ * On device this is a camera AHardwareBuffer imported into Vulkan. Host builds upload frames from
+ * CPU memory instead (see VulkanHostImage).
+ */
+class VulkanInputImage {
+public:
+    virtual ~VulkanInputImage() {}
+
+    virtual VkImage image() = 0;
+    virtual VkSampler sampler() = 0;
+    virtual VkImageView view() = 0;
+    virtual VkSemaphore semaphore() = 0;
+    virtual bool isSamplerImmutable() = 0;
+
+    /**
+     * Whether the image memory is owned outside of Vulkan and must be acquired from / released to
+     * an external queue family around each use
+     */
+    virtual bool isExternal() = 0;
+};
+
+#endif //VULKAN_PHOTO_BOOTH_VULKANINPUTIMAGE_H
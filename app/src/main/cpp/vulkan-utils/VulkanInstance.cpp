@@ -14,6 +14,9 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 #include "VulkanInstance.h"
 #include "vulkan_utils.h"
 #include "../third_party/vulkan_debug/vulkan_debug.h"
@@ -90,7 +93,12 @@ bool VulkanInstance::init() {
     instanceExt.push_back(VK_KHR_EXTERNAL_SEMAPHORE_CAPABILITIES_EXTENSION_NAME);
     instanceExt.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
     instanceExt.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+#ifdef ANDROID
     instanceExt.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
+#else
+    // Host builds render to off-screen swapchains (lavapipe, SwiftShader, etc.)
+    instanceExt.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+#endif
 
     VkInstanceCreateInfo createInfo = {
             .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
@@ -128,8 +136,10 @@ bool VulkanInstance::init() {
     deviceExt.push_back(VK_KHR_BIND_MEMORY_2_EXTENSION_NAME);
     deviceExt.push_back(VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME);
     deviceExt.push_back(VK_KHR_EXTERNAL_SEMAPHORE_EXTENSION_NAME);
+#ifdef ANDROID
     deviceExt.push_back(VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME);
     deviceExt.push_back(VK_ANDROID_EXTERNAL_MEMORY_ANDROID_HARDWARE_BUFFER_EXTENSION_NAME);
+#endif
     deviceExt.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
     deviceExt.push_back(VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME);
     // deviceExt.push_back(VK_KHR_UNIFORM_BUFFER_STANDARD_LAYOUT_EXTENSION_NAME); // Doesn't exist yet
@@ -174,7 +184,10 @@ bool VulkanInstance::init() {
                     mInstance, "vkGetPhysicalDeviceFeatures2KHR");
     ASSERT(getFeatures);
     getFeatures(mGpu, &physicalDeviceFeatures);
+#ifdef ANDROID
+    // Camera frames arrive as YUV AHBs. Host builds only sample RGBA textures.
     ASSERT(ycbcrFeatures.samplerYcbcrConversion == VK_TRUE);
+#endif
 
     float priorities[] = {1.0f};
     VkDeviceQueueCreateInfo queueCreateInfo{
@@ -200,10 +213,12 @@ bool VulkanInstance::init() {
 
     VK_CALL(vkCreateDevice(mGpu, &deviceCreateInfo, nullptr, &mDevice));
 
+#ifdef ANDROID
     mPfnGetAndroidHardwareBufferPropertiesANDROID =
             (PFN_vkGetAndroidHardwareBufferPropertiesANDROID)vkGetDeviceProcAddr(
                     mDevice, "vkGetAndroidHardwareBufferPropertiesANDROID");
     ASSERT(mPfnGetAndroidHardwareBufferPropertiesANDROID);
+#endif
 
     vkGetDeviceQueue(mDevice, 0, 0, &mQueue);
     vkGetPhysicalDeviceMemoryProperties(mGpu, &mMemoryProperties);
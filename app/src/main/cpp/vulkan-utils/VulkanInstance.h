@@ -41,10 +41,12 @@ class VulkanInstance {
         VkPhysicalDevice gpu() { return mGpu; }
         VkInstance instance() { return mInstance; }
         uint32_t queueFamilyIndex() { return mQueueFamilyIndex; }
+#ifdef ANDROID
         PFN_vkGetAndroidHardwareBufferPropertiesANDROID
         getHardwareBufferPropertiesFn() {
             return mPfnGetAndroidHardwareBufferPropertiesANDROID;
         }
+#endif
 
         uint32_t findMemoryType(uint32_t memoryTypeBitsRequirement,
                                 VkFlags requirementsMask);
@@ -58,8 +60,10 @@ class VulkanInstance {
         VkQueue mQueue = VK_NULL_HANDLE;
         uint32_t mQueueFamilyIndex = 0;
         VkPhysicalDeviceMemoryProperties mMemoryProperties = {};
+#ifdef ANDROID
         PFN_vkGetAndroidHardwareBufferPropertiesANDROID
                 mPfnGetAndroidHardwareBufferPropertiesANDROID = nullptr;
+#endif
 };
 
 #endif //VULKAN_PHOTO_BOOTH_VULKANINSTANCE_H
@@ -0,0 +1,646 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "VulkanPaletteMapper.h"
+#include "vulkan_utils.h"
+
+/**
+ * Makes writes to the whole buffer in srcStageMask available to dstStageMask
+ */
+static void addBufferBarrier(VkCommandBuffer cmdBuffer, VkBuffer buffer,
+                             VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask,
+                             VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask) {
+    VkBufferMemoryBarrier barrier{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = srcAccessMask,
+            .dstAccessMask = dstAccessMask,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = buffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+    };
+    vkCmdPipelineBarrier(cmdBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+/**
+ * addImageTransitionBarrier() of levelCount mip levels from baseMipLevel
+ */
+static void addMipTransitionBarrier(VkCommandBuffer cmdBuffer, VkImage image,
+                                    uint32_t baseMipLevel, uint32_t levelCount,
+                                    VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask,
+                                    VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+                                    VkImageLayout oldLayout, VkImageLayout newLayout) {
+    VkImageMemoryBarrier barrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = srcAccessMask,
+            .dstAccessMask = dstAccessMask,
+            .oldLayout = oldLayout,
+            .newLayout = newLayout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = image,
+            .subresourceRange = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = baseMipLevel,
+                    .levelCount = levelCount,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+            },
+    };
+    vkCmdPipelineBarrier(cmdBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+/**
+ * Size of mip level of a side size
+ */
+static int32_t mipSize(uint32_t size, uint32_t level) {
+    return (int32_t) std::max(size >> level, 1u);
+}
+
+VulkanPaletteMapper::VulkanPaletteMapper(VulkanInstance *instance) : mInstance(instance) {
+}
+
+VulkanPaletteMapper::~VulkanPaletteMapper() {
+    for (Slot &slot : mSlots) {
+        if (slot.indicesMapped != nullptr) {
+            vkUnmapMemory(mInstance->device(), slot.indicesMemory);
+            slot.indicesMapped = nullptr;
+        }
+        if (slot.indicesBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(mInstance->device(), slot.indicesBuffer, nullptr);
+            slot.indicesBuffer = VK_NULL_HANDLE;
+        }
+        if (slot.indicesMemory != VK_NULL_HANDLE) {
+            vkFreeMemory(mInstance->device(), slot.indicesMemory, nullptr);
+            slot.indicesMemory = VK_NULL_HANDLE;
+        }
+        if (slot.paramsMapped != nullptr) {
+            vkUnmapMemory(mInstance->device(), slot.paramsMemory);
+            slot.paramsMapped = nullptr;
+        }
+        if (slot.paramsBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(mInstance->device(), slot.paramsBuffer, nullptr);
+            slot.paramsBuffer = VK_NULL_HANDLE;
+        }
+        if (slot.paramsMemory != VK_NULL_HANDLE) {
+            vkFreeMemory(mInstance->device(), slot.paramsMemory, nullptr);
+            slot.paramsMemory = VK_NULL_HANDLE;
+        }
+        if (slot.frameView != VK_NULL_HANDLE) {
+            vkDestroyImageView(mInstance->device(), slot.frameView, nullptr);
+            slot.frameView = VK_NULL_HANDLE;
+        }
+        if (slot.proxyView != VK_NULL_HANDLE) {
+            vkDestroyImageView(mInstance->device(), slot.proxyView, nullptr);
+            slot.proxyView = VK_NULL_HANDLE;
+        }
+        if (slot.frame != VK_NULL_HANDLE) {
+            vkDestroyImage(mInstance->device(), slot.frame, nullptr);
+            slot.frame = VK_NULL_HANDLE;
+        }
+        if (slot.frameMemory != VK_NULL_HANDLE) {
+            vkFreeMemory(mInstance->device(), slot.frameMemory, nullptr);
+            slot.frameMemory = VK_NULL_HANDLE;
+        }
+    }
+    mSlots.clear();
+
+    if (mCountsMapped != nullptr) {
+        vkUnmapMemory(mInstance->device(), mCountsMemory);
+        mCountsMapped = nullptr;
+    }
+    if (mCountsBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(mInstance->device(), mCountsBuffer, nullptr);
+        mCountsBuffer = VK_NULL_HANDLE;
+    }
+    if (mCountsMemory != VK_NULL_HANDLE) {
+        vkFreeMemory(mInstance->device(), mCountsMemory, nullptr);
+        mCountsMemory = VK_NULL_HANDLE;
+    }
+
+    // Descriptor sets go with their pool
+    if (mDescriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(mInstance->device(), mDescriptorPool, nullptr);
+        mDescriptorPool = VK_NULL_HANDLE;
+    }
+    destroyPipeline(mMapPipeline);
+    destroyPipeline(mCountPipeline);
+}
+
+void VulkanPaletteMapper::destroyPipeline(Pipeline &pipeline) {
+    if (pipeline.pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(mInstance->device(), pipeline.pipeline, nullptr);
+        pipeline.pipeline = VK_NULL_HANDLE;
+    }
+    if (pipeline.layout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(mInstance->device(), pipeline.layout, nullptr);
+        pipeline.layout = VK_NULL_HANDLE;
+    }
+    if (pipeline.descriptorLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(mInstance->device(), pipeline.descriptorLayout, nullptr);
+        pipeline.descriptorLayout = VK_NULL_HANDLE;
+    }
+    if (pipeline.shaderModule != VK_NULL_HANDLE) {
+        vkDestroyShaderModule(mInstance->device(), pipeline.shaderModule, nullptr);
+        pipeline.shaderModule = VK_NULL_HANDLE;
+    }
+}
+
+bool VulkanPaletteMapper::isSupported() {
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(mInstance->gpu(), &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_family_props(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(mInstance->gpu(), &queue_family_count, queue_family_props.data());
+    if (mInstance->queueFamilyIndex() >= queue_family_count
+        || 0 == (queue_family_props[mInstance->queueFamilyIndex()].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+        return false;
+    }
+
+    // Both are required of every Vulkan implementation, checked all the same
+    const VkFormatFeatureFlags frameFeatures = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(mInstance->gpu(), VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+    if (frameFeatures != (formatProperties.optimalTilingFeatures & frameFeatures)) {
+        return false;
+    }
+
+    // Proxies are blitted down the frame's mip chain with a linear filter, optional in Vulkan. Without
+    // it frames are counted whole.
+    const VkFormatFeatureFlags proxyFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT
+                                               | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    mProxyLevel = 0;
+    if (proxyFeatures == (formatProperties.optimalTilingFeatures & proxyFeatures)) {
+        while (std::max(mWidth >> mProxyLevel, mHeight >> mProxyLevel) > COUNT_PROXY_SIZE) {
+            mProxyLevel++;
+        }
+    }
+
+    // Uncached reads of mapped memory are slow on most phones
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(mInstance->gpu(), &memoryProperties);
+    const VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                         | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    mReadbackMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if (cached == (memoryProperties.memoryTypes[i].propertyFlags & cached)) {
+            mReadbackMemoryFlags = cached;
+            break;
+        }
+    }
+    return true;
+}
+
+bool VulkanPaletteMapper::init(uint32_t width, uint32_t height, uint32_t numSlots) {
+    mWidth = width;
+    mHeight = height;
+    if (!isSupported()) {
+        logw("GIF palettes can't be worked on on this GPU, frames are read back as RGB565 and counted on the CPU.\n");
+        return false;
+    }
+
+    // The frame, Params and the indices
+    {
+        static const uint32_t map_spirv[] = {
+            #include "gif_palette.comp.spvnum"
+        };
+        const VkDescriptorType bindingTypes[3] = {
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        };
+        ASSERT(createPipeline(mMapPipeline, map_spirv, sizeof(map_spirv), bindingTypes, 3));
+    }
+
+    // The frame and the counts
+    {
+        static const uint32_t count_spirv[] = {
+            #include "gif_colors.comp.spvnum"
+        };
+        const VkDescriptorType bindingTypes[2] = {
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        };
+        ASSERT(createPipeline(mCountPipeline, count_spirv, sizeof(count_spirv), bindingTypes, 2));
+    }
+
+    // Three descriptor sets per slot, mapping, counting and counting the proxy, written once as the
+    // slots never change
+    {
+        const VkDescriptorPoolSize poolSizes[2] = {
+                {
+                        .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                        .descriptorCount = 3 * numSlots,
+                },
+                {
+                        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        .descriptorCount = 4 * numSlots,
+                },
+        };
+        const VkDescriptorPoolCreateInfo poolCreateInfo{
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .maxSets = 3 * numSlots,
+                .poolSizeCount = 2,
+                .pPoolSizes = poolSizes,
+        };
+        VK_CALL(vkCreateDescriptorPool(mInstance->device(), &poolCreateInfo, nullptr, &mDescriptorPool));
+    }
+
+    // Kept mapped, the histogram is read straight from it
+    ASSERT(createBuffer(mInstance, COUNT_NUM * sizeof(uint32_t),
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, mReadbackMemoryFlags,
+                        &mCountsBuffer, &mCountsMemory));
+    VK_CALL(vkMapMemory(mInstance->device(), mCountsMemory, 0, VK_WHOLE_SIZE, 0, (void **) &mCountsMapped));
+
+    mSlots.resize(numSlots);
+    for (Slot &slot : mSlots) {
+        ASSERT(createSlot(slot));
+    }
+    mParams.width = mWidth;
+    mParams.height = mHeight;
+    return true;
+}
+
+bool VulkanPaletteMapper::createPipeline(Pipeline &pipeline, const uint32_t *spirv, size_t spirvSize,
+                                         const VkDescriptorType *bindingTypes, uint32_t bindingNum) {
+    VkShaderModuleCreateInfo shaderInfo{
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0u,
+            .codeSize = spirvSize,
+            .pCode = spirv,
+    };
+    VK_CALL(vkCreateShaderModule(mInstance->device(), &shaderInfo, nullptr, &pipeline.shaderModule));
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings(bindingNum);
+    for (uint32_t i = 0; i < bindingNum; i++) {
+        bindings[i] = {
+                .binding = i,
+                .descriptorType = bindingTypes[i],
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .pImmutableSamplers = nullptr,
+        };
+    }
+    const VkDescriptorSetLayoutCreateInfo layoutCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .bindingCount = bindingNum,
+            .pBindings = bindings.data(),
+    };
+    VK_CALL(vkCreateDescriptorSetLayout(mInstance->device(), &layoutCreateInfo, nullptr, &pipeline.descriptorLayout));
+
+    const VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .setLayoutCount = 1,
+            .pSetLayouts = &pipeline.descriptorLayout,
+            .pushConstantRangeCount = 0,
+            .pPushConstantRanges = nullptr,
+    };
+    VK_CALL(vkCreatePipelineLayout(mInstance->device(), &pipelineLayoutCreateInfo, nullptr, &pipeline.layout));
+
+    VkComputePipelineCreateInfo pipelineCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .stage = {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                    .module = pipeline.shaderModule,
+                    .pName = "main",
+                    .pSpecializationInfo = nullptr,
+            },
+            .layout = pipeline.layout,
+            .basePipelineHandle = VK_NULL_HANDLE,
+            .basePipelineIndex = 0,
+    };
+    VK_CALL(vkCreateComputePipelines(mInstance->device(), VK_NULL_HANDLE, 1, &pipelineCreateInfo,
+                                     nullptr, &pipeline.pipeline));
+    return true;
+}
+
+bool VulkanPaletteMapper::createSlot(Slot &slot) {
+    // The frame is blitted in here and read by the shaders, its mip chain ends with the proxy
+    VkImageCreateInfo imageCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = VK_FORMAT_R8G8B8A8_UNORM,
+            .extent = { mWidth, mHeight, 1 },
+            .mipLevels = mProxyLevel + 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = nullptr,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    VK_CALL(vkCreateImage(mInstance->device(), &imageCreateInfo, nullptr, &slot.frame));
+
+    VkMemoryRequirements memReq;
+    vkGetImageMemoryRequirements(mInstance->device(), slot.frame, &memReq);
+    VkMemoryAllocateInfo allocInfo{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .allocationSize = memReq.size,
+            .memoryTypeIndex = mInstance->findMemoryType(memReq.memoryTypeBits,
+                                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+    };
+    VK_CALL(vkAllocateMemory(mInstance->device(), &allocInfo, nullptr, &slot.frameMemory));
+    VK_CALL(vkBindImageMemory(mInstance->device(), slot.frame, slot.frameMemory, 0));
+    ASSERT(createFrameView(slot.frame, 0, &slot.frameView));
+    ASSERT(createFrameView(slot.frame, mProxyLevel, &slot.proxyView));
+
+    // Both buffers stay mapped for the lifetime of the mapper. 4 indices to a uint.
+    VkDeviceSize indicesSize = ALIGN((VkDeviceSize) mWidth * mHeight, (VkDeviceSize) PIXELS_PER_INVOCATION);
+    ASSERT(createBuffer(mInstance, sizeof(Params), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        &slot.paramsBuffer, &slot.paramsMemory));
+    VK_CALL(vkMapMemory(mInstance->device(), slot.paramsMemory, 0, sizeof(Params), 0, (void **) &slot.paramsMapped));
+    ASSERT(createBuffer(mInstance, indicesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mReadbackMemoryFlags,
+                        &slot.indicesBuffer, &slot.indicesMemory));
+    VK_CALL(vkMapMemory(mInstance->device(), slot.indicesMemory, 0, indicesSize, 0, (void **) &slot.indicesMapped));
+
+    const VkDescriptorSetLayout setLayouts[3] = {
+            mMapPipeline.descriptorLayout,
+            mCountPipeline.descriptorLayout,
+            mCountPipeline.descriptorLayout,
+    };
+    VkDescriptorSet sets[3];
+    VkDescriptorSetAllocateInfo setAllocInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .descriptorPool = mDescriptorPool,
+            .descriptorSetCount = 3,
+            .pSetLayouts = setLayouts,
+    };
+    VK_CALL(vkAllocateDescriptorSets(mInstance->device(), &setAllocInfo, sets));
+    slot.descriptorSet = sets[0];
+    slot.countDescriptorSet = sets[1];
+    slot.proxyCountDescriptorSet = sets[2];
+
+    VkDescriptorImageInfo frameInfo{
+            .sampler = VK_NULL_HANDLE,
+            .imageView = slot.frameView,
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+    VkDescriptorImageInfo proxyInfo{
+            .sampler = VK_NULL_HANDLE,
+            .imageView = slot.proxyView,
+            .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+    VkDescriptorBufferInfo bufferInfos[3] = {
+            {
+                    .buffer = slot.paramsBuffer,
+                    .offset = 0,
+                    .range = sizeof(Params),
+            },
+            {
+                    .buffer = slot.indicesBuffer,
+                    .offset = 0,
+                    .range = indicesSize,
+            },
+            {
+                    .buffer = mCountsBuffer,
+                    .offset = 0,
+                    .range = VK_WHOLE_SIZE,
+            },
+    };
+    // Frame, Params and indices of the mapping, then frame and counts of the counting, then the
+    // proxy and counts
+    VkWriteDescriptorSet writes[7] = {};
+    for (uint32_t i = 0; i < 7; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = i < 3 ? slot.descriptorSet : i < 5 ? slot.countDescriptorSet : slot.proxyCountDescriptorSet;
+        writes[i].dstBinding = i < 3 ? i : (i - 3) % 2;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    }
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[0].pImageInfo = &frameInfo;
+    writes[1].pBufferInfo = &bufferInfos[0];
+    writes[2].pBufferInfo = &bufferInfos[1];
+    writes[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[3].pImageInfo = &frameInfo;
+    writes[4].pBufferInfo = &bufferInfos[2];
+    writes[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[5].pImageInfo = &proxyInfo;
+    writes[6].pBufferInfo = &bufferInfos[2];
+    vkUpdateDescriptorSets(mInstance->device(), 7, writes, 0, nullptr);
+    return true;
+}
+
+bool VulkanPaletteMapper::createFrameView(VkImage frame, uint32_t level, VkImageView *view) {
+    VkImageViewCreateInfo viewCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .image = frame,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = VK_FORMAT_R8G8B8A8_UNORM,
+            .components = {VK_COMPONENT_SWIZZLE_IDENTITY,
+                           VK_COMPONENT_SWIZZLE_IDENTITY,
+                           VK_COMPONENT_SWIZZLE_IDENTITY,
+                           VK_COMPONENT_SWIZZLE_IDENTITY},
+            .subresourceRange = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = level,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+            },
+    };
+    VK_CALL(vkCreateImageView(mInstance->device(), &viewCreateInfo, nullptr, view));
+    return true;
+}
+
+bool VulkanPaletteMapper::setPalette(const uint32_t *colors, uint32_t colorNum, DitherMode ditherMode) {
+    if (mSlots.empty() || 0 == colorNum || colorNum > MAX_COLOR_NUM
+        || (DITHER_NONE != ditherMode && DITHER_BAYER != ditherMode && DITHER_BLUE_NOISE != ditherMode)) {
+        mHasPalette = false;
+        return false;
+    }
+
+    mParams.colorNum = colorNum;
+    memcpy(mParams.palette, colors, colorNum * sizeof(uint32_t));
+    mParams.useDither = DITHER_NONE != ditherMode;
+    // The R offsets of the encoder's threshold maps, G and B get the same
+    for (uint32_t y = 0; y < ORDERED_DITHER_SIZE && DITHER_NONE != ditherMode; y++) {
+        const int8_t *offsets = getOrderedDitherRow(ditherMode, y);
+        for (uint32_t x = 0; x < ORDERED_DITHER_SIZE; x++) {
+            mParams.ditherOffsets[y * ORDERED_DITHER_SIZE + x] = offsets[x * 4];
+        }
+    }
+    mHasPalette = true;
+    return true;
+}
+
+void VulkanPaletteMapper::recordFrame(VkCommandBuffer cmdBuffer, uint32_t slot, VkImage source,
+                                      int32_t sourceWidth, int32_t sourceHeight, bool mapColors, bool countColors) {
+    Slot &frame = mSlots[slot];
+    if (mapColors) {
+        // The slot's last frame has completed, nothing reads its Params any more
+        memcpy(frame.paramsMapped, &mParams, sizeof(Params));
+    }
+
+    bool proxy = countColors && countsProxy();
+    addMipTransitionBarrier(
+            cmdBuffer, frame.frame, 0, proxy ? mProxyLevel + 1 : 1,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    // The same scaling as the RGB565 readback
+    VkImageBlit imageBlitRegion{
+            .srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .srcSubresource.layerCount = 1,
+            .srcOffsets[1] = VkOffset3D {
+                    .x = sourceWidth,
+                    .y = sourceHeight,
+                    .z = 1,
+            },
+            .dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .dstSubresource.layerCount = 1,
+            .dstOffsets[1] = VkOffset3D {
+                    .x = (int32_t) mWidth,
+                    .y = (int32_t) mHeight,
+                    .z = 1,
+            },
+    };
+    vkCmdBlitImage(cmdBuffer,
+                   source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   frame.frame, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   1, &imageBlitRegion, VK_FILTER_NEAREST);
+
+    if (proxy) {
+        recordProxy(cmdBuffer, frame);
+    }
+    // Level 0 is only read by the shaders when it is mapped or counted whole
+    if (mapColors || !proxy) {
+        addMipTransitionBarrier(
+                cmdBuffer, frame.frame, 0, 1,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                proxy ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                proxy ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_GENERAL);
+    }
+
+    if (mapColors) {
+        uint32_t invocations = (mWidth * mHeight + PIXELS_PER_INVOCATION - 1) / PIXELS_PER_INVOCATION;
+        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mMapPipeline.pipeline);
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mMapPipeline.layout, 0, 1,
+                                &frame.descriptorSet, 0, nullptr);
+        vkCmdDispatch(cmdBuffer, (invocations + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+        // Visible to the CPU once the frame's fence signals
+        addBufferBarrier(cmdBuffer, frame.indicesBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                         VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+    }
+    if (countColors) {
+        recordCounting(cmdBuffer, frame, proxy);
+    }
+}
+
+void VulkanPaletteMapper::recordProxy(VkCommandBuffer cmdBuffer, Slot &slot) {
+    // Each level is the one above halved and rounded down. A linear blit averages 2x2 pixels only
+    // where a side halves exactly, odd ones such as 125 to 62 are resampled instead
+    for (uint32_t level = 1; level <= mProxyLevel; level++) {
+        addMipTransitionBarrier(
+                cmdBuffer, slot.frame, level - 1, 1,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+        VkImageBlit imageBlitRegion{
+                .srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .srcSubresource.mipLevel = level - 1,
+                .srcSubresource.layerCount = 1,
+                .srcOffsets[1] = VkOffset3D {
+                        .x = mipSize(mWidth, level - 1),
+                        .y = mipSize(mHeight, level - 1),
+                        .z = 1,
+                },
+                .dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .dstSubresource.mipLevel = level,
+                .dstSubresource.layerCount = 1,
+                .dstOffsets[1] = VkOffset3D {
+                        .x = mipSize(mWidth, level),
+                        .y = mipSize(mHeight, level),
+                        .z = 1,
+                },
+        };
+        vkCmdBlitImage(cmdBuffer,
+                       slot.frame, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       slot.frame, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       1, &imageBlitRegion, VK_FILTER_LINEAR);
+    }
+
+    addMipTransitionBarrier(
+            cmdBuffer, slot.frame, mProxyLevel, 1,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+}
+
+void VulkanPaletteMapper::recordCounting(VkCommandBuffer cmdBuffer, Slot &slot, bool proxy) {
+    if (mClearCounts) {
+        // After any counting still in flight, from frames of the last GIF
+        addBufferBarrier(cmdBuffer, mCountsBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdFillBuffer(cmdBuffer, mCountsBuffer, 0, VK_WHOLE_SIZE, 0);
+        addBufferBarrier(cmdBuffer, mCountsBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        mClearCounts = false;
+    }
+
+    // Frames only add to the counts, the order they do it in makes no difference
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mCountPipeline.pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mCountPipeline.layout, 0, 1,
+                            proxy ? &slot.proxyCountDescriptorSet : &slot.countDescriptorSet, 0, nullptr);
+    uint32_t level = proxy ? mProxyLevel : 0;
+    vkCmdDispatch(cmdBuffer, (mipSize(mWidth, level) + COUNT_WORKGROUP_SIZE - 1) / COUNT_WORKGROUP_SIZE,
+                  (mipSize(mHeight, level) + COUNT_WORKGROUP_SIZE - 1) / COUNT_WORKGROUP_SIZE, 1);
+
+    addBufferBarrier(cmdBuffer, mCountsBuffer,
+                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                     VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+    mCounted = true;
+}
+
+bool VulkanPaletteMapper::readColorCounts(std::vector<uint32_t> &counts) {
+    if (!mCounted) {
+        return false;
+    }
+    counts.assign(mCountsMapped, mCountsMapped + COUNT_NUM);
+    return true;
+}
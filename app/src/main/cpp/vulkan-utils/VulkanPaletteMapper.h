@@ -0,0 +1,185 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_PHOTO_BOOTH_VULKANPALETTEMAPPER_H
+#define VULKAN_PHOTO_BOOTH_VULKANPALETTEMAPPER_H
+
+#include <vector>
+#include "VulkanInstance.h"
+#include "../third_party/androidndkgif/ColorHistogram.h"
+#include "../third_party/androidndkgif/ColorReduceKernels.h"
+#include "../third_party/androidndkgif/OrderedDither.h"
+
+/**
+ * The GIF palette work that can be done on the GPU: counting the colors the palette is built from,
+ * and mapping frames to the palette once it is known, so they are read back as one palette index
+ * byte per pixel instead of RGB565
+ *
+ * A compute shader (shaders/gif_palette.comp.glsl) does what the GIF encoder does on the CPU for a
+ * frame without dither or with an ordered one: the same offsets, nearest color and tie breaking.
+ * The encoder can go straight to LZW with the indices. Each slot holds a frame in flight: the blit
+ * target, the palette it is mapped to and the indices, which stay mapped for the CPU.
+ *
+ * Another (shaders/gif_colors.comp.glsl) adds frames to the encoder's color histogram, kept in a
+ * single buffer, so the CPU only reads back the histogram and builds the palette from it whatever
+ * the number and size of the frames. It can count a proxy of each frame instead, the level of the
+ * blit target's mip chain no larger than COUNT_PROXY_SIZE, each level filtered from the one above
+ * by a linear blit. That builds the palette faster but costs it some PSNR.
+ */
+class VulkanPaletteMapper {
+public:
+    VulkanPaletteMapper(VulkanInstance *instance);
+    ~VulkanPaletteMapper();
+
+    /**
+     * @param width Width of the frames mapped and counted
+     * @param height
+     * @param numSlots Frames that can be in flight at once
+     * @return False if the queue can't run compute shaders or anything failed, the mapper then
+     * never has a palette nor counts colors
+     */
+    bool init(uint32_t width, uint32_t height, uint32_t numSlots);
+    bool isInitialized() const { return !mSlots.empty(); }
+
+    /**
+     * Palette of the frames recorded from now on, frames already recorded keep theirs
+     *
+     * @param colors Opaque 0xAABBGGRR colors
+     * @param colorNum At most 256
+     * @param ditherMode DITHER_NONE, DITHER_BAYER or DITHER_BLUE_NOISE
+     * @return False for any other dither mode, or if the mapper did not initialize
+     */
+    bool setPalette(const uint32_t *colors, uint32_t colorNum, DitherMode ditherMode);
+    void clearPalette() { mHasPalette = false; }
+    bool hasPalette() const { return mHasPalette; }
+
+    /**
+     * Records the blit of source into the slot, then its mapping and counting, with the barriers
+     * making the indices and color counts visible to the host once the command buffer completes
+     *
+     * @param source Image in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, scaled to the frame size
+     * @param mapColors Map the frame to the palette, which must be set
+     * @param countColors Add the frame to the color counts
+     */
+    void recordFrame(VkCommandBuffer cmdBuffer, uint32_t slot, VkImage source,
+                     int32_t sourceWidth, int32_t sourceHeight, bool mapColors, bool countColors);
+
+    /**
+     * Count the colors of proxy frames, see COUNT_PROXY_SIZE, or of every pixel. Takes effect with
+     * the next frame counted, counts of both kinds should not be mixed.
+     */
+    void setCountProxy(bool countProxy) { mCountProxy = countProxy; }
+    bool countsProxy() const { return mCountProxy && 0 != mProxyLevel; }
+
+    /**
+     * The next frame counted starts the color counts over
+     */
+    void clearColorCounts() { mClearCounts = true; mCounted = false; }
+
+    /**
+     * Color counts of the frames since clearColorCounts, valid once their command buffers completed
+     *
+     * @param counts Gets ColorHistogram::BIN_NUM bins, see ColorHistogram::addCounts
+     * @return False if no frame was counted
+     */
+    bool readColorCounts(std::vector<uint32_t> &counts);
+
+    /**
+     * width * height indices of the slot's last frame, valid once its command buffer completed
+     */
+    const uint8_t *indices(uint32_t slot) const { return mSlots[slot].indicesMapped; }
+
+    uint32_t width() const { return mWidth; }
+    uint32_t height() const { return mHeight; }
+
+private:
+    static const uint32_t MAX_COLOR_NUM = 256;
+    static const uint32_t PIXELS_PER_INVOCATION = 4;
+    static const uint32_t WORKGROUP_SIZE = 64;
+    static const uint32_t COUNT_WORKGROUP_SIZE = 8; // Square
+    static const uint32_t COUNT_NUM = ColorHistogram::BIN_NUM * ColorHistogram::COUNT_NUM;
+    static const uint32_t COUNT_PROXY_SIZE = 64; // Largest side of proxy frames
+
+    /**
+     * The shader's Params buffer, std430
+     */
+    struct Params {
+        uint32_t colorNum;
+        uint32_t width;
+        uint32_t height;
+        uint32_t useDither;
+        uint32_t palette[MAX_COLOR_NUM];
+        int32_t ditherOffsets[ORDERED_DITHER_SIZE * ORDERED_DITHER_SIZE];
+    };
+
+    struct Slot {
+        VkImage frame = VK_NULL_HANDLE;
+        VkDeviceMemory frameMemory = VK_NULL_HANDLE;
+        VkImageView frameView = VK_NULL_HANDLE;
+        VkImageView proxyView = VK_NULL_HANDLE; // Mip level mProxyLevel of frame
+        VkBuffer paramsBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory paramsMemory = VK_NULL_HANDLE;
+        Params *paramsMapped = nullptr;
+        VkBuffer indicesBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory indicesMemory = VK_NULL_HANDLE;
+        uint8_t *indicesMapped = nullptr;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkDescriptorSet countDescriptorSet = VK_NULL_HANDLE;
+        VkDescriptorSet proxyCountDescriptorSet = VK_NULL_HANDLE;
+    };
+
+    /**
+     * A compute pipeline with a single descriptor set of the given bindings, all compute stage
+     */
+    struct Pipeline {
+        VkShaderModule shaderModule = VK_NULL_HANDLE;
+        VkDescriptorSetLayout descriptorLayout = VK_NULL_HANDLE;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+    };
+
+    bool isSupported();
+    bool createPipeline(Pipeline &pipeline, const uint32_t *spirv, size_t spirvSize,
+                        const VkDescriptorType *bindingTypes, uint32_t bindingNum);
+    void destroyPipeline(Pipeline &pipeline);
+    bool createSlot(Slot &slot);
+    bool createFrameView(VkImage frame, uint32_t level, VkImageView *view);
+    void recordProxy(VkCommandBuffer cmdBuffer, Slot &slot);
+    void recordCounting(VkCommandBuffer cmdBuffer, Slot &slot, bool proxy);
+
+    VulkanInstance *const mInstance;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    bool mHasPalette = false;
+    uint32_t mProxyLevel = 0; // Last mip level of the frames, 0 without proxies
+    bool mCountProxy = false;
+    Params mParams = {};
+    VkMemoryPropertyFlags mReadbackMemoryFlags = 0; // Cached when the GPU has it, the CPU reads them
+
+    Pipeline mMapPipeline;
+    Pipeline mCountPipeline;
+    VkDescriptorPool mDescriptorPool = VK_NULL_HANDLE;
+    std::vector<Slot> mSlots;
+
+    // Every slot counts into the same buffer
+    VkBuffer mCountsBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory mCountsMemory = VK_NULL_HANDLE;
+    uint32_t *mCountsMapped = nullptr;
+    bool mClearCounts = true;
+    bool mCounted = false;
+};
+
+#endif //VULKAN_PHOTO_BOOTH_VULKANPALETTEMAPPER_H
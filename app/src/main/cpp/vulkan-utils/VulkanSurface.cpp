@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 
+#ifdef ANDROID
 #include <android/native_window.h>
+#endif
 #include "VulkanSurface.h"
 #include "vulkan_utils.h"
 
@@ -29,6 +31,7 @@ VulkanSurface::~VulkanSurface() {
     }
 }
 
+#ifdef ANDROID
 bool VulkanSurface::init(ANativeWindow *output_window) {
     mOutputWindow = output_window;
     mOutputWidth = uint32_t (ANativeWindow_getWidth(output_window));
@@ -44,6 +47,31 @@ bool VulkanSurface::init(ANativeWindow *output_window) {
     };
     VK_CALL(vkCreateAndroidSurfaceKHR(mInstance->instance(), &androidSurfaceCreateInfo, nullptr, &mVkSurface));
 
+    return querySurfaceProperties();
+}
+#else
+bool VulkanSurface::initHeadless(uint32_t width, uint32_t height) {
+    mOutputWindow = nullptr;
+    mOutputWidth = width;
+    mOutputHeight = height;
+
+    logd("Headless Surface Width: %d, Height %d.", mOutputWidth, mOutputHeight);
+
+    VkHeadlessSurfaceCreateInfoEXT headlessSurfaceCreateInfo{
+            .sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT,
+            .pNext = nullptr,
+            .flags = 0,
+    };
+    auto createHeadlessSurface = (PFN_vkCreateHeadlessSurfaceEXT) vkGetInstanceProcAddr(
+            mInstance->instance(), "vkCreateHeadlessSurfaceEXT");
+    ASSERT(createHeadlessSurface);
+    VK_CALL(createHeadlessSurface(mInstance->instance(), &headlessSurfaceCreateInfo, nullptr, &mVkSurface));
+
+    return querySurfaceProperties();
+}
+#endif
+
+bool VulkanSurface::querySurfaceProperties() {
     VK_CALL(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(mInstance->gpu(), mVkSurface, &mSurfaceCaps));
 
     uint32_t format_count = 0;
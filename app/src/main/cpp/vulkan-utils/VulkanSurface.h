@@ -20,6 +20,7 @@
 
 #include <vulkan/vulkan.h>
 #include "VulkanInstance.h"
+#include "host_compat.h"
 
 /**
  * Helper class to bind a native window to a VkSurface
@@ -28,7 +29,18 @@ class VulkanSurface {
 public:
     VulkanSurface(VulkanInstance *instance, VkFormat *format, VkColorSpaceKHR *colorSpace);
     ~VulkanSurface();
+#ifdef ANDROID
     bool init(ANativeWindow *output_window);
+#else
+    /**
+     * Create an off-screen surface using VK_EXT_headless_surface (host builds only)
+     *
+     * @param width Width of the virtual display
+     * @param height Height of the virtual display
+     * @return If initialization was successful
+     */
+    bool initHeadless(uint32_t width, uint32_t height);
+#endif
 
     ANativeWindow *mOutputWindow;
     VulkanInstance *mInstance = nullptr;
@@ -42,6 +54,8 @@ public:
     uint32_t mOutputWidth;
     uint32_t mOutputHeight;
 
+private:
+    bool querySurfaceProperties();
 };
 
 
@@ -21,21 +21,6 @@ uint32_t VulkanSwapchain::RENDERER_COPY_IMAGE_WIDTH = 500;
 uint32_t VulkanSwapchain::RENDERER_COPY_IMAGE_HEIGHT = 500;
 
 
-/**
- * Set up all the uniform memory buffers for the shaders. One for each swapchain image.
- */
-void VulkanSwapchain::createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(ShaderVars);
-
-    shaderVarsBuffers.resize(mSwapchainLength);
-    shaderVarsMemory.resize(mSwapchainLength);
-
-    for (size_t i = 0; i < mSwapchainLength; i++) {
-        createBuffer(mInstance, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     &shaderVarsBuffers[i], &shaderVarsMemory[i]);
-    }
-}
-
 VulkanSwapchain::VulkanSwapchain(VulkanInstance *instance, VkCommandPool *cmdPool) {
     mInstance = instance;
     mCmdPool = cmdPool;
@@ -63,32 +48,6 @@ VulkanSwapchain::~VulkanSwapchain() {
             vkDestroySemaphore(mInstance->device(), mSwapchainImages[i].copySemaphore, nullptr);
             mSwapchainImages[i].copySemaphore = VK_NULL_HANDLE;
         }
-        if (mSwapchainImages[i].imageFence != VK_NULL_HANDLE) {
-            vkDestroyFence(mInstance->device(), mSwapchainImages[i].imageFence, nullptr);
-            mSwapchainImages[i].imageFence = VK_NULL_HANDLE;
-        }
-        if (mSwapchainFences[i] != VK_NULL_HANDLE) {
-            vkDestroyFence(mInstance->device(), mSwapchainFences[i], nullptr);
-            mSwapchainFences[i] = VK_NULL_HANDLE;
-        }
-        if (mSwapchainImages[i].cmdBuffer != VK_NULL_HANDLE) {
-//            vkFreeCommandBuffers(mInstance->device(), *mCmdPool, 1, &mSwapchainImages[i].cmdBuffer);
-            mSwapchainImages[i].cmdBuffer = VK_NULL_HANDLE;
-        }
-        if (shaderVarsBuffers[i] != VK_NULL_HANDLE) {
-            vkDestroyBuffer(mInstance->device(), shaderVarsBuffers[i], nullptr);
-            shaderVarsBuffers[i] = VK_NULL_HANDLE;
-        }
-        if (shaderVarsMemory[i] != VK_NULL_HANDLE) {
-            vkFreeMemory(mInstance->device(), shaderVarsMemory[i], nullptr);
-            shaderVarsMemory[i] = VK_NULL_HANDLE;
-        }
-        if (i >= (mSwapchainLength - 1)) {
-            if (mSwapchainImages[i].old_aimage != nullptr) {
-                AImage_delete(mSwapchainImages[i].old_aimage);
-                mSwapchainImages[i].old_aimage = nullptr;
-            }
-        }
     } // For all swapchains
 }
 
@@ -151,7 +110,6 @@ bool VulkanSwapchain::init(VkSurfaceKHR *vkSurface, VkSurfaceCapabilitiesKHR *su
 
 
     mSwapchainImages = new SwapchainImage[mSwapchainLength];
-    mSwapchainFences = new VkFence[mSwapchainLength];
 
     // Allocate VkImageViews and Framebuffers
     for (uint32_t i = 0; i < mSwapchainLength; ++i) {
@@ -187,14 +145,6 @@ bool VulkanSwapchain::init(VkSurfaceKHR *vkSurface, VkSurfaceCapabilitiesKHR *su
         };
         VK_CALL(vkCreateSemaphore(mInstance->device(), &semaphoreCreateInfo, nullptr, &presentSemaphore));
 
-        VkFence imageFence;
-        VkFenceCreateInfo fenceCreateInfo = {
-                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-                .flags = 0,
-        };
-        VK_CALL(vkCreateFence(mInstance->device(), &fenceCreateInfo, nullptr, &imageFence));
-        VK_CALL(vkResetFences(mInstance->device(), 1, &imageFence));
-
 
 
         // Set of framebuffer objects for copying out images
@@ -241,13 +191,6 @@ bool VulkanSwapchain::init(VkSurfaceKHR *vkSurface, VkSurfaceCapabilitiesKHR *su
         };
         VK_CALL(vkCreateSemaphore(mInstance->device(), &copySemaphoreCreateInfo, nullptr, &copySemaphore));
 
-        VkFence imageCopyFence;
-        VkFenceCreateInfo copyFenceCreateInfo = {
-                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-                .flags = 0,
-        };
-        VK_CALL(vkCreateFence(mInstance->device(), &copyFenceCreateInfo, nullptr, &imageCopyFence));
-        VK_CALL(vkResetFences(mInstance->device(), 1, &imageCopyFence));
 
 
         // For storing N-1 frame
@@ -305,14 +248,6 @@ bool VulkanSwapchain::init(VkSurfaceKHR *vkSurface, VkSurfaceCapabilitiesKHR *su
         };
         VK_CALL(vkCreateImageView(mInstance->device(), &imageViewPreviousCreateInfo, nullptr, &imageViewPrevious));
 
-        VkFence imagePreviousFence;
-        VkFenceCreateInfo imagePreviousFenceInfo = {
-                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-                .flags = 0,
-        };
-        VK_CALL(vkCreateFence(mInstance->device(), &imagePreviousFenceInfo, nullptr, &imagePreviousFence));
-        VK_CALL(vkResetFences(mInstance->device(), 1, &imagePreviousFence));
-
 
 
         VkImageView framebufferImageViews[1] = {
@@ -332,24 +267,6 @@ bool VulkanSwapchain::init(VkSurfaceKHR *vkSurface, VkSurfaceCapabilitiesKHR *su
         VK_CALL(vkCreateFramebuffer(mInstance->device(), &framebufferCreateInfo, nullptr, &framebuffer));
 
 
-        VkCommandBuffer cmdBuffer;
-        VkCommandBufferAllocateInfo cmdBufferCreateInfo{
-                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-                .pNext = nullptr,
-                .commandPool = *mCmdPool,
-                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-                .commandBufferCount = 1,
-        };
-        VK_CALL(vkAllocateCommandBuffers(mInstance->device(), &cmdBufferCreateInfo,
-                                         &cmdBuffer));
-
-        // Swapchain fun!
-        VkFenceCreateInfo swapchainFenceInfo =  {
-                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-                .flags = 0,
-        };
-        VK_CALL(vkCreateFence(mInstance->device(), &swapchainFenceInfo, nullptr, &mSwapchainFences[i]));
-
         mSwapchainImages[i] = SwapchainImage {
                 .index = i,
 
@@ -357,27 +274,17 @@ bool VulkanSwapchain::init(VkSurfaceKHR *vkSurface, VkSurfaceCapabilitiesKHR *su
                 .imageView = imageView,
                 .presentSemaphore = presentSemaphore,
                 .framebuffer = framebuffer,
-                .imageFence = imageFence,
-                .imageFenceSet = false,
 
                 .imageCopy = imageCopy,
                 .imageCopyMemory = imageCopyMemory,
                 .copySemaphore = copySemaphore,
-                .imageCopyFence = imageCopyFence,
 
                 .imagePrevious = imagePrevious,
                 .imageViewPrevious = imageViewPrevious,
                 .imagePreviousMemory = imagePreviousMemory,
-                .imagePreviousFence = imagePreviousFence,
-
-                .cmdBuffer = cmdBuffer,
-                .old_aimage = nullptr,
         };
     }
 
-    // Create shader variables
-    createUniformBuffers();
-
     shaderVars.imageWidth = imageReaderWidth;
     shaderVars.imageHeight = imageReaderHeight;
     shaderVars.windowWidth = windowWidth;
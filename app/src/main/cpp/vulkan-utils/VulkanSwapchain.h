@@ -18,8 +18,12 @@
 #define VULKAN_PHOTO_BOOTH_VULKANSWAPCHAIN_H
 
 #include <vulkan/vulkan.h>
+#ifdef ANDROID
 #include <media/NdkImage.h>
-#include "VulkanAHardwareBufferImage.h"
+#endif
+#include <vector>
+#include "VulkanInstance.h"
+#include "host_compat.h"
 
 /**
  * Data associated with a single frame in the swapchain
@@ -32,23 +36,16 @@ struct SwapchainImage {
     VkImageView imageView;
     VkSemaphore presentSemaphore;
     VkFramebuffer framebuffer;
-    bool imageFenceSet;
-    VkFence imageFence;
 
     // Framebuffer variables that will copied out to the ring_buffer to be saved
     VkImage imageCopy;
     VkDeviceMemory imageCopyMemory;
     VkSemaphore copySemaphore;
-    VkFence imageCopyFence;
 
     // For multi-pass effects
     VkImage imagePrevious;
     VkImageView imageViewPrevious;
     VkDeviceMemory imagePreviousMemory;
-    VkFence imagePreviousFence;
-
-    VkCommandBuffer cmdBuffer;
-    AImage *old_aimage;
 };
 
 /**
@@ -109,23 +106,17 @@ public:
               uint32_t queueIndex, VkCompositeAlphaFlagBitsKHR *alphaFlags, VkRenderPass *renderPass,
               uint32_t rendererCopyWidth = 500, uint32_t rendererCopyHeight = 0);
 
-    void createUniformBuffers();
-
     static uint32_t RENDERER_COPY_IMAGE_WIDTH;
     static uint32_t RENDERER_COPY_IMAGE_HEIGHT;
 
     VulkanInstance *mInstance;
     ShaderVars shaderVars = {};
-    std::vector<VkBuffer> shaderVarsBuffers;
-    std::vector<VkDeviceMemory> shaderVarsMemory;
 
     VkCommandPool *mCmdPool = VK_NULL_HANDLE;
     VkSwapchainKHR mVkSwapchain;
     uint32_t mSwapchainLength = 0;
     uint32_t mSwapchainIndex = 0;
     SwapchainImage *mSwapchainImages = VK_NULL_HANDLE;
-    VkFence *mSwapchainFences = VK_NULL_HANDLE;
-    uint32_t mSwapchainFenceIndex = 0;
 };
 
 #endif //VULKAN_PHOTO_BOOTH_VULKANSWAPCHAIN_H
\ No newline at end of file
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_PHOTO_BOOTH_HOST_COMPAT_H
+#define VULKAN_PHOTO_BOOTH_HOST_COMPAT_H
+
+/**
+ * Stand-ins for the handful of Android NDK types and calls used by vulkan-utils so it can be built
+ * for a (headless) Linux host. See host/CMakeLists.txt.
+ *
+ * Camera images and native windows never exist on the host, so these are opaque types and the
+ * calls that act on them are no-ops.
+ */
+#ifndef ANDROID
+
+struct AImage;
+struct ANativeWindow;
+
+inline void AImage_delete(AImage *) {}
+
+inline void ATrace_beginSection(const char *) {}
+inline void ATrace_endSection() {}
+
+#endif // ANDROID
+
+#endif //VULKAN_PHOTO_BOOTH_HOST_COMPAT_H
@@ -17,9 +17,15 @@
 #ifndef VULKAN_PHOTO_BOOTH_VULKAN_UTILS_H
 #define VULKAN_PHOTO_BOOTH_VULKAN_UTILS_H
 
+#ifdef ANDROID
 #include <android/log.h>
-#include <vulkan/vulkan_core.h>
 #include <vulkan/vulkan_android.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#include "host_compat.h"
+#endif
+#include <vulkan/vulkan_core.h>
 #include "VulkanInstance.h"
 
 #ifdef __cplusplus
@@ -105,7 +111,11 @@ void addImageTransitionBarrier(VkCommandBuffer commandBuffer, VkImage image,
 
 #define LOG_TAG2 "VulkanPhoto"
 
+#ifdef ANDROID
 #define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG2, __VA_ARGS__)
+#else
+#define ALOGE(...) fprintf(stderr, __VA_ARGS__)
+#endif
 
 #define ASSERT(a)                                                              \
   if (!(a)) {                                                                  \
@@ -143,8 +153,6 @@ void addImageTransitionBarrier(VkCommandBuffer commandBuffer, VkImage image,
 #define ASSERT_LE(a, b) \
         ASSERT((a) <= (b), "assert failed on (" #a " <= " #b ") at " __FILE__ ":%d", __LINE__)
 
-#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG2, __VA_ARGS__)
-
 #define ALIGN(x, mask) ( ((x) + (mask) - 1) & ~((mask) - 1) )
 
 #endif //VULKAN_PHOTO_BOOTH_VULKAN_UTILS_H
\ No newline at end of file
@@ -160,7 +160,8 @@ fun setAutoFlash(params: CameraParams, requestBuilder: CaptureRequest.Builder?)
 /**
  * Configure the ImageReader
  *
- * Note: format is currently overridden to PRIVATE in native for speed
+ * Note: format is currently overridden in native, to PRIVATE for speed, or to CPU readable
+ * YUV_420_888 while camera frames are recorded (see MainActivity.startFrameRecording)
  *
  * If device is a Chromebox, assume it can handle 1920x1080 and has enough memory for a large buffer
  */
@@ -52,6 +52,7 @@ import kotlinx.coroutines.launch
 import java.io.File
 import java.lang.Exception
 import java.lang.Thread.sleep
+import java.nio.ByteBuffer
 import kotlin.concurrent.thread
 import android.content.pm.ConfigurationInfo
 
@@ -64,6 +65,9 @@ import android.app.ActivityManager
 private const val REQUEST_CAMERA_PERMISSION = 1
 private const val REQUEST_FILE_WRITE_PERMISSION = 2
 
+// Intent extra with a path to record camera frames to for host/frame_replay, see README.md
+private const val EXTRA_RECORD_FRAMES = "record_frames"
+
 // TODO: Make a more comprehensive MIDI handling class
 
 // MIDI max and min values
@@ -124,6 +128,7 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
         if (!isVulkanInitialized) {
             // Initialize native engine, force 1 display for now
             val initSuccess = initializeNative(1)
+            startFrameRecordingIfRequested()
             setupImageReader(this, cameraParams)
 
             // If Vulkan cannot initialize, show a warning dialog and do not start the cameras.
@@ -154,6 +159,11 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
         // If no camera permissions, don't try to stop the camera
         if (checkPermissions()) {
             camera2CloseCamera(cameraParams)
+            // Closes the recording, so resuming does not overwrite it
+            if (frameRecordingPath.isNotEmpty()) {
+                stopFrameRecording()
+                frameRecordingPath = ""
+            }
             cleanupNative()
             isVulkanInitialized = false
         }
@@ -195,6 +205,8 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
         var cameraWaitingOnPermissions = false
         /** Did Vulkan initialize? **/
         var isVulkanInitialized = false
+        /** Camera frames are recorded here until the app is stopped, empty if not recording **/
+        var frameRecordingPath = ""
         /** Does this device support MIDI? **/
         var hasMidi = false
         /** MIDI Manager */
@@ -215,6 +227,8 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
         lateinit var nativeUpdateFpsHandler: Handler
         /** Handler for gif creation callback from native */
         lateinit var nativeGifSavedCallbackHandler: Handler
+        /** Handler for GIFs native encoded in memory */
+        lateinit var nativeGifEncodedCallbackHandler: Handler
         /** Handler to co-ordinate spinning a new thread to handle GIF encoding */
         lateinit var nativeGifReadyToEncodeHandler: Handler
         /** Handler to handle updating gif creation progress spinner */
@@ -223,6 +237,13 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
         /** Spinner for gif creation */
         lateinit var gifSpinner: CircularProgressDrawable
         var gifFilepath: String = ""
+        /**
+         * Receives the GIFs of createGifInMemory, to share or upload them without writing them to
+         * storage first. It has to call releaseGifBuffer once done with the buffer. Without a
+         * listener the buffers are released straight away. The app itself saves every GIF with
+         * createGif; this and createGifInMemory are for an upload or share feature to use.
+         */
+        var gifBufferListener: ((ByteBuffer) -> Unit)? = null
 
         /** Convenience wrapper for Log.d that can be toggled on/off */
         fun logd(message: String) {
@@ -252,25 +273,39 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
             nativeUpdateGifProgressHandler.sendMessage(message)
         }
 
-        /** Static function to allow handler to indicate gif is ready to encode */
+        /** Static function to allow handler to indicate gif is captured and queued for encoding */
         @JvmStatic
         fun gifReadyToEncode() {
             val message = Message()
             nativeGifReadyToEncodeHandler.sendMessage(message)
         }
 
-        /** Static function to allow native to indicate the GIF has been saved correctly */
+        /** Static function to allow native to indicate whether the GIF has been saved correctly */
         @JvmStatic
-        fun gifSavedCallback() {
+        fun gifSavedCallback(filepath: String, saved: Boolean) {
             val message = Message()
+            message.obj = filepath
+            message.arg1 = if (saved) 1 else 0
             nativeGifSavedCallbackHandler.sendMessage(message)
         }
+
+        /**
+         * Static function for native to hand over a GIF encoded by createGifInMemory. The buffer
+         * is direct and points at native memory, null if the GIF could not be encoded.
+         */
+        @JvmStatic
+        fun gifEncodedCallback(gif: ByteBuffer?) {
+            val message = Message()
+            message.obj = gif
+            nativeGifEncodedCallbackHandler.sendMessage(message)
+        }
     }
 
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
 
         setContentView(R.layout.activity_main)
+        frameRecordingPath = intent.getStringExtra(EXTRA_RECORD_FRAMES) ?: ""
         vulkanViewModel = ViewModelProvider(this).get(VulkanViewModel::class.java)
         allCameraParams = vulkanViewModel.getAllCameraParams()
 
@@ -313,57 +348,55 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
             }
         }
 
-        // Handler to indicate to Kotlin the GIF is ready to be encoded
-        // This indication comes from native, Kotlin starts a new thread, and then tells native
-        // to encode on this new thread. This way Kotlin handles the thread management
+        // Handler to indicate to Kotlin the GIF has been captured
+        // Native queues it to be encoded on its own threads, so the shutter can be used again
+        // while earlier GIFs are still being encoded and saved.
         nativeGifReadyToEncodeHandler = @SuppressLint("HandlerLeak")
         object : Handler() {
             override fun handleMessage(msg: Message) {
                 if (null != msg) {
-                    thread(start = true, name = "VulkanEncodeGif") {
-                        runOnUiThread {
-                            gifSpinner.start()
-                        }
-
-                        val startTime = System.currentTimeMillis()
-                        encodeAndSaveGif()
-                        val encodeTime = System.currentTimeMillis() - startTime
-                        logd("GIF Encode completed in: " + encodeTime / 1000 + " seconds.")
+                    // Capture complete
+                    restoreShutter()
+                }
+            }
+        }
 
-                        runOnUiThread {
-                            // Save complete, restore shutter button
-                            button_shutter.setImageResource(R.drawable.filter_button_enabled)
-                            progress_gif.visibility = GONE
-                            progress_gif.isIndeterminate = false;
-                            progress_gif.progress = 0
-                            gifSpinner.stop()
-
-                            // TODO: this hack assumes chromeboxes do not have on-screen controls &
-                            // phones do. Phones may have MIDI controllers and chromeboxes not.
-                            // Handles this properly (maintain current on-screen button state).
-                            if (!isChromebox()) {
-                                seek_input1.visibility = VISIBLE
-                                seek_input2.visibility = VISIBLE
-                                seek_input3.visibility = VISIBLE
-                                seek_input4.visibility = VISIBLE
-                                seek_input5.visibility = VISIBLE
-                                seek_input6.visibility = VISIBLE
-                                button_shutter.visibility = VISIBLE
-                            }
-                            lockRotation(false)
-                        }
+        // Handler to receive GIF encoding results from native
+        nativeGifSavedCallbackHandler = @SuppressLint("HandlerLeak")
+        object : Handler() {
+            override fun handleMessage(msg: Message) {
+                if (null != msg) {
+                    val filepath = msg.obj as String
+                    if (1 != msg.arg1) {
+                        logd("GIF could not be saved: " + filepath)
+                        return
+                    }
 
-                        // File is written, let media scanner know
-                        val gifFile = File(gifFilepath)
-                        val gifURI = Uri.fromFile(gifFile)
-                        val scannerIntent = Intent(Intent.ACTION_MEDIA_SCANNER_SCAN_FILE)
-                        scannerIntent.data = gifURI
-                        sendBroadcast(scannerIntent)
+                    // File is written, let media scanner know
+                    val gifFile = File(filepath)
+                    val gifURI = Uri.fromFile(gifFile)
+                    val scannerIntent = Intent(Intent.ACTION_MEDIA_SCANNER_SCAN_FILE)
+                    scannerIntent.data = gifURI
+                    sendBroadcast(scannerIntent)
+                }
+            }
+        }
 
-                        // Re-engage the shutter
-                        shutter_engaged = false;
-                    }
+        // Handler to pass GIFs encoded in memory on to whoever wants them
+        nativeGifEncodedCallbackHandler = @SuppressLint("HandlerLeak")
+        object : Handler() {
+            override fun handleMessage(msg: Message) {
+                val gif = msg.obj as ByteBuffer?
+                if (null == gif) {
+                    logd("GIF could not be encoded in memory")
+                    return
                 }
+
+                val listener = gifBufferListener
+                if (null != listener)
+                    listener(gif)
+                else
+                    releaseGifBuffer(gif)
             }
         }
 
@@ -377,6 +410,47 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
         }
     }
 
+    /**
+     * Restore the shutter button and controls hidden while a GIF is captured, and re-engage the
+     * shutter
+     */
+    fun restoreShutter() {
+        runOnUiThread {
+            button_shutter.setImageResource(R.drawable.filter_button_enabled)
+            progress_gif.visibility = GONE
+            progress_gif.isIndeterminate = false;
+            progress_gif.progress = 0
+            gifSpinner.stop()
+
+            // TODO: this hack assumes chromeboxes do not have on-screen controls &
+            // phones do. Phones may have MIDI controllers and chromeboxes not.
+            // Handles this properly (maintain current on-screen button state).
+            if (!isChromebox()) {
+                seek_input1.visibility = VISIBLE
+                seek_input2.visibility = VISIBLE
+                seek_input3.visibility = VISIBLE
+                seek_input4.visibility = VISIBLE
+                seek_input5.visibility = VISIBLE
+                seek_input6.visibility = VISIBLE
+                button_shutter.visibility = VISIBLE
+            }
+            lockRotation(false)
+        }
+
+        shutter_engaged = false;
+    }
+
+    /**
+     * Hand the path from EXTRA_RECORD_FRAMES to native before the preview ImageReader is created,
+     * so it is created CPU readable and frames are recorded from the first one
+     */
+    fun startFrameRecordingIfRequested() {
+        if (frameRecordingPath.isNotEmpty()) {
+            logd("Recording camera frames to " + frameRecordingPath)
+            startFrameRecording(frameRecordingPath)
+        }
+    }
+
     /**
      * Continue with onCreate, knowing that Camera permissions have now been granted.
      */
@@ -420,6 +494,7 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
         vulkanViewModel.getFilterParams().rotation = getCameraImageRotation(this, cameraParams)
 
         cameraParams.previewSurfaceView = surface_mirror
+        startFrameRecordingIfRequested()
         setupImageReader(this, cameraParams)
 
         // Add callbacks to the mirror surfaceview, when it is ready, open the camera
@@ -710,7 +785,11 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
 
                                 button_shutter.setImageDrawable(gifSpinner)
                             }
-                            createGif(gifFilepath) // Tell native to start taking photos
+                            // Tell native to start taking photos
+                            if (!createGif(gifFilepath)) {
+                                logd("Too many GIFs waiting to be saved, not taking photos")
+                                restoreShutter()
+                            }
                         }
                     }
                 }.start()
@@ -1203,8 +1282,24 @@ class MainActivity : AppCompatActivity(), SurfaceHolder.Callback {
     external fun isVulkanQueueEmpty() : Boolean
     /** Passes updated filter values from the UI down to native */
     external fun updateFilterParams(rotation: Int, seek_values: IntArray, use_filter: BooleanArray)
-    /** Tells native to start capturing photos for GIF creation */
+    /**
+     * Tells native to start capturing photos for GIF creation. Once captured, native encodes and
+     * saves the GIF in the background. False if a capture is in progress or too many GIFs are
+     * waiting to be encoded.
+     */
     external fun createGif(filepath: String) : Boolean
-    /** Tells native to start encoding and saving gif - should be run on a separate thread */
-    external fun encodeAndSaveGif()
+    /**
+     * Like createGif, but the GIF stays in native memory and is handed to gifBufferListener as a
+     * direct ByteBuffer, without a copy and without going through storage
+     */
+    external fun createGifInMemory() : Boolean
+    /** Frees a buffer from gifBufferListener, it must not be read afterwards */
+    external fun releaseGifBuffer(gif: ByteBuffer)
+    /**
+     * Records camera frames and filter settings to path. The preview ImageReader must be created
+     * afterwards, as CPU readable YUV_420_888. Returns true if recording started right away.
+     */
+    external fun startFrameRecording(path: String) : Boolean
+    /** Stops and closes the recording */
+    external fun stopFrameRecording()
 }
\ No newline at end of file